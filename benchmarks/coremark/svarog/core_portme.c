@@ -36,8 +36,8 @@ volatile ee_s32 seed3_volatile = 0x8;
 volatile ee_s32 seed4_volatile = ITERATIONS;
 volatile ee_s32 seed5_volatile = 0;
 
-/* Static memory region for CoreMark when MEM_METHOD == MEM_STATIC. */
-#if (MEM_METHOD == MEM_STATIC)
+/* Static memory region handed out by portable_malloc. */
+#if (MEM_METHOD == MEM_STATIC) || (MEM_METHOD == MEM_MALLOC)
 static ee_u8 coremark_mem[16 * 1024];
 static ee_size_t coremark_mem_idx;
 #endif
@@ -84,9 +84,29 @@ barebones_clock()
 static CORETIMETYPE start_time_val, stop_time_val;
 static ee_u64 cycle_start, cycle_end;
 static ee_u64 instret_start, instret_end;
-static ee_u64 branches_start, branches_end;
-static ee_u64 branch_miss_start, branch_miss_end;
-static ee_u64 hazard_stall_start, hazard_stall_end;
+
+/* Events counted by mhpmcounter3 onwards. The SoC config must implement at
+   least SVAROG_NUM_HPM counters (hpmCounters in the cluster YAML). */
+static const struct
+{
+    ee_u32      event;
+    const char *name;
+} hpm_events[] = {
+    { SVAROG_HPM_BRANCH_RETIRED, "branches retired" },
+    { SVAROG_HPM_BRANCH_MISS, "branch misses" },
+    { SVAROG_HPM_HAZARD_STALL, "hazard stalls" },
+    { SVAROG_HPM_FETCH_STALL, "  fetch stall" },
+    { SVAROG_HPM_STALL_LOAD_USE, "  load-use hazard" },
+    { SVAROG_HPM_STALL_CSR, "  CSR hazard" },
+    { SVAROG_HPM_BRANCH_FLUSH, "  branch flush" },
+    { SVAROG_HPM_LOAD_WAIT, "  load wait" },
+    { SVAROG_HPM_STORE_WAIT, "  store wait" },
+    { SVAROG_HPM_MULDIV_BUSY, "  mul/div busy" },
+    { SVAROG_HPM_TRAP_ENTRY, "trap entries" },
+};
+#define SVAROG_NUM_HPM (sizeof(hpm_events) / sizeof(hpm_events[0]))
+
+static ee_u64 hpm_start[SVAROG_NUM_HPM];
 
 #if __riscv_xlen == 32
 #define DECLARE_READ_COUNTER64(name, low_csr, high_csr)                            \
@@ -113,9 +133,48 @@ static ee_u64 hazard_stall_start, hazard_stall_end;
 
 DECLARE_READ_COUNTER64(read_cycle_counter, 0xC00, 0xC80)
 DECLARE_READ_COUNTER64(read_instret_counter, 0xC02, 0xC82)
-DECLARE_READ_COUNTER64(read_branches_counter, 0xC03, 0xC83)
-DECLARE_READ_COUNTER64(read_branch_miss_counter, 0xC04, 0xC84)
-DECLARE_READ_COUNTER64(read_hazard_stall_counter, 0xC05, 0xC85)
+DECLARE_READ_COUNTER64(read_hpm3, 0xC03, 0xC83)
+DECLARE_READ_COUNTER64(read_hpm4, 0xC04, 0xC84)
+DECLARE_READ_COUNTER64(read_hpm5, 0xC05, 0xC85)
+DECLARE_READ_COUNTER64(read_hpm6, 0xC06, 0xC86)
+DECLARE_READ_COUNTER64(read_hpm7, 0xC07, 0xC87)
+DECLARE_READ_COUNTER64(read_hpm8, 0xC08, 0xC88)
+DECLARE_READ_COUNTER64(read_hpm9, 0xC09, 0xC89)
+DECLARE_READ_COUNTER64(read_hpm10, 0xC0A, 0xC8A)
+DECLARE_READ_COUNTER64(read_hpm11, 0xC0B, 0xC8B)
+DECLARE_READ_COUNTER64(read_hpm12, 0xC0C, 0xC8C)
+DECLARE_READ_COUNTER64(read_hpm13, 0xC0D, 0xC8D)
+
+/* CSR numbers must be immediates, so counters are reached through tables. */
+static ee_u64 (*const hpm_readers[])(void) = {
+    read_hpm3,  read_hpm4,  read_hpm5,  read_hpm6,  read_hpm7,
+    read_hpm8,  read_hpm9,  read_hpm10, read_hpm11, read_hpm12,
+    read_hpm13,
+};
+
+#define DECLARE_WRITE_EVENT(name, csr)                                            \
+    static void name(ee_u32 event)                                                 \
+    {                                                                               \
+        asm volatile("csrw " #csr ", %0" ::"r"(event));                            \
+    }
+
+DECLARE_WRITE_EVENT(write_event3, 0x323)
+DECLARE_WRITE_EVENT(write_event4, 0x324)
+DECLARE_WRITE_EVENT(write_event5, 0x325)
+DECLARE_WRITE_EVENT(write_event6, 0x326)
+DECLARE_WRITE_EVENT(write_event7, 0x327)
+DECLARE_WRITE_EVENT(write_event8, 0x328)
+DECLARE_WRITE_EVENT(write_event9, 0x329)
+DECLARE_WRITE_EVENT(write_event10, 0x32A)
+DECLARE_WRITE_EVENT(write_event11, 0x32B)
+DECLARE_WRITE_EVENT(write_event12, 0x32C)
+DECLARE_WRITE_EVENT(write_event13, 0x32D)
+
+static void (*const hpm_event_writers[])(ee_u32) = {
+    write_event3,  write_event4,  write_event5,  write_event6,  write_event7,
+    write_event8,  write_event9,  write_event10, write_event11, write_event12,
+    write_event13,
+};
 
 /* Function : start_time
         This function will be called right before starting the timed portion of
@@ -175,7 +234,23 @@ time_in_secs(CORE_TICKS ticks)
     return retval;
 }
 
-ee_u32 default_num_contexts = 1;
+ee_u32 default_num_contexts = MULTITHREAD;
+
+#if (MULTITHREAD > 1)
+/* Hart 0 sets this once .bss is zeroed, so the other harts do not act on
+   the garbage that was there before. */
+#define HARTS_READY_MAGIC 0x5afeb007u
+static volatile ee_u32 harts_ready;
+
+/* Every slot has a single writer: hart 0 posts work, the hart reports
+   done. No atomics are needed, only fences to order the stores. */
+static core_results *volatile hart_work[MULTITHREAD];
+static volatile ee_u32        hart_done[MULTITHREAD];
+static core_results          *hart_context[MULTITHREAD];
+static ee_u32                 next_hart;
+
+#define FENCE() asm volatile("fence" ::: "memory")
+#endif
 
 /* Function : portable_init
         Target specific initialization code
@@ -197,16 +272,26 @@ portable_init(core_portable *p, int *argc, char *argv[])
     {
         ee_printf("ERROR! Please define ee_u32 to a 32b unsigned type!\n");
     }
-#if (MEM_METHOD == MEM_STATIC)
+#if (MEM_METHOD == MEM_STATIC) || (MEM_METHOD == MEM_MALLOC)
     coremark_mem_idx = 0;
+#endif
+#if (MULTITHREAD > 1)
+    FENCE();
+    harts_ready = HARTS_READY_MAGIC;
 #endif
     p->portable_id = 1;
 
+    for (ee_u32 i = 0; i < SVAROG_NUM_HPM; i++)
+    {
+        hpm_event_writers[i](hpm_events[i].event);
+    }
+
     cycle_start = read_cycle_counter();
     instret_start = read_instret_counter();
-    branches_start = read_branches_counter();
-    branch_miss_start = read_branch_miss_counter();
-    hazard_stall_start = read_hazard_stall_counter();
+    for (ee_u32 i = 0; i < SVAROG_NUM_HPM; i++)
+    {
+        hpm_start[i] = hpm_readers[i]();
+    }
 }
 /* Function : portable_fini
         Target specific final code
@@ -218,21 +303,21 @@ portable_fini(core_portable *p)
 
     cycle_end = read_cycle_counter();
     instret_end = read_instret_counter();
-    branches_end = read_branches_counter();
-    branch_miss_end = read_branch_miss_counter();
-    hazard_stall_end = read_hazard_stall_counter();
 
     ee_printf("CoreMark cycle count  : %llu\n", cycle_end - cycle_start);
     ee_printf("CoreMark instret count: %llu\n", instret_end - instret_start);
-    ee_printf("CoreMark branches retired: %llu\n", branches_end - branches_start);
-    ee_printf("CoreMark branch misses   : %llu\n", branch_miss_end - branch_miss_start);
-    ee_printf("CoreMark hazard stalls   : %llu\n", hazard_stall_end - hazard_stall_start);
+    for (ee_u32 i = 0; i < SVAROG_NUM_HPM; i++)
+    {
+        ee_printf("CoreMark %-18s: %llu\n",
+                  hpm_events[i].name,
+                  hpm_readers[i]() - hpm_start[i]);
+    }
 }
 
 void *
 portable_malloc(ee_size_t size)
 {
-#if (MEM_METHOD == MEM_STATIC)
+#if (MEM_METHOD == MEM_STATIC) || (MEM_METHOD == MEM_MALLOC)
     if (coremark_mem_idx + size > sizeof(coremark_mem))
         return NULL;
     void *ptr = &coremark_mem[coremark_mem_idx];
@@ -249,3 +334,65 @@ portable_free(void *p)
 {
     (void)p;
 }
+
+#if (MULTITHREAD > 1)
+ee_u8
+core_start_parallel(core_results *res)
+{
+    ee_u32 hart = next_hart++;
+
+    hart_context[hart] = res;
+    if (hart != 0)
+    {
+        hart_done[hart] = 0;
+        FENCE();
+        hart_work[hart] = res;
+    }
+    return 0;
+}
+
+ee_u8
+core_stop_parallel(core_results *res)
+{
+    ee_u32 hart = 0;
+
+    while (hart_context[hart] != res)
+        hart++;
+
+    /* Contexts are stopped in order, so hart 0 runs its own while the
+       others are busy. */
+    if (hart == 0)
+        iterate(res);
+    else
+        while (!hart_done[hart])
+            ;
+    FENCE();
+    return 0;
+}
+#endif
+
+/* Function : secondary_main
+        Entry point of harts other than hart 0 (see crt0.S). Runs the context
+   hart 0 hands over, if any, and returns to park the hart.
+*/
+void
+secondary_main(ee_u32 hart)
+{
+#if (MULTITHREAD > 1)
+    core_results *res;
+
+    if (hart >= MULTITHREAD)
+        return;
+
+    while (harts_ready != HARTS_READY_MAGIC)
+        ;
+    while ((res = hart_work[hart]) == NULL)
+        ;
+    FENCE();
+    iterate(res);
+    FENCE();
+    hart_done[hart] = 1;
+#else
+    (void)hart;
+#endif
+}
@@ -130,8 +130,12 @@ typedef ee_u64 CORE_TICKS;
         MEM_STACK - to allocate the data block on the stack (NYI).
 */
 #ifndef MEM_METHOD
+#if (MULTITHREAD > 1)
+#define MEM_METHOD MEM_MALLOC
+#else
 #define MEM_METHOD MEM_STATIC
 #endif
+#endif
 
 /* Svarog SoC memory map (see configs/svg-micro.yaml) */
 #ifndef SVAROG_UART0_BASE
@@ -157,6 +161,19 @@ typedef ee_u64 CORE_TICKS;
 #define SVAROG_MTIME_HI_OFFSET 0x0004
 #endif
 
+/* mhpmevent selectors, matching HpmEvent in CounterCSR.scala. */
+#define SVAROG_HPM_BRANCH_RETIRED 1
+#define SVAROG_HPM_BRANCH_MISS    2
+#define SVAROG_HPM_HAZARD_STALL   3
+#define SVAROG_HPM_FETCH_STALL    4
+#define SVAROG_HPM_STALL_LOAD_USE 5
+#define SVAROG_HPM_STALL_CSR      6
+#define SVAROG_HPM_BRANCH_FLUSH   7
+#define SVAROG_HPM_LOAD_WAIT      8
+#define SVAROG_HPM_STORE_WAIT     9
+#define SVAROG_HPM_MULDIV_BUSY    10
+#define SVAROG_HPM_TRAP_ENTRY     11
+
 /* Default RTC frequency; override with -DSVAROG_RTC_HZ=<hz> if needed. */
 #ifndef SVAROG_RTC_HZ
 #define SVAROG_RTC_HZ 50000000UL
@@ -186,6 +203,14 @@ typedef ee_u64 CORE_TICKS;
 #define USE_SOCKET  0
 #endif
 
+/* Svarog runs each context on its own hart: hart 0 runs context 0 and
+   hands context N to hart N. The SoC needs at least MULTITHREAD harts
+   (numCores in the cluster YAML) and no data cache, which is not coherent.
+*/
+#if (MULTITHREAD > 1)
+#define PARALLEL_METHOD "Harts"
+#endif
+
 /* Configuration : MAIN_HAS_NOARGC
         Needed if platform does not support getting arguments to main.
 
@@ -225,6 +250,8 @@ typedef struct CORE_PORTABLE_S
 /* target specific init/fini */
 void portable_init(core_portable *p, int *argc, char *argv[]);
 void portable_fini(core_portable *p);
+/* entry point of every hart but hart 0 */
+void secondary_main(ee_u32 hart);
 
 #if !defined(PROFILE_RUN) && !defined(PERFORMANCE_RUN) \
     && !defined(VALIDATION_RUN)
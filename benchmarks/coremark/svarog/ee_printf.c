@@ -16,6 +16,9 @@ limitations under the License.
 
 #include <coremark.h>
 #include <stdarg.h>
+#if SVAROG_CONSOLE_HTIF
+#include "htif.h"
+#endif
 
 #define ZEROPAD   (1 << 0) /* Pad with zero */
 #define SIGN      (1 << 1) /* Unsigned/signed long */
@@ -697,6 +700,13 @@ ee_printf(const char *fmt, ...)
     int     n = 0;
 
     va_start(args, fmt);
+#if SVAROG_CONSOLE_HTIF
+    /* One system call for the whole string */
+    n = ee_vsprintf(buf, fmt, args);
+    va_end(args);
+    (void)p;
+    htif_write(1, buf, n);
+#else
     ee_vsprintf(buf, fmt, args);
     va_end(args);
     p = buf;
@@ -709,6 +719,7 @@ ee_printf(const char *fmt, ...)
         n++;
         p++;
     }
+#endif
 
     return n;
 }
@@ -0,0 +1,15 @@
+/* Smoke test for the HTIF console: prints a line and the host time */
+
+#include <stdio.h>
+#include <sys/time.h>
+
+int
+main(void)
+{
+    struct timeval tv;
+
+    printf("Hello from Svarog over HTIF\n");
+    if (gettimeofday(&tv, NULL) == 0)
+        printf("Host time: %lld.%06ld\n", (long long)tv.tv_sec, (long)tv.tv_usec);
+    return 0;
+}
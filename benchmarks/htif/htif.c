@@ -0,0 +1,39 @@
+/* Guest side of the Svarog HTIF mailbox */
+
+#include "htif.h"
+
+/* The simulator watches tohost, so both live in .tohost, which the startup
+ * code never clears. */
+volatile uint64_t tohost __attribute__((section(".tohost"), aligned(64)));
+volatile uint64_t fromhost __attribute__((section(".tohost"), aligned(64)));
+
+/* Call number and arguments, overwritten with the result */
+static volatile uint64_t magic_mem[8] __attribute__((aligned(64)));
+
+long
+htif_syscall(long which, long arg0, long arg1, long arg2)
+{
+    magic_mem[0] = which;
+    magic_mem[1] = arg0;
+    magic_mem[2] = arg1;
+    magic_mem[3] = arg2;
+    __sync_synchronize();
+
+    /* The hart halts on this store until the call is done. Only the low
+     * word is watched, so write just that. */
+    *(volatile uint32_t *)&tohost = (uint32_t)(uintptr_t)magic_mem;
+    while (fromhost == 0)
+        ;
+    fromhost = 0;
+
+    __sync_synchronize();
+    return (long)magic_mem[0];
+}
+
+void
+htif_exit(int status)
+{
+    htif_syscall(HTIF_SYS_EXIT, status, 0, 0);
+    for (;;)
+        ;
+}
@@ -0,0 +1,39 @@
+/* Svarog HTIF system call interface
+ *
+ * System calls go through the tohost/fromhost mailbox serviced by
+ * svarog-sim (utils/simulator/src/htif.rs), so console output costs a few
+ * cycles per call rather than a UART frame per byte. Call numbers follow
+ * riscv-pk.
+ */
+#ifndef SVAROG_HTIF_H
+#define SVAROG_HTIF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HTIF_SYS_READ         63
+#define HTIF_SYS_WRITE        64
+#define HTIF_SYS_EXIT         93
+#define HTIF_SYS_GETTIMEOFDAY 169
+
+extern volatile uint64_t tohost;
+extern volatile uint64_t fromhost;
+
+/* Make system call `which`, returning its result or a negated errno. */
+long htif_syscall(long which, long arg0, long arg1, long arg2);
+
+static inline long
+htif_write(int fd, const void *buf, size_t len)
+{
+    return htif_syscall(HTIF_SYS_WRITE, fd, (long)buf, (long)len);
+}
+
+static inline long
+htif_read(int fd, void *buf, size_t len)
+{
+    return htif_syscall(HTIF_SYS_READ, fd, (long)buf, (long)len);
+}
+
+void htif_exit(int status) __attribute__((noreturn));
+
+#endif /* SVAROG_HTIF_H */
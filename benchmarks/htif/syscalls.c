@@ -0,0 +1,130 @@
+/* newlib system call stubs on top of the HTIF mailbox
+ *
+ * Console reads and writes and gettimeofday go to the host, the heap grows
+ * from the end of .bss towards the stack, and everything else fails with
+ * ENOSYS.
+ */
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "htif.h"
+
+#undef errno
+extern int errno;
+
+/* Provided by the linker script */
+extern char _end[];
+extern char _heap_limit[];
+
+static long
+check(long result)
+{
+    if (result < 0)
+    {
+        errno = -result;
+        return -1;
+    }
+    return result;
+}
+
+int
+_write(int fd, const void *buf, size_t len)
+{
+    return check(htif_write(fd, buf, len));
+}
+
+int
+_read(int fd, void *buf, size_t len)
+{
+    return check(htif_read(fd, buf, len));
+}
+
+void
+_exit(int status)
+{
+    htif_exit(status);
+}
+
+int
+_gettimeofday(struct timeval *tv, void *tz)
+{
+    (void)tz;
+    return check(htif_syscall(HTIF_SYS_GETTIMEOFDAY, (long)tv, 0, 0));
+}
+
+void *
+_sbrk(ptrdiff_t increment)
+{
+    static char *heap_end = _end;
+    char        *prev     = heap_end;
+
+    if (increment > _heap_limit - heap_end)
+    {
+        errno = ENOMEM;
+        return (void *)-1;
+    }
+    heap_end += increment;
+    return prev;
+}
+
+int
+_isatty(int fd)
+{
+    return fd >= 0 && fd <= 2;
+}
+
+int
+_fstat(int fd, struct stat *st)
+{
+    if (!_isatty(fd))
+    {
+        errno = EBADF;
+        return -1;
+    }
+    st->st_mode = S_IFCHR;
+    return 0;
+}
+
+int
+_close(int fd)
+{
+    (void)fd;
+    return 0;
+}
+
+int
+_lseek(int fd, int offset, int whence)
+{
+    (void)fd;
+    (void)offset;
+    (void)whence;
+    errno = ESPIPE;
+    return -1;
+}
+
+int
+_open(const char *path, int flags, int mode)
+{
+    (void)path;
+    (void)flags;
+    (void)mode;
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+_kill(int pid, int sig)
+{
+    (void)pid;
+    (void)sig;
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+_getpid(void)
+{
+    return 1;
+}
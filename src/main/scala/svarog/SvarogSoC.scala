@@ -4,12 +4,25 @@ import chisel3._
 import chisel3.util._
 import org.chipsalliance.cde.config.Parameters
 import org.chipsalliance.diplomacy.lazymodule.{LazyModule, LazyModuleImp}
-import freechips.rocketchip.diplomacy.IdRange
-import freechips.rocketchip.tilelink.{TLBuffer, TLFragmenter, TLXbar}
-import svarog.config.{Micro, SoC, TCM => TCMCfg}
-import svarog.debug.{DebugIOGenerator, TLChipDebugModule}
+import freechips.rocketchip.diplomacy.{AddressSet, IdRange}
+import freechips.rocketchip.tilelink.{
+  TLArbiter,
+  TLBuffer,
+  TLFilter,
+  TLFragmenter,
+  TLOutwardNode,
+  TLXbar
+}
+import svarog.config.{Dual, Micro, SoC, TCM => TCMCfg}
+import svarog.csr.HpmEvent
+import svarog.debug.{
+  BackdoorIO,
+  DebugIOGenerator,
+  IdleSkipIO,
+  TLChipDebugModule
+}
 import svarog.memory.{ROMTileLinkAdapter, TCM}
-import svarog.micro.MicroTile
+import svarog.micro.{Fetch, MicroTile, RetireInfo}
 import svarog.bits.{IOGenerator, RTC}
 import svarog.interrupt.{MSIP, Timer}
 
@@ -24,42 +37,109 @@ class SvarogSoC(
     .map(_ => 0x00480000L)
     .getOrElse(config.memories.head.getBaseAddress)
 
-  private val xbar = LazyModule(new TLXbar)
+  // Round-robin arbitration keeps one hart from starving the others at a
+  // shared TCM port
+  private val xbar = LazyModule(new TLXbar(TLArbiter.roundRobin))
+
+  private val dualPortTcms = config.memories.collect {
+    case tcm: TCMCfg if tcm.ports == 2 => tcm
+  }
+
+  // Instruction fetches and debug program loads go through their own crossbar
+  // to the instruction port of dual-port TCMs, so they never wait behind data
+  // accesses. Everything else they reach through the main crossbar.
+  private val instXbar =
+    Option.when(dualPortTcms.nonEmpty)(
+      LazyModule(new TLXbar(TLArbiter.roundRobin))
+    )
+  instXbar.foreach { ix =>
+    xbar.node := dualPortTcms.foldLeft[TLOutwardNode](ix.node) { (node, tcm) =>
+      val filter = TLFilter(
+        TLFilter.mSubtract(AddressSet(tcm.baseAddress, tcm.length - 1))
+      )
+      filter := node
+      filter
+    }
+  }
+  private val instNode = instXbar.getOrElse(xbar).node
 
   private var nextSourceId = 0
-  private def allocSourceId(): IdRange = {
+  private def allocSourceId(count: Int = 1): IdRange = {
     val id = nextSourceId
-    nextSourceId += 1
-    IdRange(id, id + 1)
+    nextSourceId += count
+    IdRange(id, id + count)
+  }
+
+  // Stores may be buffered only where they have no side effects
+  private val memoryRegions = config.memories.collect {
+    case TCMCfg(baseAddr, length, _, _) => AddressSet(baseAddr, length - 1)
   }
 
   private val tiles = config.clusters.zipWithIndex.map {
-    case (cluster, clusterIdx) if cluster.coreType == Micro =>
+    case (cluster, clusterIdx)
+        if cluster.coreType == Micro || cluster.coreType == Dual =>
       val hartBase = config.clusters.take(clusterIdx).map(_.numCores).sum
-      val instIds = Seq.fill(cluster.numCores)(allocSourceId())
+      // One source id per outstanding fetch
+      val instIds = Seq.fill(cluster.numCores)(
+        allocSourceId(Fetch.maxInFlight(cluster.timingProfile))
+      )
       val dataIds = Seq.fill(cluster.numCores)(allocSourceId())
       LazyModule(
-        new MicroTile(hartBase, cluster, startAddress, instIds, dataIds)
+        new MicroTile(
+          hartBase,
+          cluster,
+          startAddress,
+          instIds,
+          dataIds,
+          memoryRegions
+        )
       )
     case _ =>
-      sys.error("Only Micro tiles are supported in the TileLink SoC for now.")
+      sys.error(
+        "Only Micro and Dual tiles are supported in the TileLink SoC for now."
+      )
   }
 
   tiles.foreach { tile =>
-    tile.instNodes.foreach { n => xbar.node := n }
+    tile.instNodes.foreach { n => instNode := n }
     tile.dataNodes.foreach { n => xbar.node := n }
   }
 
-  private val tcm = config.memories.map { case TCMCfg(baseAddr, length) =>
-    // FIXME how do I make it dual port?
-    val tcm = LazyModule(new TCM(xlen, length, baseAddr, numPorts = 1))
-    tcm.node := xbar.node
-    tcm
+  // TCMs are shared between clusters, so one asking for registered TCM
+  // output applies it to every TCM
+  private val registeredTcm =
+    config.clusters.exists(_.timingProfile.registeredTcm)
+
+  private val tcm = config.memories.map {
+    case TCMCfg(baseAddr, length, ports, banks) =>
+      val tcm = LazyModule(
+        new TCM(
+          xlen,
+          length,
+          baseAddr,
+          numPorts = ports,
+          banks = banks,
+          simBackdoor = config.simulatorDebug,
+          registeredOutput = registeredTcm
+        )
+      )
+      // The data side binds first, so it wins bank conflicts
+      tcm.node := xbar.node
+      if (ports == 2) {
+        tcm.node := instXbar.get.node
+      }
+      tcm
   }
 
   private val romAdapter = bootloader.map { path =>
     val rom = LazyModule(
-      new ROMTileLinkAdapter(xlen, baseAddr = 0x00480000L, file = path)
+      new ROMTileLinkAdapter(
+        xlen,
+        baseAddr = 0x00480000L,
+        file = path,
+        streams = config.bootRom.streams,
+        prefetchWords = config.bootRom.prefetchWords
+      )
     )
     rom.node := xbar.node
     rom
@@ -76,7 +156,7 @@ class SvarogSoC(
     val dbg = LazyModule(
       new TLChipDebugModule(xlen, config.getNumHarts, instId, dataId)
     )
-    xbar.node := dbg.instNode
+    instNode := dbg.instNode
     xbar.node := dbg.dataNode
     Some(dbg)
   } else None
@@ -101,11 +181,27 @@ class SvarogSoC(
     val io = IO(new Bundle {
       val gpio = IOGenerator.generatePins(config)
       val debug = DebugIOGenerator(config)
+      // Retire trace of hart 0 for lock-step checking in simulation
+      val retire = Option.when(config.simulatorDebug)(
+        Valid(new RetireInfo(xlen))
+      )
+      // Second retirement of the same cycle when hart 0 is dual-issue
+      val retireSecond = Option.when(
+        config.simulatorDebug && config.clusters.head.coreType == Dual
+      )(Valid(new RetireInfo(xlen)))
+      // HpmEvent lines of hart 0, counted per instruction by the profiler
+      val hpmEvents = Option.when(config.simulatorDebug)(
+        Output(UInt(HpmEvent.Count.W))
+      )
+      // Fast-forward through wfi sleeps in simulation
+      val idle = Option.when(config.simulatorDebug)(new IdleSkipIO)
+      // Zero-time register and TCM reads in simulation
+      val backdoor = Option.when(config.simulatorDebug)(new BackdoorIO(xlen))
       val rtcClock = Input(Clock())
     })
 
     // RTC provides mtime value with clock domain crossing
-    private val rtc = Module(new RTC)
+    private val rtc = Module(new RTC(skippable = config.simulatorDebug))
     rtc.clk := clock
     rtc.reset := reset.asBool
     rtc.io.rtcClock := io.rtcClock
@@ -113,10 +209,47 @@ class SvarogSoC(
     // Connect RTC time to Timer
     outer.timer.module.io.time := rtc.io.time
 
+    // Time the simulator skips while every hart sleeps
+    private val skip = io.idle.map(_.skip)
+    private val skipTicks =
+      skip.map(s => Mux(s.valid, s.bits.ticks, 0.U)).getOrElse(0.U)
+    private val skipCycles =
+      skip.map(s => Mux(s.valid, s.bits.cycles, 0.U)).getOrElse(0.U)
+    rtc.io.skip.foreach(_ := skipTicks)
+    tiles.foreach(_.module.io.idleCycles := skipCycles)
+
     // Flatten debug signals from all tiles
     val allDebugPorts = tiles.flatMap(_.module.io.debug)
     val allRegData = tiles.flatMap(_.module.io.debugRegData)
     val allHalted = tiles.flatMap(_.module.io.halt)
+    val allSleeping = tiles.flatMap(_.module.io.sleeping)
+    val allRetire = tiles.flatMap(_.module.io.retire)
+
+    io.retire.foreach(_ := allRetire.head)
+    io.retireSecond.foreach(_ := tiles.head.module.io.retireSecond.get.head)
+    io.hpmEvents.foreach(_ := tiles.head.module.io.events.head)
+
+    io.idle.foreach { idle =>
+      idle.allSleeping := allSleeping.reduce(_ && _)
+      idle.mtime := rtc.io.time
+      idle.deadline := outer.timer.module.io.deadline
+    }
+
+    private val peekRegs = tiles.flatMap(_.module.io.peekReg)
+    private val peekRegData = tiles.flatMap(_.module.io.peekRegData)
+    peekRegs.foreach(_ := io.backdoor.map(_.reg).getOrElse(0.U))
+    io.backdoor.foreach { backdoor =>
+      backdoor.regData := MuxLookup(backdoor.hart, 0.U)(
+        peekRegData.zipWithIndex.map { case (data, i) => i.U -> data }
+      )
+
+      val tcmPorts = outer.tcm.flatMap(_.module.backdoor)
+      tcmPorts.foreach(_.addr := backdoor.memAddr)
+      backdoor.memHit := tcmPorts.map(_.hit).foldLeft(false.B)(_ || _)
+      backdoor.memData := tcmPorts.foldRight(0.U(xlen.W)) { (port, rest) =>
+        Mux(port.hit, port.data, rest)
+      }
+    }
 
     outer.debugModule match {
       case Some(debugLazy) =>
@@ -130,18 +263,18 @@ class SvarogSoC(
           port <> dbg.harts(i)
         }
 
-        // Connect register data (use first hart's data for now)
-        dbg.cpuRegData := allRegData.headOption.getOrElse {
-          val w = Wire(Valid(UInt(xlen.W)))
-          w.valid := false.B
-          w.bits := 0.U
-          w
+        // Connect register data
+        allRegData.zipWithIndex.foreach { case (data, i) =>
+          dbg.cpuRegData(i) := data
         }
 
         // Connect halt status
         allHalted.zipWithIndex.foreach { case (halt, i) =>
           dbg.cpuHalted(i) := halt
         }
+        allSleeping.zipWithIndex.foreach { case (sleeping, i) =>
+          dbg.cpuSleeping(i) := sleeping
+        }
 
       case None =>
         // No debug module - tie off debug ports
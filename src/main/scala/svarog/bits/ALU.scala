@@ -5,9 +5,22 @@ import chisel3.util._
 
 object ALUOp extends ChiselEnum {
   val ADD, SUB, SLL, SLT, SLTU, XOR, SRL, SRA, OR, AND = Value
+  // Zba
+  val SH1ADD, SH2ADD, SH3ADD = Value
+  // Zbb
+  val ANDN, ORN, XNOR, CLZ, CTZ, CPOP, MAX, MAXU, MIN, MINU, SEXTB, SEXTH,
+      ZEXTH, ROL, ROR, ORCB, REV8 = Value
 }
 
-class ALU(xlen: Int) extends Module {
+/** Integer ALU
+  *
+  * @param zba
+  *   implement the Zba address generation ops
+  * @param zbb
+  *   implement the Zbb basic bit-manipulation ops
+  */
+class ALU(xlen: Int, zba: Boolean = false, zbb: Boolean = false)
+    extends Module {
   val io = IO(new Bundle {
     val op = Input(ALUOp())
     val input1 = Input(UInt(xlen.W))
@@ -30,4 +43,49 @@ class ALU(xlen: Int) extends Module {
     is(ALUOp.SLT) { io.output := (io.input1.asSInt < io.input2.asSInt).asUInt }
     is(ALUOp.SLTU) { io.output := (io.input1 < io.input2) }
   }
+
+  if (zba) {
+    switch(io.op) {
+      is(ALUOp.SH1ADD) { io.output := (io.input1 << 1) + io.input2 }
+      is(ALUOp.SH2ADD) { io.output := (io.input1 << 2) + io.input2 }
+      is(ALUOp.SH3ADD) { io.output := (io.input1 << 3) + io.input2 }
+    }
+  }
+
+  if (zbb) {
+    val bytes = (0 until xlen / 8).map(i => io.input1(8 * i + 7, 8 * i))
+    val signedLess = io.input1.asSInt < io.input2.asSInt
+    val unsignedLess = io.input1 < io.input2
+
+    switch(io.op) {
+      is(ALUOp.ANDN) { io.output := io.input1 & ~io.input2 }
+      is(ALUOp.ORN) { io.output := io.input1 | ~io.input2 }
+      is(ALUOp.XNOR) { io.output := ~(io.input1 ^ io.input2) }
+      is(ALUOp.CLZ) {
+        io.output := Mux(
+          io.input1 === 0.U,
+          xlen.U,
+          PriorityEncoder(Reverse(io.input1))
+        )
+      }
+      is(ALUOp.CTZ) {
+        io.output := Mux(io.input1 === 0.U, xlen.U, PriorityEncoder(io.input1))
+      }
+      is(ALUOp.CPOP) { io.output := PopCount(io.input1) }
+      is(ALUOp.MAX) { io.output := Mux(signedLess, io.input2, io.input1) }
+      is(ALUOp.MAXU) { io.output := Mux(unsignedLess, io.input2, io.input1) }
+      is(ALUOp.MIN) { io.output := Mux(signedLess, io.input1, io.input2) }
+      is(ALUOp.MINU) { io.output := Mux(unsignedLess, io.input1, io.input2) }
+      is(ALUOp.SEXTB) { io.output := io.input1(7, 0).asSInt.pad(xlen).asUInt }
+      is(ALUOp.SEXTH) { io.output := io.input1(15, 0).asSInt.pad(xlen).asUInt }
+      is(ALUOp.ZEXTH) { io.output := io.input1(15, 0) }
+      is(ALUOp.ROL) { io.output := io.input1.rotateLeft(io.input2(4, 0)) }
+      is(ALUOp.ROR) { io.output := io.input1.rotateRight(io.input2(4, 0)) }
+      is(ALUOp.ORCB) {
+        io.output := Cat(bytes.reverse.map(b => Fill(8, b.orR)))
+      }
+      // Cat puts its first argument in the most significant byte
+      is(ALUOp.REV8) { io.output := Cat(bytes) }
+    }
+  }
 }
@@ -103,3 +103,112 @@ class SimpleDivider(xlen: Int, val latency: Int = 320)
     busy := false.B
   }
 }
+
+/** Iterative restoring divider retiring `radixLog2` quotient bits per cycle
+  *
+  * Operands are converted to magnitudes up front and the signs are fixed up
+  * on the last iteration. Leading zero digits of the dividend are skipped, so
+  * small dividends finish early. Divide-by-zero, signed overflow and
+  * |dividend| < |divisor| complete without iterating. Results are registered:
+  * `io.result` is valid for one cycle, 2 to xlen / radixLog2 + 1 cycles after
+  * the request.
+  *
+  * @param radixLog2
+  *   log2 of the radix; 2 gives a radix-4 divider, 4 a radix-16 one
+  */
+class RadixDivider(xlen: Int, val radixLog2: Int = 2)
+    extends AbstractDivider(xlen) {
+  require(
+    isPow2(radixLog2) && xlen % radixLog2 == 0,
+    "radixLog2 must be a power of 2 that divides xlen"
+  )
+
+  private val digits = xlen / radixLog2
+
+  private object State extends ChiselEnum {
+    val sIdle, sRun, sDone = Value
+  }
+
+  private val state = RegInit(State.sIdle)
+  // Dividend bits shift out of the top while quotient bits shift in
+  private val quotient = Reg(UInt(xlen.W))
+  private val remainder = Reg(UInt(xlen.W))
+  private val divisor = Reg(UInt(xlen.W))
+  private val digitsLeft = Reg(UInt(log2Ceil(digits + 1).W))
+  private val negQuotient = Reg(Bool())
+  private val negRemainder = Reg(Bool())
+  private val wantRemainder = Reg(Bool())
+  private val result = Reg(UInt(xlen.W))
+
+  io.inp.ready := state === State.sIdle
+  io.result.valid := state === State.sDone
+  io.result.bits := result
+
+  private val inp = io.inp.bits
+  private val signed = inp.op === DivOp.DIV || inp.op === DivOp.REM
+  private val isRem = inp.op === DivOp.REM || inp.op === DivOp.REMU
+  private val dividendNeg = signed && inp.dividend(xlen - 1)
+  private val divisorNeg = signed && inp.divisor(xlen - 1)
+  private def negate(value: UInt): UInt = 0.U(xlen.W) - value
+
+  private val dividendMag = Mux(dividendNeg, negate(inp.dividend), inp.dividend)
+  private val divisorMag = Mux(divisorNeg, negate(inp.divisor), inp.divisor)
+
+  private val mostNegative = (BigInt(1) << (xlen - 1)).U(xlen.W)
+  private val allOnes = ((BigInt(1) << xlen) - 1).U(xlen.W)
+
+  when(io.inp.fire) {
+    wantRemainder := isRem
+    negQuotient := dividendNeg =/= divisorNeg
+    negRemainder := dividendNeg
+    divisor := divisorMag
+    remainder := 0.U
+
+    when(inp.divisor === 0.U) {
+      result := Mux(isRem, inp.dividend, allOnes)
+      state := State.sDone
+    }.elsewhen(
+      signed && inp.dividend === mostNegative && inp.divisor === allOnes
+    ) {
+      result := Mux(isRem, 0.U, inp.dividend)
+      state := State.sDone
+    }.elsewhen(dividendMag < divisorMag) {
+      result := Mux(isRem, inp.dividend, 0.U)
+      state := State.sDone
+    }.otherwise {
+      // Leading zero digits only ever produce zero quotient digits
+      val leadingZeros = PriorityEncoder(Reverse(dividendMag))
+      val skip = leadingZeros >> log2Ceil(radixLog2)
+      quotient := dividendMag << (skip << log2Ceil(radixLog2))
+      digitsLeft := digits.U - skip
+      state := State.sRun
+    }
+  }
+
+  when(state === State.sRun) {
+    var r = remainder
+    var q = quotient
+    for (_ <- 0 until radixLog2) {
+      val shifted = Cat(r, q(xlen - 1))
+      val fits = shifted >= divisor
+      r = Mux(fits, shifted - divisor, shifted)(xlen - 1, 0)
+      q = Cat(q(xlen - 2, 0), fits)
+    }
+    remainder := r
+    quotient := q
+    digitsLeft := digitsLeft - 1.U
+
+    when(digitsLeft === 1.U) {
+      result := Mux(
+        wantRemainder,
+        Mux(negRemainder, negate(r), r),
+        Mux(negQuotient, negate(q), q)
+      )
+      state := State.sDone
+    }
+  }
+
+  when(state === State.sDone) {
+    state := State.sIdle
+  }
+}
@@ -15,8 +15,8 @@ object IOGenerator {
 
   /** Create UART LazyModules. Must be called from outer LazyModule scope. */
   def generateUARTs(config: SoC)(implicit p: Parameters): Seq[TLUART] = {
-    config.io.collect { case UartCfg(name, baseAddr) =>
-      LazyModule(new TLUART(baseAddr))
+    config.io.collect { case UartCfg(name, baseAddr, baudDivider) =>
+      LazyModule(new TLUART(baseAddr, baudDivider = baudDivider))
     }
   }
 
@@ -16,9 +16,16 @@ class MultiplierIO(xlen: Int) extends Bundle {
 }
 
 abstract class AbstractMultiplier(xlen: Int) extends Module {
+
+  /** Cycles from `inp.fire` to `result.valid` */
+  def latency: Int
+
   val io = IO(new Bundle {
     val inp = Flipped(Decoupled(new MultiplierIO(xlen)))
     val result = Valid(UInt(xlen.W))
+    // Low half of the full product, valid with `result`. It does not depend
+    // on signedness, so Execute reuses it for a MUL after a MULH[S]U.
+    val low = Output(UInt(xlen.W))
   })
 }
 
@@ -37,6 +44,7 @@ class SimpleMultiplier(xlen: Int, val latency: Int = 3)
   private val op = RegEnable(io.inp.bits.op, MulOp.MUL, io.inp.fire)
 
   private val result = WireDefault(0.U(xlen.W))
+  private val low = (multiplicant * multiplier)(xlen - 1, 0)
   switch(op) {
     is(MulOp.MUL) {
       val fullMul = multiplicant * multiplier
@@ -57,6 +65,7 @@ class SimpleMultiplier(xlen: Int, val latency: Int = 3)
   }
 
   io.result.bits := ShiftRegister(result, latency - 1, 0.U, true.B)
+  io.low := ShiftRegister(low, latency - 1, 0.U, true.B)
   io.result.valid := counterValue === (latency - 1).U && busy
 
   when(io.inp.fire) {
@@ -66,3 +75,73 @@ class SimpleMultiplier(xlen: Int, val latency: Int = 3)
     busy := false.B
   }
 }
+
+/** Fully pipelined multiplier accepting one operation per cycle.
+  *
+  * Operands are extended to xlen + 1 bits so that a single signed product
+  * covers MUL, MULH, MULHSU and MULHU. Each operand is split into 17-bit
+  * chunks, making every partial product at most 18x18 signed, which maps onto
+  * one DSP48 multiplier. With `latency` of 3 or more the registers line up
+  * with the DSP48 A/B, M and P registers; further stages are added after the
+  * sum for the synthesis tool to retime.
+  */
+class PipelinedMultiplier(xlen: Int, val latency: Int = 3)
+    extends AbstractMultiplier(xlen) {
+  require(latency >= 1, "Latency must be at least 1")
+
+  private val chunkBits = 17
+
+  private val inputRegs = if (latency >= 2) 1 else 0
+  private val productRegs = if (latency >= 3) 1 else 0
+  private val outputRegs = latency - inputRegs - productRegs
+
+  io.inp.ready := true.B
+
+  private val op = io.inp.bits.op
+  private val aSigned = op === MulOp.MULH || op === MulOp.MULHSU
+  private val bSigned = op === MulOp.MULH
+  private val a = Cat(
+    aSigned && io.inp.bits.multiplicant(xlen - 1),
+    io.inp.bits.multiplicant
+  ).asSInt
+  private val b = Cat(
+    bSigned && io.inp.bits.multiplier(xlen - 1),
+    io.inp.bits.multiplier
+  ).asSInt
+
+  // Lower chunks are unsigned, the top chunk carries the sign
+  private def chunks(v: SInt): Seq[(SInt, Int)] = {
+    val width = v.getWidth
+    (0 until width by chunkBits).map { lo =>
+      val hi = (lo + chunkBits).min(width) - 1
+      val bits = v.asUInt(hi, lo)
+      (if (hi == width - 1) bits.asSInt else bits.zext, lo)
+    }
+  }
+
+  // Operand registers
+  private val aReg = ShiftRegister(a, inputRegs)
+  private val bReg = ShiftRegister(b, inputRegs)
+
+  // Partial product registers
+  private val partials = for {
+    (aChunk, aShift) <- chunks(aReg)
+    (bChunk, bShift) <- chunks(bReg)
+  } yield (ShiftRegister(aChunk * bChunk, productRegs), aShift + bShift)
+
+  private val sum = partials
+    .map { case (product, shift) => product << shift }
+    .reduce(_ +& _)
+
+  // Product registers
+  private val product = ShiftRegister(sum.asUInt(2 * xlen - 1, 0), outputRegs)
+  private val resultOp = ShiftRegister(op, latency)
+
+  io.result.valid := ShiftRegister(io.inp.fire, latency, false.B, true.B)
+  io.result.bits := Mux(
+    resultOp === MulOp.MUL,
+    product(xlen - 1, 0),
+    product(2 * xlen - 1, xlen)
+  )
+  io.low := product(xlen - 1, 0)
+}
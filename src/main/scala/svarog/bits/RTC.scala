@@ -4,13 +4,20 @@ import chisel3._
 import chisel3.util._
 import freechips.rocketchip.util._
 
-class RTC extends RawModule {
+/** Real-time clock for mtime, counting in the `rtcClock` domain
+  *
+  * @param skippable
+  *   add a `skip` input, in the core clock domain, that moves time forward
+  *   by that many ticks. Only for simulation.
+  */
+class RTC(skippable: Boolean = false) extends RawModule {
   val clk = IO(Input(Clock()))
   val reset = IO(Input(Bool()))
 
   val io = IO(new Bundle {
     val rtcClock = Input(Clock())
     val time = Output(UInt(64.W))
+    val skip = Option.when(skippable)(Input(UInt(64.W)))
   })
 
   val counterGray = withClockAndReset(io.rtcClock, reset) {
@@ -35,6 +42,13 @@ class RTC extends RawModule {
     }.reverse
     timeBinary := Cat(binaryBits)
 
-    io.time := RegNext(timeBinary)
+    // Skipped time is kept on this side, so the gray code still only
+    // ever changes by one
+    val skipped = io.skip.map { skip =>
+      val total = RegInit(0.U(64.W))
+      total := total + skip
+      total
+    }
+    io.time := RegNext(timeBinary) + skipped.getOrElse(0.U)
   }
 }
@@ -17,16 +17,35 @@ class RegFileWriteIO(xlen: Int) extends Bundle {
   val writeData = Input(UInt(xlen.W))
 }
 
-class RegFile(xlen: Int) extends Module {
+/** Integer register file
+  *
+  * @param dualIssue
+  *   add a second pair of read ports and a second write port for the younger
+  *   instruction of an issue pair. Its write wins when both target the same
+  *   register.
+  */
+class RegFile(xlen: Int, dualIssue: Boolean = false) extends Module {
   val readIo = IO(new RegFileReadIO(xlen))
   val writeIo = IO(new RegFileWriteIO(xlen))
+  val readIoSecond = Option.when(dualIssue)(IO(new RegFileReadIO(xlen)))
+  val writeIoSecond = Option.when(dualIssue)(IO(new RegFileWriteIO(xlen)))
+  // Extra read port for the simulator's backdoor, unused in real builds
+  val peekIo = IO(new Bundle {
+    val addr = Input(UInt(5.W))
+    val data = Output(UInt(xlen.W))
+  })
 
   val regs = RegInit(VecInit(Seq.fill(32)(0.U(xlen.W))))
 
-  when(writeIo.writeEn && writeIo.writeAddr =/= 0.U) {
-    regs(writeIo.writeAddr) := writeIo.writeData
+  for (w <- writeIo +: writeIoSecond.toSeq) {
+    when(w.writeEn && w.writeAddr =/= 0.U) {
+      regs(w.writeAddr) := w.writeData
+    }
   }
 
-  readIo.readData1 := Mux(readIo.readAddr1 === 0.U, 0.U, regs(readIo.readAddr1))
-  readIo.readData2 := Mux(readIo.readAddr2 === 0.U, 0.U, regs(readIo.readAddr2))
+  for (r <- readIo +: readIoSecond.toSeq) {
+    r.readData1 := Mux(r.readAddr1 === 0.U, 0.U, regs(r.readAddr1))
+    r.readData2 := Mux(r.readAddr2 === 0.U, 0.U, regs(r.readAddr2))
+  }
+  peekIo.data := Mux(peekIo.addr === 0.U, 0.U, regs(peekIo.addr))
 }
@@ -187,7 +187,12 @@ object TLUART {
   val STATUS_RX_VALID = 1
 }
 
-class TLUART(baseAddr: Long, busWidth: Int = 32, dataWidth: Int = 8)(implicit
+class TLUART(
+    baseAddr: Long,
+    busWidth: Int = 32,
+    dataWidth: Int = 8,
+    baudDivider: Int = 434
+)(implicit
     p: Parameters
 ) extends LazyModule {
   private val beatBytes = busWidth / 8
@@ -213,7 +218,7 @@ class TLUART(baseAddr: Long, busWidth: Int = 32, dataWidth: Int = 8)(implicit
     uart.txd := uartCore.io.txd
     uartCore.io.rxd := uart.rxd
 
-    val baudDividerReg = RegInit(434.U(16.W))
+    val baudDividerReg = RegInit(baudDivider.U(16.W))
     uartCore.io.baudDivider := baudDividerReg
 
     // TX buffer registers - needed because RegField's Decoupled handling
@@ -1,6 +1,5 @@
 package svarog.config
 
-import io.circe.generic.semiauto._
 import io.circe.{Decoder, Encoder}
 import scala.util.Success
 import scala.util.Failure
@@ -19,13 +18,19 @@ import scala.util.Try
   *   Control and Status Register support, must be always present
   * @param zicntr
   *   Base counters (cycle/instret) support
+  * @param zba
+  *   Address generation (sh1add/sh2add/sh3add) support
+  * @param zbb
+  *   Basic bit-manipulation support
   */
 case class ISA(
     xlen: Int,
     mult: Boolean,
     zmmul: Boolean,
     zicsr: Boolean,
-    zicntr: Boolean
+    zicntr: Boolean,
+    zba: Boolean = false,
+    zbb: Boolean = false
 )
 
 object ISA {
@@ -56,7 +61,7 @@ object ISA {
           }
 
           val supportedBase = Set('i', 'm')
-          val supportedZ = Set("zmmul", "zicsr", "zicntr")
+          val supportedZ = Set("zmmul", "zicsr", "zicntr", "zba", "zbb")
 
           val unsupportedBase = baseExtensions -- supportedBase
           val unsupportedZ = zExtensions -- supportedZ
@@ -74,7 +79,9 @@ object ISA {
             zmmul =
               zExtensions.contains("zmmul") || baseExtensions.contains('m'),
             zicsr = zExtensions.contains("zicsr"),
-            zicntr = zExtensions.contains("zicntr")
+            zicntr = zExtensions.contains("zicntr"),
+            zba = zExtensions.contains("zba"),
+            zbb = zExtensions.contains("zbb")
           )
         }
 
@@ -88,16 +95,163 @@ trait CoreType
 case object Micro extends CoreType
 case object Mini extends CoreType
 
+/** The micro pipeline with a second, ALU-only issue lane fed by 64-bit
+  * fetches from the I-cache
+  */
+case object Dual extends CoreType
+
+/** Fetch-stage branch predictor, selected with the cluster's
+  * `branchPredictor` key: `none`, `static`, `bimodal` or `gshare`.
+  */
+sealed trait BranchPredictorType
+
+/** Always predict not taken */
+case object NoBranchPredictor extends BranchPredictorType
+
+/** Backward conditional branches and JAL are predicted taken */
+case object StaticBranchPredictor extends BranchPredictorType
+
+/** 2-bit counters indexed by PC, plus a BTB for JALR targets */
+case class BimodalBranchPredictor(bhtEntries: Int = 64, btbEntries: Int = 8)
+    extends BranchPredictorType
+
+/** Like bimodal, with the counters indexed by PC xor global history */
+case class GshareBranchPredictor(
+    bhtEntries: Int = 256,
+    historyBits: Int = 8,
+    btbEntries: Int = 8
+) extends BranchPredictorType
+
+/** Divider used for the M extension, selected with the cluster's `divider`
+  * key: `simple` or `radix2`/`radix4`/`radix16`.
+  */
+sealed trait DividerType
+
+/** Behavioural `/` and `%` behind a fixed 320-cycle latency; not synthesizable
+  */
+case object SimpleDividerType extends DividerType
+
+/** Iterative divider retiring log2(radix) quotient bits per cycle */
+case class RadixDividerType(radix: Int = 4) extends DividerType
+
+/** Multiplier used for Zmmul, selected with the cluster's `multiplier` key
+  * (`simple` or `pipelined`) and `multiplierLatency`.
+  */
+sealed trait MultiplierType {
+
+  /** Cycles from issue to result */
+  def latency: Int
+}
+
+/** Accepts a new operation only once the previous one has finished */
+case class SimpleMultiplierType(latency: Int = 3) extends MultiplierType
+
+/** Accepts one operation per cycle */
+case class PipelinedMultiplierType(latency: Int = 3) extends MultiplierType
+
+/** Pipeline registers traded for a shorter critical path, selected with the
+  * cluster's `timingProfile` key: `area`, `balanced` or `fmax`.
+  */
+sealed trait TimingProfile {
+
+  /** Branch resolution gets its own stage before redirecting Fetch; every
+    * mispredict, mret and fence.i costs one more cycle
+    */
+  def splitBranch: Boolean
+
+  /** CSR read data is registered behind CSRXbar; CSR ops spend two cycles in
+    * Execute
+    */
+  def registeredCsrRead: Boolean
+
+  /** TCM read data is registered; loads and fetches from TCM take one more
+    * cycle. TCMs are shared, so any cluster asking for it applies it to all.
+    */
+  def registeredTcm: Boolean
+}
+
+/** No extra registers, the lowest CPI */
+case object AreaTimingProfile extends TimingProfile {
+  def splitBranch = false
+  def registeredCsrRead = false
+  def registeredTcm = false
+}
+
+/** Cuts the branch and CSR paths, which cost little CPI */
+case object BalancedTimingProfile extends TimingProfile {
+  def splitBranch = true
+  def registeredCsrRead = true
+  def registeredTcm = false
+}
+
+/** Also registers the TCM output, for the highest clock */
+case object FmaxTimingProfile extends TimingProfile {
+  def splitBranch = true
+  def registeredCsrRead = true
+  def registeredTcm = true
+}
+
+/** L1 cache geometry, from the cluster's `icache` / `dcache` keys
+  *
+  * @param sizeBytes
+  *   capacity (`size`), a power of 2
+  * @param lineBytes
+  *   line size (`lineSize`), a power of 2 of at least two words
+  * @param ways
+  *   1 (direct-mapped) or 2
+  */
+case class CacheConfig(
+    sizeBytes: Int = 4096,
+    lineBytes: Int = 32,
+    ways: Int = 1
+)
+
+/** Cluster of identical cores
+  *
+  * @param coreType
+  *   `micro`, or `dual` for the dual-issue variant, which needs an `icache`
+  * @param multiplier
+  *   multiplier implementation and latency, only used when the ISA includes
+  *   Zmmul
+  * @param divider
+  *   divider implementation, only used when the ISA includes M
+  * @param icache
+  *   instruction cache in front of the bus, none by default
+  * @param dcache
+  *   write-back data cache in front of the bus, none by default
+  * @param storeBufferDepth
+  *   stores the Memory stage retires ahead of the data port (0 or a power of
+  *   2); 0 makes every store wait for its response
+  * @param hpmCounters
+  *   number of implemented mhpmcounters, starting at mhpmcounter3 (0 to 29)
+  * @param timingProfile
+  *   pipeline registers inserted for Fmax, see [[TimingProfile]]
+  */
 case class Cluster(
     coreType: CoreType,
     isa: ISA,
-    numCores: Int
+    numCores: Int,
+    branchPredictor: BranchPredictorType = NoBranchPredictor,
+    hpmCounters: Int = 3,
+    divider: DividerType = RadixDividerType(),
+    multiplier: MultiplierType = PipelinedMultiplierType(),
+    icache: Option[CacheConfig] = None,
+    dcache: Option[CacheConfig] = None,
+    storeBufferDepth: Int = 2,
+    timingProfile: TimingProfile = AreaTimingProfile
 )
 
 trait IO {
   def numPorts: Int
 }
-case class UART(name: String, baseAddr: Long) extends IO {
+/** UART peripheral
+  *
+  * @param baudDivider
+  *   reset value of the BAUD_DIV register; each serial bit lasts
+  *   (baudDivider + 1) core cycles
+  */
+case class UART(name: String, baseAddr: Long, baudDivider: Int = 434)
+    extends IO {
   def numPorts: Int = 2
 }
 
@@ -105,15 +259,41 @@ trait Memory {
   def getBaseAddress: Long
 }
 
-case class TCM(baseAddress: Long, length: Long) extends Memory {
+/** Tightly coupled memory
+  *
+  * @param ports
+  *   1 shares a single port between instruction and data accesses, 2 gives
+  *   the instruction side its own port
+  * @param banks
+  *   word-interleaved single-port banks (a power of 2); with 2 ports, fetch and
+  *   data accesses only proceed together when they hit different banks
+  */
+case class TCM(
+    baseAddress: Long,
+    length: Long,
+    ports: Int = 1,
+    banks: Int = 1
+) extends Memory {
   def getBaseAddress: Long = baseAddress
 }
 
+/** Boot ROM loaded with `--bootloader`, from the top-level `bootRom` key
+  *
+  * @param streams
+  *   sequential prefetch stream buffers in front of the array: 0 (default),
+  *   1 or 2. The array answers in one cycle, so they only pay off with a
+  *   slower one.
+  * @param prefetchWords
+  *   words each stream fetches ahead, a power of 2 of at least 2
+  */
+case class BootROM(streams: Int = 0, prefetchWords: Int = 4)
+
 /** SoC configuration loaded from YAML (without runtime flags) */
 case class SoCYaml(
     clusters: Seq[Cluster],
     io: Seq[IO],
-    memories: Seq[Memory]
+    memories: Seq[Memory],
+    bootRom: BootROM = BootROM()
 )
 
 /** Complete SoC configuration (YAML + runtime flags) */
@@ -121,7 +301,8 @@ case class SoC(
     clusters: Seq[Cluster],
     io: Seq[IO],
     memories: Seq[Memory],
-    simulatorDebug: Boolean
+    simulatorDebug: Boolean,
+    bootRom: BootROM = BootROM()
 ) {
   def getMaxWordLen: Int = clusters.map(_.isa.xlen).maxOption.getOrElse(0)
   def getNumHarts: Int = clusters.map(_.numCores).sum
@@ -135,15 +316,42 @@ object SoC {
       clusters = yaml.clusters,
       io = yaml.io,
       memories = yaml.memories,
-      simulatorDebug = simulatorDebug
+      simulatorDebug = simulatorDebug,
+      bootRom = yaml.bootRom
     )
   }
 }
 
 object Config {
   // Derive decoders for concrete types
-  implicit val uartDecoder: Decoder[UART] = deriveDecoder
-  implicit val tcmDecoder: Decoder[TCM] = deriveDecoder
+  implicit val uartDecoder: Decoder[UART] = Decoder.instance { cursor =>
+    for {
+      name <- cursor.get[String]("name")
+      baseAddr <- cursor.get[Long]("baseAddr")
+      baudDivider <- cursor.getOrElse[Int]("baudDivider")(434)
+    } yield UART(name, baseAddr, baudDivider)
+  }
+  implicit val tcmDecoder: Decoder[TCM] = Decoder.instance { cursor =>
+    for {
+      baseAddress <- cursor.get[Long]("baseAddress")
+      length <- cursor.get[Long]("length")
+      ports <- cursor
+        .getOrElse[Int]("ports")(1)
+        .filterOrElse(
+          p => p == 1 || p == 2,
+          io.circe.DecodingFailure("TCM ports must be 1 or 2", cursor.history)
+        )
+      banks <- cursor
+        .getOrElse[Int]("banks")(1)
+        .filterOrElse(
+          b => b > 0 && (b & (b - 1)) == 0,
+          io.circe.DecodingFailure(
+            "TCM banks must be a power of 2",
+            cursor.history
+          )
+        )
+    } yield TCM(baseAddress, length, ports, banks)
+  }
 
   // Polymorphic decoder for IO based on "type" field
   implicit val ioDecoder: Decoder[IO] = Decoder.instance { cursor =>
@@ -168,8 +376,163 @@ object Config {
     }
   }
 
-  implicit val clusterDecoder: Decoder[Cluster] = deriveDecoder
-  implicit val socYamlDecoder: Decoder[SoCYaml] = deriveDecoder
+  implicit val branchPredictorDecoder: Decoder[BranchPredictorType] =
+    Decoder.decodeString.emapTry {
+      case "none"    => Success(NoBranchPredictor)
+      case "static"  => Success(StaticBranchPredictor)
+      case "bimodal" => Success(BimodalBranchPredictor())
+      case "gshare"  => Success(GshareBranchPredictor())
+      case other =>
+        Failure(new IOException(s"invalid branch predictor: $other"))
+    }
+
+  implicit val dividerDecoder: Decoder[DividerType] =
+    Decoder.decodeString.emapTry {
+      case "simple"  => Success(SimpleDividerType)
+      case "radix2"  => Success(RadixDividerType(2))
+      case "radix4"  => Success(RadixDividerType(4))
+      case "radix16" => Success(RadixDividerType(16))
+      case other =>
+        Failure(new IOException(s"invalid divider: $other"))
+    }
+
+  implicit val timingProfileDecoder: Decoder[TimingProfile] =
+    Decoder.decodeString.emapTry {
+      case "area"     => Success(AreaTimingProfile)
+      case "balanced" => Success(BalancedTimingProfile)
+      case "fmax"     => Success(FmaxTimingProfile)
+      case other =>
+        Failure(new IOException(s"invalid timing profile: $other"))
+    }
+
+  implicit val cacheConfigDecoder: Decoder[CacheConfig] = Decoder.instance {
+    cursor =>
+      def isPow2(n: Int) = n > 0 && (n & (n - 1)) == 0
+      for {
+        size <- cursor.getOrElse[Int]("size")(4096)
+        lineSize <- cursor.getOrElse[Int]("lineSize")(32)
+        ways <- cursor.getOrElse[Int]("ways")(1)
+        config <- Either.cond(
+          isPow2(size) && isPow2(lineSize) && lineSize >= 8 &&
+            (ways == 1 || ways == 2) && size / (lineSize * ways) >= 2,
+          CacheConfig(size, lineSize, ways),
+          io.circe.DecodingFailure(
+            "cache size and lineSize must be powers of 2 with at least two " +
+              "sets, lineSize at least 8 and ways 1 or 2",
+            cursor.history
+          )
+        )
+      } yield config
+  }
+
+  implicit val clusterDecoder: Decoder[Cluster] = Decoder.instance { cursor =>
+    for {
+      coreType <- cursor.get[CoreType]("coreType")
+      isa <- cursor.get[ISA]("isa")
+      numCores <- cursor.get[Int]("numCores")
+      branchPredictor <- cursor.getOrElse[BranchPredictorType](
+        "branchPredictor"
+      )(NoBranchPredictor)
+      hpmCounters <- cursor
+        .getOrElse[Int]("hpmCounters")(3)
+        .filterOrElse(
+          n => n >= 0 && n <= 29,
+          io.circe.DecodingFailure(
+            "hpmCounters must be between 0 and 29",
+            cursor.history
+          )
+        )
+      divider <- cursor.getOrElse[DividerType]("divider")(RadixDividerType())
+      multiplierLatency <- cursor
+        .getOrElse[Int]("multiplierLatency")(3)
+        .filterOrElse(
+          _ >= 1,
+          io.circe.DecodingFailure(
+            "multiplierLatency must be at least 1",
+            cursor.history
+          )
+        )
+      multiplier <- cursor
+        .getOrElse[String]("multiplier")("pipelined")
+        .flatMap {
+          case "simple"    => Right(SimpleMultiplierType(multiplierLatency))
+          case "pipelined" => Right(PipelinedMultiplierType(multiplierLatency))
+          case other =>
+            Left(
+              io.circe.DecodingFailure(
+                s"invalid multiplier: $other",
+                cursor.history
+              )
+            )
+        }
+      icache <- cursor
+        .get[Option[CacheConfig]]("icache")
+        .filterOrElse(
+          _.isDefined || coreType != Dual,
+          io.circe.DecodingFailure(
+            "dual cores fetch through the icache, which must be configured",
+            cursor.history
+          )
+        )
+      dcache <- cursor.get[Option[CacheConfig]]("dcache")
+      storeBufferDepth <- cursor
+        .getOrElse[Int]("storeBufferDepth")(2)
+        .filterOrElse(
+          n => n == 0 || (n > 0 && (n & (n - 1)) == 0),
+          io.circe.DecodingFailure(
+            "storeBufferDepth must be 0 or a power of 2",
+            cursor.history
+          )
+        )
+      timingProfile <- cursor.getOrElse[TimingProfile]("timingProfile")(
+        AreaTimingProfile
+      )
+    } yield Cluster(
+      coreType,
+      isa,
+      numCores,
+      branchPredictor,
+      hpmCounters,
+      divider,
+      multiplier,
+      icache,
+      dcache,
+      storeBufferDepth,
+      timingProfile
+    )
+  }
+
+  implicit val bootRomDecoder: Decoder[BootROM] = Decoder.instance { cursor =>
+    for {
+      streams <- cursor
+        .getOrElse[Int]("streams")(0)
+        .filterOrElse(
+          n => n >= 0 && n <= 2,
+          io.circe.DecodingFailure(
+            "boot ROM streams must be 0, 1 or 2",
+            cursor.history
+          )
+        )
+      prefetchWords <- cursor
+        .getOrElse[Int]("prefetchWords")(4)
+        .filterOrElse(
+          n => n >= 2 && (n & (n - 1)) == 0,
+          io.circe.DecodingFailure(
+            "boot ROM prefetchWords must be a power of 2 of at least 2",
+            cursor.history
+          )
+        )
+    } yield BootROM(streams, prefetchWords)
+  }
+
+  implicit val socYamlDecoder: Decoder[SoCYaml] = Decoder.instance { cursor =>
+    for {
+      clusters <- cursor.get[Seq[Cluster]]("clusters")
+      io <- cursor.get[Seq[IO]]("io")
+      memories <- cursor.get[Seq[Memory]]("memories")
+      bootRom <- cursor.getOrElse[BootROM]("bootRom")(BootROM())
+    } yield SoCYaml(clusters, io, memories, bootRom)
+  }
 
   implicit val coreTypeDecoder: Decoder[CoreType] =
     Decoder.decodeString.emapTry { str =>
@@ -178,6 +541,8 @@ object Config {
           Success(Micro)
         case "mini" =>
           Success(Mini)
+        case "dual" =>
+          Success(Dual)
         case _ => Failure(new IOException("invalid core type"))
       }
     }
@@ -12,16 +12,21 @@ import svarog.bits.{CSRReadIO, CSRWriteIO}
   *   - CSRReadIO (addr -> data) to CSR bus read
   *   - CSRWriteIO (en, addr, data) to CSR bus write
   *
-  * The adapter maintains combinational read latency as required by RISC-V.
+  * Reads are combinational by default. With `registeredRead` the read data is
+  * registered after the crossbar, so it arrives a cycle after the address.
+  * Cycles where a write owns the bus keep the previous data, so the reader
+  * must wait for a cycle without a write.
   */
-class CSRBusAdapter(implicit p: Parameters) extends LazyModule {
+class CSRBusAdapter(registeredRead: Boolean = false)(implicit p: Parameters)
+    extends LazyModule {
 
   val node = CSRMasterNode(Seq(CSRMasterParameters(name = "cpu_csr_master")))
 
-  lazy val module = new CSRBusAdapterImp(this)
+  lazy val module = new CSRBusAdapterImp(this, registeredRead)
 }
 
-class CSRBusAdapterImp(outer: CSRBusAdapter) extends LazyModuleImp(outer) {
+class CSRBusAdapterImp(outer: CSRBusAdapter, registeredRead: Boolean)
+    extends LazyModuleImp(outer) {
   private val (port, edge) = outer.node.out.head
   private val params = edge.params
 
@@ -40,8 +45,12 @@ class CSRBusAdapterImp(outer: CSRBusAdapter) extends LazyModuleImp(outer) {
   port.m2s.wen := io.write.en
   port.m2s.ren := !io.write.en // Read when not writing
 
-  // Return read data (combinational)
-  io.read.data := port.s2m.rdata
+  // Return read data
+  if (registeredRead) {
+    io.read.data := RegEnable(port.s2m.rdata, !io.write.en)
+  } else {
+    io.read.data := port.s2m.rdata
+  }
 }
 
 /** CSR Subsystem - combines adapter and crossbar for easy instantiation
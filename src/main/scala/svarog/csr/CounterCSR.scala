@@ -7,7 +7,8 @@ import org.chipsalliance.diplomacy.lazymodule.{LazyModule, LazyModuleImp}
 
 /** CSR addresses for performance counters.
   *
-  * Implements Zicntr (cycle/instret) and a fixed subset of Zihpm counters.
+  * Implements Zicntr (cycle/instret) and the first `numHpm` Zihpm counters,
+  * starting at mhpmcounter3.
   */
 object CounterCSRAddrs {
   val MCYCLE = 0xb00
@@ -24,6 +25,7 @@ object CounterCSRAddrs {
   def MHPMCOUNTERH(index: Int): Int = 0xb80 + index
   def HPMCOUNTER(index: Int): Int = 0xc00 + index
   def HPMCOUNTERH(index: Int): Int = 0xc80 + index
+  def MHPMEVENT(index: Int): Int = 0x320 + index
 
   val MHPMCOUNTER3 = MHPMCOUNTER(3)
   val MHPMCOUNTER4 = MHPMCOUNTER(4)
@@ -39,74 +41,101 @@ object CounterCSRAddrs {
   val HPMCOUNTER4H = HPMCOUNTERH(4)
   val HPMCOUNTER5H = HPMCOUNTERH(5)
 
-  private val machineLow = Seq(
-    MCYCLE,
-    MINSTRET,
-    MHPMCOUNTER3,
-    MHPMCOUNTER4,
-    MHPMCOUNTER5
-  )
-
-  private val machineHigh = Seq(
-    MCYCLEH,
-    MINSTRETH,
-    MHPMCOUNTER3H,
-    MHPMCOUNTER4H,
-    MHPMCOUNTER5H
-  )
-
-  private val userLow = Seq(
-    CYCLE,
-    INSTRET,
-    HPMCOUNTER3,
-    HPMCOUNTER4,
-    HPMCOUNTER5
-  )
+  /** Largest number of Zihpm counters (mhpmcounter3..31) */
+  val MaxHpm = 29
 
-  private val userHigh = Seq(
-    CYCLEH,
-    INSTRETH,
-    HPMCOUNTER3H,
-    HPMCOUNTER4H,
-    HPMCOUNTER5H
-  )
+  /** Counter indices of the implemented HPM counters */
+  def hpmIndices(numHpm: Int): Seq[Int] = {
+    require(
+      numHpm >= 0 && numHpm <= MaxHpm,
+      s"Unsupported number of HPM counters: $numHpm"
+    )
+    3 until 3 + numHpm
+  }
 
-  def all(xlen: Int): Seq[Int] = {
+  def all(xlen: Int, numHpm: Int = 3): Seq[Int] = {
     require(xlen == 32 || xlen == 64, s"Unsupported xlen for counters: $xlen")
+    val indices = Seq(0, 2) ++ hpmIndices(numHpm)
+    val machineLow = indices.map(MHPMCOUNTER)
+    val userLow = indices.map(HPMCOUNTER)
+    val events = hpmIndices(numHpm).map(MHPMEVENT)
     if (xlen == 32) {
-      machineLow ++ machineHigh ++ userLow ++ userHigh
+      machineLow ++ indices.map(MHPMCOUNTERH) ++ userLow ++
+        indices.map(HPMCOUNTERH) ++ events
     } else {
-      machineLow ++ userLow
+      machineLow ++ userLow ++ events
     }
   }
 }
 
+/** Events selectable through mhpmevent3..31.
+  *
+  * Writing an unknown event number selects [[HpmEvent.None]]. Stall events
+  * count cycles, the others count occurrences.
+  */
+object HpmEvent {
+  val None = 0
+  val BranchRetired = 1 // Branches and jumps retired
+  val BranchMiss = 2 // Branch and jump mispredicts
+  val HazardStall = 3 // Any HazardUnit stall
+  val FetchStall = 4 // Decode could accept but Fetch had nothing
+  val StallLoadUse = 5 // Execute waits on a load's data
+  val StallCsr = 6 // Execute waits on a pending CSR write
+  val BranchFlush = 7 // Cycles spent flushing after a mispredict
+  val LoadWait = 8 // Cycles a load waits for memory
+  val StoreWait = 9 // Cycles a store waits for memory
+  val MulDivBusy = 10 // Cycles Execute is busy with a multiply or divide
+  val TrapEntry = 11 // Exceptions and interrupts taken
+  val ICacheHit = 12
+  val ICacheMiss = 13
+  val DCacheHit = 14
+  val DCacheMiss = 15
+
+  val Count = 16
+
+  /** Reset selection of mhpmcounter3..5, kept from the fixed counters */
+  def resetEvent(index: Int): Int = index match {
+    case 3 => BranchRetired
+    case 4 => BranchMiss
+    case 5 => HazardStall
+    case _ => None
+  }
+}
+
 class CounterCSRIO extends Bundle {
-  val cycleTick = Input(Bool())
-  val instretTick = Input(Bool())
-  val branchRetiredTick = Input(Bool())
-  val branchMissTick = Input(Bool())
-  val hazardStallTick = Input(Bool())
+  // Cycles elapsed, more than one when the simulator skips idle time
+  val cycleTick = Input(UInt(64.W))
+  val instretTick = Input(UInt(2.W)) // Instructions retired this cycle
+  // Indexed by HpmEvent; entry 0 is ignored
+  val events = Input(Vec(HpmEvent.Count, Bool()))
 }
 
-/** Zicntr + fixed HPM counters.
+/** Zicntr + Zihpm counters.
   *
   * Implemented counters:
   *   - mcycle/cycle
   *   - minstret/instret
-  *   - mhpmcounter3/hpmcounter3: branches retired
-  *   - mhpmcounter4/hpmcounter4: branch misses
-  *   - mhpmcounter5/hpmcounter5: cycles stalled due to hazards
+  *   - mhpmcounterN/hpmcounterN for N in 3 until 3 + numHpm, each counting
+  *     the [[HpmEvent]] selected by mhpmeventN. Out of reset counters 3, 4
+  *     and 5 count branches retired, branch mispredicts and hazard stall
+  *     cycles.
   */
-class CounterCSR(xlen: Int)(implicit p: Parameters) extends LazyModule {
+class CounterCSR(xlen: Int, numHpm: Int = 3)(implicit p: Parameters)
+    extends LazyModule {
   val node = CSRSlaveNode(
-    Seq(CSRSlaveParameters(CounterCSRAddrs.all(xlen), name = "counter_csr"))
+    Seq(
+      CSRSlaveParameters(
+        CounterCSRAddrs.all(xlen, numHpm),
+        name = "counter_csr"
+      )
+    )
   )
 
-  lazy val module = new CounterCSRImp(this, xlen)
+  lazy val module = new CounterCSRImp(this, xlen, numHpm)
 }
 
-class CounterCSRImp(outer: CounterCSR, xlen: Int) extends LazyModuleImp(outer) {
+class CounterCSRImp(outer: CounterCSR, xlen: Int, numHpm: Int)
+    extends LazyModuleImp(outer) {
   private val (port, edge) = outer.node.in.head
   private val params = edge.params
 
@@ -119,50 +148,33 @@ class CounterCSRImp(outer: CounterCSR, xlen: Int) extends LazyModuleImp(outer) {
       userHigh: Int
   )
 
-  private val addressMap = Seq(
-    CounterAddressMap(
-      CounterCSRAddrs.MCYCLE,
-      CounterCSRAddrs.MCYCLEH,
-      CounterCSRAddrs.CYCLE,
-      CounterCSRAddrs.CYCLEH
-    ),
-    CounterAddressMap(
-      CounterCSRAddrs.MINSTRET,
-      CounterCSRAddrs.MINSTRETH,
-      CounterCSRAddrs.INSTRET,
-      CounterCSRAddrs.INSTRETH
-    ),
-    CounterAddressMap(
-      CounterCSRAddrs.MHPMCOUNTER3,
-      CounterCSRAddrs.MHPMCOUNTER3H,
-      CounterCSRAddrs.HPMCOUNTER3,
-      CounterCSRAddrs.HPMCOUNTER3H
-    ),
-    CounterAddressMap(
-      CounterCSRAddrs.MHPMCOUNTER4,
-      CounterCSRAddrs.MHPMCOUNTER4H,
-      CounterCSRAddrs.HPMCOUNTER4,
-      CounterCSRAddrs.HPMCOUNTER4H
-    ),
-    CounterAddressMap(
-      CounterCSRAddrs.MHPMCOUNTER5,
-      CounterCSRAddrs.MHPMCOUNTER5H,
-      CounterCSRAddrs.HPMCOUNTER5,
-      CounterCSRAddrs.HPMCOUNTER5H
-    )
+  private def addressesOf(index: Int) = CounterAddressMap(
+    CounterCSRAddrs.MHPMCOUNTER(index),
+    CounterCSRAddrs.MHPMCOUNTERH(index),
+    CounterCSRAddrs.HPMCOUNTER(index),
+    CounterCSRAddrs.HPMCOUNTERH(index)
   )
 
+  private val hpmIndices = CounterCSRAddrs.hpmIndices(numHpm)
+
+  // mcycle and minstret share the MHPMCOUNTER layout at indices 0 and 2
+  private val addressMap = (Seq(0, 2) ++ hpmIndices).map(addressesOf)
+
   private val counters = RegInit(
     VecInit(Seq.fill(addressMap.length)(0.U(64.W)))
   )
 
-  private val ticks = Seq(
-    io.cycleTick,
-    io.instretTick,
-    io.branchRetiredTick,
-    io.branchMissTick,
-    io.hazardStallTick
+  private val eventBits = log2Ceil(HpmEvent.Count)
+  private val eventSelect = hpmIndices.map { index =>
+    RegInit(HpmEvent.resetEvent(index).U(eventBits.W))
+  }
+
+  private val eventTicks = VecInit(
+    false.B +: io.events.tail
   )
+
+  private val ticks = Seq(io.cycleTick, io.instretTick) ++
+    eventSelect.map(select => eventTicks(select))
   require(
     ticks.length == addressMap.length,
     "Counter tick wiring must match counter address map"
@@ -182,7 +194,7 @@ class CounterCSRImp(outer: CounterCSR, xlen: Int) extends LazyModuleImp(outer) {
 
   private val addr = port.m2s.addr
 
-  private val readCases =
+  private val counterReadCases =
     counters.zip(addressMap).flatMap { case (counter, map) =>
       val lowCases = Seq(
         (addr === map.machineLow.U) -> readLow(counter),
@@ -199,13 +211,19 @@ class CounterCSRImp(outer: CounterCSR, xlen: Int) extends LazyModuleImp(outer) {
       }
     }
 
+  private val eventReadCases =
+    eventSelect.zip(hpmIndices).map { case (select, index) =>
+      (addr === CounterCSRAddrs.MHPMEVENT(index).U) ->
+        select.pad(params.dataBits)
+    }
+
+  private val readCases = counterReadCases ++ eventReadCases
+
   port.s2m.rdata := MuxCase(0.U(params.dataBits.W), readCases)
   port.s2m.hit := readCases.map(_._1).reduce(_ || _)
 
   counters.zip(ticks).foreach { case (counter, tick) =>
-    when(tick) {
-      counter := counter + 1.U
-    }
+    counter := counter + tick
   }
 
   when(port.m2s.wen) {
@@ -226,5 +244,16 @@ class CounterCSRImp(outer: CounterCSR, xlen: Int) extends LazyModuleImp(outer) {
         }
       }
     }
+
+    eventSelect.zip(hpmIndices).foreach { case (select, index) =>
+      when(addr === CounterCSRAddrs.MHPMEVENT(index).U) {
+        val wdata = port.m2s.wdata
+        select := Mux(
+          wdata < HpmEvent.Count.U,
+          wdata(eventBits - 1, 0),
+          HpmEvent.None.U
+        )
+      }
+    }
   }
 }
@@ -33,8 +33,52 @@ class ChipDebugSimulatorIO(numHarts: Int, xlen: Int) extends Bundle {
   val mem_res = Decoupled(UInt(xlen.W))
   val reg_res = Decoupled(UInt(xlen.W))
   val halted = Output(Bool())
+  val sleeping = Output(Bool()) // Waiting in wfi
 }
 
+class IdleSkip extends Bundle {
+  val ticks = UInt(64.W) // Added to mtime
+  val cycles = UInt(64.W) // Added to every hart's mcycle
+}
+
+/** Lets the simulator skip whole stretches of time in which every hart
+  * sleeps in `wfi`. A skip applies on the cycle it is valid, and must stop
+  * short of `deadline` so the timer interrupt still fires normally.
+  */
+class IdleSkipIO extends Bundle {
+  val allSleeping = Output(Bool())
+  val mtime = Output(UInt(64.W))
+  val deadline = Output(UInt(64.W)) // Earliest mtimecmp of any hart
+  val skip = Input(Valid(new IdleSkip))
+}
+
+/** Zero-time reads of architectural state for the simulator.
+  *
+  * The data outputs are combinational from the register files and TCM
+  * arrays, so a simulator can set an address, evaluate the model and read the
+  * result without a clock edge. `memHit` is low outside every TCM.
+  */
+class BackdoorIO(xlen: Int) extends Bundle {
+  val hart = Input(UInt(8.W))
+  val reg = Input(UInt(5.W))
+  val regData = Output(UInt(xlen.W))
+  val memAddr = Input(UInt(xlen.W))
+  val memData = Output(UInt(xlen.W))
+  val memHit = Output(Bool())
+}
+
+object TLChipDebugModule {
+
+  /** `hart_in.id` value that sends halt and setPC commands to every hart */
+  val AllHarts = 0xff
+}
+
+/** Simulation debug port of the SoC.
+  *
+  * `hart_in.id` routes each command to one hart, or to every hart with
+  * `AllHarts`. Register reads, `halted` and `sleeping` report the hart most
+  * recently addressed on its own, hart 0 out of reset.
+  */
 class TLChipDebugModule(
     xlen: Int,
     numHarts: Int,
@@ -70,15 +114,24 @@ class TLChipDebugModule(
   class Impl extends LazyModuleImp(this) {
     val debug = IO(new ChipDebugSimulatorIO(numHarts, xlen))
     val harts = IO(Vec(numHarts, new HartDebugIO(xlen)))
-    val cpuRegData = IO(Input(Valid(UInt(xlen.W))))
+    val cpuRegData = IO(Input(Vec(numHarts, Valid(UInt(xlen.W)))))
     val cpuHalted = IO(Input(Vec(numHarts, Bool())))
+    val cpuSleeping = IO(Input(Vec(numHarts, Bool())))
 
     private val (instOut, instEdge) = instNode.out(0)
     private val (dataOut, dataEdge) = dataNode.out(0)
 
+    private val broadcast =
+      debug.hart_in.id.bits === TLChipDebugModule.AllHarts.U
+    private val selectedHart = RegInit(0.U(log2Ceil(numHarts).max(1).W))
+    when(debug.hart_in.id.valid && !broadcast) {
+      selectedHart := debug.hart_in.id.bits
+    }
+
     // Route hart commands to the appropriate hart
     for (i <- 0 until numHarts) {
-      val hartSelected = debug.hart_in.id.valid && debug.hart_in.id.bits === i.U
+      val hartSelected = debug.hart_in.id.valid &&
+        (debug.hart_in.id.bits === i.U || broadcast)
 
       harts(i).halt.valid := Mux(
         hartSelected,
@@ -147,11 +200,12 @@ class TLChipDebugModule(
     }
 
     // Pass through halt status
-    debug.halted := cpuHalted(0)
+    debug.halted := cpuHalted(selectedHart)
+    debug.sleeping := cpuSleeping(selectedHart)
 
     // Connect register results from CPU
-    debug.reg_res.valid := cpuRegData.valid
-    debug.reg_res.bits := cpuRegData.bits
+    debug.reg_res.valid := cpuRegData(selectedHart).valid
+    debug.reg_res.bits := cpuRegData(selectedHart).bits
 
     // Memory interface state machine
     val wordSize = xlen / 8
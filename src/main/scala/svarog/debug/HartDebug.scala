@@ -31,7 +31,12 @@ class HartDebugIO(xlen: Int) extends Bundle {
   val setPC = Valid(new PCDebugIO(xlen)) // Set PC and flush pipeline
 }
 
-class HartDebugModule(xlen: Int) extends Module {
+/** Per-hart debug control
+  *
+  * @param retireWidth
+  *   instructions the hart retires per cycle; a breakpoint matches any of them
+  */
+class HartDebugModule(xlen: Int, retireWidth: Int = 1) extends Module {
   val io = IO(new Bundle {
     val hart = Flipped(new HartDebugIO(xlen: Int))
 
@@ -39,7 +44,7 @@ class HartDebugModule(xlen: Int) extends Module {
     val watchpointTriggered = Output(Bool()) // Signal to HazardUnit
     val setPCOut = Valid(UInt(xlen.W)) // PC to set + flush signal
 
-    val wbPC = Flipped(Valid(UInt(xlen.W)))
+    val wbPC = Flipped(Vec(retireWidth, Valid(UInt(xlen.W))))
     val memStore = Flipped(Valid(UInt(xlen.W))) // Memory store address
 
     val regData = Valid(UInt(xlen.W))
@@ -125,7 +130,9 @@ class HartDebugModule(xlen: Int) extends Module {
 
   // Internal events that assert halt (these can override external release)
   // These execute after external commands, so they have higher priority
-  when(io.wbPC.valid && breakpointEnabled && io.wbPC.bits === breakpointPC) {
+  private val breakpointHit =
+    io.wbPC.map(pc => pc.valid && pc.bits === breakpointPC).reduce(_ || _)
+  when(breakpointHit && breakpointEnabled) {
     haltState := true.B
   }
   when(io.watchpointTriggered) {
@@ -221,7 +221,8 @@ case class BaseInstructions(xlen: Int) extends Module {
   val systemInstrs = Seq(
     SystemInst(SystemImm12.ECALL),
     SystemInst(SystemImm12.EBREAK),
-    SystemInst(SystemImm12.MRET)
+    SystemInst(SystemImm12.MRET),
+    SystemInst(SystemImm12.WFI)
   )
 
   val fenceInstrs = Seq(
@@ -6,4 +6,7 @@ import chisel3.util.Decoupled
 class InstWord(xlen: Int) extends Bundle {
   val word = Output(UInt(32.W))
   val pc = Output(UInt(xlen.W))
+  // Fetch's guess at where this instruction goes next
+  val predictTaken = Output(Bool())
+  val predictTarget = Output(UInt(xlen.W))
 }
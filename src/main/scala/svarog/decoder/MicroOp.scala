@@ -28,6 +28,7 @@ object OpType extends ChiselEnum {
   val ECALL = Value
   val FENCE = Value
   val FENCE_I = Value
+  val WFI = Value
 }
 
 class MicroOp(val xlen: Int) extends Bundle {
@@ -46,6 +47,9 @@ class MicroOp(val xlen: Int) extends Bundle {
   val regWrite = Output(Bool())
   val pc = Output(UInt(xlen.W))
   val csrAddr = Output(UInt(12.W))
+  val inst = Output(UInt(32.W)) // Raw instruction word for the retire trace
+  val predictTaken = Output(Bool())
+  val predictTarget = Output(UInt(xlen.W))
 
   def illegal: Bool = opType === OpType.INVALID
 }
@@ -68,6 +72,9 @@ object MicroOp {
     invalid.regWrite := false.B
     invalid.pc := 0.U
     invalid.csrAddr := 0.U
+    invalid.inst := 0.U
+    invalid.predictTaken := false.B
+    invalid.predictTarget := 0.U
     invalid
   }
 }
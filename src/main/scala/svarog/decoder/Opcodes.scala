@@ -235,7 +235,8 @@ object CSRFields {
   }
 }
 
-// DecodeField implementations for System instructions (ECALL, EBREAK, MRET)
+// DecodeField implementations for System instructions (ECALL, EBREAK, MRET,
+// WFI)
 object SystemFields {
   case object opType extends DecodeField[SystemInst, OpType.Type] {
     def name = "opType"
@@ -246,6 +247,7 @@ object SystemFields {
         case SystemImm12.ECALL  => BitPat(OpType.ECALL)
         case SystemImm12.EBREAK => BitPat(OpType.EBREAK)
         case SystemImm12.MRET   => BitPat(OpType.MRET)
+        case SystemImm12.WFI    => BitPat(OpType.WFI)
         case _                  => BitPat(OpType.INVALID)
       }
     }
@@ -312,6 +314,7 @@ object SystemImm12 {
   val ECALL = "000000000000"
   val EBREAK = "000000000001"
   val MRET = "001100000010"
+  val WFI = "000100000101"
 }
 
 object CSRFunct3 {
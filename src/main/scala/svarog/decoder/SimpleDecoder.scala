@@ -10,7 +10,8 @@ class SimpleDecodeHazardIO extends Bundle {
   val isCsrOp = Output(Bool())
 }
 
-class SimpleDecoder(xlen: Int) extends Module {
+class SimpleDecoder(xlen: Int, zba: Boolean = false, zbb: Boolean = false)
+    extends Module {
   val io = IO(new Bundle {
     val inst = Flipped(Decoupled(new InstWord(xlen)))
     val decoded = Decoupled(new MicroOp(xlen))
@@ -37,6 +38,9 @@ class SimpleDecoder(xlen: Int) extends Module {
 
   val mDecoder = Some(Module(new MInstructions(xlen)))
 
+  val zbDecoder =
+    Option.when(zba || zbb)(Module(new ZbInstructions(xlen, zba, zbb)))
+
   // Start with base decoder result (which always provides valid PC even for INVALID instructions)
   io.decoded.bits := baseDecoder.io.decoded
 
@@ -54,6 +58,19 @@ class SimpleDecoder(xlen: Int) extends Module {
     }
   }
 
+  zbDecoder.foreach { zbDecoder =>
+    zbDecoder.io.instruction := io.inst.bits.word
+    zbDecoder.io.pc := io.inst.bits.pc
+
+    when(zbDecoder.io.decoded.opType =/= OpType.INVALID) {
+      io.decoded.bits := zbDecoder.io.decoded
+    }
+  }
+
+  io.decoded.bits.inst := io.inst.bits.word
+  io.decoded.bits.predictTaken := io.inst.bits.predictTaken
+  io.decoded.bits.predictTarget := io.inst.bits.predictTarget
+
   io.hazard.valid := io.inst.valid
   io.hazard.bits.rs1 := io.decoded.bits.rs1
   io.hazard.bits.rs2 := io.decoded.bits.rs2
@@ -0,0 +1,226 @@
+package svarog.decoder
+
+import chisel3._
+import chisel3.util._
+import chisel3.util.experimental.decode._
+import svarog.bits.ALUOp
+
+object ZbFunct7 {
+  val SHADD = "0010000"
+  val NEGATE = "0100000" // ANDN, ORN, XNOR
+  val MINMAX = "0000101"
+  val ROTATE = "0110000"
+}
+
+object ZbFunct3 {
+  val SH1ADD = "010"
+  val SH2ADD = "100"
+  val SH3ADD = "110"
+  val ANDN = "111"
+  val ORN = "110"
+  val XNOR = "100"
+  val MAX = "110"
+  val MAXU = "111"
+  val MIN = "100"
+  val MINU = "101"
+  val ROL = "001"
+  val ROR = "101"
+  val UNARY = "001" // CLZ, CTZ, CPOP, SEXT.B, SEXT.H
+  val UNARY_RIGHT = "101" // ORC.B, REV8
+  val ZEXTH = "100"
+}
+
+object ZbImm12 {
+  val CLZ = "011000000000"
+  val CTZ = "011000000001"
+  val CPOP = "011000000010"
+  val SEXTB = "011000000100"
+  val SEXTH = "011000000101"
+  val ORCB = "001010000111"
+  val REV8 = "011010011000" // RV32 encoding
+  val ZEXTH = "000010000000" // RV32 encoding, PACK with rs2 = x0
+}
+
+// Single-source bit-manipulation ops: the rs2/shamt field is part of the
+// encoding
+case class UnaryInst(val imm12: String, val funct3: String, val opcode: String)
+    extends DecodePattern {
+  require(imm12.length() == 12)
+  require(funct3.length() == 3)
+  require(opcode.length() == 7)
+
+  private val reg = "?????"
+
+  def bitPat: BitPat = BitPat("b" + imm12 + reg + funct3 + reg + opcode)
+}
+
+object ZbFields {
+  case object regOpType extends DecodeField[RInst, OpType.Type] {
+    def name = "opType"
+    def chiselType = OpType()
+    override def default = BitPat(OpType.INVALID)
+    def genTable(op: RInst): BitPat = BitPat(OpType.ALU)
+  }
+
+  case object regAluOp extends DecodeField[RInst, ALUOp.Type] {
+    def name = "aluOp"
+    def chiselType = ALUOp()
+    override def default = BitPat(ALUOp.ADD)
+    def genTable(op: RInst): BitPat = {
+      (op.funct7, op.funct3) match {
+        case (ZbFunct7.SHADD, ZbFunct3.SH1ADD) => BitPat(ALUOp.SH1ADD)
+        case (ZbFunct7.SHADD, ZbFunct3.SH2ADD) => BitPat(ALUOp.SH2ADD)
+        case (ZbFunct7.SHADD, ZbFunct3.SH3ADD) => BitPat(ALUOp.SH3ADD)
+        case (ZbFunct7.NEGATE, ZbFunct3.ANDN)  => BitPat(ALUOp.ANDN)
+        case (ZbFunct7.NEGATE, ZbFunct3.ORN)   => BitPat(ALUOp.ORN)
+        case (ZbFunct7.NEGATE, ZbFunct3.XNOR)  => BitPat(ALUOp.XNOR)
+        case (ZbFunct7.MINMAX, ZbFunct3.MAX)   => BitPat(ALUOp.MAX)
+        case (ZbFunct7.MINMAX, ZbFunct3.MAXU)  => BitPat(ALUOp.MAXU)
+        case (ZbFunct7.MINMAX, ZbFunct3.MIN)   => BitPat(ALUOp.MIN)
+        case (ZbFunct7.MINMAX, ZbFunct3.MINU)  => BitPat(ALUOp.MINU)
+        case (ZbFunct7.ROTATE, ZbFunct3.ROL)   => BitPat(ALUOp.ROL)
+        case (ZbFunct7.ROTATE, ZbFunct3.ROR)   => BitPat(ALUOp.ROR)
+        case _                                 => BitPat(ALUOp.ADD)
+      }
+    }
+  }
+
+  case object unaryOpType extends DecodeField[UnaryInst, OpType.Type] {
+    def name = "opType"
+    def chiselType = OpType()
+    override def default = BitPat(OpType.INVALID)
+    def genTable(op: UnaryInst): BitPat = BitPat(OpType.ALU)
+  }
+
+  case object unaryAluOp extends DecodeField[UnaryInst, ALUOp.Type] {
+    def name = "aluOp"
+    def chiselType = ALUOp()
+    override def default = BitPat(ALUOp.ADD)
+    def genTable(op: UnaryInst): BitPat = {
+      op.imm12 match {
+        case ZbImm12.CLZ   => BitPat(ALUOp.CLZ)
+        case ZbImm12.CTZ   => BitPat(ALUOp.CTZ)
+        case ZbImm12.CPOP  => BitPat(ALUOp.CPOP)
+        case ZbImm12.SEXTB => BitPat(ALUOp.SEXTB)
+        case ZbImm12.SEXTH => BitPat(ALUOp.SEXTH)
+        case ZbImm12.ORCB  => BitPat(ALUOp.ORCB)
+        case ZbImm12.REV8  => BitPat(ALUOp.REV8)
+        case ZbImm12.ZEXTH => BitPat(ALUOp.ZEXTH)
+        case _             => BitPat(ALUOp.ADD)
+      }
+    }
+  }
+
+  case object roriOpType extends DecodeField[ShiftIInst, OpType.Type] {
+    def name = "opType"
+    def chiselType = OpType()
+    override def default = BitPat(OpType.INVALID)
+    def genTable(op: ShiftIInst): BitPat = BitPat(OpType.ALU)
+  }
+}
+
+/** Zba and Zbb decoder, RV32 encodings only
+  *
+  * @param zba
+  *   decode SH1ADD, SH2ADD and SH3ADD
+  * @param zbb
+  *   decode the basic bit-manipulation instructions
+  */
+case class ZbInstructions(xlen: Int, zba: Boolean, zbb: Boolean)
+    extends Module {
+  require(xlen == 32, "ZbInstructions only implements the RV32 encodings")
+
+  val io = IO(new Bundle {
+    val decoded = new MicroOp(xlen)
+    val pc = Input(UInt(xlen.W))
+    val instruction = Input(UInt(32.W))
+  })
+
+  val zbaInstrs = Seq(
+    RInst(ZbFunct7.SHADD, ZbFunct3.SH1ADD, Opcodes.ALU_REG),
+    RInst(ZbFunct7.SHADD, ZbFunct3.SH2ADD, Opcodes.ALU_REG),
+    RInst(ZbFunct7.SHADD, ZbFunct3.SH3ADD, Opcodes.ALU_REG)
+  )
+
+  val zbbRegInstrs = Seq(
+    RInst(ZbFunct7.NEGATE, ZbFunct3.ANDN, Opcodes.ALU_REG),
+    RInst(ZbFunct7.NEGATE, ZbFunct3.ORN, Opcodes.ALU_REG),
+    RInst(ZbFunct7.NEGATE, ZbFunct3.XNOR, Opcodes.ALU_REG),
+    RInst(ZbFunct7.MINMAX, ZbFunct3.MAX, Opcodes.ALU_REG),
+    RInst(ZbFunct7.MINMAX, ZbFunct3.MAXU, Opcodes.ALU_REG),
+    RInst(ZbFunct7.MINMAX, ZbFunct3.MIN, Opcodes.ALU_REG),
+    RInst(ZbFunct7.MINMAX, ZbFunct3.MINU, Opcodes.ALU_REG),
+    RInst(ZbFunct7.ROTATE, ZbFunct3.ROL, Opcodes.ALU_REG),
+    RInst(ZbFunct7.ROTATE, ZbFunct3.ROR, Opcodes.ALU_REG)
+  )
+
+  val zbbUnaryInstrs = Seq(
+    UnaryInst(ZbImm12.CLZ, ZbFunct3.UNARY, Opcodes.ALU_IMM),
+    UnaryInst(ZbImm12.CTZ, ZbFunct3.UNARY, Opcodes.ALU_IMM),
+    UnaryInst(ZbImm12.CPOP, ZbFunct3.UNARY, Opcodes.ALU_IMM),
+    UnaryInst(ZbImm12.SEXTB, ZbFunct3.UNARY, Opcodes.ALU_IMM),
+    UnaryInst(ZbImm12.SEXTH, ZbFunct3.UNARY, Opcodes.ALU_IMM),
+    UnaryInst(ZbImm12.ORCB, ZbFunct3.UNARY_RIGHT, Opcodes.ALU_IMM),
+    UnaryInst(ZbImm12.REV8, ZbFunct3.UNARY_RIGHT, Opcodes.ALU_IMM),
+    UnaryInst(ZbImm12.ZEXTH, ZbFunct3.ZEXTH, Opcodes.ALU_REG)
+  )
+
+  val roriInstrs = Seq(
+    ShiftIInst(ZbFunct7.ROTATE, ZbFunct3.ROR, Opcodes.ALU_IMM)
+  )
+
+  val regInstrs = (if (zba) zbaInstrs else Seq.empty) ++
+    (if (zbb) zbbRegInstrs else Seq.empty)
+
+  // Extract instruction fields
+  val rd = io.instruction(11, 7)
+  val rs1 = io.instruction(19, 15)
+  val rs2 = io.instruction(24, 20)
+
+  io.decoded := MicroOp.getInvalid(xlen)
+
+  // Common register fields
+  io.decoded.rd := rd
+  io.decoded.rs1 := rs1
+  io.decoded.pc := io.pc
+
+  if (regInstrs.nonEmpty) {
+    val regTable =
+      new DecodeTable(regInstrs, Seq(ZbFields.regOpType, ZbFields.regAluOp))
+    val regDecoded = regTable.decode(io.instruction)
+
+    when(regDecoded(ZbFields.regOpType) =/= OpType.INVALID) {
+      io.decoded.opType := regDecoded(ZbFields.regOpType)
+      io.decoded.aluOp := regDecoded(ZbFields.regAluOp)
+      io.decoded.hasImm := false.B
+      io.decoded.regWrite := true.B
+      io.decoded.rs2 := rs2
+    }
+  }
+
+  if (zbb) {
+    val unaryTable = new DecodeTable(
+      zbbUnaryInstrs,
+      Seq(ZbFields.unaryOpType, ZbFields.unaryAluOp)
+    )
+    val unaryDecoded = unaryTable.decode(io.instruction)
+    val roriTable = new DecodeTable(roriInstrs, Seq(ZbFields.roriOpType))
+    val roriDecoded = roriTable.decode(io.instruction)
+
+    when(unaryDecoded(ZbFields.unaryOpType) =/= OpType.INVALID) {
+      io.decoded.opType := unaryDecoded(ZbFields.unaryOpType)
+      io.decoded.aluOp := unaryDecoded(ZbFields.unaryAluOp)
+      io.decoded.hasImm := false.B
+      io.decoded.regWrite := true.B
+      io.decoded.rs2 := 0.U
+    }.elsewhen(roriDecoded(ZbFields.roriOpType) =/= OpType.INVALID) {
+      // The shift amount is the rs2 field, no sign extension needed
+      io.decoded.opType := roriDecoded(ZbFields.roriOpType)
+      io.decoded.aluOp := ALUOp.ROR
+      io.decoded.hasImm := true.B
+      io.decoded.imm := rs2
+      io.decoded.regWrite := true.B
+      io.decoded.rs2 := 0.U
+    }
+  }
+}
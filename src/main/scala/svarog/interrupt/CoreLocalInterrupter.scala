@@ -30,10 +30,13 @@ class CoreLocalInterrupter(xlen: Int) extends Module {
 
     // Instruction boundary detection
     val validInstruction = Input(Bool()) // Instruction completing in Execute
-    val instructionPC = Input(UInt(xlen.W))
+    val nextPC = Input(UInt(xlen.W)) // Where it continues, taken branches included
 
     // Interrupt output
     val interruptRequest = Valid(new InterruptRequest(xlen))
+    // Ends wfi: an interrupt is pending and enabled in mie, whatever
+    // MSTATUS.MIE says
+    val wakeup = Output(Bool())
   })
 
   // Global interrupt enable from MSTATUS.MIE (bit 3)
@@ -64,7 +67,8 @@ class CoreLocalInterrupter(xlen: Int) extends Module {
   // - Any interrupt is pending AND enabled
   // - An instruction is completing (clean instruction boundary)
   io.interruptRequest.valid := globalIE && anyPending && io.validInstruction
+  io.wakeup := anyPending
   io.interruptRequest.bits.cause := cause
   // EPC points to next instruction (the one that would have executed)
-  io.interruptRequest.bits.epc := io.instructionPC + 4.U
+  io.interruptRequest.bits.epc := io.nextPC
 }
@@ -41,6 +41,7 @@ class Timer(numHarts: Int, xlen: Int, baseAddr: Long)(implicit p: Parameters)
     val io = IO(new Bundle {
       val time = Input(UInt(64.W))
       val fire = Output(Vec(numHarts, Bool()))
+      val deadline = Output(UInt(64.W)) // Earliest mtimecmp of any hart
     })
 
     // mtimecmp registers as separate low/high halves for 32-bit compatibility
@@ -48,10 +49,13 @@ class Timer(numHarts: Int, xlen: Int, baseAddr: Long)(implicit p: Parameters)
     val mtimecmpHi = Seq.fill(numHarts)(RegInit(~0.U(32.W)))
 
     // Fire interrupt when time >= mtimecmp
+    val mtimecmps = mtimecmpHi.zip(mtimecmpLo).map { case (hi, lo) =>
+      Cat(hi, lo)
+    }
     for (i <- 0 until numHarts) {
-      val mtimecmp = Cat(mtimecmpHi(i), mtimecmpLo(i))
-      io.fire(i) := io.time >= mtimecmp
+      io.fire(i) := io.time >= mtimecmps(i)
     }
+    io.deadline := mtimecmps.reduce((a, b) => Mux(a < b, a, b))
 
     // For 32-bit systems, split 64-bit registers into low/high halves
     if (beatBytes == 4) {
@@ -0,0 +1,438 @@
+package svarog.memory
+
+import chisel3._
+import chisel3.util._
+import org.chipsalliance.cde.config.Parameters
+import org.chipsalliance.diplomacy.lazymodule.{LazyModule, LazyModuleImp}
+import freechips.rocketchip.diplomacy.{IdRange, RegionType, TransferSizes}
+import freechips.rocketchip.tilelink._
+import svarog.config.CacheConfig
+import svarog.bits.asLE
+
+/** Per-access cache outcome, for the performance counters */
+class CacheEvents extends Bundle {
+  val hit = Bool()
+  val miss = Bool()
+}
+
+class L1CacheIO extends Bundle {
+  // Held high to request a flush; `flushDone` stays high until it drops
+  val flush = Input(Bool())
+  val flushDone = Output(Bool())
+  val events = Output(new CacheEvents)
+}
+
+/** Blocking, incoherent L1 cache between a MemoryIO port and TileLink
+  *
+  * Direct-mapped or 2-way set-associative with LRU replacement. Memory-like
+  * regions (TileLink `RegionType.UNCACHED` and above, i.e. TCM and ROM) are
+  * cached, everything else (MMIO) is passed through one access at a time.
+  * Hits are answered one cycle after the request like the TCM, and a new
+  * request is accepted every cycle, except right after a store hit. Lines are
+  * filled and written back one word-sized Get/Put at a time.
+  *
+  * Writes are write-back and write-allocate. With `readOnly` (the I-cache)
+  * writes go straight to the bus, and a flush invalidates every line instead
+  * of cleaning the dirty ones. Like the TCM, responses must be taken when
+  * valid. Debug memory accesses bypass the caches.
+  *
+  * @param portWords
+  *   words returned per hit (read-only caches only). A hit returns the whole
+  *   aligned block holding the requested word; uncached reads return their
+  *   word in every lane.
+  */
+class L1Cache(
+    name: String,
+    xlen: Int,
+    config: CacheConfig,
+    sourceIds: IdRange,
+    readOnly: Boolean,
+    portWords: Int = 1
+)(implicit p: Parameters)
+    extends LazyModule {
+
+  private val beatBytes = xlen / 8
+
+  val node = TLClientNode(
+    Seq(
+      TLMasterPortParameters.v1(
+        Seq(
+          TLMasterParameters.v1(
+            name = name,
+            sourceId = sourceIds,
+            supportsProbe = TransferSizes(1, beatBytes),
+            supportsGet = TransferSizes(1, beatBytes),
+            supportsPutFull = TransferSizes(1, beatBytes),
+            supportsPutPartial = TransferSizes(1, beatBytes)
+          )
+        )
+      )
+    )
+  )
+
+  lazy val module = new Impl
+  class Impl extends LazyModuleImp(this) {
+    val mem = IO(Flipped(new MemoryIO(xlen, xlen * portWords)))
+    val io = IO(new L1CacheIO)
+
+    private val (tl, edge) = node.out(0)
+
+    private val wordBytes = xlen / 8
+    private val ways = config.ways
+    private val beats = config.lineBytes / wordBytes
+    private val sets = config.sizeBytes / (config.lineBytes * ways)
+
+    require(ways == 1 || ways == 2, "Only direct-mapped and 2-way caches")
+    require(beats >= 2, "Cache lines must hold at least two words")
+    require(sets >= 2, "Cache must have at least two sets")
+    require(
+      isPow2(portWords) && portWords <= beats,
+      "Cache port must be a power of 2 words no wider than a line"
+    )
+    require(portWords == 1 || readOnly, "Only read-only caches have wide ports")
+
+    private val portBytes = wordBytes * portWords
+    private val portBits = log2Ceil(portWords)
+    private val rowBits = log2Ceil(beats) - portBits
+
+    private val wordBits = log2Ceil(wordBytes)
+    private val offsetBits = log2Ceil(config.lineBytes)
+    private val setBits = log2Ceil(sets)
+    private val tagBits = xlen - offsetBits - setBits
+
+    private def setOf(addr: UInt): UInt =
+      addr(offsetBits + setBits - 1, offsetBits)
+    private def beatOf(addr: UInt): UInt = addr(offsetBits - 1, wordBits)
+    private def tagOf(addr: UInt): UInt = addr(xlen - 1, offsetBits + setBits)
+    private def lineAddr(tag: UInt, set: UInt, beat: UInt): UInt =
+      Cat(tag, set, beat, 0.U(wordBits.W))
+    // Data array row holding a beat; a row is one port-width block
+    private def rowIdx(set: UInt, beat: UInt): UInt =
+      if (rowBits == 0) set
+      else Cat(set, beat(log2Ceil(beats) - 1, portBits))
+
+    private val cacheableSets = edge.manager.managers
+      .filter(_.regionType >= RegionType.UNCACHED)
+      .flatMap(_.address)
+    private def cacheable(addr: UInt): Bool =
+      cacheableSets.map(_.contains(addr)).foldLeft(false.B)(_ || _)
+
+    private val tags = Seq.fill(ways)(SyncReadMem(sets, UInt(tagBits.W)))
+    private val data = Seq.fill(ways)(
+      SyncReadMem(sets * beats / portWords, Vec(portBytes, UInt(8.W)))
+    )
+    private val valid =
+      RegInit(VecInit(Seq.fill(ways)(VecInit(Seq.fill(sets)(false.B)))))
+    private val dirty =
+      RegInit(VecInit(Seq.fill(ways)(VecInit(Seq.fill(sets)(false.B)))))
+    // Way to replace next in each set (2-way only)
+    private val lru = RegInit(VecInit(Seq.fill(sets)(false.B)))
+
+    private object State extends ChiselEnum {
+      val sReady, sReplay, sUncachedA, sUncachedD, sWbRead, sWbPut, sWbAck,
+        sFillGet, sFillAck, sError, sFlushTag, sFlushCheck = Value
+    }
+    private val state = RegInit(State.sReady)
+
+    // Miss handling: the line being written back or filled
+    private val missSet = Reg(UInt(setBits.W))
+    private val missWay = Reg(UInt(1.W))
+    private val victimTag = Reg(UInt(tagBits.W))
+    private val beat = Reg(UInt(log2Ceil(beats + 1).W))
+    private val wbLine = Reg(Vec(beats, Vec(wordBytes, UInt(8.W))))
+    private val fillDenied = Reg(Bool())
+    private val flushing = RegInit(false.B)
+    private val flushDone = RegInit(false.B)
+
+    // Stage 0: accept a request (or replay the one that missed), read arrays
+    private val s1Valid = RegInit(false.B)
+    private val s1Replayed = RegInit(false.B)
+    private val s1Req = Reg(new MemoryRequest(xlen, xlen * portWords))
+
+    private val replay = state === State.sReplay
+    private val s0Valid = mem.req.fire || replay
+    private val s0Addr = Mux(replay, s1Req.address, mem.req.bits.address)
+
+    private val walking = state === State.sWbRead || state === State.sFlushTag
+    private val tagReadSet = Mux(walking, missSet, setOf(s0Addr))
+    private val dataReadIdx = Mux(
+      walking,
+      rowIdx(missSet, beat),
+      rowIdx(setOf(s0Addr), beatOf(s0Addr))
+    )
+    private val tagRead = tags.map(_.read(tagReadSet, s0Valid || walking))
+    private val dataRead = data.map(_.read(dataReadIdx, s0Valid || walking))
+
+    s1Valid := s0Valid
+    s1Replayed := replay
+    when(s0Valid && !replay) {
+      s1Req := mem.req.bits
+    }
+
+    // Stage 1: tag compare
+    private val s1Set = setOf(s1Req.address)
+    private val s1Tag = tagOf(s1Req.address)
+    private val s1Hits = VecInit((0 until ways).map { w =>
+      valid(w)(s1Set) && tagRead(w) === s1Tag
+    })
+    private val s1Hit = s1Hits.asUInt.orR
+    private val s1UseCache = cacheable(s1Req.address) &&
+      !(readOnly.B && s1Req.write)
+    private val s1Active = s1Valid && state === State.sReady
+    private val s1Respond = s1Active && s1UseCache && s1Hit
+
+    // A pending flush stops new requests so that the pipeline drains
+    mem.req.ready := state === State.sReady && !(io.flush && !flushDone) &&
+      !(s1Valid && (!s1UseCache || !s1Hit || s1Req.write))
+
+    mem.resp.valid := s1Respond ||
+      (state === State.sUncachedD && tl.d.valid) || state === State.sError
+    mem.resp.bits.valid := true.B
+    mem.resp.bits.dataRead := Mux1H(s1Hits, dataRead)
+    when(state === State.sUncachedD) {
+      mem.resp.bits.valid := !tl.d.bits.denied && !tl.d.bits.corrupt
+      mem.resp.bits.dataRead :=
+        VecInit(Seq.fill(portWords)(asLE(tl.d.bits.data)).flatten)
+    }
+    when(state === State.sError) {
+      mem.resp.bits.valid := false.B
+    }
+
+    io.events.hit := s1Respond && !s1Replayed
+    io.events.miss := s1Active && s1UseCache && !s1Hit
+    io.flushDone := flushDone
+
+    when(s1Respond) {
+      if (ways > 1) {
+        lru(s1Set) := s1Hits(0)
+      }
+      when(s1Req.write) {
+        for (w <- 0 until ways) {
+          when(s1Hits(w)) {
+            data(w).write(
+              rowIdx(s1Set, beatOf(s1Req.address)),
+              s1Req.dataWrite,
+              s1Req.mask
+            )
+            dirty(w)(s1Set) := true.B
+          }
+        }
+      }
+    }
+
+    // Channel A
+    private val sourceId = sourceIds.start.U
+    private val wordSize = log2Ceil(wordBytes).U
+    private val fullMask = Fill(wordBytes, 1.U(1.W))
+    private val (_, uncachedGet) = edge.Get(sourceId, s1Req.address, wordSize)
+    private val (_, uncachedPut) = edge.Put(
+      sourceId,
+      s1Req.address,
+      wordSize,
+      VecInit(s1Req.dataWrite.take(wordBytes)).asUInt,
+      VecInit(s1Req.mask.take(wordBytes)).asUInt
+    )
+    private val beatIdx = beat(log2Ceil(beats) - 1, 0)
+    private val (_, wbPut) = edge.Put(
+      sourceId,
+      lineAddr(victimTag, missSet, beatIdx),
+      wordSize,
+      wbLine(beatIdx).asUInt,
+      fullMask
+    )
+    private val (_, fillGet) =
+      edge.Get(sourceId, lineAddr(s1Tag, missSet, beatIdx), wordSize)
+
+    tl.a.valid := state === State.sUncachedA || state === State.sWbPut ||
+      state === State.sFillGet
+    tl.a.bits := fillGet
+    when(state === State.sUncachedA) {
+      tl.a.bits := Mux(s1Req.write, uncachedPut, uncachedGet)
+    }
+    when(state === State.sWbPut) {
+      tl.a.bits := wbPut
+    }
+    tl.d.ready := true.B
+
+    tl.b.valid := false.B
+    tl.c.ready := true.B
+    tl.e.ready := true.B
+
+    private def startWriteback(set: UInt, way: UInt, tag: UInt): Unit = {
+      missSet := set
+      missWay := way
+      victimTag := tag
+      beat := 0.U
+      state := State.sWbRead
+    }
+
+    private def startFill(set: UInt, way: UInt): Unit = {
+      missSet := set
+      missWay := way
+      beat := 0.U
+      fillDenied := false.B
+      state := State.sFillGet
+    }
+
+    private def advanceFlush(): Unit = {
+      val lastWay = missWay === (ways - 1).U
+      missWay := Mux(lastWay, 0.U, missWay + 1.U)
+      when(lastWay) {
+        missSet := missSet + 1.U
+      }
+      when(lastWay && missSet === (sets - 1).U) {
+        flushing := false.B
+        flushDone := true.B
+        state := State.sReady
+      }.otherwise {
+        state := State.sFlushTag
+      }
+    }
+
+    private val anyDirty = dirty.asUInt.orR
+
+    when(!io.flush) {
+      flushDone := false.B
+    }
+
+    switch(state) {
+      is(State.sReady) {
+        when(s1Active && !s1UseCache) {
+          state := State.sUncachedA
+        }.elsewhen(s1Active && !s1Hit) {
+          // Prefer an invalid way, otherwise the LRU one
+          val way =
+            if (ways > 1)
+              Mux(
+                !valid(0)(s1Set),
+                0.U,
+                Mux(!valid(1)(s1Set), 1.U, lru(s1Set).asUInt)
+              )
+            else 0.U(1.W)
+          val victimDirty = valid(way)(s1Set) && dirty(way)(s1Set)
+          when(victimDirty) {
+            startWriteback(s1Set, way, VecInit(tagRead)(way))
+          }.otherwise {
+            startFill(s1Set, way)
+          }
+        }.elsewhen(io.flush && !flushDone && !s1Valid) {
+          if (readOnly) {
+            valid.foreach(_.foreach(_ := false.B))
+            flushDone := true.B
+          } else {
+            when(anyDirty) {
+              flushing := true.B
+              missSet := 0.U
+              missWay := 0.U
+              state := State.sFlushTag
+            }.otherwise {
+              flushDone := true.B
+            }
+          }
+        }
+      }
+
+      is(State.sReplay) {
+        state := State.sReady
+      }
+
+      is(State.sUncachedA) {
+        when(tl.a.fire) {
+          state := State.sUncachedD
+        }
+      }
+
+      is(State.sUncachedD) {
+        when(tl.d.fire) {
+          state := State.sReady
+        }
+      }
+
+      is(State.sWbRead) {
+        // Data for beat N arrives while beat N + 1 is being read
+        when(beat =/= 0.U) {
+          val row = VecInit(dataRead)(missWay)
+          wbLine(beat - 1.U) := VecInit(row.take(wordBytes))
+        }
+        beat := beat + 1.U
+        when(beat === beats.U) {
+          beat := 0.U
+          state := State.sWbPut
+        }
+      }
+
+      is(State.sWbPut) {
+        when(tl.a.fire) {
+          state := State.sWbAck
+        }
+      }
+
+      is(State.sWbAck) {
+        when(tl.d.fire) {
+          beat := beat + 1.U
+          state := State.sWbPut
+          when(beat === (beats - 1).U) {
+            dirty(missWay)(missSet) := false.B
+            when(flushing) {
+              advanceFlush()
+            }.otherwise {
+              startFill(missSet, missWay)
+            }
+          }
+        }
+      }
+
+      is(State.sFillGet) {
+        when(tl.a.fire) {
+          state := State.sFillAck
+        }
+      }
+
+      is(State.sFillAck) {
+        when(tl.d.fire) {
+          val denied = tl.d.bits.denied || tl.d.bits.corrupt
+          // Each beat fills its lane of the row
+          val lane = if (portBits == 0) 0.U else beatIdx(portBits - 1, 0)
+          val fillData =
+            VecInit(Seq.fill(portWords)(asLE(tl.d.bits.data)).flatten)
+          val fillMask =
+            VecInit((0 until portBytes).map(b => (b / wordBytes).U === lane))
+          for (w <- 0 until ways) {
+            when(missWay === w.U) {
+              data(w).write(rowIdx(missSet, beatIdx), fillData, fillMask)
+            }
+          }
+          fillDenied := fillDenied || denied
+          beat := beat + 1.U
+          state := State.sFillGet
+          when(beat === (beats - 1).U) {
+            for (w <- 0 until ways) {
+              when(missWay === w.U) {
+                tags(w).write(missSet, s1Tag)
+              }
+            }
+            valid(missWay)(missSet) := !(fillDenied || denied)
+            dirty(missWay)(missSet) := false.B
+            state := Mux(fillDenied || denied, State.sError, State.sReplay)
+          }
+        }
+      }
+
+      is(State.sError) {
+        state := State.sReady
+      }
+
+      is(State.sFlushTag) {
+        state := State.sFlushCheck
+      }
+
+      is(State.sFlushCheck) {
+        when(valid(missWay)(missSet) && dirty(missWay)(missSet)) {
+          startWriteback(missSet, missWay, VecInit(tagRead)(missWay))
+        }.otherwise {
+          advanceFlush()
+        }
+      }
+    }
+  }
+}
@@ -23,18 +23,38 @@ import freechips.rocketchip.util.SeqToAugmentedSeq
   * @param memSizeBytes
   * @param baseAddr
   * @param numPorts
+  *   independent TileLink ports, each completing one access per cycle
+  * @param banks
+  *   word-interleaved single-port banks. With more than one bank, ports only
+  *   proceed together when they hit different banks, and the lower-numbered
+  *   port wins a conflict. With one bank every port gets its own port on the
+  *   array (a true dual-port RAM for two ports).
+  * @param simBackdoor
+  *   replace the SyncReadMem with [[TCMSimRam]], which simulators can preload
+  *   without going through the bus. Only meant for simulation builds.
+  * @param registeredOutput
+  *   register responses after the array, so its read data only has to reach
+  *   a flop. Every access takes two cycles instead of one.
   */
 class TCM(
     xlen: Int,
     memSizeBytes: Long,
     baseAddr: Long = 0,
-    numPorts: Int = 1
+    numPorts: Int = 1,
+    banks: Int = 1,
+    simBackdoor: Boolean = false,
+    registeredOutput: Boolean = false
 )(implicit p: Parameters)
     extends LazyModule {
   require(
     memSizeBytes % (xlen / 8) == 0,
     "Memory size must be a multiple of word size"
   )
+  require(isPow2(banks), "Number of banks must be a power of 2")
+  require(
+    memSizeBytes % (xlen / 8 * banks) == 0,
+    "Memory size must be a multiple of word size times banks"
+  )
 
   val device = new SimpleDevice("tcm", Seq("svarog,tcm"))
   val wordSize = xlen / 8
@@ -52,57 +72,131 @@ class TCM(
       )
     ),
     beatBytes = wordSize,
-    minLatency = 1
+    minLatency = if (registeredOutput) 2 else 1
   )
 
   val node = TLManagerNode(Seq.fill(numPorts)(portParams))
 
   lazy val module = new Impl
   class Impl extends LazyModuleImp(this) {
-    private val mem =
-      SyncReadMem(memSizeBytes / wordSize, Vec(wordSize, UInt(8.W)))
+    private val depth = memSizeBytes / wordSize
+    private val bankBits = log2Ceil(banks)
+    private val simRam = Option.when(simBackdoor) {
+      val ram = Module(new TCMSimRam(depth, wordSize, numPorts, baseAddr))
+      ram.io.clock := clock
+      ram
+    }
 
-    for (i <- 0 until numPorts) {
-      val (in, edge) = node.in(i)
+    // Combinational read of the word holding `addr`, for the simulator
+    val backdoor = simRam.map { ram =>
+      val port = IO(new TCMBackdoorIO(xlen))
+      val offset = port.addr - baseAddr.U
+      ram.io.peekAddr := (offset / wordSize.U)(ram.io.peekAddr.getWidth - 1, 0)
+      port.hit := port.addr >= baseAddr.U && offset < memSizeBytes.U
+      port.data := ram.io.peekData
+      port
+    }
+
+    private val ins = (0 until numPorts).map(node.in(_)._1)
 
-      val isGet = in.a.bits.opcode === TLMessages.Get
-      val isPut = in.a.bits.opcode === TLMessages.PutFullData ||
-        in.a.bits.opcode === TLMessages.PutPartialData
+    private val isGet = ins.map(_.a.bits.opcode === TLMessages.Get)
+    private val isPut = ins.map { in =>
+      in.a.bits.opcode === TLMessages.PutFullData ||
+      in.a.bits.opcode === TLMessages.PutPartialData
+    }
 
-      in.a.ready := true.B
+    private val wordIdx =
+      ins.map(in => (in.a.bits.address - baseAddr.U) / wordSize.U)
+    private val bank =
+      wordIdx.map(idx => if (banks > 1) idx(bankBits - 1, 0) else 0.U)
 
-      val addr = in.a.bits.address
+    private val denied = (0 until numPorts).map { i =>
+      val addr = ins(i).a.bits.address
       val addrInRange =
         addr >= baseAddr
           .U(xlen.W) && addr < (baseAddr.U(xlen.W) + memSizeBytes.U(xlen.W))
+      !addrInRange || (!isPut(i) && !isGet(i))
+    }
+
+    // Lower-numbered ports win a shared bank
+    private val wantsArray =
+      (0 until numPorts).map(i => ins(i).a.valid && !denied(i))
+    for (i <- 0 until numPorts) {
+      val conflict =
+        if (banks > 1)
+          (0 until i)
+            .map(j => wantsArray(j) && bank(j) === bank(i))
+            .foldLeft(false.B)(_ || _)
+        else false.B
+      ins(i).a.ready := !conflict
+    }
 
-      val wordIdx = (addr - baseAddr.U) / wordSize.U
+    private val enable = (0 until numPorts).map { i =>
+      ins(i).a.fire && !denied(i)
+    }
 
-      val denied = !addrInRange || (!isPut && !isGet)
-      val enable = in.a.fire && !denied
-      val mask = VecInit(in.a.bits.mask.asBools)
+    private val readData: Seq[UInt] = simRam match {
+      case Some(ram) =>
+        // One array with a port per TileLink port; the arbitration above
+        // already keeps banked configurations conflict free
+        (0 until numPorts).map { i =>
+          val port = ram.io.ports(i)
+          port.en := enable(i)
+          port.wen := isPut(i)
+          port.addr := wordIdx(i)(port.addr.getWidth - 1, 0)
+          port.wdata := ins(i).a.bits.data
+          port.wmask := ins(i).a.bits.mask
+          port.rdata
+        }
 
-      val readData = mem.readWrite(
-        wordIdx,
-        asLE(in.a.bits.data),
-        mask,
-        enable,
-        isPut
-      )
+      case None if banks == 1 =>
+        val mem = SyncReadMem(depth, Vec(wordSize, UInt(8.W)))
+        (0 until numPorts).map { i =>
+          mem
+            .readWrite(
+              wordIdx(i),
+              asLE(ins(i).a.bits.data),
+              VecInit(ins(i).a.bits.mask.asBools),
+              enable(i),
+              isPut(i)
+            )
+            .asUInt
+        }
+
+      case None =>
+        val bankData = VecInit((0 until banks).map { b =>
+          val mem = SyncReadMem(depth / banks, Vec(wordSize, UInt(8.W)))
+          val grants =
+            (0 until numPorts).map(i => enable(i) && bank(i) === b.U)
+          val a = Mux1H(grants, ins.map(_.a.bits))
+          mem
+            .readWrite(
+              Mux1H(grants, wordIdx) >> bankBits,
+              asLE(a.data),
+              VecInit(a.mask.asBools),
+              grants.reduce(_ || _),
+              Mux1H(grants, isPut)
+            )
+            .asUInt
+        })
+        bank.map(b => bankData(RegNext(b)))
+    }
 
-      val respValid = RegNext(enable, false.B)
+    for (i <- 0 until numPorts) {
+      val (in, edge) = node.in(i)
+
+      val respValid = RegNext(enable(i), false.B)
       val sizeReg = RegNext(in.a.bits.size)
       val sourceReg = RegNext(in.a.bits.source)
-      val isGetReg = RegNext(isGet)
-      val deniedReg = RegNext(denied)
+      val isGetReg = RegNext(isGet(i))
+      val deniedReg = RegNext(denied(i))
 
-      in.d.valid := respValid
-      in.d.bits := Mux(
+      val response = Mux(
         isGetReg,
         edge.AccessAck(
           sourceReg,
           sizeReg,
-          readData.asUInt,
+          readData(i),
           denied = deniedReg,
           corrupt = deniedReg
         ),
@@ -112,6 +206,101 @@ class TCM(
           denied = deniedReg
         )
       )
+
+      if (registeredOutput) {
+        in.d.valid := RegNext(respValid, false.B)
+        in.d.bits := RegEnable(response, respValid)
+      } else {
+        in.d.valid := respValid
+        in.d.bits := response
+      }
     }
   }
 }
+
+class TCMBackdoorIO(xlen: Int) extends Bundle {
+  val addr = Input(UInt(xlen.W))
+  val data = Output(UInt(xlen.W))
+  val hit = Output(Bool())
+}
+
+class TCMSimRamPort(addrBits: Int, wordSize: Int) extends Bundle {
+  val en = Input(Bool())
+  val wen = Input(Bool())
+  val addr = Input(UInt(addrBits.W))
+  val wdata = Input(UInt((wordSize * 8).W))
+  val wmask = Input(UInt(wordSize.W))
+  val rdata = Output(UInt((wordSize * 8).W))
+}
+
+/** Behavioural TCM array for simulation builds
+  *
+  * Same timing as the SyncReadMem it replaces, plus an initial block that loads
+  * a `$readmemh` image named by the `+svarog_tcm_<baseAddr in hex>=<path>`
+  * plusarg. Simulators set that plusarg before the first eval to skip loading
+  * programs word by word over the debug bus. `peekAddr`/`peekData` read the
+  * array combinationally, for reading results back the same way.
+  */
+class TCMSimRam(depth: Long, wordSize: Int, numPorts: Int, baseAddr: Long)
+    extends BlackBox
+    with HasBlackBoxInline {
+  private val addrBits = log2Ceil(depth)
+  private val dataBits = wordSize * 8
+
+  val io = IO(new Bundle {
+    val clock = Input(Clock())
+    val ports = Vec(numPorts, new TCMSimRamPort(addrBits, wordSize))
+    val peekAddr = Input(UInt(addrBits.W))
+    val peekData = Output(UInt(dataBits.W))
+  })
+
+  override def desiredName: String = f"TCMSimRam_$baseAddr%x"
+
+  private val portDecls = (0 until numPorts).map { i =>
+    s"""  input                 ports_${i}_en,
+  input                 ports_${i}_wen,
+  input  [${addrBits - 1}:0] ports_${i}_addr,
+  input  [${dataBits - 1}:0] ports_${i}_wdata,
+  input  [${wordSize - 1}:0] ports_${i}_wmask,
+  output reg [${dataBits - 1}:0] ports_${i}_rdata"""
+  }
+
+  private val portLogic = (0 until numPorts).map { i =>
+    val byteWrites = (0 until wordSize).map { b =>
+      s"""        if (ports_${i}_wmask[$b])
+          mem[ports_${i}_addr][${b * 8 + 7}:${b * 8}] <= ports_${i}_wdata[${b * 8 + 7}:${b * 8}];"""
+    }
+    s"""  always @(posedge clock) begin
+    if (ports_${i}_en) begin
+      if (ports_${i}_wen) begin
+${byteWrites.mkString("\n")}
+      end else begin
+        ports_${i}_rdata <= mem[ports_${i}_addr];
+      end
+    end
+  end"""
+  }
+
+  setInline(
+    s"$desiredName.sv",
+    s"""module $desiredName (
+  input                 clock,
+${portDecls.mkString(",\n")},
+  input  [${addrBits - 1}:0] peekAddr,
+  output [${dataBits - 1}:0] peekData
+);
+  reg [${dataBits - 1}:0] mem [0:${depth - 1}];
+
+  assign peekData = mem[peekAddr];
+
+  initial begin
+    string image;
+    if ($$value$$plusargs("svarog_tcm_${f"$baseAddr%x"}=%s", image))
+      $$readmemh(image, mem);
+  end
+
+${portLogic.mkString("\n\n")}
+endmodule
+"""
+  )
+}
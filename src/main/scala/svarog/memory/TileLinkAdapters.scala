@@ -12,16 +12,46 @@ import freechips.rocketchip.diplomacy.{
 }
 import freechips.rocketchip.tilelink._
 
+/** Boot ROM for executing in place
+  *
+  * One request is accepted per cycle and answered one cycle later, so
+  * straight-line code runs from ROM as fast as from TCM. Writes are denied.
+  *
+  * Optional stream buffers prefetch sequentially. Each one holds the next
+  * `prefetchWords` words after the last word it supplied. While the array
+  * port is idle, it is used to fill the most recently used stream. A Get that
+  * hits a buffer is answered from it, and the words before it are dropped. A
+  * Get for the word a stream is about to fetch reads the array directly and
+  * moves the stream past it. Any other Get is read from the array and
+  * restarts the least recently used stream after it. Two streams let
+  * instruction fetch and loads from `.rodata` or the `.data` image stream side
+  * by side. The array answers in a cycle as well, so the buffers only pay off
+  * in front of a slower one, and there are none by default.
+  *
+  * @param streams
+  *   independent stream buffers, 0, 1 or 2
+  * @param prefetchWords
+  *   words each stream fetches ahead, a power of 2 of at least 2
+  */
 final class ROMTileLinkAdapter(
     xlen: Int,
     baseAddr: Long = 0,
-    file: String
+    file: String,
+    streams: Int = 0,
+    prefetchWords: Int = 4
 )(implicit p: Parameters)
     extends LazyModule {
+  require(streams >= 0 && streams <= 2, "ROM streams must be 0, 1 or 2")
+  require(
+    prefetchWords >= 2 && isPow2(prefetchWords),
+    "ROM prefetch depth must be a power of 2 of at least 2"
+  )
 
   private val beatBytes = xlen / 8
   private val romSizeBytes = 65536L
 
+  // UNCACHED lets masters cache it, which the L1 caches do; CACHED would
+  // claim a coherence manager in front of it
   val node = TLManagerNode(
     Seq(
       TLSlavePortParameters.v1(
@@ -49,81 +79,145 @@ final class ROMTileLinkAdapter(
     private val memPort = mem.io
     private val (in, edge) = node.in(0)
 
-    private object State extends ChiselEnum {
-      val sIdle, sMemWait, sResp = Value
-    }
-
-    private val state = RegInit(State.sIdle)
-    private val savedSource = Reg(UInt(edge.bundle.sourceBits.W))
-    private val savedSize = Reg(UInt(edge.bundle.sizeBits.W))
-    private val savedIsGet = RegInit(false.B)
-    private val pendingDenied = RegInit(false.B)
-    private val pendingData = RegInit(0.U(xlen.W))
+    private val wordBits = log2Ceil(beatBytes)
 
-    val isGet = in.a.bits.opcode === TLMessages.Get
-    val isPut = in.a.bits.opcode === TLMessages.PutFullData ||
-      in.a.bits.opcode === TLMessages.PutPartialData
+    private val isGet = in.a.bits.opcode === TLMessages.Get
+    private val inRange = in.a.bits.address >= baseAddr.U &&
+      in.a.bits.address < (baseAddr + romSizeBytes).U
+    private val get = in.a.fire && isGet && inRange
 
-    val useMem = isGet
+    // Without stream buffers every Get reads the array
+    private val demand = WireDefault(get)
+    private val fill = WireDefault(false.B)
+    private val fillAddress = WireDefault(0.U(xlen.W))
+    // The response leaving this cycle comes from a stream buffer
+    private val respBuffered = WireDefault(false.B)
+    private val respBufferData = WireDefault(0.U(xlen.W))
 
-    in.a.ready := state === State.sIdle && (memPort.req.ready || !useMem)
-
-    memPort.req.valid := in.a.fire && useMem
-    memPort.req.bits.address := in.a.bits.address
+    memPort.req.valid := demand || fill
+    memPort.req.bits.address := Mux(demand, in.a.bits.address, fillAddress)
     memPort.req.bits.write := false.B
-    memPort.req.bits.mask := VecInit(in.a.bits.mask.asBools)
+    memPort.req.bits.mask := VecInit(Seq.fill(beatBytes)(true.B))
     memPort.req.bits.dataWrite := 0.U.asTypeOf(memPort.req.bits.dataWrite)
+    memPort.resp.ready := true.B
+
+    private val romData = memPort.resp.bits.dataRead.asUInt
+
+    if (streams > 0) {
+      val wordAddrBits = xlen - wordBits
+      val slotBits = log2Ceil(prefetchWords)
+      val countBits = log2Ceil(prefetchWords + 1)
+
+      // Word addresses, so a stream never has to think about byte offsets
+      def wordOf(addr: UInt): UInt =
+        (addr >> wordBits).pad(wordAddrBits)(wordAddrBits - 1, 0)
+
+      // Stream s holds the words from base(s) on in data(s), starting at
+      // slot head(s). count(s) reads have been issued for it; a read issued
+      // in one cycle lands in its slot at the end of the next.
+      val valid = RegInit(VecInit(Seq.fill(streams)(false.B)))
+      val base = Reg(Vec(streams, UInt(wordAddrBits.W)))
+      val head = Reg(Vec(streams, UInt(slotBits.W)))
+      val count = RegInit(VecInit(Seq.fill(streams)(0.U(countBits.W))))
+      val data = Reg(Vec(streams, Vec(prefetchWords, UInt(xlen.W))))
+      // The stream replaced on the next miss
+      val lru = RegInit(0.U(1.W))
+
+      val reqWord = wordOf(in.a.bits.address)
+      val offset = (0 until streams).map(s => reqWord - base(s))
+      val buffered =
+        (0 until streams).map(s => valid(s) && offset(s) < count(s))
+      val nextUp =
+        (0 until streams).map(s => valid(s) && offset(s) === count(s))
+      val hits = buffered.zip(nextUp).map { case (b, n) => b || n }
+      val hit = hits.reduce(_ || _)
+      val hitStream = PriorityEncoder(hits)
+      val hitBuffered = VecInit(buffered)(hitStream)
+
+      demand := get && !(hit && hitBuffered)
+      val victim =
+        if (streams == 1) 0.U
+        else Mux(!valid(0), 0.U, Mux(!valid(1), 1.U, lru))
+
+      // The array prefetches whenever no demand read needs it, most
+      // recently used stream first
+      val canFill = VecInit((0 until streams).map { s =>
+        valid(s) && count(s) < prefetchWords.U
+      })
+      val fillStream =
+        if (streams == 1) 0.U else Mux(canFill(~lru), ~lru, lru)
+      fill := !demand && canFill(fillStream)
+      fillAddress := Cat(base(fillStream) + count(fillStream), 0.U(wordBits.W))
+
+      val filling = RegNext(fill, false.B)
+      val fillTarget = RegNext(fillStream)
+      val fillSlot =
+        RegNext(head(fillStream) + count(fillStream)(slotBits - 1, 0))
+      when(filling) {
+        data(fillTarget)(fillSlot) := romData
+      }
+
+      for (s <- 0 until streams) {
+        val consumed = Mux(
+          get && hit && hitStream === s.U,
+          Mux(buffered(s), offset(s)(countBits - 1, 0) + 1.U, count(s)),
+          0.U
+        )
+        head(s) := (head(s) + consumed)(slotBits - 1, 0)
+        count(s) := count(s) - consumed + (fill && fillStream === s.U).asUInt
+        when(get && hit && hitStream === s.U) {
+          base(s) := reqWord + 1.U
+        }
+      }
+      when(get && hit) {
+        lru := ~hitStream
+      }
+      when(get && !hit) {
+        valid(victim) := true.B
+        base(victim) := reqWord + 1.U
+        head(victim) := 0.U
+        count(victim) := 0.U
+        lru := ~victim
+      }
+
+      val respStream = RegNext(hitStream)
+      val respSlot = RegNext(
+        VecInit(head)(hitStream) + VecInit(offset)(hitStream)(slotBits - 1, 0)
+      )
+      respBuffered := RegNext(get && hit && hitBuffered, false.B)
+      respBufferData := data(respStream)(respSlot)
+    }
+
+    // Responses come one cycle after the request, from the buffer or the
+    // array. The queue holds them while D is stalled.
+    private val respQueue = Module(
+      new Queue(new TLBundleD(edge.bundle), 2, flow = true)
+    )
+    private val pending = RegNext(in.a.fire, false.B)
+    in.a.ready := respQueue.io.count +& pending < 2.U
 
-    memPort.resp.ready := state === State.sMemWait
+    private val respSource = RegNext(in.a.bits.source)
+    private val respSize = RegNext(in.a.bits.size)
+    private val respIsGet = RegNext(isGet)
+    private val respDenied = RegNext(!isGet || !inRange)
 
-    in.d.valid := state === State.sResp
-    in.d.bits := Mux(
-      savedIsGet,
+    respQueue.io.enq.valid := pending
+    respQueue.io.enq.bits := Mux(
+      respIsGet,
       edge.AccessAck(
-        savedSource,
-        savedSize,
-        pendingData,
-        denied = pendingDenied,
-        corrupt = pendingDenied
+        respSource,
+        respSize,
+        Mux(respBuffered, respBufferData, romData),
+        denied = respDenied,
+        corrupt = respDenied
       ),
-      edge.AccessAck(savedSource, savedSize, denied = pendingDenied)
+      edge.AccessAck(respSource, respSize, denied = respDenied)
     )
+    in.d <> respQueue.io.deq
 
     in.b.valid := false.B
     in.c.ready := true.B
     in.e.ready := true.B
-
-    switch(state) {
-      is(State.sIdle) {
-        when(in.a.fire) {
-          savedSource := in.a.bits.source
-          savedSize := in.a.bits.size
-          savedIsGet := isGet
-
-          when(isPut) {
-            pendingDenied := true.B
-            pendingData := 0.U
-            state := State.sResp
-          }.otherwise {
-            state := State.sMemWait
-          }
-        }
-      }
-
-      is(State.sMemWait) {
-        when(memPort.resp.valid) {
-          pendingDenied := !memPort.resp.bits.valid
-          pendingData := memPort.resp.bits.dataRead.asUInt
-          state := State.sResp
-        }
-      }
-
-      is(State.sResp) {
-        when(in.d.fire) {
-          state := State.sIdle
-        }
-      }
-    }
   }
 }
 
@@ -306,3 +400,87 @@ final class MemoryIOTileLinkBundleAdapter(
     }
   }
 }
+
+/** MemoryIO to TileLink adapter that keeps several requests in flight
+  *
+  * Requests go straight onto channel A and take source ids round-robin from
+  * the client's range, so the number of ids bounds the number of outstanding
+  * requests. Managers may answer different sources out of order; responses are
+  * parked per source and handed back to MemoryIO in issue order, bypassing the
+  * parking slot when the oldest response arrives first.
+  */
+final class PipelinedMemoryIOTileLinkBundleAdapter(
+    edge: TLEdgeOut,
+    xlen: Int
+) extends Module {
+  val mem = IO(Flipped(new MemoryIO(xlen, xlen)))
+  val tl = IO(new TLBundle(edge.bundle))
+
+  private val wordSize = xlen / 8
+  private val sourceIds = edge.client.masters.head.sourceId
+  private val numSlots = sourceIds.size
+  private val slotBits = log2Ceil(numSlots).max(1)
+
+  private val issuePtr = RegInit(0.U(slotBits.W))
+  private val retirePtr = RegInit(0.U(slotBits.W))
+  private val outstanding = RegInit(0.U(log2Ceil(numSlots + 1).W))
+  private val slotValid = RegInit(VecInit(Seq.fill(numSlots)(false.B)))
+  private val slotData = Reg(Vec(numSlots, new MemoryResponse(xlen)))
+
+  private def wrap(ptr: UInt): UInt =
+    Mux(ptr === (numSlots - 1).U, 0.U, ptr + 1.U)
+
+  private val hasSlot = outstanding =/= numSlots.U
+
+  mem.req.ready := tl.a.ready && hasSlot
+  tl.a.valid := mem.req.valid && hasSlot
+  tl.a.bits := {
+    val size = log2Ceil(wordSize).U
+    val sourceId = sourceIds.start.U + issuePtr
+    val data = mem.req.bits.dataWrite.asUInt
+    val mask = mem.req.bits.mask.asUInt
+    val (_, getA) = edge.Get(sourceId, mem.req.bits.address, size)
+    val (_, putA) = edge.Put(sourceId, mem.req.bits.address, size, data, mask)
+    val a = Wire(new TLBundleA(edge.bundle))
+    a := getA
+    when(mem.req.bits.write) {
+      a := putA
+    }
+    a
+  }
+
+  tl.b.valid := false.B
+  tl.c.ready := true.B
+  tl.e.ready := true.B
+
+  // Every outstanding source owns a slot, so D never has to wait
+  tl.d.ready := true.B
+
+  private val dSlot = (tl.d.bits.source - sourceIds.start.U)(slotBits - 1, 0)
+  private val dResp = Wire(new MemoryResponse(xlen))
+  dResp.valid := !tl.d.bits.denied && !tl.d.bits.corrupt
+  dResp.dataRead := svarog.bits.asLE(tl.d.bits.data)
+
+  private val headParked = slotValid(retirePtr)
+  private val bypass = !headParked && tl.d.valid && dSlot === retirePtr
+
+  mem.resp.valid := headParked || bypass
+  mem.resp.bits := Mux(headParked, slotData(retirePtr), dResp)
+
+  when(tl.d.fire && !(bypass && mem.resp.ready)) {
+    slotValid(dSlot) := true.B
+    slotData(dSlot) := dResp
+  }
+
+  when(mem.resp.fire && headParked) {
+    slotValid(retirePtr) := false.B
+  }
+
+  when(tl.a.fire) {
+    issuePtr := wrap(issuePtr)
+  }
+  when(mem.resp.fire) {
+    retirePtr := wrap(retirePtr)
+  }
+  outstanding := outstanding + tl.a.fire.asUInt - mem.resp.fire.asUInt
+}
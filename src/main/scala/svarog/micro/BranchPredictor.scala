@@ -0,0 +1,175 @@
+package svarog.micro
+
+import chisel3._
+import chisel3.util._
+import svarog.config.{
+  BimodalBranchPredictor,
+  BranchPredictorType,
+  GshareBranchPredictor,
+  NoBranchPredictor,
+  StaticBranchPredictor
+}
+
+class BranchPrediction(xlen: Int) extends Bundle {
+  val taken = Bool()
+  val target = UInt(xlen.W)
+}
+
+/** Resolved control flow reported by Execute to train the predictor. */
+class BranchUpdate(xlen: Int) extends Bundle {
+  val pc = UInt(xlen.W)
+  val isConditional = Bool() // B-type branch, otherwise JALR
+  val taken = Bool()
+  val target = UInt(xlen.W)
+}
+
+/** One instruction looked up by Fetch */
+class BranchLookup(xlen: Int) extends Bundle {
+  val pc = Input(UInt(xlen.W))
+  val inst = Input(UInt(32.W))
+  val prediction = Output(new BranchPrediction(xlen))
+}
+
+/** Fetch-side branch predictor.
+  *
+  * Fetch hands over every instruction word as it arrives from memory, so
+  * direct targets (B-type and JAL) are computed from the word itself and only
+  * the direction of conditional branches needs predicting. JAL is always
+  * taken. The dynamic predictors add a small fully associative BTB for JALR
+  * targets.
+  *
+  * @param lookups
+  *   instructions predicted per cycle, one per word of a fetch block. They
+  *   share the tables, which are only written by `io.update`.
+  */
+class BranchPredictor(
+    xlen: Int,
+    kind: BranchPredictorType,
+    lookups: Int = 1
+) extends Module {
+  val io = IO(new Bundle {
+    val lookup = Vec(lookups, new BranchLookup(xlen))
+    val update = Flipped(Valid(new BranchUpdate(xlen)))
+  })
+
+  private class Decoded(l: BranchLookup) {
+    private val inst = l.inst
+    private val opcode = inst(6, 0)
+    val isBranch = opcode === "b1100011".U
+    val isJal = opcode === "b1101111".U
+    val isJalr = opcode === "b1100111".U
+
+    private val immB = Cat(
+      Fill(xlen - 12, inst(31)),
+      inst(7),
+      inst(30, 25),
+      inst(11, 8),
+      0.U(1.W)
+    )
+    private val immJ = Cat(
+      Fill(xlen - 20, inst(31)),
+      inst(19, 12),
+      inst(20),
+      inst(30, 21),
+      0.U(1.W)
+    )
+    val directTarget = l.pc + Mux(isJal, immJ, immB)
+
+    // Backward branches are usually loops
+    val backwardTaken = inst(31)
+  }
+
+  private val decoded = io.lookup.map(new Decoded(_))
+
+  io.lookup.zip(decoded).foreach { case (l, d) =>
+    l.prediction.taken := false.B
+    l.prediction.target := d.directTarget
+  }
+
+  kind match {
+    case NoBranchPredictor =>
+
+    case StaticBranchPredictor =>
+      io.lookup.zip(decoded).foreach { case (l, d) =>
+        l.prediction.taken := d.isJal || (d.isBranch && d.backwardTaken)
+      }
+
+    case BimodalBranchPredictor(bhtEntries, btbEntries) =>
+      val direction = counterTable(bhtEntries, pcIndex(_, bhtEntries))
+      predictDynamic(direction, btbEntries)
+
+    case GshareBranchPredictor(bhtEntries, historyBits, btbEntries) =>
+      require(
+        historyBits >= 2 && historyBits <= log2Ceil(bhtEntries),
+        "gshare history must be between 2 bits and the table index width"
+      )
+      // History is updated when branches resolve, not speculatively in fetch
+      val history = RegInit(0.U(historyBits.W))
+      when(io.update.valid && io.update.bits.isConditional) {
+        history := Cat(history(historyBits - 2, 0), io.update.bits.taken)
+      }
+      val direction = counterTable(
+        bhtEntries,
+        pc => pcIndex(pc, bhtEntries) ^ history.pad(log2Ceil(bhtEntries))
+      )
+      predictDynamic(direction, btbEntries)
+  }
+
+  private def pcIndex(pc: UInt, entries: Int): UInt =
+    pc(log2Ceil(entries) + 1, 2)
+
+  /** 2-bit saturating counters; returns whether each lookup is predicted
+    * taken
+    */
+  private def counterTable(entries: Int, index: UInt => UInt): Seq[Bool] = {
+    require(isPow2(entries), "branch history table size must be a power of 2")
+    // Start weakly not-taken
+    val counters = RegInit(VecInit(Seq.fill(entries)(1.U(2.W))))
+
+    when(io.update.valid && io.update.bits.isConditional) {
+      val idx = index(io.update.bits.pc)
+      val counter = counters(idx)
+      when(io.update.bits.taken && counter =/= 3.U) {
+        counter := counter + 1.U
+      }.elsewhen(!io.update.bits.taken && counter =/= 0.U) {
+        counter := counter - 1.U
+      }
+    }
+
+    io.lookup.map(l => counters(index(l.pc))(1))
+  }
+
+  private def predictDynamic(branchTaken: Seq[Bool], btbEntries: Int): Unit = {
+    val btbValid = RegInit(VecInit(Seq.fill(btbEntries)(false.B)))
+    val btbTag = Reg(Vec(btbEntries, UInt(xlen.W)))
+    val btbTarget = Reg(Vec(btbEntries, UInt(xlen.W)))
+    val btbNext = RegInit(0.U(log2Ceil(btbEntries).max(1).W))
+
+    for (((l, d), taken) <- io.lookup.zip(decoded).zip(branchTaken)) {
+      val hits = VecInit((0 until btbEntries).map { i =>
+        btbValid(i) && btbTag(i) === l.pc
+      })
+
+      when(d.isJalr && hits.asUInt.orR) {
+        l.prediction.taken := true.B
+        l.prediction.target := Mux1H(hits, btbTarget)
+      }.otherwise {
+        l.prediction.taken := d.isJal || (d.isBranch && taken)
+      }
+    }
+
+    // Refresh the matching entry, or replace round-robin
+    when(io.update.valid && !io.update.bits.isConditional) {
+      val updateHits = VecInit((0 until btbEntries).map { i =>
+        btbValid(i) && btbTag(i) === io.update.bits.pc
+      })
+      val slot = Mux(updateHits.asUInt.orR, OHToUInt(updateHits), btbNext)
+      btbValid(slot) := true.B
+      btbTag(slot) := io.update.bits.pc
+      btbTarget(slot) := io.update.bits.target
+      when(!updateHits.asUInt.orR) {
+        btbNext := Mux(btbNext === (btbEntries - 1).U, 0.U, btbNext + 1.U)
+      }
+    }
+  }
+}
@@ -5,6 +5,7 @@ import chisel3.util._
 import chisel3.util.experimental.BoringUtils
 import org.chipsalliance.cde.config.Parameters
 import org.chipsalliance.diplomacy.lazymodule.{LazyModule, LazyModuleImp}
+import freechips.rocketchip.diplomacy.AddressSet
 import svarog.bits.{CSRReadIO, CSRWriteIO}
 import svarog.bits.RegFile
 import svarog.bits.RegFileReadIO
@@ -15,28 +16,46 @@ import svarog.decoder.InstWord
 import svarog.decoder.MicroOp
 import svarog.decoder.OpType
 import svarog.decoder.SimpleDecoder
+import svarog.memory.CacheEvents
 import svarog.memory.MemoryIO
 import svarog.memory.MemoryRequest
 import svarog.MicroCoreConfig
-import svarog.config.Cluster
+import svarog.config.{Cluster, Dual}
 import svarog.csr.{
   CSRBusAdapter,
   CSRXbar,
   CounterCSR,
+  HpmEvent,
   MachineInfoCSR,
   MachineCSR,
   InterruptCSR
 }
 import svarog.interrupt.CoreLocalInterrupter
 
-class CpuIO(xlen: Int) extends Bundle {
+class CpuIO(xlen: Int, issueWidth: Int = 1) extends Bundle {
   // Memory interfaces (TileLink adapters are in MicroTile)
-  val instMem = new MemoryIO(xlen, xlen)
+  val instMem = new MemoryIO(xlen, xlen * issueWidth)
   val dataMem = new MemoryIO(xlen, xlen)
   // Debug and control
   val debug = Flipped(new HartDebugIO(xlen))
   val debugRegData = Valid(UInt(xlen.W))
   val halt = Output(Bool())
+  val sleeping = Output(Bool()) // Waiting in wfi
+  // Cycles the simulator skips while every hart sleeps, for mcycle
+  val idleCycles = Input(UInt(64.W))
+  val retire = Valid(new RetireInfo(xlen))
+  // The younger instruction of a pair retiring in the same cycle
+  val retireSecond = Option.when(issueWidth > 1)(Valid(new RetireInfo(xlen)))
+  // Register file read that bypasses the debug handshake, for the simulator
+  val peekReg = Input(UInt(5.W))
+  val peekRegData = Output(UInt(xlen.W))
+  // HpmEvent lines as a bit vector, for the simulator's profiler
+  val events = Output(UInt(HpmEvent.Count.W))
+  // fence.i handshake with the L1 caches, see L1CacheIO
+  val fenceI = Output(Bool())
+  val fenceIDone = Input(Bool())
+  val icacheEvents = Input(new CacheEvents)
+  val dcacheEvents = Input(new CacheEvents)
   // Interrupt inputs
   val timerInterrupt = Input(Bool())
   val softwareInterrupt = Input(Bool())
@@ -45,20 +64,23 @@ class CpuIO(xlen: Int) extends Bundle {
 class Cpu(
     val hartId: Int,
     val config: Cluster,
-    val startAddress: Long
+    val startAddress: Long,
+    val memoryRegions: Seq[AddressSet] = Seq.empty
 )(implicit p: Parameters)
     extends LazyModule {
 
   private val xlen = config.isa.xlen
 
   // CSR diplomatic subsystem - core-local
-  val csrAdapter = LazyModule(new CSRBusAdapter)
+  val csrAdapter = LazyModule(
+    new CSRBusAdapter(registeredRead = config.timingProfile.registeredCsrRead)
+  )
   val csrXbar = LazyModule(new CSRXbar)
   val machineInfoCSR = LazyModule(new MachineInfoCSR(hartId))
   val machineCSR = LazyModule(new MachineCSR(xlen))
   val interruptCSR = LazyModule(new InterruptCSR)
   val counterCSR = if (config.isa.zicntr) {
-    Some(LazyModule(new CounterCSR(xlen)))
+    Some(LazyModule(new CounterCSR(xlen, config.hpmCounters)))
   } else {
     None
   }
@@ -79,29 +101,67 @@ class CpuImp(outer: Cpu) extends LazyModuleImp(outer) {
   private val config = outer.config
   private val xlen = config.isa.xlen
   private val startAddress = outer.startAddress
+  // Dual cores issue up to two instructions per cycle, see HazardUnit for
+  // the pairing rules
+  private val dual = config.coreType == Dual
+  private val issueWidth = if (dual) 2 else 1
 
-  val io = IO(new CpuIO(xlen))
+  val io = IO(new CpuIO(xlen, issueWidth))
 
-  val debug = Module(new HartDebugModule(xlen))
+  val debug = Module(new HartDebugModule(xlen, issueWidth))
   val halt = RegInit(false.B)
   halt := debug.io.halt
 
   // Connect debug interface
   debug.io.hart <> io.debug
   io.debugRegData <> debug.io.regData
-  io.halt := halt
 
   // Memories
-  val regFile = Module(new RegFile(xlen))
+  val regFile = Module(new RegFile(xlen, dual))
+  regFile.peekIo.addr := io.peekReg
+  io.peekRegData := regFile.peekIo.data
 
   // Stages
-  val fetch = Module(new Fetch(xlen, startAddress))
-  val decode = Module(new SimpleDecoder(xlen))
-  val execute = Module(new Execute(config.isa))
-  val memory = Module(new Memory(xlen))
+  // Whole fetch blocks are only requested where the I-cache can serve them
+  val fetch = Module(
+    new Fetch(
+      xlen,
+      startAddress,
+      config.branchPredictor,
+      maxInFlight = Fetch.maxInFlight(config.timingProfile),
+      fetchWidth = issueWidth,
+      wideRegions = if (dual) outer.memoryRegions else Seq.empty
+    )
+  )
+  val decode = Module(
+    new SimpleDecoder(xlen, config.isa.zba, config.isa.zbb)
+  )
+  val execute = Module(
+    new Execute(
+      config.isa,
+      config.divider,
+      config.multiplier,
+      config.timingProfile
+    )
+  )
+  val memory = Module(
+    new Memory(xlen, config.storeBufferDepth, outer.memoryRegions)
+  )
   val writeback = Module(new Writeback(xlen))
+  io.retire := writeback.io.retire
+  io.sleeping := execute.io.sleeping && !halt
+
+  val hazardUnit = Module(new HazardUnit(dual))
 
-  val hazardUnit = Module(new HazardUnit)
+  // Second issue lane: ALU ops only, retiring next to the first lane
+  val decodeSecond = Option.when(dual)(
+    Module(new SimpleDecoder(xlen, config.isa.zba, config.isa.zbb))
+  )
+  val executeSecond = Option.when(dual)(
+    Module(new Execute(config.isa.copy(mult = false, zmmul = false)))
+  )
+  val writebackSecond = Option.when(dual)(Module(new Writeback(xlen)))
+  io.retireSecond.foreach(_ := writebackSecond.get.io.retire)
 
   // Connect memory interfaces (adapters are in MicroTile)
   fetch.io.mem <> io.instMem
@@ -119,37 +179,6 @@ class CpuImp(outer: Cpu) extends LazyModuleImp(outer) {
     debug.io.regRead.readAddr2,
     execute.io.regFile.readAddr2
   )
-  // Simple writeback bypass so execute sees the most recent value without waiting
-  val wbWriteEn = regFile.writeIo.writeEn
-  val wbWriteAddr = regFile.writeIo.writeAddr
-  val wbWriteData = regFile.writeIo.writeData
-
-  private val memBypassValid =
-    memory.io.res.valid && memory.io.res.bits.gprWrite &&
-      (memory.io.res.bits.rd =/= 0.U)
-  private val memBypassAddr = memory.io.res.bits.rd
-  private val memBypassData = memory.io.res.bits.gprData
-
-  def bypass(readAddr: UInt, readData: UInt): UInt = {
-    Mux(
-      memBypassValid && (memBypassAddr === readAddr),
-      memBypassData,
-      Mux(
-        wbWriteEn && (wbWriteAddr =/= 0.U) && (wbWriteAddr === readAddr),
-        wbWriteData,
-        readData
-      )
-    )
-  }
-
-  execute.io.regFile.readData1 := bypass(
-    execute.io.regFile.readAddr1,
-    regFile.readIo.readData1
-  )
-  execute.io.regFile.readData2 := bypass(
-    execute.io.regFile.readAddr2,
-    regFile.readIo.readData2
-  )
   debug.io.regRead.readData1 := regFile.readIo.readData1
   debug.io.regRead.readData2 := regFile.readIo.readData2
 
@@ -171,10 +200,18 @@ class CpuImp(outer: Cpu) extends LazyModuleImp(outer) {
     debug.io.regWrite.writeData,
     writeback.io.regFile.writeData
   )
+  // The second port writes the younger instruction, so it wins on a conflict
+  regFile.writeIoSecond.foreach { w =>
+    val wb = writebackSecond.get.io.regFile
+    w.writeEn := wb.writeEn && !debug.io.regWrite.writeEn
+    w.writeAddr := wb.writeAddr
+    w.writeData := wb.writeData
+  }
 
   // CSR file connection - internal to Cpu via diplomatic CSR subsystem
   outer.csrAdapter.module.io.read <> execute.io.csrFile.read
   outer.csrAdapter.module.io.write <> writeback.io.csrFile
+  execute.io.csrFile.busy := writeback.io.csrFile.en
 
   // Connect interrupt signals to InterruptCSR
   outer.interruptCSR.module.io.timerInterrupt := io.timerInterrupt
@@ -186,19 +223,33 @@ class CpuImp(outer: Cpu) extends LazyModuleImp(outer) {
   clint.io.mie := outer.interruptCSR.module.io.mie
   clint.io.mip := outer.interruptCSR.module.io.mip
   clint.io.mstatus := outer.machineCSR.module.io.mstatus
+  execute.io.wakeup := clint.io.wakeup
 
   // Interrupt at instruction boundaries (Execute stage commit)
-  // Only trigger on successful instruction completion, not during exceptions
-  clint.io.validInstruction := execute.io.res.fire && !execute.io.exception.valid
-  clint.io.instructionPC := execute.io.res.bits.pc
+  // Only trigger on successful instruction completion, not during exceptions,
+  // and not while younger multiplies are still in flight behind it. The
+  // bubble behind a split-stage branch fires too but is not a boundary: the
+  // registered redirect would be lost to the trap.
+  clint.io.validInstruction := execute.io.res.fire &&
+    !execute.io.exception.valid && execute.io.resLast && !execute.io.squash
+  // A pair commits together, so the interrupt is taken after the younger one
+  clint.io.nextPC := executeSecond
+    .map(ex => Mux(ex.io.res.fire, ex.io.nextPC, execute.io.nextPC))
+    .getOrElse(execute.io.nextPC)
 
   // IF -> ID
-  val fetchDecodeQueue = Module(
-    new Queue(new InstWord(xlen), 1, pipe = true, hasFlush = true)
+  // Dual cores decode straight from the Fetch buffer, which holds both
+  // instructions of a block until the pairing decision is made
+  val fetchDecodeQueue = Option.when(!dual)(
+    Module(new Queue(new InstWord(xlen), 1, pipe = true, hasFlush = true))
   )
 
-  fetchDecodeQueue.io.enq <> fetch.io.inst_out
-  decode.io.inst <> fetchDecodeQueue.io.deq
+  fetchDecodeQueue match {
+    case Some(queue) =>
+      queue.io.enq <> fetch.io.inst_out
+      decode.io.inst <> queue.io.deq
+    case None => decode.io.inst <> fetch.io.inst_out
+  }
 
   // ID -> EX
   val decodeExecQueue = Module(
@@ -207,6 +258,38 @@ class CpuImp(outer: Cpu) extends LazyModuleImp(outer) {
   decodeExecQueue.io.enq <> decode.io.decoded
   execute.io.uop <> decodeExecQueue.io.deq
 
+  private def candidate(uop: MicroOp): IssueCandidate = {
+    val c = Wire(new IssueCandidate)
+    c.opType := uop.opType
+    c.rd := uop.rd
+    c.regWrite := uop.regWrite
+    c.rs1 := uop.rs1
+    c.rs2 := uop.rs2
+    c
+  }
+
+  // The second instruction only enters Decode together with the first one,
+  // and only enters Execute together with it
+  val decodeExecQueueSecond = decodeSecond.map { dec =>
+    val pair = hazardUnit.io.pair.get
+    val second = fetch.io.inst_second.get
+    val queue = Module(
+      new Queue(new MicroOp(xlen), 1, pipe = true, hasFlush = true)
+    )
+    pair.first := candidate(decode.io.decoded.bits)
+    pair.second := candidate(dec.io.decoded.bits)
+
+    dec.io.inst.valid := second.valid
+    dec.io.inst.bits := second.bits
+    dec.io.decoded.ready := queue.io.enq.ready
+    second.ready := decode.io.inst.ready && queue.io.enq.ready && pair.canPair
+
+    queue.io.enq.valid := second.fire
+    queue.io.enq.bits := dec.io.decoded.bits
+    queue.io.deq.ready := execute.io.uop.fire
+    queue
+  }
+
   // EX -> MEM
   val execMemQueue = Module(
     new Queue(
@@ -226,11 +309,122 @@ class CpuImp(outer: Cpu) extends LazyModuleImp(outer) {
   memWbQueue.io.enq <> memory.io.res
   writeback.io.in <> memWbQueue.io.deq
 
-  // Branch flush pipeline queues on branch mispredict (including the cycle after branch resolution
-  // to cover the extra cycle of latency in the fetch redirect path).
-  val branchFlushNow = execute.io.branch.valid
-  val branchFlushHold = RegNext(branchFlushNow, init = false.B)
-  val branchFlush = branchFlushNow || branchFlushHold
+  // The second lane's results follow the first lane's through Memory without
+  // a memory access of their own
+  val execMemQueueSecond = executeSecond.map { ex =>
+    val queue = Module(
+      new Queue(new ExecuteResult(xlen), 1, pipe = true, hasFlush = true)
+    )
+    queue.io.enq <> ex.io.res
+    queue.io.deq.ready := memory.io.ex.fire
+    queue
+  }
+
+  // Holds the second result while the first one waits for memory. Not a
+  // pipe queue: its ready would then depend on Memory's output, which can
+  // depend on Memory's input in the same cycle.
+  val memSecond = execMemQueueSecond.map { exQueue =>
+    val queue = Module(
+      new Queue(new MemResult(xlen), 1, flow = true, hasFlush = true)
+    )
+    val res = exQueue.io.deq.bits
+    queue.io.enq.valid := memory.io.ex.fire && exQueue.io.deq.valid
+    queue.io.enq.bits.opType := res.opType
+    queue.io.enq.bits.rd := res.rd
+    queue.io.enq.bits.gprWrite := res.gprWrite
+    queue.io.enq.bits.gprData := res.gprResult
+    queue.io.enq.bits.csrAddr := res.csrAddr
+    queue.io.enq.bits.csrWrite := false.B
+    queue.io.enq.bits.csrData := res.csrResult
+    queue.io.enq.bits.pc := res.pc
+    queue.io.enq.bits.storeAddr := res.memAddress
+    queue.io.enq.bits.isStore := false.B
+    queue.io.enq.bits.storeData := res.storeData
+    queue.io.enq.bits.inst := res.inst
+    queue.io.deq.ready := memory.io.res.fire
+
+    // The pair only enters Memory once there is room for the second result
+    memory.io.ex.valid := execMemQueue.io.deq.valid &&
+      (!exQueue.io.deq.valid || queue.io.enq.ready)
+    execMemQueue.io.deq.ready := memory.io.ex.ready &&
+      (!exQueue.io.deq.valid || queue.io.enq.ready)
+    queue
+  }
+
+  val memWbQueueSecond = memSecond.map { mem =>
+    val queue = Module(
+      new Queue(new MemResult(xlen), 1, pipe = true, hasFlush = true)
+    )
+    queue.io.enq.valid := memory.io.res.fire && mem.io.deq.valid
+    queue.io.enq.bits := mem.io.deq.bits
+    writebackSecond.get.io.in <> queue.io.deq
+    queue
+  }
+
+  // Forwarding into Execute, youngest producer first: the execMemQueue entry
+  // (Execute's previous result), the Memory stage output (completing loads),
+  // then the Writeback port. The HazardUnit stalls when the youngest match is
+  // a load that has no data yet. In each stage the second lane holds the
+  // younger instruction of a pair, so it is checked first.
+  private case class BypassSource(valid: Bool, addr: UInt, data: UInt)
+
+  private def execSource(res: ExecuteResult, valid: Bool) = BypassSource(
+    valid && res.gprWrite && res.opType =/= OpType.LOAD && res.rd =/= 0.U,
+    res.rd,
+    res.gprResult
+  )
+
+  private def memSource(res: MemResult, valid: Bool) =
+    BypassSource(valid && res.gprWrite && res.rd =/= 0.U, res.rd, res.gprData)
+
+  private def wbSource(port: RegFileWriteIO) = BypassSource(
+    port.writeEn && port.writeAddr =/= 0.U,
+    port.writeAddr,
+    port.writeData
+  )
+
+  private val execSources = (execMemQueueSecond.toSeq :+ execMemQueue).map {
+    q => execSource(q.io.deq.bits, q.io.deq.valid)
+  }
+  private val memSources =
+    memSecond.toSeq.map(q => memSource(q.io.deq.bits, q.io.deq.valid)) :+
+      memSource(memory.io.res.bits, memory.io.res.valid)
+  private val wbSources = (regFile.writeIoSecond.toSeq :+ regFile.writeIo)
+    .map(wbSource)
+  private val bypassSources = execSources ++ memSources ++ wbSources
+
+  def bypass(readAddr: UInt, readData: UInt): UInt = {
+    MuxCase(
+      readData,
+      bypassSources.map(src => (src.valid && src.addr === readAddr) -> src.data)
+    )
+  }
+
+  execute.io.regFile.readData1 := bypass(
+    execute.io.regFile.readAddr1,
+    regFile.readIo.readData1
+  )
+  execute.io.regFile.readData2 := bypass(
+    execute.io.regFile.readAddr2,
+    regFile.readIo.readData2
+  )
+
+  executeSecond.foreach { ex =>
+    val read = regFile.readIoSecond.get
+    // Issue with the first lane or not at all
+    ex.io.uop.valid := decodeExecQueueSecond.get.io.deq.valid &&
+      execute.io.uop.fire
+    ex.io.uop.bits := decodeExecQueueSecond.get.io.deq.bits
+    read.readAddr1 := ex.io.regFile.readAddr1
+    read.readAddr2 := ex.io.regFile.readAddr2
+    ex.io.regFile.readData1 := bypass(ex.io.regFile.readAddr1, read.readData1)
+    ex.io.regFile.readData2 := bypass(ex.io.regFile.readAddr2, read.readData2)
+    ex.io.csrFile.read.data := 0.U
+    ex.io.csrFile.busy := false.B
+    ex.io.mepc := 0.U
+    ex.io.fenceIDone := false.B
+    ex.io.wakeup := false.B
+  }
 
   // Exception and interrupt handling - connect to MachineCSR
   val exceptionValid = execute.io.exception.valid
@@ -250,6 +444,20 @@ class CpuImp(outer: Cpu) extends LazyModuleImp(outer) {
     clint.io.interruptRequest.bits.cause
   )
 
+  // With a split branch stage the redirect is registered before it flushes
+  // the queues and reaches Fetch. A trap in the same cycle redirects to mtvec
+  // instead, so it cancels the registered branch.
+  val branchResolved =
+    if (config.timingProfile.splitBranch)
+      Pipe(execute.io.branch.valid && !trapValid, execute.io.branch.bits)
+    else execute.io.branch
+
+  // Branch flush pipeline queues on branch mispredict (including the cycle after branch resolution
+  // to cover the extra cycle of latency in the fetch redirect path).
+  val branchFlushNow = branchResolved.valid
+  val branchFlushHold = RegNext(branchFlushNow, init = false.B)
+  val branchFlush = branchFlushNow || branchFlushHold
+
   // MRET handling
   outer.machineCSR.module.io.mretFired := execute.io.mretFired
 
@@ -258,7 +466,7 @@ class CpuImp(outer: Cpu) extends LazyModuleImp(outer) {
 
   // Backprop pipes for branch feedback
   val execFetchPipe = Module(new Pipe(new BranchFeedback(xlen)))
-  execFetchPipe.io.enq <> execute.io.branch
+  execFetchPipe.io.enq := branchResolved
 
   // Trap redirect to mtvec - pipe through to Fetch like branch
   // Handles both exceptions and interrupts
@@ -266,6 +474,8 @@ class CpuImp(outer: Cpu) extends LazyModuleImp(outer) {
   exceptionRedirectPipe.io.enq.valid := trapValid
   exceptionRedirectPipe.io.enq.bits.targetPC := outer.machineCSR.module.io.mtvec
 
+  fetch.io.predictorUpdate := execute.io.predictorUpdate
+
   // Combine branch and exception redirects for Fetch
   // Exception takes priority if both occur on same cycle (shouldn't happen normally)
   fetch.io.branch.valid := execFetchPipe.io.deq.valid || exceptionRedirectPipe.io.deq.valid
@@ -282,30 +492,77 @@ class CpuImp(outer: Cpu) extends LazyModuleImp(outer) {
 
   // Flush all pipeline queues when debug sets PC or branch/exception
   val debugFlush = debug.io.setPCOut.valid
-  fetchDecodeQueue.io.flush.get := debugFlush || totalFlush
+  fetchDecodeQueue.foreach(_.io.flush.get := debugFlush || totalFlush)
   decodeExecQueue.io.flush.get := debugFlush || totalFlush
+  decodeExecQueueSecond.foreach(_.io.flush.get := debugFlush || totalFlush)
   execMemQueue.io.flush.get := debugFlush
   memWbQueue.io.flush.get := debugFlush
+  (execMemQueueSecond ++ memSecond ++ memWbQueueSecond).foreach {
+    _.io.flush.get := debugFlush
+  }
 
   // Debug connections
-  debug.io.wbPC <> writeback.io.debugPC
+  debug.io.wbPC(0) <> writeback.io.debugPC
+  writebackSecond.foreach { wb =>
+    debug.io.wbPC(1) <> wb.io.debugPC
+    wb.io.halt := halt
+  }
   debug.io.memStore <> writeback.io.debugStore
   fetch.io.debugSetPC <> debug.io.setPCOut
   fetch.io.halt := halt
 
-  // Determine which source registers are actually used by the instruction currently in decode.
+  // Execute stops issuing on halt. Report halted only once everything past
+  // it has written back and buffered stores are visible to the debugger.
+  private val drained = !execMemQueue.io.deq.valid &&
+    !memory.io.loadWait && !memory.io.storeWait &&
+    !memWbQueue.io.deq.valid &&
+    (execMemQueueSecond ++ memSecond ++ memWbQueueSecond)
+      .map(!_.io.deq.valid)
+      .foldLeft(true.B)(_ && _)
+  io.halt := halt && drained && memory.io.storeBufferEmpty
+
+  // Older stores must reach the D-cache before it is cleaned for fence.i
+  io.fenceI := execute.io.fenceI && !execMemQueue.io.deq.valid &&
+    !memory.io.loadWait && !memory.io.storeWait &&
+    memory.io.storeBufferEmpty
+  execute.io.fenceIDone := io.fenceIDone
+
+  // Hazards are checked against the instruction in Execute, where operands are read.
   // Hazard signals
-  hazardUnit.io.decode <> decode.io.hazard
-  hazardUnit.io.exec := execute.io.hazard
-  hazardUnit.io.mem := memory.io.hazard
-  hazardUnit.io.wb := writeback.io.hazard
-  hazardUnit.io.execCsr := execute.io.csrHazard
+  private val execUop = decodeExecQueue.io.deq.bits
+  hazardUnit.io.exec.valid := decodeExecQueue.io.deq.valid
+  hazardUnit.io.exec.bits.rs1 := execUop.rs1
+  hazardUnit.io.exec.bits.rs2 := execUop.rs2
+  hazardUnit.io.exec.bits.csrAddr := execUop.csrAddr
+  hazardUnit.io.exec.bits.isCsrOp := (
+    execUop.opType === OpType.CSRRW ||
+      execUop.opType === OpType.CSRRS ||
+      execUop.opType === OpType.CSRRC
+  )
+  hazardUnit.io.execSecond.foreach { exec =>
+    val uop = decodeExecQueueSecond.get.io.deq.bits
+    exec.valid := decodeExecQueueSecond.get.io.deq.valid
+    exec.bits.rs1 := uop.rs1
+    exec.bits.rs2 := uop.rs2
+    exec.bits.csrAddr := uop.csrAddr
+    exec.bits.isCsrOp := false.B
+  }
+  hazardUnit.io.load := memory.io.hazard
   hazardUnit.io.memCsr := memory.io.csrHazard
   hazardUnit.io.wbCsr := writeback.io.csrHazard
   hazardUnit.io.watchpointHit := debug.io.watchpointTriggered
 
-  execute.io.stall := hazardUnit.io.stall || halt || branchFlushHold ||
-    trapFlushHold || memory.io.hazard.valid
+  // A pair waits until the second lane can hand its result on as well
+  private val secondBlocked = executeSecond
+    .map(ex => decodeExecQueueSecond.get.io.deq.valid && !ex.io.res.ready)
+    .getOrElse(false.B)
+  // A split branch stage also holds Execute while the dropped instruction
+  // behind the redirect waits in it
+  private val branchStall =
+    if (config.timingProfile.splitBranch) branchFlush else branchFlushHold
+  execute.io.stall := hazardUnit.io.stall || halt || branchStall ||
+    trapFlushHold || secondBlocked
+  executeSecond.foreach(_.io.stall := execute.io.stall)
   writeback.io.halt := halt
 
   private val retiredBranch = writeback.io.in.valid && (
@@ -314,20 +571,45 @@ class CpuImp(outer: Cpu) extends LazyModuleImp(outer) {
       writeback.io.in.bits.opType === OpType.JALR
   )
 
-  // Frontend always follows the sequential path until EX resolves branch.
-  // Taken conditional branches therefore represent branch misses.
+  // Execute only redirects when Fetch's prediction was wrong, so every
+  // redirect from a branch or jump is a miss.
   private val branchMiss =
     execute.io.branch.valid &&
-      execute.io.res.fire &&
-      execute.io.res.bits.opType === OpType.BRANCH
+      execute.io.res.fire && (
+        execute.io.res.bits.opType === OpType.BRANCH ||
+          execute.io.res.bits.opType === OpType.JAL ||
+          execute.io.res.bits.opType === OpType.JALR
+      )
 
-  private val hazardStallCycle = hazardUnit.io.stall || memory.io.hazard.valid
+  private val hazardStallCycle = hazardUnit.io.stall
+
+  // Decode could take an instruction but Fetch has none to give
+  private val fetchStall =
+    fetch.io.inst_out.ready && !fetch.io.inst_out.valid && !halt
+
+  private val events = WireDefault(VecInit(Seq.fill(HpmEvent.Count)(false.B)))
+  events(HpmEvent.BranchRetired) := retiredBranch
+  events(HpmEvent.BranchMiss) := branchMiss
+  events(HpmEvent.HazardStall) := hazardStallCycle
+  events(HpmEvent.FetchStall) := fetchStall
+  events(HpmEvent.StallLoadUse) := hazardUnit.io.cause.loadUse
+  events(HpmEvent.StallCsr) := hazardUnit.io.cause.csr
+  events(HpmEvent.BranchFlush) := branchFlush
+  events(HpmEvent.LoadWait) := memory.io.loadWait
+  events(HpmEvent.StoreWait) := memory.io.storeWait
+  events(HpmEvent.MulDivBusy) := execute.io.mulDivBusy
+  events(HpmEvent.TrapEntry) := trapValid
+  events(HpmEvent.ICacheHit) := io.icacheEvents.hit
+  events(HpmEvent.ICacheMiss) := io.icacheEvents.miss
+  events(HpmEvent.DCacheHit) := io.dcacheEvents.hit
+  events(HpmEvent.DCacheMiss) := io.dcacheEvents.miss
+  io.events := events.asUInt
 
   outer.counterCSR.foreach { counter =>
-    counter.module.io.cycleTick := true.B
-    counter.module.io.instretTick := writeback.io.retired
-    counter.module.io.branchRetiredTick := retiredBranch
-    counter.module.io.branchMissTick := branchMiss
-    counter.module.io.hazardStallTick := hazardStallCycle
+    counter.module.io.cycleTick := 1.U + io.idleCycles
+    counter.module.io.instretTick := PopCount(
+      writeback.io.retired +: writebackSecond.toSeq.map(_.io.retired)
+    )
+    counter.module.io.events := events
   }
 }
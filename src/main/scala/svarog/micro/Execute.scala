@@ -4,13 +4,23 @@ import chisel3._
 import chisel3.util._
 import svarog.bits.RegFileReadIO
 import svarog.bits.ALU
-import svarog.bits.{MulOp, SimpleMultiplier}
-import svarog.bits.{DivOp, SimpleDivider}
+import svarog.bits.{MulOp, PipelinedMultiplier, SimpleMultiplier}
+import svarog.bits.{DivOp, RadixDivider, SimpleDivider}
 import svarog.decoder.BranchOp
 import svarog.decoder.{MicroOp, OpType}
 import svarog.memory.MemWidth
 import svarog.bits.{CSREx, CSRReadIO}
-import svarog.config.ISA
+import svarog.config.{
+  AreaTimingProfile,
+  DividerType,
+  ISA,
+  MultiplierType,
+  PipelinedMultiplierType,
+  RadixDividerType,
+  SimpleDividerType,
+  SimpleMultiplierType,
+  TimingProfile
+}
 
 class ExecuteResult(xlen: Int) extends Bundle {
   val opType = Output(OpType())
@@ -30,6 +40,7 @@ class ExecuteResult(xlen: Int) extends Bundle {
   val storeData = Output(UInt(xlen.W))
 
   val pc = Output(UInt(xlen.W))
+  val inst = Output(UInt(32.W))
 }
 
 class BranchFeedback(xlen: Int) extends Bundle {
@@ -41,28 +52,59 @@ class ExceptionSignal(xlen: Int) extends Bundle {
   val cause = UInt(xlen.W)
 }
 
-class Execute(isa: ISA) extends Module {
+/** Multiply issued to the multiplier and not yet handed to Memory */
+class PendingMul(xlen: Int) extends Bundle {
+  val uop = new MicroOp(xlen)
+  val fused = Bool() // Takes the low half of the previous product
+}
+
+class Execute(
+    isa: ISA,
+    divider: DividerType = RadixDividerType(),
+    multiplier: MultiplierType = PipelinedMultiplierType(),
+    timing: TimingProfile = AreaTimingProfile
+) extends Module {
   private val xlen = isa.xlen
 
   val io = IO(new Bundle {
     val uop = Flipped(Decoupled(new MicroOp(xlen)))
     val res = Decoupled(new ExecuteResult(xlen))
-    val branch = Valid(new BranchFeedback(xlen))
+    val branch = Valid(new BranchFeedback(xlen)) // Raised on mispredicts only
+    val predictorUpdate = Valid(new BranchUpdate(xlen))
 
     val regFile = Flipped(new RegFileReadIO(xlen))
     val csrFile = new Bundle {
       val read = Flipped(new CSRReadIO())
+      // A CSR write owns the bus this cycle, so a registered read misses it
+      val busy = Input(Bool())
     }
 
-    // Write register for hazard control
-    val hazard = Valid(UInt(5.W))
-    val csrHazard = Valid(new HazardUnitCSRIO)
+    // Operands are read here, so the HazardUnit checks this stage's uop
     val stall = Input(Bool())
 
     // Exception handling
     val exception = Valid(new ExceptionSignal(xlen))
     val mretFired = Output(Bool())
     val mepc = Input(UInt(xlen.W)) // For MRET target
+
+    val mulDivBusy = Output(Bool()) // Multi-cycle op in progress
+    // No younger instruction is in flight behind io.res, so an interrupt
+    // may be taken after it
+    val resLast = Output(Bool())
+    // io.res is the bubble left in place of an instruction fetched behind a
+    // redirect, so it is not an instruction boundary
+    val squash = Output(Bool())
+    // Where execution continues after io.res, the resume point of an
+    // interrupt taken on it
+    val nextPC = Output(UInt(xlen.W))
+
+    // fence.i waits in Execute until the caches report they are in sync
+    val fenceI = Output(Bool())
+    val fenceIDone = Input(Bool())
+
+    // wfi waits in Execute until an enabled interrupt is pending
+    val wakeup = Input(Bool())
+    val sleeping = Output(Bool())
   })
 
   // If the branch is mispredicted on current cycle, whatever instruction
@@ -70,9 +112,18 @@ class Execute(isa: ISA) extends Module {
   val needFlush = RegInit(false.B)
   needFlush := false.B // reset at each cycle
 
-  val alu = Module(new ALU(xlen))
-  val mul = if (isa.zmmul) Some(Module(new SimpleMultiplier(xlen))) else None
-  val div = if (isa.mult) Some(Module(new SimpleDivider(xlen))) else None
+  val alu = Module(new ALU(xlen, isa.zba, isa.zbb))
+  val mul = Option.when(isa.zmmul)(Module(multiplier match {
+    case SimpleMultiplierType(latency) =>
+      new SimpleMultiplier(xlen, latency)
+    case PipelinedMultiplierType(latency) =>
+      new PipelinedMultiplier(xlen, latency)
+  }))
+  val div = Option.when(isa.mult)(Module(divider match {
+    case SimpleDividerType => new SimpleDivider(xlen)
+    case RadixDividerType(radix) =>
+      new RadixDivider(xlen, radixLog2 = log2Ceil(radix))
+  }))
   val csr = Module(new CSREx(xlen))
 
   // Track multi-cycle operations
@@ -80,18 +131,71 @@ class Execute(isa: ISA) extends Module {
   val bufferedUop = Reg(new MicroOp(xlen))
 
   // Determine if current instruction is multi-cycle
-  val isMultiCycle = io.uop.valid && (
-    io.uop.bits.opType === OpType.MUL ||
-      io.uop.bits.opType === OpType.DIV
+  val isMultiCycle = io.uop.valid && io.uop.bits.opType === OpType.DIV
+  val isMul = io.uop.valid && io.uop.bits.opType === OpType.MUL
+
+  // Multiplies stay in this in-order queue from issue until their result is
+  // handed on, so independent MULs can issue back to back. Other instructions
+  // wait for the queue to drain to keep results in program order.
+  private val mulDepth = multiplier.latency + 1
+  val mulQueue = Reg(Vec(mulDepth, new PendingMul(xlen)))
+  val mulQueueValid = RegInit(VecInit(Seq.fill(mulDepth)(false.B)))
+  val mulIssue = WireDefault(false.B)
+  val mulRetire = WireDefault(false.B)
+  val (mulTail, _) = Counter(mulIssue, mulDepth)
+  val (mulHead, _) = Counter(mulRetire, mulDepth)
+  val mulHeadEntry = mulQueue(mulHead)
+  val mulPending = mulQueueValid.asUInt.orR
+  val mulQueueFull = mulQueueValid.asUInt.andR
+
+  // Results wait here when Memory is not ready. Every entry has a slot in
+  // mulQueue, so this never overflows.
+  val mulResults = Module(new Queue(UInt((2 * xlen).W), mulDepth, flow = true))
+  mulResults.io.enq.valid := false.B
+  mulResults.io.enq.bits := 0.U
+  mulResults.io.deq.ready := false.B
+  mul.foreach { m =>
+    mulResults.io.enq.valid := m.io.result.valid
+    mulResults.io.enq.bits := Cat(m.io.result.bits, m.io.low)
+  }
+
+  // MULH[S[U]] rdh, rs1, rs2 followed by MUL rdl, rs1, rs2 is fused: the MUL
+  // takes the low half of the previous product instead of a multiplier slot.
+  // Operands are compared by value, so any register reuse is safe.
+  val lastMulValid = RegInit(false.B)
+  val lastMulA = Reg(UInt(xlen.W))
+  val lastMulB = Reg(UInt(xlen.W))
+  val lastMulLow = Reg(UInt(xlen.W))
+  val mulFuse = io.uop.bits.mulOp === MulOp.MUL && lastMulValid &&
+    lastMulA === io.regFile.readData1 && lastMulB === io.regFile.readData2
+
+  // A multiply reading the result of one still in flight must wait for it to
+  // reach the forwarding network
+  val mulReadsPending = (0 until mulDepth)
+    .map { i =>
+      val e = mulQueue(i).uop
+      mulQueueValid(i) && e.regWrite && e.rd =/= 0.U &&
+        (e.rd === io.uop.bits.rs1 || e.rd === io.uop.bits.rs2)
+    }
+    .reduce(_ || _)
+
+  val mulReady = mul.map(_.io.inp.ready).getOrElse(false.B)
+  val mulCanIssue = (!mulQueueFull || mulRetire) && !mulReadsPending &&
+    (mulFuse || mulReady)
+
+  val mulHeadDone = mulHeadEntry.fused || mulResults.io.deq.valid
+  val mulHeadResult = Mux(
+    mulHeadEntry.fused,
+    lastMulLow,
+    mulResults.io.deq.bits(2 * xlen - 1, xlen)
   )
 
   // Check if multi-cycle operation completes
   val multiCycleComplete = WireDefault(false.B)
-  mul.foreach { m => when(m.io.result.valid) { multiCycleComplete := true.B } }
   div.foreach { d => when(d.io.result.valid) { multiCycleComplete := true.B } }
 
   // Buffer the MicroOp when starting a multi-cycle operation
-  when(io.uop.fire && isMultiCycle) {
+  when(io.uop.fire && isMultiCycle && !needFlush) {
     executingMultiCycle := true.B
     bufferedUop := io.uop.bits
   }
@@ -101,39 +205,90 @@ class Execute(isa: ISA) extends Module {
     executingMultiCycle := false.B
   }
 
+  io.mulDivBusy := executingMultiCycle || mulPending
+
   // Use buffered MicroOp during multi-cycle execution
-  val activeUop =
-    Mux(executingMultiCycle || multiCycleComplete, bufferedUop, io.uop.bits)
+  val activeUop = MuxCase(
+    io.uop.bits,
+    Seq(
+      (executingMultiCycle || multiCycleComplete) -> bufferedUop,
+      mulPending -> mulHeadEntry.uop
+    )
+  )
 
   // Exception detection: illegal instruction (INVALID opcode), ecall, or ebreak
   val isException = activeUop.illegal ||
     activeUop.opType === OpType.ECALL ||
     activeUop.opType === OpType.EBREAK
 
+  val isFenceI = io.uop.valid && io.uop.bits.opType === OpType.FENCE_I
+  io.fenceI := isFenceI && !needFlush && !executingMultiCycle && !mulPending
+
+  // Interrupts are taken after the wfi retires, so mepc points past it
+  val isWfi = io.uop.valid && io.uop.bits.opType === OpType.WFI
+  io.sleeping := isWfi && !io.wakeup && !needFlush && !executingMultiCycle &&
+    !mulPending
+
+  // A registered CSR read presents the address for a cycle the bus is free
+  // and uses the data in the next one
+  val isCsrOp = io.uop.valid && (
+    io.uop.bits.opType === OpType.CSRRW ||
+      io.uop.bits.opType === OpType.CSRRS ||
+      io.uop.bits.opType === OpType.CSRRC
+  )
+  val csrReadDone = RegInit(false.B)
+  val csrReadWait = timing.registeredCsrRead.B && isCsrOp && !csrReadDone
+
   // This execution unit is not fully pipelined. New instructions can only be
   // accepted when all of the FUs are ready and no multi-cycle op is executing.
-  val canDequeue = io.res.ready && !io.stall && !executingMultiCycle
-  io.uop.ready := canDequeue
+  val canDequeue =
+    io.res.ready && !io.stall && !executingMultiCycle && !mulPending &&
+      (!isFenceI || io.fenceIDone || needFlush) &&
+      (!isWfi || io.wakeup || needFlush) && (!csrReadWait || needFlush)
+  // Multiplies do not produce a result on issue, so they only need the
+  // multiplier (or a fusion partner) and a free mulQueue slot
+  val canIssueMul =
+    !io.stall && !executingMultiCycle && (needFlush || mulCanIssue)
+  io.uop.ready := Mux(isMul, canIssueMul, canDequeue)
+
+  mulIssue := io.uop.fire && isMul && !needFlush
+  mulRetire := mulPending && mulHeadDone && io.res.ready
+
+  when(mulIssue) {
+    mulQueue(mulTail).uop := io.uop.bits
+    mulQueue(mulTail).fused := mulFuse
+    mulQueueValid(mulTail) := true.B
+    when(!mulFuse) {
+      lastMulValid := true.B
+      lastMulA := io.regFile.readData1
+      lastMulB := io.regFile.readData2
+    }
+  }
+  when(mulRetire) {
+    // A full queue may refill the head slot in the same cycle
+    when(!(mulIssue && mulTail === mulHead)) {
+      mulQueueValid(mulHead) := false.B
+    }
+    when(!mulHeadEntry.fused) {
+      mulResults.io.deq.ready := true.B
+      lastMulLow := mulResults.io.deq.bits(xlen - 1, 0)
+    }
+  }
 
   // Output is valid for single-cycle ops or when multi-cycle completes
-  io.res.valid := (io.uop.valid && canDequeue && !isMultiCycle) || (multiCycleComplete && !needFlush)
-
-  // Hazard signals should be valid during entire multi-cycle operation
-  val hazardActive =
-    (io.uop.valid && !isMultiCycle) || executingMultiCycle || multiCycleComplete
-  io.hazard.valid := hazardActive && activeUop.regWrite && !(activeUop.rd === 0.U)
-  io.hazard.bits := activeUop.rd
-
-  io.csrHazard.valid := hazardActive && (
-    activeUop.opType === OpType.CSRRW ||
-      activeUop.opType === OpType.CSRRS ||
-      activeUop.opType === OpType.CSRRC
-  )
-  io.csrHazard.bits.addr := activeUop.csrAddr
-  io.csrHazard.bits.isWrite := csr.io.csr.write.en
+  io.res.valid := (io.uop.valid && canDequeue && !isMultiCycle && !isMul) ||
+    (multiCycleComplete && !needFlush) || (mulPending && mulHeadDone)
+
+  // The multiply leaving now is the last one unless more are queued behind it
+  io.resLast := !mulPending ||
+    (PopCount(mulQueueValid) === 1.U && !mulIssue)
+
+  io.squash := needFlush
+  io.nextPC := activeUop.pc + 4.U
 
   io.res.bits.opType := activeUop.opType
   io.res.bits.pc := activeUop.pc
+  io.res.bits.inst := activeUop.inst
 
   // ALU result
   io.res.bits.gprResult := 0.U
@@ -142,6 +297,23 @@ class Execute(isa: ISA) extends Module {
   io.branch.bits.targetPC := 0.U
   io.branch.valid := false.B
 
+  io.predictorUpdate.valid := false.B
+  io.predictorUpdate.bits.pc := activeUop.pc
+  io.predictorUpdate.bits.isConditional := false.B
+  io.predictorUpdate.bits.taken := false.B
+  io.predictorUpdate.bits.target := 0.U
+
+  // Compare the resolved control flow with what Fetch predicted and redirect
+  // only when they disagree. Returns whether a redirect was raised.
+  def resolve(taken: Bool, target: UInt): Bool = {
+    val mispredict = taken =/= activeUop.predictTaken ||
+      (taken && target =/= activeUop.predictTarget)
+    io.branch.valid := mispredict
+    io.branch.bits.targetPC := Mux(taken, target, activeUop.pc + 4.U)
+    io.nextPC := Mux(taken, target, activeUop.pc + 4.U)
+    mispredict
+  }
+
   // Exception defaults
   io.exception.valid := false.B
   io.exception.bits.epc := activeUop.pc
@@ -177,8 +349,9 @@ class Execute(isa: ISA) extends Module {
   io.res.bits.csrWrite := false.B
   io.res.bits.csrResult := 0.U
 
-  io.regFile.readAddr1 := activeUop.rs1
-  io.regFile.readAddr2 := activeUop.rs2
+  // Operands are read for the incoming uop, also while older ops finish
+  io.regFile.readAddr1 := io.uop.bits.rs1
+  io.regFile.readAddr2 := io.uop.bits.rs2
 
   alu.io.op := activeUop.aluOp
   alu.io.input1 := io.regFile.readData1
@@ -190,10 +363,10 @@ class Execute(isa: ISA) extends Module {
 
   // Multiplier wiring
   mul.foreach { mul =>
-    mul.io.inp.bits.op := activeUop.mulOp
+    mul.io.inp.bits.op := io.uop.bits.mulOp
     mul.io.inp.bits.multiplicant := io.regFile.readData1
     mul.io.inp.bits.multiplier := io.regFile.readData2
-    mul.io.inp.valid := io.uop.valid && (io.uop.bits.opType === OpType.MUL)
+    mul.io.inp.valid := mulIssue && !mulFuse
   }
 
   // Divider wiring
@@ -201,7 +374,8 @@ class Execute(isa: ISA) extends Module {
     div.io.inp.bits.op := activeUop.divOp
     div.io.inp.bits.dividend := io.regFile.readData1
     div.io.inp.bits.divisor := io.regFile.readData2
-    div.io.inp.valid := io.uop.valid && (io.uop.bits.opType === OpType.DIV)
+    div.io.inp.valid := io.uop.valid && canDequeue && !needFlush &&
+      (io.uop.bits.opType === OpType.DIV)
   }
 
   // CSR wiring
@@ -211,11 +385,18 @@ class Execute(isa: ISA) extends Module {
 
   io.csrFile.read <> csr.io.csr.read
 
+  when(io.uop.fire || !isCsrOp) {
+    csrReadDone := false.B
+  }.elsewhen(csrReadWait && !io.stall && !io.csrFile.busy && !needFlush) {
+    csrReadDone := true.B
+  }
+
   val acceptUop = io.uop.valid && canDequeue
-  val executeUop = acceptUop || executingMultiCycle || multiCycleComplete
+  val executeUop =
+    acceptUop || executingMultiCycle || multiCycleComplete || mulPending
 
-  val opReady =
-    !needFlush && (!io.stall || executingMultiCycle || multiCycleComplete)
+  val opReady = !needFlush &&
+    (!io.stall || executingMultiCycle || multiCycleComplete || mulPending)
 
   when(executeUop && opReady) {
     switch(activeUop.opType) {
@@ -264,17 +445,17 @@ class Execute(isa: ISA) extends Module {
         }
 
         when(acceptUop) {
-          io.branch.valid := taken
-          needFlush := taken
-          io.branch.bits.targetPC := activeUop.pc + activeUop.imm
+          needFlush := resolve(taken, activeUop.pc + activeUop.imm)
+          io.predictorUpdate.valid := true.B
+          io.predictorUpdate.bits.isConditional := true.B
+          io.predictorUpdate.bits.taken := taken
         }
       }
 
       is(OpType.JAL) {
         // Unconditional jump
         when(acceptUop) {
-          io.branch.valid := true.B
-          io.branch.bits.targetPC := activeUop.pc + activeUop.imm
+          resolve(true.B, activeUop.pc + activeUop.imm)
           io.res.bits.gprResult := activeUop.pc + 4.U // Save return address
         }
       }
@@ -282,17 +463,18 @@ class Execute(isa: ISA) extends Module {
       is(OpType.JALR) {
         // Indirect jump
         when(acceptUop) {
-          io.branch.valid := true.B
-          val target = io.regFile.readData1 + activeUop.imm
-          io.branch.bits.targetPC := Cat(target(31, 1), 0.U(1.W)) // Clear LSB
+          val sum = io.regFile.readData1 + activeUop.imm
+          val target = Cat(sum(31, 1), 0.U(1.W)) // Clear LSB
+          resolve(true.B, target)
+          io.predictorUpdate.valid := true.B
+          io.predictorUpdate.bits.taken := true.B
+          io.predictorUpdate.bits.target := target
           io.res.bits.gprResult := activeUop.pc + 4.U // Save return address
         }
       }
 
       is(OpType.MUL) {
-        mul.foreach { mul =>
-          io.res.bits.gprResult := mul.io.result.bits
-        }
+        io.res.bits.gprResult := mulHeadResult
       }
 
       is(OpType.DIV) {
@@ -308,12 +490,28 @@ class Execute(isa: ISA) extends Module {
         io.res.bits.csrResult := csr.io.csr.write.data
       }
 
+      is(OpType.FENCE_I) {
+        // Instructions fetched behind fence.i may be stale, refetch them
+        when(acceptUop) {
+          io.branch.valid := true.B
+          io.branch.bits.targetPC := activeUop.pc + 4.U
+          needFlush := true.B
+        }
+      }
+
       is(OpType.MRET) {
         // Return from machine-mode trap handler
         io.branch.valid := true.B
         io.branch.bits.targetPC := io.mepc
+        io.nextPC := io.mepc
         io.mretFired := true.B
       }
     }
   }
+
+  // With branch resolution in its own stage the queues are flushed a cycle
+  // late, so the instruction behind the redirect has reached Execute already
+  if (timing.splitBranch) {
+    when(io.branch.valid) { needFlush := true.B }
+  }
 }
@@ -2,85 +2,216 @@ package svarog.micro
 
 import chisel3._
 import chisel3.util._
+import freechips.rocketchip.diplomacy.AddressSet
 import svarog.memory.{MemoryRequest, MemoryIO}
 import svarog.decoder.InstWord
 import svarog.memory.MemWidth
 import svarog.bits.MemoryUtils
+import svarog.config.{BranchPredictorType, NoBranchPredictor, TimingProfile}
 
-class FetchIO(xlen: Int) extends Bundle {
+class FetchIO(xlen: Int, fetchWidth: Int = 1) extends Bundle {
   val inst_out = Decoupled(new InstWord(xlen))
+  // The instruction after inst_out in the same fetch block. It can only be
+  // taken in the same cycle as inst_out.
+  val inst_second =
+    Option.when(fetchWidth > 1)(Decoupled(new InstWord(xlen)))
 
   val branch = Flipped(Valid(new BranchFeedback(xlen)))
+  val predictorUpdate = Flipped(Valid(new BranchUpdate(xlen)))
   val debugSetPC = Flipped(Valid(UInt(xlen.W))) // Debug interface to set PC
   val halt = Input(Bool()) // Stop fetching when halted
 
-  val mem = new MemoryIO(xlen, xlen)
+  val mem = new MemoryIO(xlen, xlen * fetchWidth)
 }
 
-class Fetch(xlen: Int, resetVector: BigInt = 0) extends Module {
-  val io = IO(new FetchIO(xlen))
+/** Bookkeeping for a request that has been issued but not answered yet */
+class FetchInFlight(xlen: Int) extends Bundle {
+  val pc = UInt(xlen.W)
+  val epoch = UInt(Fetch.EpochBits.W)
+  val block = Bool() // Every word from pc to the end of the block is used
+}
+
+/** Instructions from one fetch response, packed from slot 0 */
+class FetchPacket(xlen: Int, fetchWidth: Int) extends Bundle {
+  val insts = Vec(fetchWidth, new InstWord(xlen))
+  val valid = Vec(fetchWidth, Bool())
+}
+
+object Fetch {
+  // Enough to cover the TCM's one-cycle latency plus a buffered instruction
+  // while the next request is already on the bus.
+  val DefaultMaxInFlight = 3
+
+  // A registered TCM output adds a cycle of latency to cover
+  def maxInFlight(timing: TimingProfile): Int =
+    DefaultMaxInFlight + (if (timing.registeredTcm) 1 else 0)
+
+  // Redirects are at least a few cycles apart, so a small epoch never wraps
+  // while a stale request is still waiting for its response.
+  val EpochBits = 2
+}
+
+/** Instruction fetch
+  *
+  * @param fetchWidth
+  *   instructions delivered per cycle, 1 or 2. With 2 the memory port returns
+  *   an aligned 64-bit block and the second instruction comes out of
+  *   `inst_second`.
+  * @param wideRegions
+  *   where the memory port returns whole blocks (the I-cache's cacheable
+  *   regions). Elsewhere only the requested word is used.
+  */
+class Fetch(
+    xlen: Int,
+    resetVector: BigInt = 0,
+    predictorType: BranchPredictorType = NoBranchPredictor,
+    maxInFlight: Int = Fetch.DefaultMaxInFlight,
+    fetchWidth: Int = 1,
+    wideRegions: Seq[AddressSet] = Seq.empty
+) extends Module {
+  require(maxInFlight >= 1, "Fetch needs at least one request in flight")
+  require(fetchWidth == 1 || fetchWidth == 2, "Fetch width must be 1 or 2")
+  require(fetchWidth == 1 || xlen == 32, "Wide fetch is only done on RV32")
 
-  // For now we statically predict branches as not taken, so io.branch.valid is
-  // also the flush signal. In future we'll need to reconsider this decision.
+  val io = IO(new FetchIO(xlen, fetchWidth))
+
+  // Fetch keeps up to maxInFlight requests going. Each request reserves an
+  // entry in the instruction buffer when it is issued, so responses (which
+  // memory returns in order) never need backpressure. Every request is
+  // tagged with the current epoch; a redirect bumps the epoch and responses
+  // carrying an older tag are dropped as they arrive.
+  //
+  // Every fetched word goes through the branch predictor as it arrives. A
+  // predicted-taken instruction redirects pc_reg and bumps the epoch, which
+  // discards the sequential requests issued behind it. Execute checks the
+  // prediction and raises io.branch only on a mispredict, so io.branch.valid
+  // is still the flush signal.
+  //
+  // With a fetch width of 2 each response is a packet of up to two words.
+  // A request starting at the second word of a block, one outside
+  // wideRegions, or a predicted-taken first word leaves a single instruction
+  // in the packet.
 
   private val resetVec = resetVector.U(xlen.W)
   val pc_reg = RegInit(resetVec)
-  val reqPending = RegInit(false.B)
-  val dropResponse = RegInit(false.B)
-  val respPending = RegInit(false.B)
-  val respData = Reg(UInt(32.W))
-  val respPC = Reg(UInt(xlen.W))
+  val epoch = RegInit(0.U(Fetch.EpochBits.W))
 
-  val pc_plus_4 = pc_reg + 4.U
-  val next_pc = Mux(
-    io.debugSetPC.valid,
-    io.debugSetPC.bits,
-    Mux(io.branch.valid, io.branch.bits.targetPC, pc_plus_4)
+  val inFlight = Module(new Queue(new FetchInFlight(xlen), maxInFlight))
+  val buffer = Module(
+    new Queue(new FetchPacket(xlen, fetchWidth), maxInFlight, hasFlush = true)
   )
 
-  val canRequest = !reqPending && !respPending && !io.halt
+  val redirect = io.debugSetPC.valid || io.branch.valid
+
+  private val blockBytes = 4 * fetchWidth
+  private val blockBits = log2Ceil(blockBytes)
+
+  val pc_plus_4 = pc_reg + 4.U
+  val blockFetch =
+    if (fetchWidth == 1) false.B
+    else wideRegions.map(_.contains(pc_reg)).foldLeft(false.B)(_ || _)
+  val nextBlock = Cat(pc_reg(xlen - 1, blockBits) + 1.U, 0.U(blockBits.W))
+
+  val slotsUsed = inFlight.io.count +& buffer.io.count
+  val canRequest = slotsUsed < maxInFlight.U && !io.halt
   io.mem.req.valid := canRequest
   io.mem.req.bits.address := pc_reg
-  io.mem.req.bits.mask := MemoryUtils.fullWordMask(xlen / 8)
+  io.mem.req.bits.mask := MemoryUtils.fullWordMask(xlen / 8 * fetchWidth)
   io.mem.req.bits.write := false.B
-  io.mem.req.bits.dataWrite := VecInit(Seq.fill(xlen / 8)(0.U(8.W)))
+  io.mem.req.bits.dataWrite :=
+    VecInit(Seq.fill(xlen / 8 * fetchWidth)(0.U(8.W)))
+
+  // canRequest already guarantees room in inFlight
+  inFlight.io.enq.valid := io.mem.req.fire
+  inFlight.io.enq.bits.pc := pc_reg
+  inFlight.io.enq.bits.epoch := epoch
+  inFlight.io.enq.bits.block := blockFetch
 
   when(io.mem.req.fire) {
-    reqPending := true.B
-    respPC := pc_reg
-    pc_reg := pc_plus_4
+    pc_reg := Mux(blockFetch, nextBlock, pc_plus_4)
   }
 
   io.mem.resp.ready := true.B
-  when(io.mem.resp.valid) {
-    when(dropResponse) {
-      dropResponse := false.B
-      reqPending := false.B
-    }.otherwise {
-      respPending := true.B
-      respData := io.mem.resp.bits.dataRead.asUInt
-      reqPending := false.B
+  inFlight.io.deq.ready := io.mem.resp.valid
+
+  private val respPc = inFlight.io.deq.bits.pc
+  private val respWords = VecInit(
+    io.mem.resp.bits.dataRead.grouped(4).map(b => VecInit(b).asUInt).toSeq
+  )
+  private val firstSlot =
+    if (fetchWidth == 1) 0.U else respPc(blockBits - 1, 2)
+
+  val predictor =
+    Module(new BranchPredictor(xlen, predictorType, lookups = fetchWidth))
+  predictor.io.update := io.predictorUpdate
+  private val predictions = predictor.io.lookup.map(_.prediction)
+
+  private val packet = Wire(new FetchPacket(xlen, fetchWidth))
+  for (i <- 0 until fetchWidth) {
+    val slot = firstSlot +& i.U
+    packet.insts(i).pc := respPc + (4 * i).U
+    packet.insts(i).word :=
+      (if (fetchWidth == 1) respWords(0) else respWords(slot(0)))
+    packet.insts(i).predictTaken := predictions(i).taken
+    packet.insts(i).predictTarget := predictions(i).target
+    predictor.io.lookup(i).pc := packet.insts(i).pc
+    predictor.io.lookup(i).inst := packet.insts(i).word
+
+    packet.valid(i) := true.B
+    if (i > 0) {
+      // A predicted-taken instruction ends the packet
+      val earlierTaken = predictions.take(i).map(_.taken).reduce(_ || _)
+      packet.valid(i) := slot < fetchWidth.U && inFlight.io.deq.bits.block &&
+        !earlierTaken
     }
   }
 
-  io.inst_out.valid := respPending
-  io.inst_out.bits.pc := respPC
-  io.inst_out.bits.word := respData
+  private val takenSlots = VecInit(
+    packet.valid.zip(predictions).map { case (v, p) => v && p.taken }
+  )
+
+  val respLive = io.mem.resp.valid && inFlight.io.deq.bits.epoch === epoch
+  buffer.io.enq.valid := respLive && !redirect
+  buffer.io.enq.bits := packet
+
+  when(buffer.io.enq.fire && takenSlots.asUInt.orR) {
+    pc_reg := PriorityMux(takenSlots, predictions.map(_.target))
+    epoch := epoch + 1.U
+  }
+
+  private val head = buffer.io.deq.bits
+  io.inst_out.valid := buffer.io.deq.valid && !redirect
+  buffer.io.flush.get := redirect
+
+  io.inst_second match {
+    case None =>
+      io.inst_out.bits := head.insts(0)
+      buffer.io.deq.ready := io.inst_out.ready && !redirect
+
+    case Some(second) =>
+      // The first instruction of the head packet left on its own
+      val firstTaken = RegInit(false.B)
+
+      io.inst_out.bits := Mux(firstTaken, head.insts(1), head.insts(0))
+      second.valid := buffer.io.deq.valid && !firstTaken && head.valid(1) &&
+        !redirect
+      second.bits := head.insts(1)
+
+      buffer.io.deq.ready := io.inst_out.ready && !redirect &&
+        (firstTaken || !head.valid(1) || second.ready)
 
-  when(io.inst_out.fire) {
-    respPending := false.B
+      when(buffer.io.deq.fire || redirect) {
+        firstTaken := false.B
+      }.elsewhen(io.inst_out.fire) {
+        firstTaken := true.B
+      }
   }
 
   when(io.debugSetPC.valid) {
     pc_reg := io.debugSetPC.bits
-    reqPending := false.B
-    respPending := false.B
-    dropResponse := false.B
+    epoch := epoch + 1.U
   }.elsewhen(io.branch.valid) {
     pc_reg := io.branch.bits.targetPC
-    respPending := false.B
-    val needDrop = reqPending && !io.mem.resp.valid
-    dropResponse := needDrop
-    reqPending := false.B
+    epoch := epoch + 1.U
   }
 }
@@ -2,73 +2,116 @@ package svarog.micro
 
 import chisel3._
 import chisel3.util._
-import svarog.decoder.SimpleDecodeHazardIO
+import svarog.decoder.{OpType, SimpleDecodeHazardIO}
 
 class HazardUnitCSRIO extends Bundle {
   val addr = UInt(12.W)
   val isWrite = Bool()
 }
 
-class HazardUnit extends Module {
+/** Which hazard is holding Execute back, for the performance counters */
+class HazardStallCause extends Bundle {
+  val loadUse = Bool()
+  val csr = Bool()
+}
+
+/** What the pairing rules need to know about a decoded instruction */
+class IssueCandidate extends Bundle {
+  val opType = OpType()
+  val rd = UInt(5.W)
+  val regWrite = Bool()
+  val rs1 = UInt(5.W)
+  val rs2 = UInt(5.W)
+}
+
+class HazardUnitPairIO extends Bundle {
+  val first = Input(new IssueCandidate)
+  val second = Input(new IssueCandidate)
+  val canPair = Output(Bool())
+}
+
+/** Stall logic for the instruction in Execute.
+  *
+  * Execute reads its operands, and Cpu forwards results from the execMemQueue
+  * entry, the Memory stage and Writeback. The only GPR dependency that cannot
+  * be forwarded is on a load whose data has not come back yet. Execute
+  * itself holds consumers of in-flight mul/div ops until the result is handed
+  * on, then they pick it up through forwarding. CSR reads still wait for older
+  * CSR writes to commit in Writeback.
+  *
+  * @param dualIssue
+  *   also check the younger instruction of an issue pair in Execute, which
+  *   stalls together with the older one, and decide in Decode which pairs may
+  *   issue together. The second lane only has an ALU, so it takes ALU, LUI and
+  *   AUIPC ops, and only behind a first instruction that cannot redirect,
+  *   trap or take several cycles (ALU ops, LUI, AUIPC, loads and stores). The
+  *   pair must be independent: the second instruction cannot read the first
+  *   one's result.
+  */
+class HazardUnit(dualIssue: Boolean = false) extends Module {
   val io = IO(new Bundle {
-    val decode = Flipped(Valid(new SimpleDecodeHazardIO))
-    val exec = Flipped(Valid(UInt(5.W)))
-    val mem = Flipped(Valid(UInt(5.W)))
-    val wb = Flipped(Valid(UInt(5.W)))
-    val execCsr = Flipped(Valid(new HazardUnitCSRIO))
+    val exec = Flipped(Valid(new SimpleDecodeHazardIO))
+    val execSecond =
+      Option.when(dualIssue)(Flipped(Valid(new SimpleDecodeHazardIO)))
+    val pair = Option.when(dualIssue)(new HazardUnitPairIO)
+    val load = Flipped(Vec(2, Valid(UInt(5.W))))
     val memCsr = Flipped(Valid(new HazardUnitCSRIO))
     val wbCsr = Flipped(Valid(new HazardUnitCSRIO))
     val watchpointHit = Input(Bool()) // Watchpoint trigger from debug module
     val stall = Output(Bool())
+    val cause = Output(new HazardStallCause)
   })
 
   def hazardOn(reg: UInt, rs: UInt): Bool =
     reg =/= 0.U && rs =/= 0.U && reg === rs
 
-  def csrHazardOn(csrAddr: UInt, decodeCsrAddr: UInt, isWrite: Bool): Bool =
-    isWrite && csrAddr === decodeCsrAddr
-
-  // GPR hazards
-  val hazardExec = io.decode.valid && io.exec.valid && (
-    hazardOn(io.exec.bits, io.decode.bits.rs1) ||
-      hazardOn(io.exec.bits, io.decode.bits.rs2)
-  )
+  def csrHazardOn(csrAddr: UInt, execCsrAddr: UInt, isWrite: Bool): Bool =
+    isWrite && csrAddr === execCsrAddr
 
-  val hazardMem = io.decode.valid && io.mem.valid && (
-    hazardOn(io.mem.bits, io.decode.bits.rs1) ||
-      hazardOn(io.mem.bits, io.decode.bits.rs2)
-  )
+  def loadUseOn(exec: Valid[SimpleDecodeHazardIO]): Bool =
+    exec.valid && io.load
+      .map { load =>
+        load.valid && (
+          hazardOn(load.bits, exec.bits.rs1) ||
+            hazardOn(load.bits, exec.bits.rs2)
+        )
+      }
+      .reduce(_ || _)
 
-  val hazardWb = io.decode.valid && io.wb.valid && (
-    hazardOn(io.wb.bits, io.decode.bits.rs1) ||
-      hazardOn(io.wb.bits, io.decode.bits.rs2)
-  )
-
-  // CSR hazards - stall if decode has a CSR op and there's a pending CSR write to the same address
-  val csrHazardExec =
-    io.decode.valid && io.decode.bits.isCsrOp && io.execCsr.valid &&
-      csrHazardOn(
-        io.execCsr.bits.addr,
-        io.decode.bits.csrAddr,
-        io.execCsr.bits.isWrite
-      )
+  val loadUse = (io.exec +: io.execSecond.toSeq).map(loadUseOn).reduce(_ || _)
 
+  // CSR hazards - stall if Execute has a CSR op and there's a pending CSR write to the same address
   val csrHazardMem =
-    io.decode.valid && io.decode.bits.isCsrOp && io.memCsr.valid &&
+    io.exec.valid && io.exec.bits.isCsrOp && io.memCsr.valid &&
       csrHazardOn(
         io.memCsr.bits.addr,
-        io.decode.bits.csrAddr,
+        io.exec.bits.csrAddr,
         io.memCsr.bits.isWrite
       )
 
   val csrHazardWb =
-    io.decode.valid && io.decode.bits.isCsrOp && io.wbCsr.valid &&
+    io.exec.valid && io.exec.bits.isCsrOp && io.wbCsr.valid &&
       csrHazardOn(
         io.wbCsr.bits.addr,
-        io.decode.bits.csrAddr,
+        io.exec.bits.csrAddr,
         io.wbCsr.bits.isWrite
       )
 
-  io.stall := io.watchpointHit || hazardExec || hazardMem || hazardWb ||
-    csrHazardExec || csrHazardMem || csrHazardWb
+  io.stall := io.watchpointHit || loadUse || csrHazardMem || csrHazardWb
+
+  io.cause.loadUse := loadUse
+  io.cause.csr := csrHazardMem || csrHazardWb
+
+  io.pair.foreach { pair =>
+    def aluOnly(op: OpType.Type): Bool =
+      op === OpType.ALU || op === OpType.LUI || op === OpType.AUIPC
+
+    val firstOk = aluOnly(pair.first.opType) ||
+      pair.first.opType === OpType.LOAD || pair.first.opType === OpType.STORE
+    val dependent = pair.first.regWrite && (
+      hazardOn(pair.first.rd, pair.second.rs1) ||
+        hazardOn(pair.first.rd, pair.second.rs2)
+    )
+    pair.canPair := firstOk && aluOnly(pair.second.opType) && !dependent
+  }
 }
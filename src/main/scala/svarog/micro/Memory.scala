@@ -2,6 +2,7 @@ package svarog.micro
 
 import chisel3._
 import chisel3.util._
+import freechips.rocketchip.diplomacy.AddressSet
 import svarog.memory.{MemoryRequest, MemoryIO => MemIO, MemWidth}
 import svarog.decoder.OpType
 import svarog.bits.MemoryUtils
@@ -18,6 +19,8 @@ class MemResult(xlen: Int) extends Bundle {
   val pc = Output(UInt(xlen.W))
   val storeAddr = Output(UInt(xlen.W)) // Store address for watchpoint
   val isStore = Output(Bool()) // Flag indicating if this was a store
+  val storeData = Output(UInt(xlen.W))
+  val inst = Output(UInt(32.W))
 }
 
 private class MemLatch(xlen: Int) extends Bundle {
@@ -25,16 +28,53 @@ private class MemLatch(xlen: Int) extends Bundle {
   val pc = UInt(xlen.W)
   val storeAddr = UInt(xlen.W)
   val isStore = Bool()
+  val storeData = UInt(xlen.W)
+  val inst = UInt(32.W)
   val opWidth = MemWidth.Type()
   val unsigned = Bool()
+  // Load bytes supplied by the store buffer, overlaid on the response
+  val fwdMask = Vec(xlen / 8, Bool())
+  val fwdData = Vec(xlen / 8, UInt(8.W))
 }
 
-class Memory(xlen: Int) extends Module {
+/** A retired store waiting for the data port, already shifted into its word */
+private class StoreBufferEntry(xlen: Int) extends Bundle {
+  val address = UInt(xlen.W)
+  val data = Vec(xlen / 8, UInt(8.W))
+  val mask = Vec(xlen / 8, Bool())
+}
+
+/** Memory stage.
+  *
+  * @param storeBufferDepth
+  *   stores to `bufferable` addresses retire into a FIFO of this many entries
+  *   and drain in the background; 0 makes every store wait for its response
+  * @param bufferable
+  *   memory-like regions whose stores may be buffered. Everything else is
+  *   treated as MMIO: accesses there wait for the buffer to drain first.
+  */
+class Memory(
+    xlen: Int,
+    storeBufferDepth: Int = 0,
+    bufferable: Seq[AddressSet] = Seq.empty
+) extends Module {
+  require(
+    storeBufferDepth == 0 || isPow2(storeBufferDepth),
+    "store buffer depth must be 0 or a power of 2"
+  )
+
   val io = IO(new Bundle {
     val ex = Flipped(Decoupled(new ExecuteResult(xlen)))
     val res = Decoupled(new MemResult(xlen))
-    val hazard = Valid(UInt(5.W))
+    // Loads whose data is not available yet: the one waiting on the data
+    // port and the one queued behind it in io.ex
+    val hazard = Vec(2, Valid(UInt(5.W)))
     val csrHazard = Valid(new HazardUnitCSRIO)
+    // Cycles spent waiting on the data port, for the performance counters
+    val loadWait = Output(Bool())
+    val storeWait = Output(Bool())
+    // No buffered stores left, neither queued nor in flight
+    val storeBufferEmpty = Output(Bool())
   })
 
   val wordSize = xlen / 8
@@ -48,14 +88,15 @@ class Memory(xlen: Int) extends Module {
   mem.req.bits.mask := VecInit(Seq.fill(wordSize)(false.B))
   mem.resp.ready := true.B
   mem.req.bits.address := 0.U
-  io.hazard.valid := false.B
-  io.hazard.bits := 0.U
+  io.hazard.foreach { h =>
+    h.valid := false.B
+    h.bits := 0.U
+  }
   io.csrHazard.valid := false.B
   io.csrHazard.bits.addr := 0.U
   io.csrHazard.bits.isWrite := false.B
 
   // Pass through data
-  io.res.valid := io.ex.fire && io.ex.bits.opType =/= OpType.LOAD && io.ex.bits.opType =/= OpType.STORE
   io.res.bits.opType := io.ex.bits.opType
   io.res.bits.rd := io.ex.bits.rd
   io.res.bits.gprWrite := io.ex.bits.gprWrite
@@ -66,11 +107,101 @@ class Memory(xlen: Int) extends Module {
   io.res.bits.pc := io.ex.bits.pc
   io.res.bits.storeAddr := 0.U
   io.res.bits.isStore := false.B
+  io.res.bits.storeData := 0.U
+  io.res.bits.inst := io.ex.bits.inst
 
   private val pendingRequest = RegInit(false.B)
   private val pendingInst = RegInit(0.U.asTypeOf(new MemLatch(xlen)))
 
-  io.ex.ready := !pendingRequest && mem.req.ready
+  // Store buffer. Slots are allocated at the tail, drained from the head; the
+  // head entry stays put while its write is in flight so loads still see it.
+  private val sbSlots = storeBufferDepth.max(1)
+  private val sbEntries = Reg(Vec(sbSlots, new StoreBufferEntry(xlen)))
+  private val sbCount = RegInit(0.U(log2Ceil(sbSlots + 1).W))
+  private val sbPush = WireDefault(false.B)
+  private val sbPop = WireDefault(false.B)
+  private val (sbHead, _) = Counter(sbPop, sbSlots)
+  private val (sbTail, _) = Counter(sbPush, sbSlots)
+  private val draining = RegInit(false.B)
+
+  sbCount := sbCount + sbPush.asUInt - sbPop.asUInt
+
+  private val sbEmpty = sbCount === 0.U
+  private val sbFull = sbCount === sbSlots.U
+  private val portFree = !pendingRequest && !draining
+
+  // Slot holding the `age`-th oldest buffered store
+  private def sbSlot(age: Int): UInt =
+    if (sbSlots == 1) 0.U
+    else (sbHead + age.U)(log2Ceil(sbSlots) - 1, 0)
+
+  io.storeBufferEmpty := sbEmpty
+
+  private val opType = io.ex.bits.opType
+  private val isLoad = opType === OpType.LOAD
+  private val isStore = opType === OpType.STORE
+
+  private val (exWordAddr, exOffset) =
+    MemoryUtils.alignAddress(io.ex.bits.memAddress, wordSize)
+  private val exMask =
+    MemoryUtils.generateShiftedMask(io.ex.bits.memWidth, exOffset, xlen)
+  private val exData = {
+    val data = Wire(Vec(wordSize, UInt(8.W)))
+    data := asLE(io.ex.bits.storeData)
+    MemoryUtils.shiftWriteData(data, exOffset, wordSize)
+  }
+
+  private val exBufferable =
+    if (storeBufferDepth == 0) false.B
+    else
+      bufferable
+        .map(_.contains(io.ex.bits.memAddress))
+        .foldLeft(false.B)(_ || _)
+
+  // Per byte, the youngest buffered store covering it wins
+  private val fwd = (0 until wordSize).map { b =>
+    (0 until sbSlots).foldLeft((false.B, 0.U(8.W))) { case ((hit, data), age) =>
+      val entry = sbEntries(sbSlot(age))
+      val matches = age.U < sbCount && entry.address === exWordAddr &&
+        entry.mask(b)
+      (hit || matches, Mux(matches, entry.data(b), data))
+    }
+  }
+  private val fwdMask = VecInit(fwd.map(_._1))
+  private val fwdData = VecInit(fwd.map(_._2))
+  private val fwdComplete = exMask.zip(fwdMask).map { case (m, h) =>
+    !m || h
+  }.reduce(_ && _)
+
+  private val bufferStore = isStore && exBufferable
+  private val forwardLoad = isLoad && exBufferable && fwdComplete
+  private val needsPort = (isLoad || isStore) && !bufferStore && !forwardLoad
+
+  // Loads to memory-like regions may pass buffered stores; MMIO accesses and
+  // FENCE wait for the buffer to drain.
+  io.ex.ready := !pendingRequest && MuxCase(
+    true.B,
+    Seq(
+      bufferStore -> !sbFull,
+      forwardLoad -> true.B,
+      (isLoad && exBufferable) -> (portFree && mem.req.ready),
+      needsPort -> (sbEmpty && portFree && mem.req.ready),
+      (opType === OpType.FENCE) -> sbEmpty
+    )
+  )
+
+  io.res.valid := io.ex.fire && !needsPort
+
+  io.loadWait := Mux(
+    pendingRequest,
+    !pendingInst.isStore,
+    io.ex.valid && isLoad && !io.ex.ready
+  )
+  io.storeWait := Mux(
+    pendingRequest,
+    pendingInst.isStore,
+    io.ex.valid && isStore && !io.ex.ready
+  )
 
   def latchInst() = {
     pendingRequest := true.B
@@ -80,28 +211,22 @@ class Memory(xlen: Int) extends Module {
     inst.rd := io.ex.bits.rd
     inst.storeAddr := io.ex.bits.memAddress
     inst.isStore := io.ex.bits.opType === OpType.STORE
+    inst.storeData := io.ex.bits.storeData
+    inst.inst := io.ex.bits.inst
     inst.opWidth := io.ex.bits.memWidth
     inst.unsigned := io.ex.bits.memUnsigned
+    inst.fwdMask := fwdMask
+    inst.fwdData := fwdData
 
     pendingInst := inst
   }
 
   def sendRequest(store: Boolean) = {
-    val (address, offset) =
-      MemoryUtils.alignAddress(io.ex.bits.memAddress, wordSize)
     mem.req.valid := true.B
-    mem.req.bits.address := address
+    mem.req.bits.address := exWordAddr
     mem.req.bits.write := store.B
-
-    val data = Wire(Vec(wordSize, UInt(8.W)))
-    data := asLE(io.ex.bits.storeData)
-
-    mem.req.bits.dataWrite := MemoryUtils.shiftWriteData(data, offset, wordSize)
-    mem.req.bits.mask := MemoryUtils.generateShiftedMask(
-      io.ex.bits.memWidth,
-      offset,
-      xlen
-    )
+    mem.req.bits.dataWrite := exData
+    mem.req.bits.mask := exMask
   }
 
   def extractData(
@@ -143,13 +268,17 @@ class Memory(xlen: Int) extends Module {
     extracted
   }
 
-  // Hazard handling
+  // Hazard handling. Everything else is forwarded: ALU results from the
+  // execMemQueue entry, loads from io.res in the cycle their data returns.
   when(pendingRequest) {
-    io.hazard.valid := !pendingInst.isStore && pendingInst.rd =/= 0.U
-    io.hazard.bits := pendingInst.rd
-  }.elsewhen(io.ex.fire && io.ex.bits.gprWrite && io.ex.bits.rd =/= 0.U) {
-    io.hazard.valid := true.B
-    io.hazard.bits := io.ex.bits.rd
+    io.hazard(0).valid := !pendingInst.isStore && pendingInst.rd =/= 0.U &&
+      !mem.resp.valid
+    io.hazard(0).bits := pendingInst.rd
+  }
+  when(io.ex.valid && isLoad) {
+    io.hazard(1).valid := io.ex.bits.rd =/= 0.U &&
+      !(forwardLoad && io.ex.fire)
+    io.hazard(1).bits := io.ex.bits.rd
   }
 
   when(io.ex.valid && io.ex.bits.csrWrite) {
@@ -158,19 +287,50 @@ class Memory(xlen: Int) extends Module {
     io.csrHazard.bits.isWrite := true.B
   }
 
-  when(io.ex.fire) {
-    switch(io.ex.bits.opType) {
-      is(OpType.LOAD) {
-        latchInst()
-        sendRequest(false)
-      }
-      is(OpType.STORE) {
-        latchInst()
-        sendRequest(true)
-      }
+  when(io.ex.fire && needsPort) {
+    latchInst()
+    sendRequest(isStore)
+  }
+
+  when(io.ex.fire && bufferStore) {
+    sbPush := true.B
+    sbEntries(sbTail).address := exWordAddr
+    sbEntries(sbTail).data := exData
+    sbEntries(sbTail).mask := exMask
+    io.res.bits.storeAddr := io.ex.bits.memAddress
+    io.res.bits.isStore := true.B
+    io.res.bits.storeData := io.ex.bits.storeData
+    io.res.bits.gprWrite := false.B
+  }
+
+  when(io.ex.fire && forwardLoad) {
+    io.res.bits.gprWrite := true.B
+    io.res.bits.gprData := extractData(
+      fwdData,
+      io.ex.bits.memWidth,
+      io.ex.bits.memUnsigned,
+      exOffset
+    )
+  }
+
+  // Drain the oldest buffered store whenever the pipeline leaves the port idle
+  when(!(io.ex.fire && needsPort) && !sbEmpty && portFree) {
+    val head = sbEntries(sbHead)
+    mem.req.valid := true.B
+    mem.req.bits.address := head.address
+    mem.req.bits.write := true.B
+    mem.req.bits.dataWrite := head.data
+    mem.req.bits.mask := head.mask
+    when(mem.req.ready) {
+      draining := true.B
     }
   }
 
+  when(draining && mem.resp.valid) {
+    draining := false.B
+    sbPop := true.B
+  }
+
   // Writeback stage is guaranteed to take just 1 cycle.
   // Memory ops are at least 2 cycles long. We can always
   // issue result after mem op is complete.
@@ -181,12 +341,21 @@ class Memory(xlen: Int) extends Module {
     io.res.bits.rd := pendingInst.rd
     io.res.bits.storeAddr := pendingInst.storeAddr
     io.res.bits.isStore := pendingInst.isStore
+    io.res.bits.storeData := pendingInst.storeData
+    io.res.bits.inst := pendingInst.inst
     io.res.bits.opType := Mux(pendingInst.isStore, OpType.STORE, OpType.LOAD)
     io.res.bits.gprWrite := !pendingInst.isStore
 
     val (_, offset) = MemoryUtils.alignAddress(pendingInst.storeAddr, wordSize)
+    val bytes = VecInit((0 until wordSize).map { b =>
+      Mux(
+        pendingInst.fwdMask(b),
+        pendingInst.fwdData(b),
+        mem.resp.bits.dataRead(b)
+      )
+    })
     io.res.bits.gprData := extractData(
-      mem.resp.bits.dataRead,
+      bytes,
       pendingInst.opWidth,
       pendingInst.unsigned,
       offset
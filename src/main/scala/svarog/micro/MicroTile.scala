@@ -4,28 +4,41 @@ import chisel3._
 import chisel3.util._
 import org.chipsalliance.cde.config.Parameters
 import org.chipsalliance.diplomacy.lazymodule.{LazyModule, LazyModuleImp}
-import freechips.rocketchip.diplomacy.{IdRange, TransferSizes}
+import freechips.rocketchip.diplomacy.{AddressSet, IdRange, TransferSizes}
 import freechips.rocketchip.tilelink.{
   TLClientNode,
   TLMasterParameters,
   TLMasterPortParameters
 }
-import svarog.config.Cluster
+import svarog.config.{Cluster, Dual}
+import svarog.csr.HpmEvent
 import svarog.debug.HartDebugIO
-import svarog.memory.MemoryIOTileLinkBundleAdapter
+import svarog.memory.{
+  CacheEvents,
+  L1Cache,
+  MemoryIOTileLinkBundleAdapter,
+  PipelinedMemoryIOTileLinkBundleAdapter
+}
 
 class MicroTile(
     val hartBase: Int,
     val cluster: Cluster,
     val startAddress: Long,
     val instSourceIds: Seq[IdRange],
-    val dataSourceIds: Seq[IdRange]
+    val dataSourceIds: Seq[IdRange],
+    val memoryRegions: Seq[AddressSet] = Seq.empty
 )(override implicit val p: Parameters)
     extends LazyModule {
 
   private val beatBytes = cluster.isa.xlen / 8
   private val xlen = cluster.isa.xlen
   private val numCores = cluster.numCores
+  // Dual cores fetch two instructions per cycle from the I-cache
+  private val fetchWords = if (cluster.coreType == Dual) 2 else 1
+  require(
+    cluster.coreType != Dual || cluster.icache.isDefined,
+    "dual cores fetch through the icache, which must be configured"
+  )
 
   private def clientParams(name: String, id: IdRange) =
     TLMasterParameters.v1(
@@ -37,17 +50,43 @@ class MicroTile(
       supportsPutPartial = TransferSizes(1, beatBytes)
     )
 
+  // Optional L1 caches take over the hart's TileLink source ids
+  val icaches = instSourceIds.zipWithIndex.map { case (id, idx) =>
+    cluster.icache.map { cfg =>
+      LazyModule(
+        new L1Cache(
+          s"icache_$idx",
+          xlen,
+          cfg,
+          id,
+          readOnly = true,
+          portWords = fetchWords
+        )
+      )
+    }
+  }
+
+  val dcaches = dataSourceIds.zipWithIndex.map { case (id, idx) =>
+    cluster.dcache.map { cfg =>
+      LazyModule(new L1Cache(s"dcache_$idx", xlen, cfg, id, readOnly = false))
+    }
+  }
+
   // TileLink nodes stay in MicroTile for proper diplomatic resolution
   val instNodes = instSourceIds.zipWithIndex.map { case (id, idx) =>
-    TLClientNode(
-      Seq(TLMasterPortParameters.v1(Seq(clientParams(s"inst_$idx", id))))
-    )
+    icaches(idx).map(_.node).getOrElse {
+      TLClientNode(
+        Seq(TLMasterPortParameters.v1(Seq(clientParams(s"inst_$idx", id))))
+      )
+    }
   }
 
   val dataNodes = dataSourceIds.zipWithIndex.map { case (id, idx) =>
-    TLClientNode(
-      Seq(TLMasterPortParameters.v1(Seq(clientParams(s"data_$idx", id))))
-    )
+    dcaches(idx).map(_.node).getOrElse {
+      TLClientNode(
+        Seq(TLMasterPortParameters.v1(Seq(clientParams(s"data_$idx", id))))
+      )
+    }
   }
 
   // Instantiate Cpu LazyModules - CSR subsystem is inside each Cpu
@@ -56,7 +95,8 @@ class MicroTile(
       new Cpu(
         hartId = hartBase + i,
         config = cluster,
-        startAddress = startAddress
+        startAddress = startAddress,
+        memoryRegions = memoryRegions
       )
     )
   }
@@ -72,6 +112,15 @@ class MicroTileImp(outer: MicroTile) extends LazyModuleImp(outer) {
     val debug = Vec(numCores, Flipped(new HartDebugIO(xlen)))
     val debugRegData = Vec(numCores, Valid(UInt(xlen.W)))
     val halt = Output(Vec(numCores, Bool()))
+    val sleeping = Output(Vec(numCores, Bool()))
+    val idleCycles = Input(UInt(64.W))
+    val retire = Vec(numCores, Valid(new RetireInfo(xlen)))
+    val retireSecond = Option.when(outer.cluster.coreType == Dual)(
+      Vec(numCores, Valid(new RetireInfo(xlen)))
+    )
+    val events = Output(Vec(numCores, UInt(HpmEvent.Count.W)))
+    val peekReg = Input(Vec(numCores, UInt(5.W)))
+    val peekRegData = Output(Vec(numCores, UInt(xlen.W)))
     val timerInterrupt = Input(Vec(numCores, Bool()))
     val softwareInterrupt = Input(Vec(numCores, Bool()))
   })
@@ -79,27 +128,57 @@ class MicroTileImp(outer: MicroTile) extends LazyModuleImp(outer) {
   require(outer.instNodes.length == numCores, "instNodes must match numCores")
   require(outer.dataNodes.length == numCores, "dataNodes must match numCores")
 
-  // Connect each Cpu with TileLink adapters
+  // Connect each Cpu to its caches or directly through TileLink adapters
   outer.cpus.zipWithIndex.foreach { case (cpu, i) =>
-    val (instOut, instEdge) = outer.instNodes(i).out(0)
-    val (dataOut, dataEdge) = outer.dataNodes(i).out(0)
-
-    // Create TileLink adapters
-    val instAdapter = Module(new MemoryIOTileLinkBundleAdapter(instEdge, xlen))
-    val dataAdapter = Module(new MemoryIOTileLinkBundleAdapter(dataEdge, xlen))
-
-    // Connect TileLink bundles to adapter
-    instOut <> instAdapter.tl
-    dataOut <> dataAdapter.tl
-
-    // Connect adapter's MemoryIO to Cpu
-    cpu.module.io.instMem <> instAdapter.mem
-    cpu.module.io.dataMem <> dataAdapter.mem
+    val icache = outer.icaches(i)
+    val dcache = outer.dcaches(i)
+
+    icache match {
+      case Some(cache) => cpu.module.io.instMem <> cache.module.mem
+      case None =>
+        val (instOut, instEdge) = outer.instNodes(i).out(0)
+        val instAdapter = Module(
+          new PipelinedMemoryIOTileLinkBundleAdapter(instEdge, xlen)
+        )
+        instOut <> instAdapter.tl
+        cpu.module.io.instMem <> instAdapter.mem
+    }
+
+    dcache match {
+      case Some(cache) => cpu.module.io.dataMem <> cache.module.mem
+      case None =>
+        val (dataOut, dataEdge) = outer.dataNodes(i).out(0)
+        val dataAdapter =
+          Module(new MemoryIOTileLinkBundleAdapter(dataEdge, xlen))
+        dataOut <> dataAdapter.tl
+        cpu.module.io.dataMem <> dataAdapter.mem
+    }
+
+    // fence.i: clean the D-cache first so the I-cache refills see the stores
+    val dcacheDone = dcache.map(_.module.io.flushDone).getOrElse(true.B)
+    val icacheDone = icache.map(_.module.io.flushDone).getOrElse(true.B)
+    dcache.foreach(_.module.io.flush := cpu.module.io.fenceI)
+    icache.foreach(_.module.io.flush := cpu.module.io.fenceI && dcacheDone)
+    cpu.module.io.fenceIDone := dcacheDone && icacheDone
+
+    cpu.module.io.icacheEvents := icache
+      .map(_.module.io.events)
+      .getOrElse(0.U.asTypeOf(new CacheEvents))
+    cpu.module.io.dcacheEvents := dcache
+      .map(_.module.io.events)
+      .getOrElse(0.U.asTypeOf(new CacheEvents))
 
     // Connect external IO
     cpu.module.io.debug <> io.debug(i)
     io.debugRegData(i) <> cpu.module.io.debugRegData
     io.halt(i) := cpu.module.io.halt
+    io.sleeping(i) := cpu.module.io.sleeping
+    cpu.module.io.idleCycles := io.idleCycles
+    io.retire(i) := cpu.module.io.retire
+    io.retireSecond.foreach(_(i) := cpu.module.io.retireSecond.get)
+    io.events(i) := cpu.module.io.events
+    cpu.module.io.peekReg := io.peekReg(i)
+    io.peekRegData(i) := cpu.module.io.peekRegData
     cpu.module.io.timerInterrupt := io.timerInterrupt(i)
     cpu.module.io.softwareInterrupt := io.softwareInterrupt(i)
   }
@@ -6,26 +6,37 @@ import svarog.bits.RegFileWriteIO
 import svarog.bits.CSRWriteIO
 import svarog.decoder.OpType
 
+/** RVFI-style record of one retired instruction, for lock-step comparison
+  * against a reference model in simulation.
+  */
+class RetireInfo(xlen: Int) extends Bundle {
+  val pc = UInt(xlen.W)
+  val inst = UInt(32.W)
+  val rd = UInt(5.W) // 0 when the instruction writes no GPR
+  val rdWdata = UInt(xlen.W)
+  val memValid = Bool()
+  val memWrite = Bool()
+  val memAddr = UInt(xlen.W)
+  val memWdata = UInt(xlen.W)
+}
+
 class Writeback(xlen: Int) extends Module {
   val io = IO(new Bundle {
     val in = Flipped(Decoupled(new MemResult(xlen)))
     val regFile = Flipped(new RegFileWriteIO(xlen))
     val csrFile = Flipped(new CSRWriteIO())
-    val hazard = Valid(UInt(5.W))
     val csrHazard = Valid(new HazardUnitCSRIO)
     val debugPC = Valid(UInt(xlen.W))
     val debugStore = Valid(UInt(xlen.W)) // For watchpoint support
     val halt = Input(Bool())
     val retired = Output(Bool())
+    val retire = Valid(new RetireInfo(xlen))
   })
 
   // Always ready - don't backpressure based on halt
   // Halt is handled by not writing registers (below)
   io.in.ready := true.B
 
-  io.hazard.valid := io.in.valid
-  io.hazard.bits := io.in.bits.rd
-
   io.csrHazard.valid := io.in.valid && io.in.bits.csrWrite
   io.csrHazard.bits.addr := io.in.bits.csrAddr
   io.csrHazard.bits.isWrite := io.in.bits.csrWrite
@@ -39,6 +50,18 @@ class Writeback(xlen: Int) extends Module {
 
   io.retired := io.in.valid
 
+  private val isMemOp =
+    io.in.bits.opType === OpType.LOAD || io.in.bits.opType === OpType.STORE
+  io.retire.valid := io.in.valid
+  io.retire.bits.pc := io.in.bits.pc
+  io.retire.bits.inst := io.in.bits.inst
+  io.retire.bits.rd := Mux(io.in.bits.gprWrite, io.in.bits.rd, 0.U)
+  io.retire.bits.rdWdata := io.in.bits.gprData
+  io.retire.bits.memValid := isMemOp
+  io.retire.bits.memWrite := io.in.bits.isStore
+  io.retire.bits.memAddr := io.in.bits.storeAddr
+  io.retire.bits.memWdata := io.in.bits.storeData
+
   io.regFile.writeEn := false.B
   io.regFile.writeAddr := 0.U
   io.regFile.writeData := 0.U
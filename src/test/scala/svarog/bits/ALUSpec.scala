@@ -0,0 +1,109 @@
+package svarog.bits
+
+import chisel3._
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+import org.scalatest.matchers.should.Matchers
+import scala.util.Random
+
+class ALUSpec extends AnyFlatSpec with Matchers with ChiselSim {
+  behavior of "ALU"
+
+  private val xlen = 32
+  private val mask = (BigInt(1) << xlen) - 1
+
+  private def toSigned(value: BigInt): BigInt =
+    if (value.testBit(xlen - 1)) value - (BigInt(1) << xlen) else value
+
+  private def bytes(value: BigInt): Seq[BigInt] =
+    (0 until xlen / 8).map(i => (value >> (8 * i)) & 0xff)
+
+  private def fromBytes(bs: Seq[BigInt]): BigInt =
+    bs.zipWithIndex.map { case (b, i) => b << (8 * i) }.sum
+
+  private def reference(op: ALUOp.Type, a: BigInt, b: BigInt): BigInt = {
+    val shamt = (b & (xlen - 1)).toInt
+    val result = op match {
+      case ALUOp.SH1ADD => (a << 1) + b
+      case ALUOp.SH2ADD => (a << 2) + b
+      case ALUOp.SH3ADD => (a << 3) + b
+      case ALUOp.ANDN   => a & ~b
+      case ALUOp.ORN    => a | (~b & mask)
+      case ALUOp.XNOR   => ~(a ^ b)
+      case ALUOp.CLZ =>
+        BigInt((xlen - 1 to 0 by -1).takeWhile(!a.testBit(_)).length)
+      case ALUOp.CTZ  => BigInt((0 until xlen).takeWhile(!a.testBit(_)).length)
+      case ALUOp.CPOP => BigInt(a.bitCount)
+      case ALUOp.MAX  => if (toSigned(a) < toSigned(b)) b else a
+      case ALUOp.MAXU => a.max(b)
+      case ALUOp.MIN  => if (toSigned(a) < toSigned(b)) a else b
+      case ALUOp.MINU => a.min(b)
+      case ALUOp.SEXTB =>
+        if (a.testBit(7)) (a & 0xff) | (mask ^ 0xff) else a & 0xff
+      case ALUOp.SEXTH =>
+        if (a.testBit(15)) (a & 0xffff) | (mask ^ 0xffff) else a & 0xffff
+      case ALUOp.ZEXTH => a & 0xffff
+      case ALUOp.ROL   => (a << shamt) | (a >> ((xlen - shamt) % xlen))
+      case ALUOp.ROR   => (a >> shamt) | (a << ((xlen - shamt) % xlen))
+      case ALUOp.ORCB =>
+        fromBytes(bytes(a).map(b => if (b != 0) BigInt(0xff) else BigInt(0)))
+      case ALUOp.REV8 => fromBytes(bytes(a).reverse)
+      case _          => sys.error(s"no reference for $op")
+    }
+    result & mask
+  }
+
+  private val zbaOps = Seq(ALUOp.SH1ADD, ALUOp.SH2ADD, ALUOp.SH3ADD)
+  private val zbbOps = Seq(
+    ALUOp.ANDN,
+    ALUOp.ORN,
+    ALUOp.XNOR,
+    ALUOp.CLZ,
+    ALUOp.CTZ,
+    ALUOp.CPOP,
+    ALUOp.MAX,
+    ALUOp.MAXU,
+    ALUOp.MIN,
+    ALUOp.MINU,
+    ALUOp.SEXTB,
+    ALUOp.SEXTH,
+    ALUOp.ZEXTH,
+    ALUOp.ROL,
+    ALUOp.ROR,
+    ALUOp.ORCB,
+    ALUOp.REV8
+  )
+
+  private val edgeValues = Seq(
+    BigInt(0),
+    BigInt(1),
+    BigInt(0x80),
+    BigInt(0x8000),
+    BigInt("7FFFFFFF", 16),
+    BigInt("80000000", 16),
+    BigInt("FFFFFFFF", 16),
+    BigInt("12345678", 16),
+    BigInt("00FF0100", 16)
+  )
+
+  private val random = new Random(0x5eed)
+
+  private val operands = (for {
+    a <- edgeValues
+    b <- edgeValues
+  } yield (a, b)) ++
+    Seq.fill(100)((BigInt(xlen, random), BigInt(xlen, random)))
+
+  it should "compute Zba and Zbb operations" in {
+    simulate(new ALU(xlen, zba = true, zbb = true)) { dut =>
+      for (op <- zbaOps ++ zbbOps; (a, b) <- operands) {
+        dut.io.op.poke(op)
+        dut.io.input1.poke(a.U)
+        dut.io.input2.poke(b.U)
+        withClue(f"$op a=0x$a%x b=0x$b%x: ") {
+          dut.io.output.peek().litValue shouldBe reference(op, a, b)
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,114 @@
+package svarog.bits
+
+import chisel3._
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+import org.scalatest.matchers.should.Matchers
+import scala.util.Random
+
+class PipelinedMultiplierSpec extends AnyFlatSpec with Matchers with ChiselSim {
+  behavior of "PipelinedMultiplier"
+
+  private val xlen = 32
+  private val mask = (BigInt(1) << xlen) - 1
+
+  private def toSigned(value: BigInt): BigInt =
+    if (value.testBit(xlen - 1)) value - (BigInt(1) << xlen) else value
+
+  /** Returns (result, low half of the product) */
+  private def reference(
+      op: MulOp.Type,
+      a: BigInt,
+      b: BigInt
+  ): (BigInt, BigInt) = {
+    val product = op match {
+      case MulOp.MULH   => toSigned(a) * toSigned(b)
+      case MulOp.MULHSU => toSigned(a) * b
+      case _            => a * b
+    }
+    val high = (product >> xlen) & mask
+    val low = product & mask
+    (if (op == MulOp.MUL) low else high, low)
+  }
+
+  private val edgeValues = Seq(
+    BigInt(0),
+    BigInt(1),
+    BigInt(7),
+    BigInt("7FFFFFFF", 16),
+    BigInt("80000000", 16),
+    BigInt("FFFFFFFF", 16),
+    BigInt("12345678", 16),
+    BigInt("9ABCDEF0", 16)
+  )
+
+  private val ops = Seq(MulOp.MUL, MulOp.MULH, MulOp.MULHSU, MulOp.MULHU)
+
+  private val random = new Random(0x5eed)
+
+  private val vectors = (for {
+    a <- edgeValues
+    b <- edgeValues
+    op <- ops
+  } yield (op, a, b)) ++
+    Seq.fill(200)(
+      (
+        ops(random.nextInt(ops.length)),
+        BigInt(xlen, random),
+        BigInt(xlen, random)
+      )
+    )
+
+  /** Issues a new operation every cycle and checks results in order */
+  private def runBackToBack(latency: Int): Unit = {
+    simulate(new PipelinedMultiplier(xlen, latency)) { dut =>
+      dut.io.inp.valid.poke(false.B)
+      dut.clock.step(1)
+
+      val expected = scala.collection.mutable.Queue[(BigInt, BigInt)]()
+      var cycle = 0
+      var issueCycles = Seq.empty[Int]
+      var resultCycles = Seq.empty[Int]
+
+      for ((op, a, b) <- vectors) {
+        dut.io.inp.ready.expect(true.B)
+        dut.io.inp.bits.op.poke(op)
+        dut.io.inp.bits.multiplicant.poke(a.U)
+        dut.io.inp.bits.multiplier.poke(b.U)
+        dut.io.inp.valid.poke(true.B)
+        expected.enqueue(reference(op, a, b))
+        issueCycles :+= cycle
+
+        if (dut.io.result.valid.peek().litToBoolean) {
+          val (result, low) = expected.dequeue()
+          dut.io.result.bits.expect(result.U)
+          dut.io.low.expect(low.U)
+          resultCycles :+= cycle
+        }
+        dut.clock.step(1)
+        cycle += 1
+      }
+
+      dut.io.inp.valid.poke(false.B)
+      while (expected.nonEmpty) {
+        if (dut.io.result.valid.peek().litToBoolean) {
+          val (result, low) = expected.dequeue()
+          dut.io.result.bits.expect(result.U)
+          dut.io.low.expect(low.U)
+          resultCycles :+= cycle
+        }
+        cycle should be <= (vectors.length + latency)
+        dut.clock.step(1)
+        cycle += 1
+      }
+
+      resultCycles shouldBe issueCycles.map(_ + latency)
+    }
+  }
+
+  for (latency <- Seq(1, 2, 3, 5)) {
+    it should s"accept one operation per cycle with latency $latency" in {
+      runBackToBack(latency)
+    }
+  }
+}
@@ -0,0 +1,120 @@
+package svarog.bits
+
+import chisel3._
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+import org.scalatest.matchers.should.Matchers
+import scala.util.Random
+
+class RadixDividerSpec extends AnyFlatSpec with Matchers with ChiselSim {
+  behavior of "RadixDivider"
+
+  private val xlen = 32
+  private val mask = (BigInt(1) << xlen) - 1
+
+  private def toSigned(value: BigInt): BigInt =
+    if (value.testBit(xlen - 1)) value - (BigInt(1) << xlen) else value
+
+  /** RISC-V M semantics, including the divide-by-zero and overflow cases */
+  private def reference(op: DivOp.Type, a: BigInt, b: BigInt): BigInt = {
+    val sa = toSigned(a)
+    val sb = toSigned(b)
+    val overflow = sa == -(BigInt(1) << (xlen - 1)) && sb == -1
+    val result = op match {
+      case DivOp.DIV if b == 0  => BigInt(-1)
+      case DivOp.DIV if overflow => sa
+      case DivOp.DIV            => sa / sb // BigInt truncates toward zero
+      case DivOp.DIVU if b == 0 => mask
+      case DivOp.DIVU           => a / b
+      case DivOp.REM if b == 0  => a
+      case DivOp.REM if overflow => BigInt(0)
+      case DivOp.REM            => sa % sb
+      case DivOp.REMU if b == 0 => a
+      case _                    => a % b
+    }
+    result & mask
+  }
+
+  private val edgeValues = Seq(
+    BigInt(0),
+    BigInt(1),
+    BigInt(2),
+    BigInt(3),
+    BigInt(7),
+    BigInt("7FFFFFFF", 16),
+    BigInt("80000000", 16),
+    BigInt("FFFFFFFF", 16),
+    BigInt("FFFFFFFE", 16),
+    BigInt("FFFFFFEC", 16)
+  )
+
+  private val ops = Seq(DivOp.DIV, DivOp.DIVU, DivOp.REM, DivOp.REMU)
+
+  /** Runs one division and returns (result, cycles until valid) */
+  private def divide(
+      dut: RadixDivider,
+      op: DivOp.Type,
+      a: BigInt,
+      b: BigInt
+  ): (BigInt, Int) = {
+    dut.io.inp.ready.expect(true.B)
+    dut.io.inp.bits.op.poke(op)
+    dut.io.inp.bits.dividend.poke(a.U)
+    dut.io.inp.bits.divisor.poke(b.U)
+    dut.io.inp.valid.poke(true.B)
+    dut.clock.step(1)
+    dut.io.inp.valid.poke(false.B)
+
+    var cycles = 1
+    while (!dut.io.result.valid.peek().litToBoolean) {
+      cycles should be <= (xlen + 1)
+      dut.clock.step(1)
+      cycles += 1
+    }
+    val result = dut.io.result.bits.peek().litValue
+    dut.clock.step(1)
+    (result, cycles)
+  }
+
+  for (radixLog2 <- Seq(1, 2, 4)) {
+    it should s"match RISC-V semantics at radix ${1 << radixLog2}" in {
+      val random = new Random(radixLog2)
+      val randomPairs = Seq.fill(64)(
+        (BigInt(xlen, random), BigInt(random.nextInt(1 << 12)))
+      ) ++ Seq.fill(64)((BigInt(xlen, random), BigInt(xlen, random)))
+      val pairs = (for (a <- edgeValues; b <- edgeValues) yield (a, b)) ++
+        randomPairs
+
+      simulate(new RadixDivider(xlen, radixLog2)) { dut =>
+        dut.io.inp.valid.poke(false.B)
+        dut.clock.step(1)
+
+        for ((a, b) <- pairs; op <- ops) {
+          val (result, _) = divide(dut, op, a, b)
+          withClue(f"$op 0x$a%x / 0x$b%x: ") {
+            result shouldBe reference(op, a, b)
+          }
+        }
+      }
+    }
+  }
+
+  it should "take the fast paths and exit early on small dividends" in {
+    simulate(new RadixDivider(xlen, radixLog2 = 2)) { dut =>
+      dut.io.inp.valid.poke(false.B)
+      dut.clock.step(1)
+
+      // Divide by zero, overflow and |dividend| < |divisor| skip iterating
+      divide(dut, DivOp.DIV, 42, 0)._2 shouldBe 1
+      divide(dut, DivOp.DIV, BigInt("80000000", 16), mask)._2 shouldBe 1
+      divide(dut, DivOp.DIVU, 5, 9)._2 shouldBe 1
+
+      // A 4-bit dividend needs two radix-4 digits, not sixteen
+      val (quotient, cycles) = divide(dut, DivOp.DIVU, 13, 3)
+      quotient shouldBe 4
+      cycles shouldBe 3
+
+      divide(dut, DivOp.DIVU, mask, 3)._2 shouldBe (xlen / 2 + 1)
+    }
+  }
+}
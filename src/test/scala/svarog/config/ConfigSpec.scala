@@ -70,6 +70,20 @@ class ConfigSpec extends AnyFlatSpec with Matchers {
     )
   }
 
+  it should "parse RV32I with Zba and Zbb extensions" in {
+    val result = ISA.parseFromString("rv32i_zmmul_zba_zbb")
+    result shouldBe a[Success[_]]
+    result.get shouldBe ISA(
+      xlen = 32,
+      mult = false,
+      zmmul = true,
+      zicsr = false,
+      zicntr = false,
+      zba = true,
+      zbb = true
+    )
+  }
+
   it should "parse RV32IM with multiple Z extensions" in {
     val result = ISA.parseFromString("rv32im_zicsr_zmmul")
     result shouldBe a[Success[_]]
@@ -178,6 +192,12 @@ class ConfigSpec extends AnyFlatSpec with Matchers {
     result shouldBe Right(Mini)
   }
 
+  it should "decode 'dual' to Dual" in {
+    val yaml = "dual"
+    val result = parse(yaml).flatMap(_.as[CoreType](Config.coreTypeDecoder))
+    result shouldBe Right(Dual)
+  }
+
   it should "reject invalid core type" in {
     val yaml = "invalid"
     val result = parse(yaml).flatMap(_.as[CoreType](Config.coreTypeDecoder))
@@ -247,6 +267,126 @@ numCores: 4
     result shouldBe a[Left[_, _]]
   }
 
+  it should "decode cluster with branch predictor" in {
+    val yaml = """coreType: micro
+isa: rv32i
+numCores: 1
+branchPredictor: gshare
+"""
+    val result = parse(yaml).flatMap(_.as[Cluster](Config.clusterDecoder))
+    result.map(_.branchPredictor) shouldBe Right(GshareBranchPredictor())
+  }
+
+  it should "reject cluster with unknown branch predictor" in {
+    val yaml = """coreType: micro
+isa: rv32i
+numCores: 1
+branchPredictor: tage
+"""
+    val result = parse(yaml).flatMap(_.as[Cluster](Config.clusterDecoder))
+    result shouldBe a[Left[_, _]]
+  }
+
+  it should "decode cluster with HPM counter count" in {
+    val yaml = """coreType: micro
+isa: rv32i_zicntr
+numCores: 1
+hpmCounters: 13
+"""
+    val result = parse(yaml).flatMap(_.as[Cluster](Config.clusterDecoder))
+    result.map(_.hpmCounters) shouldBe Right(13)
+  }
+
+  it should "reject cluster with too many HPM counters" in {
+    val yaml = """coreType: micro
+isa: rv32i_zicntr
+numCores: 1
+hpmCounters: 30
+"""
+    val result = parse(yaml).flatMap(_.as[Cluster](Config.clusterDecoder))
+    result shouldBe a[Left[_, _]]
+  }
+
+  it should "decode cluster with multiplier and latency" in {
+    val yaml = """coreType: micro
+isa: rv32im
+numCores: 1
+multiplier: simple
+multiplierLatency: 2
+"""
+    val result = parse(yaml).flatMap(_.as[Cluster](Config.clusterDecoder))
+    result.map(_.multiplier) shouldBe Right(SimpleMultiplierType(2))
+  }
+
+  it should "reject cluster with zero multiplier latency" in {
+    val yaml = """coreType: micro
+isa: rv32im
+numCores: 1
+multiplierLatency: 0
+"""
+    val result = parse(yaml).flatMap(_.as[Cluster](Config.clusterDecoder))
+    result shouldBe a[Left[_, _]]
+  }
+
+  it should "decode cluster with L1 caches" in {
+    val yaml = """coreType: micro
+isa: rv32im
+numCores: 1
+icache:
+  size: 2048
+  ways: 2
+dcache: {}
+"""
+    val result = parse(yaml).flatMap(_.as[Cluster](Config.clusterDecoder))
+    result.map(c => (c.icache, c.dcache)) shouldBe Right(
+      (Some(CacheConfig(2048, 32, 2)), Some(CacheConfig()))
+    )
+  }
+
+  it should "reject dual cluster without an icache" in {
+    val yaml = """coreType: dual
+isa: rv32i
+numCores: 1
+"""
+    val result = parse(yaml).flatMap(_.as[Cluster](Config.clusterDecoder))
+    result shouldBe a[Left[_, _]]
+  }
+
+  it should "reject cluster with invalid cache geometry" in {
+    for (cache <- Seq("size: 3000", "lineSize: 4", "ways: 4")) {
+      val yaml = s"""coreType: micro
+isa: rv32im
+numCores: 1
+dcache:
+  $cache
+"""
+      val result = parse(yaml).flatMap(_.as[Cluster](Config.clusterDecoder))
+      result shouldBe a[Left[_, _]]
+    }
+  }
+
+  it should "decode cluster store buffer depth" in {
+    val yaml = """coreType: micro
+isa: rv32i
+numCores: 1
+storeBufferDepth: 4
+"""
+    val result = parse(yaml).flatMap(_.as[Cluster](Config.clusterDecoder))
+    result.map(_.storeBufferDepth) shouldBe Right(4)
+  }
+
+  it should "reject cluster with invalid store buffer depth" in {
+    for (depth <- Seq(-1, 3)) {
+      val yaml = s"""coreType: micro
+isa: rv32i
+numCores: 1
+storeBufferDepth: $depth
+"""
+      val result = parse(yaml).flatMap(_.as[Cluster](Config.clusterDecoder))
+      result shouldBe a[Left[_, _]]
+    }
+  }
+
   behavior of "SoCYaml decoder"
 
   it should "decode valid SoC YAML with single cluster" in {
@@ -335,6 +475,22 @@ baseAddr: 0x10000000
     )
   }
 
+  it should "decode UART with custom baudDivider" in {
+    val yaml = """type: uart
+name: fast
+baseAddr: 0x10000000
+baudDivider: 26
+"""
+    val result = parse(yaml).flatMap(_.as[IO](Config.ioDecoder))
+    result shouldBe Right(
+      UART(
+        name = "fast",
+        baseAddr = 0x10000000L,
+        baudDivider = 26
+      )
+    )
+  }
+
   it should "reject IO with unknown type" in {
     val yaml = """type: SPI
 name: spi0
@@ -383,6 +539,36 @@ length: 0x10000
     )
   }
 
+  it should "decode dual-port banked TCM" in {
+    val yaml = """type: tcm
+baseAddress: 0x80000000
+length: 0x10000
+ports: 2
+banks: 4
+"""
+    val result = parse(yaml).flatMap(_.as[Memory](Config.memoryDecoder))
+    result shouldBe Right(
+      TCM(
+        baseAddress = 0x80000000L,
+        length = 0x10000L,
+        ports = 2,
+        banks = 4
+      )
+    )
+  }
+
+  it should "reject TCM with unsupported port or bank count" in {
+    for (extra <- Seq("ports: 3", "banks: 3")) {
+      val yaml = s"""type: tcm
+baseAddress: 0x80000000
+length: 0x10000
+$extra
+"""
+      val result = parse(yaml).flatMap(_.as[Memory](Config.memoryDecoder))
+      result shouldBe a[Left[_, _]]
+    }
+  }
+
   it should "reject Memory with unknown type" in {
     val yaml = """type: DRAM
 baseAddress: 0x80000000
@@ -465,4 +651,43 @@ memories:
     val result = parse(yaml).flatMap(_.as[SoCYaml](Config.socYamlDecoder))
     result shouldBe a[Left[_, _]]
   }
+
+  behavior of "SoCYaml decoder with boot ROM"
+
+  private val minimalSoC = """clusters:
+  - coreType: micro
+    isa: rv32i
+    numCores: 1
+io: []
+memories: []
+"""
+
+  it should "default to a boot ROM without stream buffers" in {
+    val result = parse(minimalSoC).flatMap(_.as[SoCYaml](Config.socYamlDecoder))
+    result.map(_.bootRom) shouldBe Right(BootROM(streams = 0, prefetchWords = 4))
+  }
+
+  it should "decode boot ROM stream buffers" in {
+    val yaml = minimalSoC + """bootRom:
+  streams: 2
+  prefetchWords: 8
+"""
+    val result = parse(yaml).flatMap(_.as[SoCYaml](Config.socYamlDecoder))
+    result.map(_.bootRom) shouldBe Right(BootROM(streams = 2, prefetchWords = 8))
+  }
+
+  it should "reject unsupported boot ROM stream settings" in {
+    for (
+      bootRom <- Seq(
+        "bootRom:\n  streams: 3\n",
+        "bootRom:\n  streams: -1\n",
+        "bootRom:\n  streams: 1\n  prefetchWords: 6\n",
+        "bootRom:\n  streams: 1\n  prefetchWords: 1\n"
+      )
+    ) {
+      val result =
+        parse(minimalSoC + bootRom).flatMap(_.as[SoCYaml](Config.socYamlDecoder))
+      withClue(bootRom) { result shouldBe a[Left[_, _]] }
+    }
+  }
 }
@@ -573,7 +573,7 @@ class BaseInstructionsSpec extends AnyFlatSpec with Matchers with ChiselSim {
     }
   }
 
-  it should "decode ECALL and EBREAK instructions" in {
+  it should "decode ECALL, EBREAK and WFI instructions" in {
     val vectors = Seq(
       DecodeVector(
         pc = 0,
@@ -592,6 +592,14 @@ class BaseInstructionsSpec extends AnyFlatSpec with Matchers with ChiselSim {
           dut.io.decoded.hasImm.expect(false.B)
           dut.io.decoded.regWrite.expect(false.B)
         }
+      ),
+      DecodeVector(
+        pc = 8,
+        instruction = BigInt("10500073", 16), // wfi
+        check = { dut =>
+          dut.io.decoded.opType.expect(OpType.WFI)
+          dut.io.decoded.regWrite.expect(false.B)
+        }
       )
     )
 
@@ -55,6 +55,7 @@ class SimpleDecoderSpec extends AnyFlatSpec with Matchers with ChiselSim {
           dut.io.decoded.bits.imm.expect(5.U)
           dut.io.decoded.bits.regWrite.expect(true.B)
           dut.io.monitor.aluOp.expect(ALUOp.ADD.litValue.U)
+          dut.io.decoded.bits.inst.expect("h00500093".U)
           dut.io.hazard.bits.rs1.expect(0.U)
           dut.io.hazard.bits.rs2.expect(0.U)
         }
@@ -0,0 +1,80 @@
+package svarog.decoder
+
+import chisel3._
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+import org.scalatest.matchers.should.Matchers
+import svarog.bits.ALUOp
+
+class ZbInstructionsSpec extends AnyFlatSpec with Matchers with ChiselSim {
+  behavior of "ZbInstructions"
+
+  private val xlen = 32
+
+  private case class DecodeVector(
+      instruction: BigInt,
+      aluOp: ALUOp.Type,
+      rs2: Int,
+      hasImm: Boolean = false,
+      imm: Int = 0
+  )
+
+  private val vectors = Seq(
+    DecodeVector(BigInt("2020c1b3", 16), ALUOp.SH2ADD, 2), // sh2add x3, x1, x2
+    DecodeVector(BigInt("4020f1b3", 16), ALUOp.ANDN, 2), // andn x3, x1, x2
+    DecodeVector(BigInt("0a20d1b3", 16), ALUOp.MINU, 2), // minu x3, x1, x2
+    DecodeVector(BigInt("6020d1b3", 16), ALUOp.ROR, 2), // ror x3, x1, x2
+    DecodeVector(BigInt("60009193", 16), ALUOp.CLZ, 0), // clz x3, x1
+    DecodeVector(BigInt("60209193", 16), ALUOp.CPOP, 0), // cpop x3, x1
+    DecodeVector(BigInt("6980d193", 16), ALUOp.REV8, 0), // rev8 x3, x1
+    DecodeVector(BigInt("2870d193", 16), ALUOp.ORCB, 0), // orc.b x3, x1
+    DecodeVector(BigInt("0800c1b3", 16), ALUOp.ZEXTH, 0), // zext.h x3, x1
+    DecodeVector( // rori x3, x1, 7
+      BigInt("6070d193", 16),
+      ALUOp.ROR,
+      0,
+      hasImm = true,
+      imm = 7
+    )
+  )
+
+  it should "decode Zba and Zbb instructions" in {
+    simulate(new ZbInstructions(xlen, zba = true, zbb = true)) { dut =>
+      for (vector <- vectors) {
+        dut.io.instruction.poke(vector.instruction.U)
+        dut.io.pc.poke(0x100.U)
+        dut.clock.step(1)
+        dut.io.decoded.opType.expect(OpType.ALU)
+        dut.io.decoded.aluOp.expect(vector.aluOp)
+        dut.io.decoded.rd.expect(3.U)
+        dut.io.decoded.rs1.expect(1.U)
+        dut.io.decoded.rs2.expect(vector.rs2.U)
+        dut.io.decoded.hasImm.expect(vector.hasImm.B)
+        dut.io.decoded.regWrite.expect(true.B)
+        dut.io.decoded.pc.expect(0x100.U)
+        if (vector.hasImm) {
+          dut.io.decoded.imm.expect(vector.imm.U)
+        }
+      }
+    }
+  }
+
+  it should "leave base instructions to the other decoders" in {
+    simulate(new ZbInstructions(xlen, zba = true, zbb = true)) { dut =>
+      dut.io.instruction.poke(BigInt("002081b3", 16).U) // add x3, x1, x2
+      dut.clock.step(1)
+      dut.io.decoded.opType.expect(OpType.INVALID)
+    }
+  }
+
+  it should "only decode the enabled extensions" in {
+    simulate(new ZbInstructions(xlen, zba = true, zbb = false)) { dut =>
+      dut.io.instruction.poke(BigInt("4020f1b3", 16).U) // andn x3, x1, x2
+      dut.clock.step(1)
+      dut.io.decoded.opType.expect(OpType.INVALID)
+      dut.io.instruction.poke(BigInt("2020c1b3", 16).U) // sh2add x3, x1, x2
+      dut.clock.step(1)
+      dut.io.decoded.opType.expect(OpType.ALU)
+    }
+  }
+}
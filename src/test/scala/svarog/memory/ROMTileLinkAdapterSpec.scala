@@ -0,0 +1,180 @@
+package svarog.memory
+
+import chisel3._
+import chisel3.util._
+import chisel3.simulator.scalatest.ChiselSim
+import org.chipsalliance.cde.config.Parameters
+import org.chipsalliance.diplomacy.lazymodule.{LazyModule, LazyModuleImp}
+import org.scalatest.flatspec.AnyFlatSpec
+import org.scalatest.matchers.should.Matchers
+import freechips.rocketchip.diplomacy.IdRange
+import freechips.rocketchip.tilelink._
+import svarog.VerilatorWarningSilencer
+
+/** Drives word Gets into a [[ROMTileLinkAdapter]] from plain ports */
+class ROMTileLinkAdapterHarness(
+    baseAddr: Long,
+    file: String,
+    streams: Int,
+    sources: Int
+)(implicit p: Parameters)
+    extends LazyModule {
+  private val client = TLClientNode(
+    Seq(
+      TLMasterPortParameters.v1(
+        Seq(
+          TLMasterParameters.v1(
+            name = "rom_test",
+            sourceId = IdRange(0, sources)
+          )
+        )
+      )
+    )
+  )
+  private val rom = LazyModule(
+    new ROMTileLinkAdapter(32, baseAddr, file, streams = streams)
+  )
+  rom.node := client
+
+  lazy val module = new Impl
+  class Impl extends LazyModuleImp(this) {
+    val io = IO(new Bundle {
+      val req = Flipped(Decoupled(new Bundle {
+        val address = UInt(32.W)
+        val source = UInt(log2Ceil(sources).W)
+      }))
+      val resp = Decoupled(new Bundle {
+        val data = UInt(32.W)
+        val source = UInt(log2Ceil(sources).W)
+        val denied = Bool()
+      })
+    })
+
+    private val (out, edge) = client.out(0)
+
+    out.a.valid := io.req.valid
+    out.a.bits := edge.Get(io.req.bits.source, io.req.bits.address, 2.U)._2
+    io.req.ready := out.a.ready
+
+    io.resp.valid := out.d.valid
+    io.resp.bits.data := out.d.bits.data
+    io.resp.bits.source := out.d.bits.source
+    io.resp.bits.denied := out.d.bits.denied
+    out.d.ready := io.resp.ready
+  }
+}
+
+class ROMTileLinkAdapterSpec
+    extends AnyFlatSpec
+    with Matchers
+    with ChiselSim
+    with VerilatorWarningSilencer {
+  behavior of "ROMTileLinkAdapter"
+
+  private val baseAddr = 0x00480000L
+  private val romWords = 256
+  private val sources = 4
+
+  private def word(index: Int): Long =
+    (index.toLong * 0x9e3779b1L + 0x1234567L) & 0xffffffffL
+
+  private lazy val romFile = {
+    val file = java.io.File.createTempFile("rom-adapter", ".hex")
+    file.deleteOnExit()
+    java.nio.file.Files.writeString(
+      file.toPath,
+      (0 until romWords).map(i => f"${word(i)}%08x\n").mkString
+    )
+    file.getAbsolutePath
+  }
+
+  // Code runs straight, loops back and interleaves loads from a data region
+  private val straight = 0 until 24
+  private val loop = Seq.fill(3)(8 until 16).flatten
+  private val rodata = (40 until 52).zip(200 until 212).flatMap { case (c, d) =>
+    Seq(c, d)
+  }
+  private val accessPattern = straight ++ loop ++ rodata ++ Seq(3, 250, 4, 5)
+
+  /** Issues `pattern` and returns (word index, data, cycle) per response, in
+    * order. `reqValid` and `respReady` pick the handshakes for each cycle.
+    */
+  private def runPattern(
+      streams: Int,
+      pattern: Seq[Int],
+      reqValid: Int => Boolean,
+      respReady: Int => Boolean
+  ): Seq[(Int, Long, Int)] = {
+    implicit val p: Parameters = Parameters.empty
+    var responses = Seq.empty[(Int, Long, Int)]
+
+    simulate(
+      LazyModule(
+        new ROMTileLinkAdapterHarness(baseAddr, romFile, streams, sources)
+      ).module
+    ) { dut =>
+      val inFlight = scala.collection.mutable.Queue.empty[(Int, Int)]
+      var next = 0
+      var cycle = 0
+
+      dut.reset.poke(true.B)
+      dut.clock.step()
+      dut.reset.poke(false.B)
+
+      while (responses.length < pattern.length && cycle < 2000) {
+        val offer =
+          next < pattern.length && inFlight.length < sources && reqValid(cycle)
+        val source = next % sources
+        dut.io.req.valid.poke(offer.B)
+        val index = pattern.lift(next).getOrElse(0)
+        dut.io.req.bits.address.poke((baseAddr + index * 4).U)
+        dut.io.req.bits.source.poke(source.U)
+        dut.io.resp.ready.poke(respReady(cycle).B)
+
+        if (dut.io.resp.valid.peek().litToBoolean && respReady(cycle)) {
+          val (expected, expectedSource) = inFlight.dequeue()
+          dut.io.resp.bits.source.expect(expectedSource.U)
+          dut.io.resp.bits.denied.expect(false.B)
+          val data = dut.io.resp.bits.data.peek().litValue.toLong
+          responses :+= ((expected, data, cycle))
+        }
+        if (offer && dut.io.req.ready.peek().litToBoolean) {
+          inFlight.enqueue((index, source))
+          next += 1
+        }
+
+        dut.clock.step()
+        cycle += 1
+      }
+    }
+
+    responses
+  }
+
+  for (streams <- 0 to 2) {
+    it should s"return the right words under D backpressure with $streams stream buffers" in {
+      val random = new scala.util.Random(streams)
+      val valid = Seq.fill(2000)(random.nextInt(4) != 0)
+      val ready = Seq.fill(2000)(random.nextInt(3) != 0)
+
+      val responses = runPattern(streams, accessPattern, valid, ready)
+
+      responses.map(_._1) shouldBe accessPattern
+      responses.foreach { case (index, data, _) =>
+        withClue(s"word $index: ") { data shouldBe word(index) }
+      }
+    }
+
+    it should s"answer one Get per cycle with $streams stream buffers" in {
+      val responses =
+        runPattern(streams, accessPattern, _ => true, _ => true)
+
+      responses.map(_._1) shouldBe accessPattern
+      responses.foreach { case (index, data, _) => data shouldBe word(index) }
+      // Back to back from the first response on, jumps included
+      responses.map(_._3).sliding(2).foreach { case Seq(a, b) =>
+        (b - a) shouldBe 1
+      }
+    }
+  }
+}
@@ -0,0 +1,241 @@
+package svarog.memory
+
+import chisel3._
+import chisel3.util._
+import chisel3.simulator.scalatest.ChiselSim
+import org.chipsalliance.cde.config.Parameters
+import org.chipsalliance.diplomacy.lazymodule.{LazyModule, LazyModuleImp}
+import org.scalatest.flatspec.AnyFlatSpec
+import org.scalatest.matchers.should.Matchers
+import freechips.rocketchip.diplomacy.IdRange
+import freechips.rocketchip.tilelink._
+import svarog.VerilatorWarningSilencer
+
+/** Drives word Gets and Puts into each port of a [[TCM]] built on SyncReadMem
+  * from plain ports. Port `i` of the harness is bound to TCM port `i`.
+  */
+class TCMHarness(baseAddr: Long, words: Int, numPorts: Int, banks: Int)(
+    implicit p: Parameters
+) extends LazyModule {
+  private val clients = Seq.tabulate(numPorts) { i =>
+    TLClientNode(
+      Seq(
+        TLMasterPortParameters.v1(
+          Seq(
+            TLMasterParameters.v1(
+              name = s"tcm_test_$i",
+              sourceId = IdRange(0, 1)
+            )
+          )
+        )
+      )
+    )
+  }
+  private val tcm = LazyModule(
+    new TCM(32, words * 4, baseAddr, numPorts = numPorts, banks = banks)
+  )
+  clients.foreach(client => tcm.node := client)
+
+  lazy val module = new Impl
+  class Impl extends LazyModuleImp(this) {
+    val io = IO(new Bundle {
+      val req = Vec(
+        numPorts,
+        Flipped(Decoupled(new Bundle {
+          val address = UInt(32.W)
+          val write = Bool()
+          val data = UInt(32.W)
+        }))
+      )
+      val resp = Vec(
+        numPorts,
+        Valid(new Bundle {
+          val data = UInt(32.W)
+          val denied = Bool()
+        })
+      )
+    })
+
+    for (i <- 0 until numPorts) {
+      val (out, edge) = clients(i).out(0)
+      val req = io.req(i).bits
+
+      out.a.valid := io.req(i).valid
+      out.a.bits := Mux(
+        req.write,
+        edge.Put(0.U, req.address, 2.U, req.data)._2,
+        edge.Get(0.U, req.address, 2.U)._2
+      )
+      io.req(i).ready := out.a.ready
+
+      io.resp(i).valid := out.d.valid
+      io.resp(i).bits.data := out.d.bits.data
+      io.resp(i).bits.denied := out.d.bits.denied
+      out.d.ready := true.B
+    }
+  }
+}
+
+class TCMSpec
+    extends AnyFlatSpec
+    with Matchers
+    with ChiselSim
+    with VerilatorWarningSilencer {
+  behavior of "TCM"
+
+  private val baseAddr = 0x80000000L
+  private val words = 64
+
+  private def word(index: Int): Long =
+    (index.toLong * 0x9e3779b1L + 0x1234567L) & 0xffffffffL
+
+  /** One access: a read of word `index`, or a write of `data` to it */
+  private case class Access(index: Int, data: Option[Long] = None)
+
+  /** An accepted access with the cycle A fired and the data D returned */
+  private case class Done(access: Access, acceptCycle: Int, data: Long)
+
+  /** Offers each port its accesses in order, back to back, and returns what
+    * every port completed. Cycles count from the start of the call.
+    */
+  private def run(
+      dut: TCMHarness#Impl,
+      accesses: Seq[Seq[Access]]
+  ): Seq[Seq[Done]] = {
+    val ports = accesses.indices
+    val next = Array.fill(accesses.length)(0)
+    val inFlight = Array.fill(accesses.length)(
+      scala.collection.mutable.Queue.empty[(Access, Int)]
+    )
+    val done = Array.fill(accesses.length)(Seq.empty[Done])
+    var cycle = 0
+
+    while (
+      ports.exists(i => done(i).length < accesses(i).length) && cycle < 200
+    ) {
+      val offers = ports.map { i =>
+        val req = dut.io.req(i)
+        val access = accesses(i).lift(next(i))
+        req.valid.poke(access.isDefined.B)
+        req.bits.address.poke((baseAddr + access.fold(0)(_.index) * 4).U)
+        req.bits.write.poke(access.exists(_.data.isDefined).B)
+        req.bits.data.poke(access.flatMap(_.data).getOrElse(0L).U)
+        access
+      }
+      for (i <- ports) {
+        val resp = dut.io.resp(i)
+        if (resp.valid.peek().litToBoolean) {
+          val (access, acceptCycle) = inFlight(i).dequeue()
+          resp.bits.denied.expect(false.B)
+          val data = resp.bits.data.peek().litValue.toLong
+          done(i) :+= Done(access, acceptCycle, data)
+        }
+        offers(i).foreach { access =>
+          if (dut.io.req(i).ready.peek().litToBoolean) {
+            inFlight(i).enqueue((access, cycle))
+            next(i) += 1
+          }
+        }
+      }
+      dut.clock.step()
+      cycle += 1
+    }
+    for (i <- ports) dut.io.req(i).valid.poke(false.B)
+
+    done.toSeq
+  }
+
+  private def simulateTcm(numPorts: Int, banks: Int)(
+      body: TCMHarness#Impl => Unit
+  ): Unit = {
+    implicit val p: Parameters = Parameters.empty
+    simulate(
+      LazyModule(new TCMHarness(baseAddr, words, numPorts, banks)).module
+    ) { dut =>
+      dut.reset.poke(true.B)
+      dut.clock.step()
+      dut.reset.poke(false.B)
+      body(dut)
+    }
+  }
+
+  private def reads(indices: Seq[Int]): Seq[Access] = indices.map(Access(_))
+
+  private def checkReads(done: Seq[Done]): Unit =
+    done.foreach { case Done(Access(index, _), _, data) =>
+      withClue(s"word $index: ") { data shouldBe word(index) }
+    }
+
+  // Every port writes half the array at once, so the write path of each bank
+  // sees every port
+  private def fill(dut: TCMHarness#Impl, numPorts: Int): Unit =
+    run(
+      dut,
+      Seq.tabulate(numPorts) { i =>
+        (i until words by numPorts).map(w => Access(w, Some(word(w))))
+      }
+    )
+
+  it should "return written words on both ports of two banks" in {
+    simulateTcm(numPorts = 2, banks = 2) { dut =>
+      fill(dut, 2)
+      val done =
+        run(dut, Seq(reads(0 until words), reads((0 until words).reverse)))
+      done.map(_.length) shouldBe Seq(words, words)
+      done.foreach(checkReads)
+    }
+  }
+
+  it should "complete one access per port per cycle on different banks" in {
+    simulateTcm(numPorts = 2, banks = 2) { dut =>
+      fill(dut, 2)
+      val even = reads(0 until 32 by 2)
+      val odd = reads(1 until 32 by 2)
+      val done = run(dut, Seq(even, odd))
+
+      done.foreach(checkReads)
+      done(0).map(_.acceptCycle) shouldBe even.indices
+      done(1).map(_.acceptCycle) shouldBe odd.indices
+    }
+  }
+
+  it should "let the lower-numbered port win a shared bank" in {
+    simulateTcm(numPorts = 2, banks = 2) { dut =>
+      fill(dut, 2)
+      val first = reads(0 until 16 by 2)
+      val second = reads(16 until 32 by 2)
+      val done = run(dut, Seq(first, second))
+
+      done.foreach(checkReads)
+      // Port 0 never waits, port 1 only gets the bank once port 0 is done
+      done(0).map(_.acceptCycle) shouldBe first.indices
+      done(1).map(_.acceptCycle) shouldBe second.indices.map(_ + first.length)
+    }
+  }
+
+  it should "serve a write and a read to different banks in the same cycle" in {
+    simulateTcm(numPorts = 2, banks = 2) { dut =>
+      fill(dut, 2)
+      val write = Access(4, Some(0xcafef00dL))
+      val done = run(dut, Seq(Seq(write), reads(Seq(5))))
+      done.map(_.map(_.acceptCycle)) shouldBe Seq(Seq(0), Seq(0))
+      done(1).head.data shouldBe word(5)
+
+      val readBack = run(dut, Seq(reads(Seq(4)), Seq.empty))
+      readBack.head.head.data shouldBe 0xcafef00dL
+    }
+  }
+
+  it should "give each port its own array port with one bank" in {
+    simulateTcm(numPorts = 2, banks = 1) { dut =>
+      fill(dut, 2)
+      val first = reads(0 until 16 by 2)
+      val second = reads(16 until 32 by 2)
+      val done = run(dut, Seq(first, second))
+
+      done.foreach(checkReads)
+      done(0).map(_.acceptCycle) shouldBe first.indices
+      done(1).map(_.acceptCycle) shouldBe second.indices
+    }
+  }
+}
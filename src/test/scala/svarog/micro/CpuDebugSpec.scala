@@ -68,6 +68,10 @@ class CpuDebugSpec
       dut.io.debug.get.hart_in.bits.setPC.bits.pc.poke(0.U)
       dut.io.debug.get.mem_in.valid.poke(false.B)
       dut.io.debug.get.reg_res.ready.poke(false.B)
+      dut.io.idle.get.skip.valid.poke(false.B)
+      dut.io.backdoor.get.hart.poke(0.U)
+      dut.io.backdoor.get.reg.poke(0.U)
+      dut.io.backdoor.get.memAddr.poke(0.U)
 
       // Reset
       dut.reset.poke(true.B)
@@ -317,6 +321,20 @@ class CpuDebugSpec
         }
       }
 
+      println("=== Step 7: Check the backdoor against the debug reads ===")
+      def unsigned(value: Int): UInt = (BigInt(value) & 0xffffffffL).U
+      for (reg <- 0 until 32) {
+        dut.io.backdoor.get.reg.poke(reg.U)
+        dut.io.backdoor.get.regData.expect(unsigned(results(reg)))
+      }
+      for ((inst, idx) <- program.zipWithIndex) {
+        dut.io.backdoor.get.memAddr.poke((baseAddr + idx * 4).U)
+        dut.io.backdoor.get.memHit.expect(true.B)
+        dut.io.backdoor.get.memData.expect(unsigned(inst))
+      }
+      dut.io.backdoor.get.memAddr.poke((baseAddr + 4096).U)
+      dut.io.backdoor.get.memHit.expect(false.B)
+
       println("=== Test Complete ===")
     }
 
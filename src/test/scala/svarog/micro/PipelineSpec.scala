@@ -7,8 +7,23 @@ import org.scalatest.flatspec.AnyFlatSpec
 import org.scalatest.matchers.should.Matchers
 import org.chipsalliance.diplomacy.lazymodule.LazyModule
 import svarog.SvarogSoC
-import svarog.config.{Cluster, ISA, Micro, SoC, TCM}
+import svarog.config.{BootROM, CacheConfig, Cluster, CoreType, Dual, ISA}
+import svarog.config.{Micro, SoC, TCM}
+import svarog.config.{
+  BimodalBranchPredictor,
+  BranchPredictorType,
+  GshareBranchPredictor,
+  NoBranchPredictor,
+  StaticBranchPredictor
+}
+import svarog.config.{
+  AreaTimingProfile,
+  BalancedTimingProfile,
+  FmaxTimingProfile,
+  TimingProfile
+}
 import svarog.VerilatorWarningSilencer
+import svarog.debug.TLChipDebugModule
 import svarog.memory.MemWidth
 
 class PipelineSpec
@@ -26,32 +41,66 @@ class PipelineSpec
   // beq x0, x0, 0 - infinite loop to prevent executing garbage after program ends
   private val infiniteLoop = 0x00000063
 
-  def runProgram(program: Seq[Int], cycles: Int = 20): Map[Int, Int] = {
+  // Where SvarogSoC maps the boot ROM
+  private val romBase = 0x00480000L
+
+  /** One entry of the SoC retire trace */
+  case class Retired(cycle: Int, pc: Long, rd: Int, value: Long)
+
+  def runProgram(
+      program: Seq[Int],
+      cycles: Int = 20,
+      mult: Boolean = false,
+      tcm: TCM = TCM(baseAddress = 0x80000000L, length = 4096L),
+      caches: Option[CacheConfig] = None,
+      numCores: Int = 1,
+      storeBufferDepth: Int = 2,
+      coreType: CoreType = Micro,
+      timingProfile: TimingProfile = AreaTimingProfile,
+      bootRom: Option[BootROM] = None,
+      branchPredictor: BranchPredictorType = NoBranchPredictor
+  ): Seq[Retired] = {
     // Append infinite loop to prevent CPU from executing garbage memory
     val safeProgram = program :+ infiniteLoop
+    // With a boot ROM the program executes in place from it
+    val romFile = bootRom.map { _ =>
+      val file = java.io.File.createTempFile("pipeline-rom", ".hex")
+      file.deleteOnExit()
+      java.nio.file.Files.writeString(
+        file.toPath,
+        safeProgram.map(word => f"$word%08x\n").mkString
+      )
+      file.getAbsolutePath
+    }
     val config = SoC(
       clusters = Seq(
         Cluster(
-          coreType = Micro,
+          coreType = coreType,
           isa = ISA(
             xlen = xlen,
-            mult = false,
-            zmmul = false,
+            mult = mult,
+            zmmul = mult,
             zicsr = false,
             zicntr = false
           ),
-          numCores = 1
+          numCores = numCores,
+          icache = caches,
+          dcache = caches,
+          storeBufferDepth = storeBufferDepth,
+          timingProfile = timingProfile,
+          branchPredictor = branchPredictor
         )
       ),
       io = Seq(),
-      memories = Seq(TCM(baseAddress = 0x80000000L, length = 4096L)),
-      simulatorDebug = true
+      memories = Seq(tcm),
+      simulatorDebug = true,
+      bootRom = bootRom.getOrElse(BootROM())
     )
 
-    var results: Map[Int, Int] = Map()
+    var results = Seq.empty[Retired]
 
     implicit val p: Parameters = Parameters.empty
-    simulate(LazyModule(new SvarogSoC(config, None)).module) { dut =>
+    simulate(LazyModule(new SvarogSoC(config, romFile)).module) { dut =>
       def tick(): Unit = dut.clock.step(1)
 
       val dbg = dut.io.debug.get
@@ -65,12 +114,13 @@ class PipelineSpec
       dbg.hart_in.bits.setPC.bits.pc.poke(0.U)
       dbg.mem_in.valid.poke(false.B)
       dbg.mem_res.ready.poke(false.B)
+      dut.io.idle.get.skip.valid.poke(false.B)
 
-      // Reset + halt
+      // Reset + halt, every hart starts from the same program
       dut.reset.poke(true.B)
       tick()
       dbg.hart_in.id.valid.poke(true.B)
-      dbg.hart_in.id.bits.poke(0.U)
+      dbg.hart_in.id.bits.poke(TLChipDebugModule.AllHarts.U)
       dbg.hart_in.bits.halt.valid.poke(true.B)
       dbg.hart_in.bits.halt.bits.poke(true.B)
       dut.reset.poke(false.B)
@@ -79,8 +129,8 @@ class PipelineSpec
 
       // Load program via debug mem interface (byte writes)
       dbg.mem_res.ready.poke(true.B)
-      val baseAddr = 0x80000000L
-      for ((inst, idx) <- safeProgram.zipWithIndex) {
+      val baseAddr = if (bootRom.isDefined) romBase else 0x80000000L
+      for ((inst, idx) <- safeProgram.zipWithIndex if bootRom.isEmpty) {
         val addr = baseAddr + (idx * 4)
         val bytes = wordToBytes(inst)
         for ((byte, byteIdx) <- bytes.zipWithIndex) {
@@ -110,12 +160,19 @@ class PipelineSpec
       dbg.hart_in.bits.halt.valid.poke(false.B)
       dbg.hart_in.id.valid.poke(false.B)
 
-      // Run a few cycles
-      for (_ <- 0 until cycles) {
+      // Run a few cycles, recording what retires, older instruction first
+      val retirePorts = dut.io.retire.toSeq ++ dut.io.retireSecond.toSeq
+      for (cycle <- 0 until cycles) {
+        for (retire <- retirePorts if retire.valid.peek().litToBoolean) {
+          results = results :+ Retired(
+            cycle,
+            retire.bits.pc.peek().litValue.toLong,
+            retire.bits.rd.peek().litValue.toInt,
+            retire.bits.rdWdata.peek().litValue.toLong
+          )
+        }
         tick()
       }
-
-      results = Map(0 -> 0) // Placeholder
     }
 
     results
@@ -198,6 +255,447 @@ class PipelineSpec
     println("Test completed without crash")
   }
 
+  it should "issue back-to-back dependent ALU ops every cycle" in {
+    // addi x1, x0, 1 followed by seven addi x1, x1, 1
+    val program = 0x00100093 +: Seq.fill(7)(0x00108093)
+
+    val retired = runProgram(program, cycles = 40)
+      .filter(_.pc < 0x80000000L + program.length * 4)
+
+    retired.map(_.value) shouldBe (1 to program.length)
+    retired.foreach(_.rd shouldBe 1)
+    // Dependent instructions retire on consecutive cycles: no hazard stalls
+    retired.map(_.cycle).sliding(2).foreach { case Seq(a, b) =>
+      (b - a) shouldBe 1
+    }
+  }
+
+  for (depth <- Seq(0, 2)) {
+    it should s"hold a consumer of back-to-back loads with a $depth-entry store buffer" in {
+      // The second load waits in Memory behind the first, and the add needs
+      // its data
+      val program = Seq(
+        0x02a00093, // addi x1, x0, 42
+        0x00700213, // addi x4, x0, 7
+        0x80000137, // lui x2, 0x80000
+        0x10112023, // sw x1, 0x100(x2)
+        0x10412223, // sw x4, 0x104(x2)
+        0x0ff0000f, // fence
+        0x10012503, // lw x10, 0x100(x2)
+        0x10412583, // lw x11, 0x104(x2)
+        0x00a58633 // add x12, x11, x10
+      )
+
+      val retired = runProgram(program, cycles = 80, storeBufferDepth = depth)
+        .filter(_.pc < 0x80000000L + program.length * 4)
+
+      retired.map(_.pc) shouldBe program.indices.map(0x80000000L + _ * 4)
+      retired.filter(_.rd == 11).map(_.value) shouldBe Seq(7L)
+      retired.filter(_.rd == 12).map(_.value) shouldBe Seq(49L)
+    }
+  }
+
+  it should "retire independent ALU pairs together on a dual core" in {
+    val program = Seq(
+      0x00100093, // addi x1, x0, 1
+      0x00200113, // addi x2, x0, 2
+      0x00300193, // addi x3, x0, 3
+      0x00400213, // addi x4, x0, 4
+      0x002082b3, // add x5, x1, x2
+      0x00418333, // add x6, x3, x4
+      0x006283b3, // add x7, x5, x6
+      0x00138413 // addi x8, x7, 1
+    )
+
+    val retired = runProgram(
+      program,
+      cycles = 200,
+      caches = Some(CacheConfig(256, 16, 2)),
+      coreType = Dual
+    ).filter(_.pc < 0x80000000L + program.length * 4)
+
+    retired.map(_.pc) shouldBe program.indices.map(0x80000000L + _ * 4)
+    retired.map(r => (r.rd, r.value)) shouldBe Seq(
+      (1, 1L),
+      (2, 2L),
+      (3, 3L),
+      (4, 4L),
+      (5, 3L),
+      (6, 7L),
+      (7, 10L),
+      (8, 11L)
+    )
+    // The first three blocks hold independent pairs; the last one does not
+    val cycles = retired.map(_.cycle)
+    for (i <- Seq(0, 2, 4)) {
+      cycles(i + 1) shouldBe cycles(i)
+    }
+    cycles(7) should be > cycles(6)
+  }
+
+  // M-extension R-type: funct7 = 1, opcode OP
+  private def mulInst(funct3: Int, rd: Int, rs1: Int, rs2: Int): Int =
+    (1 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | 0x33
+
+  it should "pipeline independent MULs and fuse MULH+MUL" in {
+    val program = Seq(
+      0x00500093, // addi x1, x0, 5
+      0x00700113, // addi x2, x0, 7
+      mulInst(0, 3, 1, 2), // mul x3, x1, x2
+      mulInst(0, 4, 1, 1), // mul x4, x1, x1
+      mulInst(0, 5, 2, 2), // mul x5, x2, x2
+      mulInst(1, 6, 1, 2), // mulh x6, x1, x2
+      mulInst(0, 7, 1, 2) // mul x7, x1, x2 (fused with the mulh)
+    )
+
+    val retired = runProgram(program, cycles = 60, mult = true)
+      .filter(_.pc < 0x80000000L + program.length * 4)
+
+    retired.map(r => (r.rd, r.value)) shouldBe Seq(
+      (1, 5L),
+      (2, 7L),
+      (3, 35L),
+      (4, 25L),
+      (5, 49L),
+      (6, 0L),
+      (7, 35L)
+    )
+    // The multiplier accepts one op per cycle, so results come out together
+    retired.drop(2).map(_.cycle).sliding(2).foreach { case Seq(a, b) =>
+      (b - a) shouldBe 1
+    }
+  }
+
+  for ((ports, banks) <- Seq((2, 1), (2, 2))) {
+    it should s"store and load through a TCM with $ports ports and $banks banks" in {
+      val program = Seq(
+        0x02a00093, // addi x1, x0, 42
+        0x80000137, // lui x2, 0x80000
+        0x10112023, // sw x1, 0x100(x2)
+        0x10012183 // lw x3, 0x100(x2)
+      )
+
+      val tcm = TCM(0x80000000L, 4096L, ports = ports, banks = banks)
+      val retired = runProgram(program, cycles = 40, tcm = tcm)
+        .filter(_.pc < 0x80000000L + program.length * 4)
+
+      retired.map(_.pc) shouldBe program.indices.map(0x80000000L + _ * 4)
+      retired.last.rd shouldBe 3
+      retired.last.value shouldBe 42L
+    }
+  }
+
+  for (
+    profile <- Seq(
+      AreaTimingProfile,
+      BalancedTimingProfile,
+      FmaxTimingProfile
+    )
+  ) {
+    it should s"run loads, a redirect and CSR accesses with the $profile" in {
+      val program = Seq(
+        0x02a00093, // addi x1, x0, 42
+        0x80000137, // lui x2, 0x80000
+        0x10112023, // sw x1, 0x100(x2)
+        0x10012183, // lw x3, 0x100(x2)
+        0x00000463, // beq x0, x0, 8
+        0x00100213, // addi x4, x0, 1 (skipped)
+        0x34019073, // csrrw x0, mscratch, x3
+        0x340022f3 // csrrs x5, mscratch, x0
+      )
+
+      val retired =
+        runProgram(program, cycles = 80, timingProfile = profile)
+          .filter(_.pc < 0x80000000L + program.length * 4)
+
+      retired.map(_.pc) shouldBe Seq(0, 1, 2, 3, 4, 6, 7)
+        .map(0x80000000L + _ * 4)
+      retired.filter(_.rd == 3).map(_.value) shouldBe Seq(42L)
+      retired.filter(_.rd == 5).map(_.value) shouldBe Seq(42L)
+    }
+  }
+
+  for (
+    profile <- Seq(
+      AreaTimingProfile,
+      BalancedTimingProfile,
+      FmaxTimingProfile
+    )
+  ) {
+    it should s"resume at the branch target after an interrupt with the $profile" in {
+      // The padding moves the cycle mstatus.MIE lands in across the taken
+      // branch and the squashed instruction behind it
+      for (padding <- 0 to 4) {
+        val handler = 14 + padding
+        val program = Seq(
+          0x00800093, // addi x1, x0, 8
+          0x3040a073, // csrrs x0, mie, x1 (MSIE)
+          0x02010137, // lui x2, 0x02010 (MSIP)
+          0x00100193, // addi x3, x0, 1
+          0x00312023, // sw x3, 0(x2)
+          0x00000297, // auipc x5, 0
+          (((handler - 5) * 4) << 20) | 0x28293, // addi x5, x5, handler
+          0x30529073, // csrrw x0, mtvec, x5
+          0x30046073 // csrrsi x0, mstatus, 8 (MIE)
+        ) ++ Seq.fill(padding)(0x00000013) ++ Seq(
+          0x00000663, // beq x0, x0, 12
+          0x00100213, // addi x4, x0, 1 (skipped)
+          0x00200213, // addi x4, x0, 2 (skipped)
+          0x02a00313, // addi x6, x0, 42
+          0x0000006f, // j .
+          // handler:
+          0x00012023, // sw x0, 0(x2)
+          0x3040b073, // csrrc x0, mie, x1
+          0x00138393, // addi x7, x7, 1
+          0x30200073 // mret
+        )
+
+        val retired =
+          runProgram(program, cycles = 200, timingProfile = profile)
+
+        withClue(s"padding $padding: ") {
+          retired.filter(_.rd == 7).map(_.value) shouldBe Seq(1L)
+          retired.filter(_.rd == 4) shouldBe empty
+          retired.filter(_.rd == 6).map(_.value) shouldBe Seq(42L)
+        }
+      }
+    }
+  }
+
+  // A 20-iteration loop, then four calls through JALR to a function that
+  // returns with JALR. A trained predictor mispredicts each loop exit, so
+  // Fetch has to recover from the wrong path.
+  private val predictorProgram = Seq(
+    0x01400093, // addi x1, x0, 20
+    0x00110113, // loop: addi x2, x2, 1
+    0xfff08093, // addi x1, x1, -1
+    0xfe009ce3, // bne x1, x0, loop
+    0x00700193, // addi x3, x0, 7
+    0x00000297, // auipc x5, 0
+    0x01c28293, // addi x5, x5, 28 (func)
+    0x00400313, // addi x6, x0, 4
+    0x000283e7, // call: jalr x7, 0(x5)
+    0xfff30313, // addi x6, x6, -1
+    0xfe031ce3, // bne x6, x0, call
+    0x00000063, // beq x0, x0, 0
+    0x00140413, // func: addi x8, x8, 1
+    0x00038067 // jalr x0, 0(x7)
+  )
+  private def predictorPC(idx: Int): Long = 0x80000000L + idx * 4
+
+  /** Cycles from each retirement of instruction `from` to the next one of
+    * `to`
+    */
+  private def retireGaps(retired: Seq[Retired], from: Int, to: Int): Seq[Int] =
+    retired.zip(retired.drop(1)).collect {
+      case (a, b) if a.pc == predictorPC(from) && b.pc == predictorPC(to) =>
+        b.cycle - a.cycle
+    }
+
+  private def predictorRun(predictor: BranchPredictorType): Seq[Retired] =
+    runProgram(predictorProgram, cycles = 500, branchPredictor = predictor)
+      .filter(_.pc != predictorPC(11))
+
+  private lazy val unpredictedRun = predictorRun(NoBranchPredictor)
+
+  for (
+    (name, predictor) <- Seq(
+      "no" -> NoBranchPredictor,
+      "static" -> StaticBranchPredictor,
+      "bimodal" -> BimodalBranchPredictor(),
+      "gshare" -> GshareBranchPredictor()
+    )
+  ) {
+    it should s"retire the right stream with the $name branch predictor" in {
+      val retired = predictorRun(predictor)
+
+      val expected = Seq(0) ++ Seq.fill(20)(Seq(1, 2, 3)).flatten ++
+        Seq(4, 5, 6, 7) ++ Seq.fill(4)(Seq(8, 12, 13, 9, 10)).flatten
+      retired.map(_.pc) shouldBe expected.map(predictorPC)
+      retired.filter(_.rd == 2).last.value shouldBe 20L
+      retired.filter(_.rd == 3).map(_.value) shouldBe Seq(7L)
+      retired.filter(_.rd == 8).map(_.value) shouldBe (1L to 4L)
+
+      if (predictor != NoBranchPredictor) {
+        // The loop branch is predicted taken once trained: the last
+        // iterations are faster than redirecting from Execute every time
+        val trained = retireGaps(retired, from = 3, to = 1).takeRight(4)
+        val untrained = retireGaps(unpredictedRun, from = 3, to = 1)
+        trained.max should be < untrained.min
+      }
+      predictor match {
+        case _: BimodalBranchPredictor | _: GshareBranchPredictor =>
+          // The BTB supplies both JALR targets after the first call
+          for ((from, to) <- Seq((8, 12), (13, 9))) {
+            val trained = retireGaps(retired, from, to).last
+            val untrained = retireGaps(unpredictedRun, from, to).min
+            withClue(s"JALR at $from: ") { trained should be < untrained }
+          }
+        case _ =>
+      }
+    }
+  }
+
+  it should "store, load and refetch after fence.i through L1 caches" in {
+    val program = Seq(
+      0x02a00093, // addi x1, x0, 42
+      0x80000137, // lui x2, 0x80000
+      0x10112023, // sw x1, 0x100(x2)
+      0x10012183, // lw x3, 0x100(x2)
+      0x0000100f, // fence.i
+      0x10012203 // lw x4, 0x100(x2)
+    )
+
+    // Four-word lines, so the program takes two I-cache refills
+    val retired =
+      runProgram(program, cycles = 200, caches = Some(CacheConfig(256, 16, 2)))
+        .filter(_.pc < 0x80000000L + program.length * 4)
+
+    retired.map(_.pc) shouldBe program.indices.map(0x80000000L + _ * 4)
+    retired.filter(_.rd == 3).map(_.value) shouldBe Seq(42L)
+    retired.filter(_.rd == 4).map(_.value) shouldBe Seq(42L)
+  }
+
+  it should "write back dirty victims and read them again through L1 caches" in {
+    // Store to 24 consecutive lines, three per set of the 8-set cache, then
+    // load them all back. Each word holds its own address.
+    val program = Seq(
+      0x80000137, // lui x2, 0x80000
+      0x40010113, // addi x2, x2, 0x400
+      0x00010193, // addi x3, x2, 0
+      0x01800093, // addi x1, x0, 24
+      0x0031a023, // store: sw x3, 0(x3)
+      0x01018193, // addi x3, x3, 16
+      0xfff08093, // addi x1, x1, -1
+      0xfe009ae3, // bne x1, x0, store
+      0x00010193, // addi x3, x2, 0
+      0x01800093, // addi x1, x0, 24
+      0x0001a303, // load: lw x6, 0(x3)
+      0x01018193, // addi x3, x3, 16
+      0xfff08093, // addi x1, x1, -1
+      0xfe009ae3 // bne x1, x0, load
+    )
+
+    val retired = runProgram(
+      program,
+      cycles = 3000,
+      caches = Some(CacheConfig(256, 16, 2))
+    )
+
+    retired.filter(_.rd == 6).map(_.value) shouldBe
+      (0 until 24).map(0x80000400L + _ * 16)
+  }
+
+  for (streams <- 0 to 2) {
+    it should s"execute in place from the boot ROM with $streams stream buffers" in {
+      // A loop that sums a .rodata word, one more .rodata load, then
+      // straight-line code. The data sits behind the closing self-loop.
+      val program = Seq(
+        0x00000117, // auipc x2, 0
+        0x00300093, // addi x1, x0, 3
+        0x02c12183, // lw x3, 44(x2)
+        0x00320233, // add x4, x4, x3
+        0xfff08093, // addi x1, x1, -1
+        0xfe009ae3, // bne x1, x0, -12
+        0x03012283, // lw x5, 48(x2)
+        0x00100313, // addi x6, x0, 1
+        0x00130313, // addi x6, x6, 1
+        0x00130313, // addi x6, x6, 1
+        0x00000063, // beq x0, x0, 0
+        0x00000011, // .word 0x11
+        0x00001234 // .word 0x1234
+      )
+
+      val retired = runProgram(
+        program,
+        cycles = 200,
+        bootRom = Some(BootROM(streams = streams))
+      ).filter(_.pc < romBase + 10 * 4)
+
+      retired.filter(_.rd == 4).map(_.value) shouldBe Seq(0x11L, 0x22L, 0x33L)
+      retired.filter(_.rd == 5).map(_.value) shouldBe Seq(0x1234L)
+      val straightLine = retired.filter(_.rd == 6)
+      straightLine.map(_.value) shouldBe Seq(1L, 2L, 3L)
+      // Fetch from ROM keeps up with the pipeline
+      straightLine.map(_.cycle).sliding(2).foreach { case Seq(a, b) =>
+        (b - a) shouldBe 1
+      }
+    }
+  }
+
+  for (depth <- Seq(0, 1, 2, 4)) {
+    it should s"forward buffered stores to loads with a $depth-entry store buffer" in {
+      // With a buffer, x3 comes entirely from buffered stores, x6 merges a
+      // buffered byte into the word read from memory and x4 reads the drain
+      val program = Seq(
+        0x02a00093, // addi x1, x0, 42
+        0x80000137, // lui x2, 0x80000
+        0x10112023, // sw x1, 0x100(x2)
+        0x07f00293, // addi x5, x0, 0x7f
+        0x105100a3, // sb x5, 0x101(x2)
+        0x10012183, // lw x3, 0x100(x2)
+        0x10112423, // sw x1, 0x108(x2)
+        0x0ff0000f, // fence
+        0x105104a3, // sb x5, 0x109(x2)
+        0x10812303, // lw x6, 0x108(x2)
+        0x0ff0000f, // fence
+        0x10012203 // lw x4, 0x100(x2)
+      )
+
+      val retired = runProgram(program, cycles = 80, storeBufferDepth = depth)
+        .filter(_.pc < 0x80000000L + program.length * 4)
+
+      retired.map(_.pc) shouldBe program.indices.map(0x80000000L + _ * 4)
+      for (rd <- Seq(3, 4, 6)) {
+        retired.filter(_.rd == rd).map(_.value) shouldBe Seq(0x7f2aL)
+      }
+    }
+  }
+
+  it should "run two harts that see their own mhartid and shared TCM" in {
+    val program = Seq(
+      0xf14020f3, // csrrs x1, mhartid, x0
+      0x80000137, // lui x2, 0x80000
+      0x00209193, // slli x3, x1, 2
+      0x002181b3, // add x3, x3, x2
+      0x00708213, // addi x4, x1, 7
+      0x1041a023, // sw x4, 0x100(x3)
+      0x00800313, // addi x6, x0, 8
+      0x10412283, // lw x5, 0x104(x2)
+      0xfe629ee3 // bne x5, x6, -4 (wait for hart 1)
+    )
+
+    val retired = runProgram(program, cycles = 200, numCores = 2)
+      .filter(_.pc < 0x80000000L + program.length * 4)
+
+    // The retire trace follows hart 0
+    retired.head.rd shouldBe 1
+    retired.head.value shouldBe 0L
+    retired.filter(_.rd == 4).map(_.value) shouldBe Seq(7L)
+    retired.filter(_.rd == 5).last.value shouldBe 8L
+  }
+
+  it should "hold wfi until an enabled interrupt is pending" in {
+    val asleep = Seq(
+      0x10500073, // wfi
+      0x02a00213 // addi x4, x0, 42
+    )
+    runProgram(asleep, cycles = 60).filter(_.rd == 4) shouldBe empty
+
+    // mstatus.MIE stays clear, so the wakeup falls through without a trap
+    val woken = Seq(
+      0x00800093, // addi x1, x0, 8
+      0x3040a073, // csrrs x0, mie, x1 (MSIE)
+      0x02010137, // lui x2, 0x02010 (MSIP)
+      0x00100193, // addi x3, x0, 1
+      0x00312023, // sw x3, 0(x2)
+      0x10500073, // wfi
+      0x02a00213 // addi x4, x0, 42
+    )
+    runProgram(woken, cycles = 100).filter(_.rd == 4).map(_.value) shouldBe
+      Seq(42L)
+  }
+
   it should "execute CSRRS to read mvendorid (read-only CSR)" in {
     // csrrs x1, mvendorid, x0  - Read mvendorid into x1
     // mvendorid = 0xf11, funct3 = 0b010 (CSRRS)
@@ -0,0 +1,287 @@
+//! CoreMark benchmark
+//!
+//! Builds benchmarks/coremark for every model, runs it with the console UART
+//! captured and reports CoreMark/MHz and CPI from the port's mcycle and
+//! minstret readings. Results are written to target/benchmarks/coremark.json
+//! and compared against a stored baseline.
+//!
+//! Multi-hart models run one CoreMark context per hart, so their
+//! CoreMark/MHz counts the iterations of every hart and shows how the
+//! cluster scales. CPI stays hart 0's.
+//!
+//! ```text
+//! cargo bench --bench coremark [-- MODEL...]
+//! ```
+//!
+//! - `SVAROG_COREMARK_ITERATIONS`: CoreMark iterations per hart (default 10)
+//! - `SVAROG_COREMARK_BASELINE`: baseline file (default
+//!   benchmarks/coremark/baseline.json)
+//! - `SVAROG_COREMARK_TOLERANCE`: allowed CoreMark/MHz drop in percent
+//!   (default 0.5)
+//! - `SVAROG_COREMARK_SAVE_BASELINE=1`: write the results as the new baseline
+//! - `SVAROG_MAX_CYCLES`: simulation timeout per model
+
+use anyhow::{Context, Result};
+use serde::{Deserialize, Serialize};
+use std::collections::HashMap;
+use std::path::{Path, PathBuf};
+use testbench::{Backend, Simulator};
+
+const WORKSPACE_PATH: &str = concat!(env!("CARGO_MANIFEST_DIR"), "/..");
+
+#[derive(Serialize, Deserialize, Debug, Clone)]
+struct CoremarkResult {
+    model: String,
+    harts: u32,
+    /// Iterations of every hart together
+    iterations: u64,
+    cycles: u64,
+    instret: u64,
+    coremark_per_mhz: f64,
+    cpi: f64,
+    seedcrc: u32,
+    /// One CRC per context
+    crclist: Vec<u32>,
+    crcmatrix: Vec<u32>,
+    crcstate: Vec<u32>,
+    crcfinal: Vec<u32>,
+}
+
+fn main() -> Result<()> {
+    let iterations: u64 = env_or("SVAROG_COREMARK_ITERATIONS", 10);
+    let tolerance: f64 = env_or("SVAROG_COREMARK_TOLERANCE", 0.5);
+    let max_cycles: usize = env_or("SVAROG_MAX_CYCLES", 200_000_000);
+    let baseline_path = std::env::var("SVAROG_COREMARK_BASELINE")
+        .map(PathBuf::from)
+        .unwrap_or_else(|_| Path::new(WORKSPACE_PATH).join("benchmarks/coremark/baseline.json"));
+    let save_baseline = std::env::var("SVAROG_COREMARK_SAVE_BASELINE").is_ok_and(|v| v == "1");
+
+    // cargo passes --bench; anything else selects models
+    let filters: Vec<String> = std::env::args()
+        .skip(1)
+        .filter(|arg| !arg.starts_with("--"))
+        .collect();
+    let models: Vec<&str> = Simulator::available_models(Backend::Verilator)
+        .iter()
+        .copied()
+        .filter(|model| filters.is_empty() || filters.iter().any(|f| model.contains(f.as_str())))
+        .collect();
+
+    let mut results = Vec::new();
+    for model in models {
+        let (elf, harts) = build_coremark(model, iterations)
+            .with_context(|| format!("Failed to build CoreMark for {model}"))?;
+        let result = run_coremark(model, &elf, iterations, harts, max_cycles)
+            .with_context(|| format!("CoreMark failed on {model}"))?;
+        results.push(result);
+    }
+
+    let output_dir = Path::new(WORKSPACE_PATH).join("target/benchmarks");
+    std::fs::create_dir_all(&output_dir)?;
+    let output_path = output_dir.join("coremark.json");
+    std::fs::write(&output_path, serde_json::to_string_pretty(&results)?)?;
+    println!("Results written to {}", output_path.display());
+
+    if save_baseline {
+        std::fs::write(&baseline_path, serde_json::to_string_pretty(&results)?)?;
+        println!("Baseline written to {}", baseline_path.display());
+        report(&results, &HashMap::new());
+        return Ok(());
+    }
+
+    let baseline: HashMap<String, CoremarkResult> = if baseline_path.exists() {
+        let text = std::fs::read_to_string(&baseline_path)?;
+        let entries: Vec<CoremarkResult> = serde_json::from_str(&text)
+            .with_context(|| format!("Invalid baseline {}", baseline_path.display()))?;
+        entries.into_iter().map(|r| (r.model.clone(), r)).collect()
+    } else {
+        println!("No baseline at {}", baseline_path.display());
+        HashMap::new()
+    };
+
+    report(&results, &baseline);
+
+    let regressions: Vec<String> = results
+        .iter()
+        .filter_map(|result| check_regression(result, baseline.get(&result.model)?, tolerance))
+        .collect();
+    if !regressions.is_empty() {
+        anyhow::bail!("CoreMark regressed:\n{}", regressions.join("\n"));
+    }
+    Ok(())
+}
+
+fn env_or<T: std::str::FromStr>(name: &str, default: T) -> T {
+    std::env::var(name)
+        .ok()
+        .and_then(|val| val.parse().ok())
+        .unwrap_or(default)
+}
+
+/// Build CoreMark with the model's ISA and one context per hart, returning
+/// the ELF path and the number of harts.
+fn build_coremark(model: &str, iterations: u64) -> Result<(PathBuf, u32)> {
+    let workspace = Path::new(WORKSPACE_PATH);
+    let config = simtools::Config::from_file(&workspace.join(format!("configs/{model}.yaml")))?;
+    let march = config
+        .isa()
+        .ok_or_else(|| anyhow::anyhow!("Model {model} has no cluster"))?
+        .to_owned();
+
+    let output_path = workspace.join(format!("target/benchmarks/coremark/{model}"));
+    let harts = config.num_harts();
+    let build_dir = simtools::build_coremark(workspace, &march, iterations, harts, &output_path)?;
+    Ok((build_dir.join("coremark.elf"), harts))
+}
+
+fn run_coremark(
+    model: &str,
+    elf: &Path,
+    iterations: u64,
+    harts: u32,
+    max_cycles: usize,
+) -> Result<CoremarkResult> {
+    let simulator = Simulator::new(Backend::Verilator, model)
+        .map_err(|e| anyhow::anyhow!("Failed to create simulator: {}", e))?;
+    simulator.enable_uart_console(0);
+    simulator.capture_uart_console();
+
+    // crt0.S stores to tohost once main returns
+    simulator
+        .load_binary_fast(elf, Some("tohost"))
+        .context("Failed to load binary")?
+        .ok_or_else(|| anyhow::anyhow!("CoreMark image has no tohost symbol"))?;
+
+    println!("Running CoreMark ({iterations} iterations on {harts} harts) on {model}...");
+    simulator
+        .run(None, max_cycles)
+        .context("Simulation failed")?;
+    let output = String::from_utf8_lossy(&simulator.take_uart_console_output()).into_owned();
+
+    parse_output(model, harts, &output).with_context(|| format!("CoreMark output:\n{output}"))
+}
+
+/// Pull the score and CRCs out of CoreMark's report.
+///
+/// A simulated run never lasts the 10 seconds CoreMark asks for, so it
+/// always ends in "Errors detected". Only CRC mismatches count as failures.
+fn parse_output(model: &str, harts: u32, output: &str) -> Result<CoremarkResult> {
+    if output.contains("should be") {
+        anyhow::bail!("CoreMark CRC validation failed");
+    }
+    if output.contains("Cannot validate") {
+        anyhow::bail!("CoreMark ran with unknown seeds");
+    }
+
+    let fields: HashMap<&str, &str> = output
+        .lines()
+        .filter_map(|line| line.split_once(':'))
+        .map(|(key, value)| (key.trim(), value.trim()))
+        .collect();
+    let field = |key: &str| {
+        fields
+            .get(key)
+            .copied()
+            .ok_or_else(|| anyhow::anyhow!("Missing \"{key}\", the run did not finish"))
+    };
+    let number = |key: &str| -> Result<u64> {
+        field(key)?
+            .parse()
+            .with_context(|| format!("Invalid \"{key}\""))
+    };
+    let crc = |key: &str| -> Result<u32> {
+        let value = field(key)?;
+        u32::from_str_radix(value.trim_start_matches("0x"), 16)
+            .with_context(|| format!("Invalid \"{key}\""))
+    };
+    // CoreMark prints "[N]crcfinal" and friends once per context
+    let crcs = |name: &str| -> Result<Vec<u32>> {
+        (0..harts).map(|i| crc(&format!("[{i}]{name}"))).collect()
+    };
+
+    let cycles = number("CoreMark cycle count")?;
+    let instret = number("CoreMark instret count")?;
+    let iterations = number("Iterations")?;
+    if cycles == 0 || instret == 0 {
+        anyhow::bail!("CoreMark reported no cycles or instructions");
+    }
+
+    Ok(CoremarkResult {
+        model: model.to_owned(),
+        harts,
+        iterations,
+        cycles,
+        instret,
+        coremark_per_mhz: iterations as f64 * 1e6 / cycles as f64,
+        cpi: cycles as f64 / instret as f64,
+        seedcrc: crc("seedcrc")?,
+        crclist: crcs("crclist")?,
+        crcmatrix: crcs("crcmatrix")?,
+        crcstate: crcs("crcstate")?,
+        crcfinal: crcs("crcfinal")?,
+    })
+}
+
+fn report(results: &[CoremarkResult], baseline: &HashMap<String, CoremarkResult>) {
+    println!(
+        "\n{:<20} {:>5} {:>10} {:>14} {:>8} {:>12}",
+        "model", "harts", "iterations", "CoreMark/MHz", "CPI", "vs baseline"
+    );
+    for result in results {
+        let delta = match baseline.get(&result.model) {
+            Some(base) if comparable(result, base) => format!(
+                "{:+.2}%",
+                (result.coremark_per_mhz / base.coremark_per_mhz - 1.0) * 100.0
+            ),
+            _ => "-".to_owned(),
+        };
+        println!(
+            "{:<20} {:>5} {:>10} {:>14.4} {:>8.4} {:>12}",
+            result.model,
+            result.harts,
+            result.iterations,
+            result.coremark_per_mhz,
+            result.cpi,
+            delta
+        );
+    }
+}
+
+/// Baselines taken at a different iteration or hart count are not comparable.
+fn comparable(result: &CoremarkResult, baseline: &CoremarkResult) -> bool {
+    baseline.iterations == result.iterations && baseline.harts == result.harts
+}
+
+/// Describe how `result` regressed from `baseline`, if it did. Baselines that
+/// are not [`comparable`] are skipped.
+fn check_regression(
+    result: &CoremarkResult,
+    baseline: &CoremarkResult,
+    tolerance: f64,
+) -> Option<String> {
+    if !comparable(result, baseline) {
+        return None;
+    }
+    let crcs = |r: &CoremarkResult| {
+        (
+            r.seedcrc,
+            r.crclist.clone(),
+            r.crcmatrix.clone(),
+            r.crcstate.clone(),
+            r.crcfinal.clone(),
+        )
+    };
+    if crcs(result) != crcs(baseline) {
+        return Some(format!(
+            "{}: CRCs changed (crcfinal {:04x?}, baseline {:04x?})",
+            result.model, result.crcfinal, baseline.crcfinal
+        ));
+    }
+    let floor = baseline.coremark_per_mhz * (1.0 - tolerance / 100.0);
+    (result.coremark_per_mhz < floor).then(|| {
+        format!(
+            "{}: {:.4} CoreMark/MHz, baseline {:.4} (tolerance {}%)",
+            result.model, result.coremark_per_mhz, baseline.coremark_per_mhz, tolerance
+        )
+    })
+}
@@ -0,0 +1,130 @@
+//! Simulation speed benchmark
+//!
+//! Runs CoreMark on every model and reports how fast the Verilated model
+//! simulates, in kHz of simulated clock. The models are built with whatever
+//! profile `SVAROG_VERILATOR_PROFILE` or the config selects, so compare
+//! profiles by running the bench once per profile:
+//!
+//! ```text
+//! SVAROG_VERILATOR_PROFILE=trace cargo bench --bench sim-speed
+//! SVAROG_VERILATOR_PROFILE=fast cargo bench --bench sim-speed
+//! ```
+//!
+//! Results are written to target/benchmarks/sim-speed-<profile>.json.
+//!
+//! - `SVAROG_SIM_SPEED_ITERATIONS`: CoreMark iterations (default 2)
+//! - `SVAROG_MAX_CYCLES`: simulation timeout per model
+
+use anyhow::{Context, Result};
+use serde::Serialize;
+use std::path::{Path, PathBuf};
+use std::time::Instant;
+use testbench::{Backend, Simulator};
+
+const WORKSPACE_PATH: &str = concat!(env!("CARGO_MANIFEST_DIR"), "/..");
+
+#[derive(Serialize, Debug)]
+struct SpeedResult {
+    model: String,
+    profile: String,
+    cycles: u64,
+    seconds: f64,
+    khz: f64,
+}
+
+fn main() -> Result<()> {
+    let iterations: u64 = env_or("SVAROG_SIM_SPEED_ITERATIONS", 2);
+    let max_cycles: usize = env_or("SVAROG_MAX_CYCLES", 200_000_000);
+
+    // cargo passes --bench; anything else selects models
+    let filters: Vec<String> = std::env::args()
+        .skip(1)
+        .filter(|arg| !arg.starts_with("--"))
+        .collect();
+    let models: Vec<&str> = Simulator::available_models(Backend::Verilator)
+        .iter()
+        .copied()
+        .filter(|model| filters.is_empty() || filters.iter().any(|f| model.contains(f.as_str())))
+        .collect();
+
+    let mut results = Vec::new();
+    for model in models {
+        let result = measure(model, iterations, max_cycles)
+            .with_context(|| format!("Speed run failed on {model}"))?;
+        results.push(result);
+    }
+
+    println!(
+        "\n{:<20} {:>8} {:>12} {:>10} {:>10}",
+        "model", "profile", "cycles", "seconds", "kHz"
+    );
+    for result in &results {
+        println!(
+            "{:<20} {:>8} {:>12} {:>10.2} {:>10.1}",
+            result.model, result.profile, result.cycles, result.seconds, result.khz
+        );
+    }
+
+    // Every model in one build shares the profile unless a config pins its own
+    let profile = match results.first() {
+        Some(first) if results.iter().all(|r| r.profile == first.profile) => first.profile.clone(),
+        Some(_) => "mixed".to_owned(),
+        None => return Ok(()),
+    };
+    let output_dir = Path::new(WORKSPACE_PATH).join("target/benchmarks");
+    std::fs::create_dir_all(&output_dir)?;
+    let output_path = output_dir.join(format!("sim-speed-{profile}.json"));
+    std::fs::write(&output_path, serde_json::to_string_pretty(&results)?)?;
+    println!("Results written to {}", output_path.display());
+    Ok(())
+}
+
+fn env_or<T: std::str::FromStr>(name: &str, default: T) -> T {
+    std::env::var(name)
+        .ok()
+        .and_then(|val| val.parse().ok())
+        .unwrap_or(default)
+}
+
+fn build_coremark(simulator: &Simulator, model: &str, iterations: u64) -> Result<PathBuf> {
+    let workspace = Path::new(WORKSPACE_PATH);
+    let output_path = workspace.join(format!("target/benchmarks/sim-speed/{model}"));
+    let build_dir =
+        simtools::build_coremark(workspace, simulator.isa(), iterations, 1, &output_path)?;
+    Ok(build_dir.join("coremark.elf"))
+}
+
+fn measure(model: &str, iterations: u64, max_cycles: usize) -> Result<SpeedResult> {
+    let simulator = Simulator::new(Backend::Verilator, model)
+        .map_err(|e| anyhow::anyhow!("Failed to create simulator: {}", e))?;
+    let elf = build_coremark(&simulator, model, iterations)
+        .with_context(|| format!("Failed to build CoreMark for {model}"))?;
+    // Skipped idle cycles would count as simulated without costing anything
+    simulator.set_idle_skip(false);
+    // Keep the console out of the measurement, only the model's speed counts
+    simulator.enable_uart_console(0);
+    simulator.capture_uart_console();
+    simulator
+        .load_binary_fast(&elf, Some("tohost"))
+        .context("Failed to load binary")?
+        .ok_or_else(|| anyhow::anyhow!("CoreMark image has no tohost symbol"))?;
+
+    println!(
+        "Running CoreMark on {model} ({} profile)...",
+        simulator.build_profile()
+    );
+    let mut cycles = 0;
+    let start = Instant::now();
+    simulator
+        .run_with_entry_point_and_progress(None, max_cycles, 0x80000000, |cycle| cycles = cycle)
+        .context("Simulation failed")?;
+    let seconds = start.elapsed().as_secs_f64();
+
+    Ok(SpeedResult {
+        model: model.to_owned(),
+        profile: simulator.build_profile().to_owned(),
+        cycles: cycles as u64,
+        seconds,
+        khz: cycles as f64 / seconds / 1e3,
+    })
+}
@@ -133,7 +133,11 @@ fn build_riscv_arch_tests(sh: &Shell, riscv_arch_dir: &Path) -> Result<()> {
     // Write back the patched file
     std::fs::write(&arch_header, patched_content).context("Failed to write patched arch_test.h")?;
 
-    let suites = [("I", "rv32i_zicsr"), ("M", "rv32im_zicsr")];
+    let suites = [
+        ("I", "rv32i_zicsr"),
+        ("M", "rv32im_zicsr"),
+        ("B", "rv32i_zicsr_zba_zbb"),
+    ];
     for (suite, march) in suites {
         let src_dir = suite_dir.join(format!("rv32i_m/{suite}/src"));
         let out_dir = riscv_arch_dir.join(format!("rv32i_m/{suite}"));
@@ -147,6 +151,9 @@ fn build_riscv_arch_tests(sh: &Shell, riscv_arch_dir: &Path) -> Result<()> {
             }
 
             let test_name = path.file_stem().unwrap().to_str().unwrap();
+            if suite == "B" && !is_zba_zbb_test(test_name) {
+                continue;
+            }
             let output_elf = out_dir.join(format!("{test_name}.elf"));
 
             cmd!(
@@ -160,3 +167,15 @@ fn build_riscv_arch_tests(sh: &Shell, riscv_arch_dir: &Path) -> Result<()> {
 
     Ok(())
 }
+
+/// The B suite also covers Zbc and Zbs, which the core does not implement.
+fn is_zba_zbb_test(test_name: &str) -> bool {
+    const ZBA_ZBB: &[&str] = &[
+        "sh1add", "sh2add", "sh3add", "andn", "orn", "xnor", "clz", "ctz", "cpop", "max", "maxu",
+        "min", "minu", "sext.b", "sext.h", "zext.h", "rol", "ror", "rori", "orc.b", "rev8",
+    ];
+    // Test names look like `rev8_32-01` or `andn-01`
+    let mnemonic = test_name.split('-').next().unwrap_or(test_name);
+    let mnemonic = mnemonic.strip_suffix("_32").unwrap_or(mnemonic);
+    ZBA_ZBB.contains(&mnemonic)
+}
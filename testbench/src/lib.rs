@@ -1,71 +1,76 @@
-use std::{
-    io::{BufRead, BufReader},
-    path::Path,
-    process::{Command, Stdio},
-};
+use std::path::Path;
 
 use anyhow::{Context, Result};
 
+mod spike;
+use spike::SpikeCommit;
+
 // Re-export simulator types
-pub use simulator::{Backend, RegisterFile, Simulator, TestResult};
+pub use simulator::{Backend, RegisterFile, Retirement, Simulator, TestResult, elf_symbol};
+
+const WORKSPACE_PATH: &str = concat!(env!("CARGO_MANIFEST_DIR"), "/..");
+
+/// Every single-hart model on every backend the ISA suites check against
+/// Spike. The functional model is covered too, since fast-forward hands its
+/// state to the RTL.
+pub fn test_backends() -> impl Iterator<Item = (Backend, &'static str)> {
+    [Backend::Verilator, Backend::Functional]
+        .into_iter()
+        .flat_map(|backend| {
+            single_hart_models(backend).map(move |model_name| (backend, model_name))
+        })
+}
+
+/// Models of `backend` with one hart. The ISA suites start every hart at the
+/// same ELF, and their environments are not hart-aware, so on a multi-hart
+/// model the harts would race on the test's data.
+pub fn single_hart_models(backend: Backend) -> impl Iterator<Item = &'static str> {
+    Simulator::available_models(backend)
+        .iter()
+        .copied()
+        .filter(|model_name| num_harts(model_name).is_ok_and(|harts| harts == 1))
+}
+
+/// Harts across every cluster of `model_name`, from its config.
+pub fn num_harts(model_name: &str) -> Result<u32> {
+    let path = Path::new(WORKSPACE_PATH).join(format!("configs/{model_name}.yaml"));
+    let config = simtools::Config::from_file(&path)
+        .with_context(|| format!("Failed to read {}", path.display()))?;
+    Ok(config.num_harts())
+}
 
-/// Run test in Spike and return register state
+/// Test name prefix for `model_name` on `backend`. RTL tests keep the bare
+/// model name.
+pub fn test_prefix(backend: Backend, model_name: &str) -> String {
+    match backend {
+        Backend::Verilator => model_name.to_owned(),
+        _ => format!("{}::{}", backend.name(), model_name),
+    }
+}
+
+/// Run test in Spike and return its register state once it stores to
+/// `watchpoint_addr`, or when it finishes if there is no watchpoint.
 pub fn run_spike_test(
     elf_path: &Path,
     watchpoint_addr: Option<u32>,
     isa: &str,
 ) -> Result<TestResult> {
-    let mut child = Command::new("spike")
-        .arg(format!("--isa={isa}"))
-        .args(["-l", "--log-commits"])
-        .arg(elf_path)
-        .stdout(Stdio::null())
-        .stderr(Stdio::piped())
-        .spawn()
-        .context("Failed to run spike")?;
-
-    let stderr = child
-        .stderr
-        .take()
-        .ok_or_else(|| anyhow::anyhow!("Failed to capture spike stderr"))?;
-    let reader = BufReader::new(stderr);
     let mut regs = RegisterFile::new();
-
-    let mut lines_seen = 0usize;
     let mut hit_watchpoint = false;
-    for line in reader.lines() {
-        let line = line?;
-        lines_seen += 1;
-        if let Some(reg_write) = parse_spike_reg_write(&line) {
-            regs.set(reg_write.0, reg_write.1);
+    for commit in spike::commits(elf_path, isa)? {
+        if let Some((reg, value)) = commit.rd {
+            regs.set(reg, value as u32);
         }
-
-        if let Some(addr) = parse_spike_mem_write(&line) {
-            if Some(addr) == watchpoint_addr {
-                // Test reached tohost; stop spike execution.
-                let _ = child.kill();
+        if let Some((addr, Some(_))) = commit.mem {
+            if Some(addr as u32) == watchpoint_addr {
                 hit_watchpoint = true;
                 break;
             }
         }
-
-        if lines_seen > 1_000_000 {
-            let _ = child.kill();
-            anyhow::bail!(
-                "Spike did not reach tohost (addr=0x{:08x}) within log limit",
-                watchpoint_addr.unwrap_or(0)
-            );
-        }
     }
 
-    // Wait for spike to exit (ignore errors)
-    let _ = child.wait();
-
-    if watchpoint_addr.is_some() && !hit_watchpoint {
-        anyhow::bail!(
-            "Spike terminated without hitting tohost (addr=0x{:08x})",
-            watchpoint_addr.unwrap()
-        );
+    if let Some(addr) = watchpoint_addr.filter(|_| !hit_watchpoint) {
+        anyhow::bail!("Spike terminated without hitting tohost (addr=0x{addr:08x})");
     }
 
     Ok(TestResult {
@@ -74,61 +79,201 @@ pub fn run_spike_test(
     })
 }
 
-/// Parse a single spike register write line
-/// Returns (register_index, value) if successful
-fn parse_spike_reg_write(line: &str) -> Option<(u8, u32)> {
-    let parts: Vec<&str> = line.split_whitespace().collect();
-    let mut i = 0;
-
-    while i < parts.len() {
-        let part = parts[i];
-
-        // Case 1: token is exactly "x" and next token is the register number
-        if part == "x" && i + 2 < parts.len() {
-            if let (Ok(reg_num), Some(value)) =
-                (parts[i + 1].parse::<u8>(), parse_hex(parts[i + 2]))
-            {
-                return Some((reg_num, value));
+/// Checks instructions retired by the simulator against Spike's commit log
+/// as they happen, so a divergence is reported at the first instruction that
+/// disagrees instead of at the end of the run.
+///
+/// Feed it from [`Simulator::set_retire_sink`].
+pub struct SpikeLockstep {
+    commits: std::vec::IntoIter<SpikeCommit>,
+    xlen_mask: u64,
+    /// Commit read ahead of time that no DUT retirement has consumed yet.
+    peeked: Option<SpikeCommit>,
+    /// Whether Spike has left its boot ROM and reached the DUT's first PC.
+    synced: bool,
+    regs: RegisterFile,
+    checked: u64,
+}
+
+impl SpikeLockstep {
+    /// Replays Spike's commits for `elf_path`, running Spike only if they
+    /// are not cached yet.
+    pub fn spawn(elf_path: &Path, isa: &str) -> Result<Self> {
+        let commits = spike::commits(elf_path, isa)?;
+        let xlen_mask = if isa.to_ascii_lowercase().starts_with("rv64") {
+            u64::MAX
+        } else {
+            0xffff_ffff
+        };
+
+        Ok(SpikeLockstep {
+            commits: commits.into_iter(),
+            xlen_mask,
+            peeked: None,
+            synced: false,
+            regs: RegisterFile::new(),
+            checked: 0,
+        })
+    }
+
+    /// Compare one retired instruction with the next one Spike commits.
+    pub fn check(&mut self, dut: &Retirement) -> Result<()> {
+        let spike = loop {
+            let commit = self.peek_commit().ok_or_else(|| {
+                anyhow::anyhow!(
+                    "Spike stopped before the DUT retired pc=0x{:08x} (after {} matching instructions)",
+                    dut.pc,
+                    self.checked
+                )
+            })?;
+            // Skip Spike's boot ROM until it jumps to where the DUT starts.
+            if self.synced || commit.pc == dut.pc & self.xlen_mask {
+                break commit;
             }
+            self.take_commit();
+        };
+        self.synced = true;
+
+        // Spike does not log instructions that trap, the DUT retires them.
+        if spike.pc != dut.pc & self.xlen_mask && is_trap_instruction(dut.inst) {
+            return Ok(());
         }
 
-        // Case 2: token looks like "x5"
-        if let Some(reg_str) = part.strip_prefix('x') {
-            if let (Ok(reg_num), Some(value)) = (
-                reg_str.parse::<u8>(),
-                parts.get(i + 1).and_then(|token| parse_hex(token)),
-            ) {
-                return Some((reg_num, value));
+        if let Err(mismatch) = self.compare(dut, &spike) {
+            anyhow::bail!(
+                "Lock-step mismatch after {} matching instructions: {}\n  dut:   pc=0x{:08x} inst=0x{:08x} rd=x{} data=0x{:08x} mem={}\n  spike: pc=0x{:08x} inst=0x{:08x} {:?} mem={:?}",
+                self.checked,
+                mismatch,
+                dut.pc,
+                dut.inst,
+                dut.rd,
+                dut.rd_wdata,
+                match (dut.mem_valid, dut.mem_write) {
+                    (false, _) => "none".to_string(),
+                    (true, false) => format!("load 0x{:08x}", dut.mem_addr),
+                    (true, true) => format!("store 0x{:08x} 0x{:08x}", dut.mem_addr, dut.mem_wdata),
+                },
+                spike.pc,
+                spike.inst,
+                spike.rd,
+                spike.mem
+            );
+        }
+
+        self.take_commit();
+        self.checked += 1;
+        Ok(())
+    }
+
+    /// Spike's register file after the last instruction that was checked.
+    pub fn result(&self) -> TestResult {
+        TestResult {
+            regs: self.regs.clone(),
+            exit_code: None,
+        }
+    }
+
+    fn compare(&self, dut: &Retirement, spike: &SpikeCommit) -> Result<(), &'static str> {
+        let mask = self.xlen_mask;
+        if dut.pc & mask != spike.pc || dut.inst != spike.inst {
+            return Err("different instruction");
+        }
+
+        let dut_rd = (dut.rd != 0).then_some((dut.rd, dut.rd_wdata & mask));
+        if dut_rd != spike.rd {
+            return Err("different register write");
+        }
+
+        match spike.mem {
+            None if dut.mem_valid => return Err("unexpected memory access"),
+            None => {}
+            Some((addr, data)) => {
+                if !dut.mem_valid || dut.mem_write != data.is_some() || dut.mem_addr & mask != addr
+                {
+                    return Err("different memory access");
+                }
+                let width_mask = match (dut.inst >> 12) & 0x3 {
+                    0 => 0xff,
+                    1 => 0xffff,
+                    2 => 0xffff_ffff,
+                    _ => u64::MAX,
+                };
+                if data.is_some_and(|data| data & width_mask != dut.mem_wdata & width_mask) {
+                    return Err("different store data");
+                }
             }
         }
 
-        i += 1;
+        Ok(())
     }
 
-    None
-}
+    fn peek_commit(&mut self) -> Option<SpikeCommit> {
+        if self.peeked.is_none() {
+            self.peeked = self.commits.next();
+        }
+        self.peeked
+    }
 
-fn parse_hex(token: &str) -> Option<u32> {
-    let trimmed = token
-        .trim_start_matches('(')
-        .trim_end_matches(')')
-        .trim_start_matches("0x");
-    if trimmed.is_empty() {
-        return None;
+    fn take_commit(&mut self) {
+        if let Some(SpikeCommit {
+            rd: Some((reg, value)),
+            ..
+        }) = self.peeked.take()
+        {
+            self.regs.set(reg, value as u32);
+        }
     }
-    u32::from_str_radix(trimmed, 16).ok()
 }
 
-fn parse_spike_mem_write(line: &str) -> Option<u32> {
-    let parts: Vec<&str> = line.split_whitespace().collect();
-    for i in 0..parts.len() {
-        if parts[i] == "mem" && i + 2 < parts.len() {
-            if let Some(addr) = parse_hex(parts[i + 1]) {
-                return Some(addr);
-            }
-        }
+fn is_trap_instruction(inst: u32) -> bool {
+    inst == 0x0000_0073 || inst == 0x0010_0073 // ecall, ebreak
+}
+
+/// Run `elf_path` to completion in Spike and return the memory signature
+/// between `begin_signature` and `end_signature`, one word per entry. A copy
+/// of Spike's signature file is left at `signature_path`.
+pub fn run_spike_signature(elf_path: &Path, isa: &str, signature_path: &Path) -> Result<Vec<u32>> {
+    let text = spike::signature(elf_path, isa, signature_path)?;
+    text.lines()
+        .filter(|line| !line.trim().is_empty())
+        .map(|line| {
+            u32::from_str_radix(line.trim(), 16)
+                .with_context(|| format!("Invalid signature line {line:?}"))
+        })
+        .collect()
+}
+
+/// Compare a memory signature read from the simulator with Spike's.
+pub fn compare_signatures(verilator: &[u32], spike: &[u32]) -> Result<()> {
+    if verilator.len() != spike.len() {
+        anyhow::bail!(
+            "Signature lengths differ: verilator={} words, spike={} words",
+            verilator.len(),
+            spike.len()
+        );
     }
-    None
+
+    let mismatches: Vec<String> = verilator
+        .iter()
+        .zip(spike)
+        .enumerate()
+        .filter(|(_, (v, s))| v != s)
+        .map(|(i, (v, s))| format!("word {i}: verilator=0x{v:08x}, spike=0x{s:08x}"))
+        .collect();
+    if !mismatches.is_empty() {
+        anyhow::bail!(
+            "{} of {} signature words differ:\n{}",
+            mismatches.len(),
+            spike.len(),
+            mismatches
+                .iter()
+                .take(16)
+                .cloned()
+                .collect::<Vec<_>>()
+                .join("\n")
+        );
+    }
+    Ok(())
 }
 
 /// Compare Verilator and Spike results
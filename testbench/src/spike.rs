@@ -0,0 +1,301 @@
+//! Spike reference runs, memoized on disk.
+//!
+//! Spike's behaviour on a binary never changes, so its commit trace and
+//! signature are recorded once and replayed afterwards. Entries are keyed on
+//! the ELF contents, the ISA string and the Spike executable itself, so a
+//! rebuilt test or an upgraded Spike misses the cache instead of reusing
+//! stale results. The cache lives in `SVAROG_SPIKE_CACHE`, or
+//! `target/spike-cache` by default, and can be deleted at any time.
+
+use std::{
+    io::{BufRead, BufReader},
+    path::{Path, PathBuf},
+    process::{Command, Stdio},
+    sync::{
+        OnceLock,
+        atomic::{AtomicU64, Ordering},
+    },
+};
+
+use anyhow::{Context, Result};
+use simtools::{FNV_OFFSET, fnv1a};
+
+const DEFAULT_CACHE_DIR: &str = concat!(env!("CARGO_MANIFEST_DIR"), "/../target/spike-cache");
+
+/// Bump when the entry format changes.
+const CACHE_FORMAT: u32 = 1;
+
+/// Longest trace recorded; a test that runs past this is killed and fails.
+const MAX_COMMITS: usize = 1_000_000;
+
+/// pc, inst, flags, rd, rd value, mem address, mem data
+const RECORD_BYTES: usize = 8 + 4 + 1 + 1 + 8 + 8 + 8;
+const HAS_RD: u8 = 1;
+const HAS_MEM: u8 = 2;
+const HAS_MEM_DATA: u8 = 4;
+
+/// One instruction as logged by `spike --log-commits`.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub(crate) struct SpikeCommit {
+    pub pc: u64,
+    pub inst: u32,
+    pub rd: Option<(u8, u64)>,
+    /// Address, plus the data for stores.
+    pub mem: Option<(u64, Option<u64>)>,
+}
+
+/// Every instruction Spike commits running `elf_path`.
+pub(crate) fn commits(elf_path: &Path, isa: &str) -> Result<Vec<SpikeCommit>> {
+    let entry = cache_entry(elf_path, isa, "commits")?;
+    if let Some(commits) = std::fs::read(&entry).ok().and_then(|data| decode(&data)) {
+        return Ok(commits);
+    }
+
+    let commits = record_commits(elf_path, isa)?;
+    store(&entry, &encode(&commits))?;
+    Ok(commits)
+}
+
+/// Spike's `+signature` output for `elf_path`, copied to `signature_path`.
+pub(crate) fn signature(elf_path: &Path, isa: &str, signature_path: &Path) -> Result<String> {
+    let entry = cache_entry(elf_path, isa, "sig")?;
+    if let Ok(text) = std::fs::read_to_string(&entry) {
+        std::fs::write(signature_path, &text)?;
+        return Ok(text);
+    }
+
+    let status = Command::new("spike")
+        .arg(format!("--isa={isa}"))
+        .arg(format!("+signature={}", signature_path.display()))
+        .arg("+signature-granularity=4")
+        .arg(elf_path)
+        .stdout(Stdio::null())
+        .stderr(Stdio::null())
+        .status()
+        .context("Failed to run spike")?;
+    if !status.success() {
+        anyhow::bail!("Spike exited with {status}");
+    }
+
+    let text = std::fs::read_to_string(signature_path)
+        .with_context(|| format!("Spike wrote no signature to {}", signature_path.display()))?;
+    store(&entry, text.as_bytes())?;
+    Ok(text)
+}
+
+fn record_commits(elf_path: &Path, isa: &str) -> Result<Vec<SpikeCommit>> {
+    let mut child = Command::new("spike")
+        .arg(format!("--isa={isa}"))
+        .arg("--log-commits")
+        .arg(elf_path)
+        .stdout(Stdio::null())
+        .stderr(Stdio::piped())
+        .spawn()
+        .context("Failed to run spike")?;
+    let stderr = child
+        .stderr
+        .take()
+        .ok_or_else(|| anyhow::anyhow!("Failed to capture spike stderr"))?;
+
+    let mut reader = BufReader::with_capacity(1 << 16, stderr);
+    let mut line = Vec::with_capacity(256);
+    let mut commits = Vec::new();
+    let mut result = Ok(());
+    loop {
+        if commits.len() >= MAX_COMMITS {
+            result = Err(anyhow::anyhow!(
+                "Spike ran past {MAX_COMMITS} commits without finishing"
+            ));
+            break;
+        }
+        line.clear();
+        match reader.read_until(b'\n', &mut line) {
+            Ok(0) => break,
+            Ok(_) => commits.extend(parse_commit(&line)),
+            Err(e) => {
+                result = Err(e).context("Failed to read spike output");
+                break;
+            }
+        }
+    }
+
+    // Only a complete trace may be cached, so a crash or a rejected --isa
+    // is an error rather than a short reference
+    if let Err(e) = result {
+        let _ = child.kill();
+        let _ = child.wait();
+        return Err(e);
+    }
+    let status = child.wait().context("Failed to wait for spike")?;
+    if !status.success() {
+        anyhow::bail!("Spike exited with {status}");
+    }
+    if commits.is_empty() {
+        anyhow::bail!("Spike logged no commits");
+    }
+    Ok(commits)
+}
+
+/// Parse a `--log-commits` line such as
+/// `core   0: 3 0x80000004 (0x00000013) x5  0x80000000 mem 0x80001000 0x00000001`
+fn parse_commit(line: &[u8]) -> Option<SpikeCommit> {
+    let mut tokens = line
+        .split(|b| b.is_ascii_whitespace())
+        .filter(|token| !token.is_empty())
+        .peekable();
+    if tokens.next()? != b"core" || !tokens.next()?.ends_with(b":") {
+        return None;
+    }
+    // The privilege level tells commit lines apart from other output.
+    let privilege = tokens.next()?;
+    if privilege.len() != 1 || !privilege[0].is_ascii_digit() {
+        return None;
+    }
+    let pc = parse_hex(tokens.next()?)?;
+    let inst = parse_hex(tokens.next()?)? as u32;
+
+    let mut rd = None;
+    let mut mem = None;
+    while let Some(token) = tokens.next() {
+        if token == b"mem" {
+            if let Some(addr) = tokens.next_if(|t| parse_hex(t).is_some()) {
+                let data = tokens.next_if(|t| parse_hex(t).is_some());
+                mem = Some((parse_hex(addr)?, data.and_then(parse_hex)));
+            }
+        } else if let Some(reg) = token.strip_prefix(b"x").and_then(parse_dec) {
+            if let Some(value) = tokens.next_if(|t| parse_hex(t).is_some()) {
+                if reg != 0 {
+                    rd = Some((reg, parse_hex(value)?));
+                }
+            }
+        }
+    }
+
+    Some(SpikeCommit { pc, inst, rd, mem })
+}
+
+fn parse_hex(token: &[u8]) -> Option<u64> {
+    let token = token.strip_prefix(b"(").unwrap_or(token);
+    let token = token.strip_suffix(b")").unwrap_or(token);
+    let digits = token.strip_prefix(b"0x")?;
+    if digits.is_empty() || digits.len() > 16 {
+        return None;
+    }
+    digits.iter().try_fold(0u64, |value, &digit| {
+        let nibble = (digit as char).to_digit(16)?;
+        Some(value << 4 | u64::from(nibble))
+    })
+}
+
+fn parse_dec(token: &[u8]) -> Option<u8> {
+    if token.is_empty() || token.len() > 2 {
+        return None;
+    }
+    token.iter().try_fold(0u8, |value, &digit| {
+        digit.is_ascii_digit().then(|| value * 10 + (digit - b'0'))
+    })
+}
+
+fn encode(commits: &[SpikeCommit]) -> Vec<u8> {
+    let mut data = Vec::with_capacity(commits.len() * RECORD_BYTES);
+    for commit in commits {
+        let (rd, rd_value) = commit.rd.unwrap_or_default();
+        let (mem_addr, mem_data) = commit.mem.unwrap_or_default();
+        let mut flags = 0;
+        if commit.rd.is_some() {
+            flags |= HAS_RD;
+        }
+        if commit.mem.is_some() {
+            flags |= HAS_MEM;
+        }
+        if mem_data.is_some() {
+            flags |= HAS_MEM_DATA;
+        }
+        data.extend_from_slice(&commit.pc.to_le_bytes());
+        data.extend_from_slice(&commit.inst.to_le_bytes());
+        data.push(flags);
+        data.push(rd);
+        data.extend_from_slice(&rd_value.to_le_bytes());
+        data.extend_from_slice(&mem_addr.to_le_bytes());
+        data.extend_from_slice(&mem_data.unwrap_or(0).to_le_bytes());
+    }
+    data
+}
+
+/// `None` for a truncated or otherwise unreadable entry, which is then
+/// recorded again.
+fn decode(data: &[u8]) -> Option<Vec<SpikeCommit>> {
+    if data.len() % RECORD_BYTES != 0 {
+        return None;
+    }
+    let u64_at = |record: &[u8], offset: usize| {
+        u64::from_le_bytes(record[offset..offset + 8].try_into().unwrap())
+    };
+    let commits = data
+        .chunks_exact(RECORD_BYTES)
+        .map(|record| {
+            let flags = record[12];
+            SpikeCommit {
+                pc: u64_at(record, 0),
+                inst: u32::from_le_bytes(record[8..12].try_into().unwrap()),
+                rd: (flags & HAS_RD != 0).then(|| (record[13], u64_at(record, 14))),
+                mem: (flags & HAS_MEM != 0).then(|| {
+                    let data = (flags & HAS_MEM_DATA != 0).then(|| u64_at(record, 30));
+                    (u64_at(record, 22), data)
+                }),
+            }
+        })
+        .collect();
+    Some(commits)
+}
+
+fn cache_dir() -> PathBuf {
+    std::env::var_os("SVAROG_SPIKE_CACHE")
+        .map(PathBuf::from)
+        .unwrap_or_else(|| PathBuf::from(DEFAULT_CACHE_DIR))
+}
+
+fn cache_entry(elf_path: &Path, isa: &str, kind: &str) -> Result<PathBuf> {
+    let elf = std::fs::read(elf_path)
+        .with_context(|| format!("Failed to read {}", elf_path.display()))?;
+    let mut key = fnv1a(FNV_OFFSET, &CACHE_FORMAT.to_le_bytes());
+    key = fnv1a(key, &spike_hash()?.to_le_bytes());
+    key = fnv1a(key, isa.to_ascii_lowercase().as_bytes());
+    key = fnv1a(key, &[0]);
+    key = fnv1a(key, &elf);
+
+    let stem = elf_path
+        .file_stem()
+        .map_or("elf".into(), |stem| stem.to_string_lossy());
+    Ok(cache_dir().join(format!("{stem}-{key:016x}.{kind}")))
+}
+
+/// Hash of the `spike` on PATH, standing in for its version because builds
+/// from the same release can still behave differently.
+fn spike_hash() -> Result<u64> {
+    static HASH: OnceLock<Option<u64>> = OnceLock::new();
+    let hash = HASH.get_or_init(|| {
+        let path = std::env::var_os("PATH")?;
+        let spike = std::env::split_paths(&path)
+            .map(|dir| dir.join("spike"))
+            .find(|candidate| candidate.is_file())?;
+        Some(fnv1a(FNV_OFFSET, &std::fs::read(spike).ok()?))
+    });
+    hash.ok_or_else(|| anyhow::anyhow!("spike not found on PATH"))
+}
+
+/// Write through a temporary file so parallel tests never see a partial entry.
+fn store(entry: &Path, data: &[u8]) -> Result<()> {
+    static STAGING_ID: AtomicU64 = AtomicU64::new(0);
+    let dir = entry.parent().unwrap();
+    std::fs::create_dir_all(dir)?;
+    let staging = dir.join(format!(
+        ".{}.{}.{}",
+        entry.file_name().unwrap().to_string_lossy(),
+        std::process::id(),
+        STAGING_ID.fetch_add(1, Ordering::Relaxed)
+    ));
+    std::fs::write(&staging, data)?;
+    std::fs::rename(&staging, entry)?;
+    Ok(())
+}
@@ -7,7 +7,7 @@ use anyhow::{Context, Result};
 use glob::glob;
 use libtest_mimic::{Arguments, Failed, Trial};
 use std::path::{Path, PathBuf};
-use testbench::{Backend, Simulator};
+use testbench::{Backend, Simulator, single_hart_models};
 
 const TARGET_PATH: &str = concat!(env!("CARGO_MANIFEST_DIR"), "/../target/");
 
@@ -25,10 +25,11 @@ fn main() -> Result<()> {
 fn discover_tests() -> Result<Vec<Trial>> {
     let mut trials = Vec::new();
 
-    let models = Simulator::available_models(Backend::VerilatorMonitored);
+    // The direct tests' startup code is single-hart
+    let models = single_hart_models(Backend::VerilatorMonitored);
 
     // For each model, create tests
-    for &model_name in models {
+    for model_name in models {
         // Discover built test binaries
         let pattern = format!("{TARGET_PATH}/direct-tests/rv32/*");
         for test_path in glob(&pattern)? {
@@ -66,14 +67,17 @@ fn run_test(test_path: &Path, model_name: &'static str) -> Result<(), Failed> {
 
 fn run_test_impl(test_path: &Path, model_name: &'static str) -> Result<()> {
     let test_name = test_path.file_name().unwrap().to_str().unwrap().to_owned();
-    let vcd_path = PathBuf::from(format!(
-        "{}/vcd/direct_{}_{}.vcd",
-        TARGET_PATH, model_name, test_name
-    ));
 
     // Create simulator with specified model
     let simulator = Simulator::new(Backend::VerilatorMonitored, model_name)
         .map_err(|e| anyhow::anyhow!("Failed to create simulator: {}", e))?;
+    let vcd_path = PathBuf::from(format!(
+        "{}/vcd/direct_{}_{}.{}",
+        TARGET_PATH,
+        model_name,
+        test_name,
+        simulator.trace_extension()
+    ));
 
     // Load the ELF binary with watchpoint on 'tohost' symbol
     let _tohost_addr = simulator
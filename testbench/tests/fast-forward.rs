@@ -0,0 +1,185 @@
+//! Fast-forward round trip
+//!
+//! Runs CoreMark on every model the functional backend covers, once on the
+//! RTL alone and once with the first half fast-forwarded on the functional
+//! model, and checks that both runs report the same CRCs and retire the same
+//! number of instructions.
+//!
+//! - `SVAROG_COREMARK_ITERATIONS`: CoreMark iterations (default 1)
+//! - `SVAROG_MAX_CYCLES`: simulation timeout per run
+
+use anyhow::{Context, Result};
+use libtest_mimic::{Arguments, Failed, Trial};
+use std::collections::BTreeMap;
+use std::path::{Path, PathBuf};
+use testbench::{Backend, Simulator};
+
+const WORKSPACE_PATH: &str = concat!(env!("CARGO_MANIFEST_DIR"), "/..");
+
+/// Report lines that do not depend on timing, so must match across the runs
+const INVARIANT_FIELDS: [&str; 8] = [
+    "CoreMark Size",
+    "Iterations",
+    "seedcrc",
+    "[0]crclist",
+    "[0]crcmatrix",
+    "[0]crcstate",
+    "[0]crcfinal",
+    "CoreMark instret count",
+];
+
+fn main() -> Result<()> {
+    let args = Arguments::from_args();
+
+    let tests = Simulator::available_models(Backend::Functional)
+        .iter()
+        .map(|&model_name| {
+            Trial::test(format!("{}::coremark", model_name), move || {
+                run_test(model_name)
+            })
+        })
+        .collect();
+
+    libtest_mimic::run(&args, tests).exit();
+}
+
+fn env_or<T: std::str::FromStr>(name: &str, default: T) -> T {
+    std::env::var(name)
+        .ok()
+        .and_then(|val| val.parse().ok())
+        .unwrap_or(default)
+}
+
+fn run_test(model_name: &'static str) -> Result<(), Failed> {
+    match run_test_impl(model_name) {
+        Ok(()) => Ok(()),
+        Err(e) => Err(format!("{:#}", e).into()),
+    }
+}
+
+fn run_test_impl(model_name: &'static str) -> Result<()> {
+    let iterations: u64 = env_or("SVAROG_COREMARK_ITERATIONS", 1);
+    let max_cycles: usize = env_or("SVAROG_MAX_CYCLES", 50_000_000);
+
+    let elf = build_coremark(model_name, iterations)?;
+
+    println!("Running CoreMark on model {}...", model_name);
+    let reference = run_rtl(model_name, &elf, max_cycles)?;
+    let expected =
+        invariant_fields(&reference).with_context(|| format!("RTL output:\n{reference}"))?;
+
+    // Switch half way through, inside the timed region or just before it
+    let instructions = expected["CoreMark instret count"]
+        .parse::<u64>()
+        .context("Invalid instret count")?
+        / 2;
+    println!("Fast-forwarding {} instructions...", instructions);
+    let output = run_fast_forwarded(model_name, &elf, instructions, max_cycles)?;
+    let actual =
+        invariant_fields(&output).with_context(|| format!("Fast-forwarded output:\n{output}"))?;
+
+    let mismatches: Vec<String> = INVARIANT_FIELDS
+        .iter()
+        .filter(|&&key| expected[key] != actual[key])
+        .map(|&key| {
+            format!(
+                "{key}: RTL {}, fast-forwarded {}",
+                expected[key], actual[key]
+            )
+        })
+        .collect();
+    if !mismatches.is_empty() {
+        anyhow::bail!(
+            "Fast-forwarded run differs from the RTL run:\n{}",
+            mismatches.join("\n")
+        );
+    }
+    Ok(())
+}
+
+/// Build CoreMark with the model's ISA, returning the ELF path.
+fn build_coremark(model_name: &str, iterations: u64) -> Result<PathBuf> {
+    let workspace = Path::new(WORKSPACE_PATH);
+    let config =
+        simtools::Config::from_file(&workspace.join(format!("configs/{model_name}.yaml")))?;
+    let march = config
+        .isa()
+        .ok_or_else(|| anyhow::anyhow!("Model {model_name} has no cluster"))?
+        .to_owned();
+
+    let output_path = workspace.join(format!("target/fast-forward/coremark/{model_name}"));
+    let build_dir = simtools::build_coremark(workspace, &march, iterations, 1, &output_path)
+        .with_context(|| format!("Failed to build CoreMark for {model_name}"))?;
+    Ok(build_dir.join("coremark.elf"))
+}
+
+/// Simulator with the console UART captured.
+fn console_simulator(backend: Backend, model_name: &str) -> Result<Simulator> {
+    let simulator = Simulator::new(backend, model_name)
+        .map_err(|e| anyhow::anyhow!("Failed to create simulator: {}", e))?;
+    simulator.enable_uart_console(0);
+    simulator.capture_uart_console();
+    Ok(simulator)
+}
+
+fn run_rtl(model_name: &str, elf: &Path, max_cycles: usize) -> Result<String> {
+    let simulator = console_simulator(Backend::Verilator, model_name)?;
+    simulator
+        .load_binary_fast(elf, Some("tohost"))
+        .context("Failed to load binary")?;
+    simulator
+        .run(None, max_cycles)
+        .context("Verilator simulation failed")?;
+    Ok(String::from_utf8_lossy(&simulator.take_uart_console_output()).into_owned())
+}
+
+fn run_fast_forwarded(
+    model_name: &str,
+    elf: &Path,
+    instructions: u64,
+    max_cycles: usize,
+) -> Result<String> {
+    let functional = console_simulator(Backend::Functional, model_name)?;
+    functional
+        .load_binary_fast(elf, Some("tohost"))
+        .context("Failed to load binary")?;
+    let state = functional
+        .fast_forward(0x8000_0000, instructions)
+        .context("Fast-forward failed")?;
+    if state.halted {
+        anyhow::bail!("CoreMark finished before the fast-forward point");
+    }
+    let mut output = functional.take_uart_console_output();
+
+    let simulator = console_simulator(Backend::Verilator, model_name)?;
+    simulator
+        .load_arch_state(&state)
+        .context("Failed to load the fast-forwarded state")?;
+    simulator
+        .resume_with_progress(None, max_cycles, |_| {})
+        .context("Verilator simulation failed")?;
+    output.extend(simulator.take_uart_console_output());
+    Ok(String::from_utf8_lossy(&output).into_owned())
+}
+
+/// Pull [`INVARIANT_FIELDS`] out of CoreMark's report.
+fn invariant_fields(output: &str) -> Result<BTreeMap<&'static str, String>> {
+    if output.contains("should be") {
+        anyhow::bail!("CoreMark CRC validation failed");
+    }
+
+    let fields: BTreeMap<&str, &str> = output
+        .lines()
+        .filter_map(|line| line.split_once(':'))
+        .map(|(key, value)| (key.trim(), value.trim()))
+        .collect();
+    INVARIANT_FIELDS
+        .iter()
+        .map(|&key| {
+            let value = fields
+                .get(key)
+                .ok_or_else(|| anyhow::anyhow!("Missing \"{key}\", the run did not finish"))?;
+            Ok((key, value.to_string()))
+        })
+        .collect()
+}
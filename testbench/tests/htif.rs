@@ -0,0 +1,95 @@
+//! HTIF system calls
+//!
+//! Builds the `benchmarks/htif` hello program for every single-hart model and
+//! runs it on every backend, checking the console output of its `write`
+//! calls, the `gettimeofday` answer and the status it passes to `exit`.
+//!
+//! - `SVAROG_MAX_CYCLES`: simulation timeout per run
+
+use anyhow::{Context, Result};
+use libtest_mimic::{Arguments, Failed, Trial};
+use std::path::{Path, PathBuf};
+use testbench::{Backend, Simulator, test_backends, test_prefix};
+
+const WORKSPACE_PATH: &str = concat!(env!("CARGO_MANIFEST_DIR"), "/..");
+
+fn main() -> Result<()> {
+    let args = Arguments::from_args();
+
+    let tests = test_backends()
+        .map(|(backend, model_name)| {
+            Trial::test(
+                format!("{}::hello", test_prefix(backend, model_name)),
+                move || run_test(backend, model_name),
+            )
+        })
+        .collect();
+
+    libtest_mimic::run(&args, tests).exit();
+}
+
+fn run_test(backend: Backend, model_name: &'static str) -> Result<(), Failed> {
+    match run_test_impl(backend, model_name) {
+        Ok(()) => Ok(()),
+        Err(e) => Err(format!("{:#}", e).into()),
+    }
+}
+
+fn run_test_impl(backend: Backend, model_name: &'static str) -> Result<()> {
+    let max_cycles: usize = std::env::var("SVAROG_MAX_CYCLES")
+        .ok()
+        .and_then(|val| val.parse().ok())
+        .unwrap_or(5_000_000);
+
+    let elf = build_hello(backend, model_name)?;
+
+    let simulator = Simulator::new(backend, model_name)
+        .map_err(|e| anyhow::anyhow!("Failed to create simulator: {}", e))?;
+    simulator.enable_uart_console(0);
+    simulator.capture_uart_console();
+    simulator
+        .load_binary_fast(&elf, Some("tohost"))
+        .context("Failed to load binary")?;
+    let result = simulator
+        .run(None, max_cycles)
+        .context("Simulation failed")?;
+    let output = String::from_utf8_lossy(&simulator.take_uart_console_output()).into_owned();
+
+    let mut lines = output.lines();
+    if lines.next() != Some("Hello from Svarog over HTIF") {
+        anyhow::bail!("Missing greeting, console output:\n{output}");
+    }
+    let seconds = lines
+        .next()
+        .and_then(|line| line.strip_prefix("Host time: "))
+        .and_then(|time| time.split_once('.'))
+        .and_then(|(seconds, _)| seconds.parse::<i64>().ok())
+        .ok_or_else(|| anyhow::anyhow!("Missing host time, console output:\n{output}"))?;
+    if seconds <= 0 {
+        anyhow::bail!("gettimeofday returned {seconds} seconds");
+    }
+    if result.exit_code != Some(0) {
+        anyhow::bail!(
+            "Exit status {:?}, expected 0, console output:\n{output}",
+            result.exit_code
+        );
+    }
+    Ok(())
+}
+
+/// Build the hello program with the model's ISA, returning the ELF path.
+/// Each backend gets its own copy, since their tests run in parallel.
+fn build_hello(backend: Backend, model_name: &str) -> Result<PathBuf> {
+    let workspace = Path::new(WORKSPACE_PATH);
+    let config =
+        simtools::Config::from_file(&workspace.join(format!("configs/{model_name}.yaml")))?;
+    let march = config
+        .isa()
+        .ok_or_else(|| anyhow::anyhow!("Model {model_name} has no cluster"))?
+        .to_owned();
+
+    let output_path = workspace.join(format!("target/htif/{}/{model_name}", backend.name()));
+    let build_dir = simtools::build_htif(workspace, &march, &output_path)
+        .with_context(|| format!("Failed to build the HTIF hello program for {model_name}"))?;
+    Ok(build_dir.join("hello.elf"))
+}
@@ -2,13 +2,18 @@ use anyhow::{Context, Result};
 use glob::glob;
 use libtest_mimic::{Arguments, Failed, Trial};
 use std::path::{Path, PathBuf};
-use testbench::{Backend, Simulator, compare_results, run_spike_test};
+use std::sync::{Arc, Mutex};
+use testbench::{
+    Backend, Simulator, SpikeLockstep, compare_results, compare_signatures, elf_symbol,
+    run_spike_signature, test_backends, test_prefix,
+};
 
 const TARGET_PATH: &str = concat!(env!("CARGO_MANIFEST_DIR"), "/../target/");
 
 fn main() -> Result<()> {
     let vcd_path = PathBuf::from(format!("{}/vcd", TARGET_PATH));
     std::fs::create_dir_all(&vcd_path)?;
+    std::fs::create_dir_all(format!("{}/signatures", TARGET_PATH))?;
     let args = Arguments::from_args();
 
     let tests = discover_tests()?;
@@ -20,14 +25,12 @@ fn main() -> Result<()> {
 fn discover_tests() -> Result<Vec<Trial>> {
     let mut trials = Vec::new();
 
-    let backend = Backend::Verilator;
-    let models = Simulator::available_models(backend);
-    let suites = ["I", "M"];
+    let suites = ["I", "M", "B"];
 
     // Maximum binary size that can fit in RAM (64KB = 65536 bytes)
     const MAX_BINARY_SIZE: u64 = 64 * 1024;
 
-    for &model_name in models {
+    for (backend, model_name) in test_backends() {
         for suite in suites {
             let pattern = format!("{TARGET_PATH}/riscv-arch-test/rv32i_m/{suite}/*.elf");
             for test_path in glob(&pattern)? {
@@ -47,7 +50,12 @@ fn discover_tests() -> Result<Vec<Trial>> {
                     // Create an ignored test with a reason
                     trials.push(
                         Trial::test(
-                            format!("{}::arch::{}::{}", model_name, suite, test_name),
+                            format!(
+                                "{}::arch::{}::{}",
+                                test_prefix(backend, model_name),
+                                suite,
+                                test_name
+                            ),
                             || Ok(()),
                         )
                         .with_ignored_flag(true)
@@ -56,18 +64,14 @@ fn discover_tests() -> Result<Vec<Trial>> {
                             file_size, MAX_BINARY_SIZE
                         )),
                     );
-                } else if test_name.contains("rem") || test_name.contains("div") {
-                    trials.push(
-                        Trial::test(
-                            format!("{}::arch::{}::{}", model_name, suite, test_name),
-                            || Ok(()),
-                        )
-                        .with_ignored_flag(true)
-                        .with_kind("Division is not synthesizable for now"),
-                    );
                 } else {
                     trials.push(Trial::test(
-                        format!("{}::arch::{}::{}", model_name, suite, test_name),
+                        format!(
+                            "{}::arch::{}::{}",
+                            test_prefix(backend, model_name),
+                            suite,
+                            test_name
+                        ),
                         move || run_test(&test_path, backend, model_name, &suite_name),
                     ));
                 }
@@ -98,27 +102,45 @@ fn run_test_impl(
     suite: &str,
 ) -> Result<()> {
     let test_name = test_path.file_stem().unwrap().to_str().unwrap().to_owned();
-    let vcd_path = PathBuf::from(format!(
-        "{}/vcd/arch_{}_{}_{}.vcd",
-        TARGET_PATH, model_name, suite, test_name
-    ));
 
     let simulator = Simulator::new(backend, model_name)
         .map_err(|e| anyhow::anyhow!("Failed to create simulator: {}", e))?;
+    let vcd_path = PathBuf::from(format!(
+        "{}/vcd/arch_{}_{}_{}.{}",
+        TARGET_PATH,
+        model_name,
+        suite,
+        test_name,
+        simulator.trace_extension()
+    ));
 
-    let tohost_addr = simulator
-        .load_binary(test_path, Some("tohost"))
+    let _tohost_addr = simulator
+        .load_binary_fast(test_path, Some("tohost"))
         .context("Failed to load binary")?;
 
+    // Check every retired instruction against Spike while simulating
+    let isa = match suite {
+        "M" => "RV32IM",
+        "B" => "RV32I_Zba_Zbb",
+        _ => "RV32I",
+    };
+    let lockstep = Arc::new(Mutex::new(
+        SpikeLockstep::spawn(test_path, isa).context("Failed to start Spike")?,
+    ));
+    let sink = Arc::clone(&lockstep);
+    simulator.set_retire_sink(move |retired| sink.lock().unwrap().check(retired));
+
     let max_cycles = std::env::var("SVAROG_MAX_CYCLES")
         .ok()
         .and_then(|val| val.parse::<usize>().ok())
         .unwrap_or(50_000);
 
     println!("Simulating {} on model {}...", test_name, model_name);
+    // The functional model has no signals to trace
+    let vcd_path = (backend != Backend::Functional).then_some(vcd_path.as_path());
     let verilator_result = simulator
-        .run(Some(&vcd_path), max_cycles)
-        .context("Verilator simulation failed")?;
+        .run(vcd_path, max_cycles)
+        .with_context(|| format!("{} simulation failed", backend.name()))?;
     println!("Simulation complete, capturing registers");
 
     let mut has_activity = false;
@@ -131,17 +153,36 @@ fn run_test_impl(
 
     if !has_activity {
         anyhow::bail!(
-            "No register writes detected from Verilator. \
+            "No register writes detected from the simulator. \
             CPU may not be completing writeback stage."
         );
     }
 
-    let isa = if suite == "M" { "RV32IM" } else { "RV32I" };
-    println!("Running Spike for {}", test_name);
-    let spike_result =
-        run_spike_test(test_path, tohost_addr, isa).context("Spike simulation failed")?;
-
     println!("Comparing architectural state");
+    let spike_result = lockstep.lock().unwrap().result();
     compare_results(&verilator_result, &spike_result)?;
+
+    // The signature holds every result the test stored, not just x3
+    println!("Comparing memory signatures");
+    let begin = elf_symbol(test_path, "begin_signature")?
+        .ok_or_else(|| anyhow::anyhow!("Test has no begin_signature"))?;
+    let end = elf_symbol(test_path, "end_signature")?
+        .ok_or_else(|| anyhow::anyhow!("Test has no end_signature"))?;
+    let signature: Vec<u32> = simulator
+        .read_memory(begin, end.saturating_sub(begin) as usize)
+        .context("Failed to read the signature")?
+        .chunks_exact(4)
+        .map(|word| u32::from_le_bytes(word.try_into().unwrap()))
+        .collect();
+    let signature_path = PathBuf::from(format!(
+        "{}/signatures/{}_{}_{}_{}.spike.sig",
+        TARGET_PATH,
+        backend.name(),
+        model_name,
+        suite,
+        test_name
+    ));
+    let spike_signature = run_spike_signature(test_path, isa, &signature_path)?;
+    compare_signatures(&signature, &spike_signature)?;
     Ok(())
 }
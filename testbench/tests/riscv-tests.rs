@@ -2,7 +2,8 @@ use anyhow::{Context, Result};
 use glob::glob;
 use libtest_mimic::{Arguments, Failed, Trial};
 use std::path::{Path, PathBuf};
-use testbench::{Backend, Simulator, compare_results, run_spike_test};
+use std::sync::{Arc, Mutex};
+use testbench::{Backend, Simulator, SpikeLockstep, compare_results, test_backends, test_prefix};
 
 const TARGET_PATH: &str = concat!(env!("CARGO_MANIFEST_DIR"), "/../target/");
 
@@ -23,12 +24,7 @@ fn main() -> Result<()> {
 fn discover_tests() -> Result<Vec<Trial>> {
     let mut trials = Vec::new();
 
-    // Get all available models
-    let backend = Backend::Verilator;
-    let models = Simulator::available_models(backend);
-
-    // For each model, create tests
-    for &model_name in models {
+    for (backend, model_name) in test_backends() {
         // Use the generated manifest for test discovery
         for test_path in glob(&format!("{TARGET_PATH}/riscv-tests/isa/rv32ui-p-*"))? {
             let test_path = test_path?;
@@ -41,7 +37,7 @@ fn discover_tests() -> Result<Vec<Trial>> {
                 continue;
             }
             trials.push(Trial::test(
-                format!("{}::{}", model_name, test_name),
+                format!("{}::{}", test_prefix(backend, model_name), test_name),
                 move || run_test(&test_path, backend, model_name),
             ));
         }
@@ -60,20 +56,30 @@ fn run_test(test_path: &Path, backend: Backend, model_name: &'static str) -> Res
 
 fn run_test_impl(test_path: &Path, backend: Backend, model_name: &'static str) -> Result<()> {
     let test_name = test_path.file_name().unwrap().to_str().unwrap().to_owned();
-    let vcd_path = PathBuf::from(format!(
-        "{}/vcd/{}_{}.vcd",
-        TARGET_PATH, model_name, test_name
-    ));
 
     // Create simulator with specified model
     let simulator = Simulator::new(backend, model_name)
         .map_err(|e| anyhow::anyhow!("Failed to create simulator: {}", e))?;
+    let vcd_path = PathBuf::from(format!(
+        "{}/vcd/{}_{}.{}",
+        TARGET_PATH,
+        model_name,
+        test_name,
+        simulator.trace_extension()
+    ));
 
     // Load the ELF binary with watchpoint on 'tohost' symbol
-    let tohost_addr = simulator
-        .load_binary(test_path, Some("tohost"))
+    let _tohost_addr = simulator
+        .load_binary_fast(test_path, Some("tohost"))
         .context("Failed to load binary")?;
 
+    // Check every retired instruction against Spike while simulating
+    let lockstep = Arc::new(Mutex::new(
+        SpikeLockstep::spawn(test_path, "RV32I").context("Failed to start Spike")?,
+    ));
+    let sink = Arc::clone(&lockstep);
+    simulator.set_retire_sink(move |retired| sink.lock().unwrap().check(retired));
+
     // Run Verilator simulation
     let max_cycles = std::env::var("SVAROG_MAX_CYCLES")
         .ok()
@@ -81,9 +87,11 @@ fn run_test_impl(test_path: &Path, backend: Backend, model_name: &'static str) -
         .unwrap_or(20_000);
 
     println!("Simulating {} on model {}...", test_name, model_name);
+    // The functional model has no signals to trace
+    let vcd_path = (backend != Backend::Functional).then_some(vcd_path.as_path());
     let verilator_result = simulator
-        .run(Some(&vcd_path), max_cycles)
-        .context("Verilator simulation failed")?;
+        .run(vcd_path, max_cycles)
+        .with_context(|| format!("{} simulation failed", backend.name()))?;
     println!("Simulation complete, capturing registers");
 
     // Check if there was any register activity
@@ -97,17 +105,13 @@ fn run_test_impl(test_path: &Path, backend: Backend, model_name: &'static str) -
 
     if !has_activity {
         anyhow::bail!(
-            "No register writes detected from Verilator. \
+            "No register writes detected from the simulator. \
             CPU may not be completing writeback stage."
         );
     }
 
-    // Run Spike and compare architectural state
-    println!("Running Spike for {}", test_name);
-    let spike_result =
-        run_spike_test(test_path, tohost_addr, "RV32I").context("Spike simulation failed")?;
-
     println!("Comparing architectural state");
+    let spike_result = lockstep.lock().unwrap().result();
     compare_results(&verilator_result, &spike_result)?;
     Ok(())
 }
@@ -0,0 +1,122 @@
+//! Multi-hart clusters
+//!
+//! The ISA suites only run on single-hart models. This runs CoreMark with one
+//! context per hart on every multi-hart model instead, and checks that every
+//! context finished with the CRCs of the first: the contexts share their
+//! seeds, so any difference means the harts interfered.
+//!
+//! - `SVAROG_COREMARK_ITERATIONS`: CoreMark iterations per hart (default 1)
+//! - `SVAROG_MAX_CYCLES`: simulation timeout per run
+
+use anyhow::{Context, Result};
+use libtest_mimic::{Arguments, Failed, Trial};
+use std::collections::HashMap;
+use std::path::{Path, PathBuf};
+use testbench::{Backend, Simulator, num_harts};
+
+const WORKSPACE_PATH: &str = concat!(env!("CARGO_MANIFEST_DIR"), "/..");
+
+/// Per-context report lines
+const CONTEXT_FIELDS: [&str; 4] = ["crclist", "crcmatrix", "crcstate", "crcfinal"];
+
+fn main() -> Result<()> {
+    let args = Arguments::from_args();
+
+    let mut tests = Vec::new();
+    for &model_name in Simulator::available_models(Backend::Verilator) {
+        let harts = num_harts(model_name)?;
+        if harts > 1 {
+            tests.push(Trial::test(
+                format!("{}::coremark", model_name),
+                move || run_test(model_name, harts),
+            ));
+        }
+    }
+
+    libtest_mimic::run(&args, tests).exit();
+}
+
+fn env_or<T: std::str::FromStr>(name: &str, default: T) -> T {
+    std::env::var(name)
+        .ok()
+        .and_then(|val| val.parse().ok())
+        .unwrap_or(default)
+}
+
+fn run_test(model_name: &'static str, harts: u32) -> Result<(), Failed> {
+    match run_test_impl(model_name, harts) {
+        Ok(()) => Ok(()),
+        Err(e) => Err(format!("{:#}", e).into()),
+    }
+}
+
+fn run_test_impl(model_name: &'static str, harts: u32) -> Result<()> {
+    let iterations: u64 = env_or("SVAROG_COREMARK_ITERATIONS", 1);
+    let max_cycles: usize = env_or("SVAROG_MAX_CYCLES", 50_000_000);
+
+    let elf = build_coremark(model_name, iterations, harts)?;
+
+    let simulator = Simulator::new(Backend::Verilator, model_name)
+        .map_err(|e| anyhow::anyhow!("Failed to create simulator: {}", e))?;
+    simulator.enable_uart_console(0);
+    simulator.capture_uart_console();
+    simulator
+        .load_binary_fast(&elf, Some("tohost"))
+        .context("Failed to load binary")?;
+    simulator
+        .run(None, max_cycles)
+        .context("Simulation failed")?;
+    let output = String::from_utf8_lossy(&simulator.take_uart_console_output()).into_owned();
+
+    check_output(&output, iterations, harts).with_context(|| format!("CoreMark output:\n{output}"))
+}
+
+/// Build CoreMark with the model's ISA and one context per hart, returning
+/// the ELF path.
+fn build_coremark(model_name: &str, iterations: u64, harts: u32) -> Result<PathBuf> {
+    let workspace = Path::new(WORKSPACE_PATH);
+    let config =
+        simtools::Config::from_file(&workspace.join(format!("configs/{model_name}.yaml")))?;
+    let march = config
+        .isa()
+        .ok_or_else(|| anyhow::anyhow!("Model {model_name} has no cluster"))?
+        .to_owned();
+
+    let output_path = workspace.join(format!("target/smp/coremark/{model_name}"));
+    let build_dir = simtools::build_coremark(workspace, &march, iterations, harts, &output_path)
+        .with_context(|| format!("Failed to build CoreMark for {model_name}"))?;
+    Ok(build_dir.join("coremark.elf"))
+}
+
+fn check_output(output: &str, iterations: u64, harts: u32) -> Result<()> {
+    if output.contains("should be") {
+        anyhow::bail!("CoreMark CRC validation failed");
+    }
+
+    let fields: HashMap<&str, &str> = output
+        .lines()
+        .filter_map(|line| line.split_once(':'))
+        .map(|(key, value)| (key.trim(), value.trim()))
+        .collect();
+    let field = |key: &str| {
+        fields
+            .get(key)
+            .copied()
+            .ok_or_else(|| anyhow::anyhow!("Missing \"{key}\", the run did not finish"))
+    };
+
+    let total = iterations * u64::from(harts);
+    if field("Iterations")? != total.to_string() {
+        anyhow::bail!("Expected {total} iterations over {harts} contexts");
+    }
+    for name in CONTEXT_FIELDS {
+        let first = field(&format!("[0]{name}"))?;
+        for hart in 1..harts {
+            let value = field(&format!("[{hart}]{name}"))?;
+            if value != first {
+                anyhow::bail!("Context {hart} has {name} {value}, context 0 has {first}");
+            }
+        }
+    }
+    Ok(())
+}
@@ -1,5 +1,8 @@
 use serde::Deserialize;
 
+/// Reset value of the UART BAUD_DIV register when the config does not set one.
+const DEFAULT_UART_BAUD_DIVIDER: u32 = 434;
+
 #[derive(Deserialize, Debug, Clone)]
 #[allow(dead_code)]
 pub struct Cluster {
@@ -18,6 +21,8 @@ pub struct Io {
     name: String,
     #[serde(rename = "baseAddr")]
     base_addr: String,
+    #[serde(rename = "baudDivider", default)]
+    baud_divider: Option<u32>,
 }
 
 #[derive(Deserialize, Debug, Clone)]
@@ -36,13 +41,26 @@ pub struct Config {
     clusters: Vec<Cluster>,
     io: Vec<Io>,
     memories: Vec<Memory>,
+    #[serde(rename = "verilatorProfile", default)]
+    verilator_profile: Option<String>,
 }
 
 impl Config {
+    /// Parse a SoC config YAML, as found in `configs/`.
+    pub fn from_file(path: &std::path::Path) -> anyhow::Result<Self> {
+        let file = std::fs::File::open(path)?;
+        Ok(yaml_serde::from_reader(file)?)
+    }
+
     pub fn isa(&self) -> Option<&str> {
         self.clusters.first().map(|cluster| cluster.isa.as_str())
     }
 
+    /// Verilator build profile requested by the config, see `Profile`.
+    pub fn verilator_profile(&self) -> Option<&str> {
+        self.verilator_profile.as_deref()
+    }
+
     pub fn xlen(&self) -> u8 {
         match self.isa() {
             Some(isa) if isa.contains("rv64") => 64,
@@ -51,7 +69,58 @@ impl Config {
         }
     }
 
+    /// Whether hart 0 can retire two instructions per cycle.
+    pub fn dual_issue(&self) -> bool {
+        self.clusters
+            .first()
+            .is_some_and(|cluster| cluster.core_type == "dual")
+    }
+
+    /// Harts across every cluster.
+    pub fn num_harts(&self) -> u32 {
+        self.clusters.iter().map(|cluster| cluster.num_cores).sum()
+    }
+
     pub fn num_uarts(&self) -> usize {
         self.io.iter().filter(|io| io.ty == "uart").count()
     }
+
+    /// `(base address, length)` of every TCM.
+    pub fn tcm_regions(&self) -> anyhow::Result<Vec<(u64, u64)>> {
+        self.memories
+            .iter()
+            .filter(|memory| memory.ty == "tcm")
+            .map(|memory| Ok((parse_address(&memory.base_addr)?, memory.length)))
+            .collect()
+    }
+
+    /// Base addresses of all UARTs, in pin order.
+    pub fn uart_base_addresses(&self) -> anyhow::Result<Vec<u64>> {
+        self.io
+            .iter()
+            .filter(|io| io.ty == "uart")
+            .map(|io| parse_address(&io.base_addr))
+            .collect()
+    }
+
+    /// Baud dividers of all UARTs, in pin order.
+    pub fn uart_baud_dividers(&self) -> Vec<u32> {
+        self.io
+            .iter()
+            .filter(|io| io.ty == "uart")
+            .map(|io| io.baud_divider.unwrap_or(DEFAULT_UART_BAUD_DIVIDER))
+            .collect()
+    }
+}
+
+fn parse_address(value: &str) -> anyhow::Result<u64> {
+    let value = value.trim();
+    let parsed = match value
+        .strip_prefix("0x")
+        .or_else(|| value.strip_prefix("0X"))
+    {
+        Some(hex) => u64::from_str_radix(&hex.replace('_', ""), 16),
+        None => value.replace('_', "").parse(),
+    };
+    parsed.map_err(|err| anyhow::anyhow!("Invalid address {value:?}: {err}"))
 }
@@ -3,6 +3,9 @@ mod utils;
 mod verilator;
 
 pub use config::Config;
-pub use verilator::{GeneratedVerilator, generate_verilator, generate_verilator_with_monitors};
+pub use verilator::{
+    GeneratedVerilator, Profile, VerilatorOptions, generate_verilator,
+    generate_verilator_with_monitors, generate_verilator_with_options,
+};
 
-pub use utils::clone_repo;
+pub use utils::{FNV_OFFSET, build_coremark, build_htif, clone_repo, fnv1a};
@@ -1,7 +1,20 @@
 use anyhow::Context;
-use std::path::Path;
+use std::path::{Path, PathBuf};
 use xshell::{Shell, cmd};
 
+/// Starting state for [`fnv1a`].
+pub const FNV_OFFSET: u64 = 0xcbf2_9ce4_8422_2325;
+
+/// Fold `bytes` into an FNV-1a `hash`. Unlike std's hashers its output is
+/// stable across Rust releases, so it can key on-disk caches.
+pub fn fnv1a(mut hash: u64, bytes: &[u8]) -> u64 {
+    for &byte in bytes {
+        hash ^= u64::from(byte);
+        hash = hash.wrapping_mul(0x0000_0100_0000_01b3);
+    }
+    hash
+}
+
 pub fn clone_repo(url: &str, dest: &Path) -> anyhow::Result<()> {
     if dest.exists() {
         std::fs::remove_dir_all(dest)?;
@@ -14,3 +27,53 @@ pub fn clone_repo(url: &str, dest: &Path) -> anyhow::Result<()> {
         .context(format!("Failed to clone {url}"))?;
     Ok(())
 }
+
+/// Build benchmarks/coremark for `march` into `output_path`, returning the
+/// directory holding coremark.elf and its $readmemh image coremark.hex.
+/// With `harts` above 1 each hart runs its own context of `iterations`.
+pub fn build_coremark(
+    workspace_dir: &Path,
+    march: &str,
+    iterations: u64,
+    harts: u32,
+    output_path: &Path,
+) -> anyhow::Result<PathBuf> {
+    let sh = Shell::new().unwrap();
+    let source_dir = workspace_dir.join("benchmarks/coremark");
+    let iterations = iterations.to_string();
+    let harts_arg = harts.to_string();
+
+    cmd!(
+        sh,
+        "make -C {source_dir} MARCH={march} ITERATIONS={iterations} HARTS={harts_arg} OUTPUT_PATH={output_path}"
+    )
+    .quiet()
+    .run()
+    .context("Failed to build CoreMark")?;
+    // Mirrors CONFIG_NAME in the Makefile
+    let config_name = match harts {
+        1 => format!("{march}_ram"),
+        _ => format!("{march}_ram_{harts}harts"),
+    };
+    Ok(output_path.join(config_name))
+}
+
+/// Build benchmarks/htif for `march` into `output_path`, returning the
+/// directory holding hello.elf, libhtif.a and crt0.o.
+pub fn build_htif(
+    workspace_dir: &Path,
+    march: &str,
+    output_path: &Path,
+) -> anyhow::Result<PathBuf> {
+    let sh = Shell::new().unwrap();
+    let source_dir = workspace_dir.join("benchmarks/htif");
+
+    cmd!(
+        sh,
+        "make -C {source_dir} MARCH={march} OUTPUT_PATH={output_path}"
+    )
+    .quiet()
+    .run()
+    .context("Failed to build the HTIF library")?;
+    Ok(output_path.join(march))
+}
@@ -8,6 +8,10 @@ use quote::{TokenStreamExt, format_ident, quote};
 use xshell::{Shell, cmd};
 
 use crate::config::Config;
+use crate::utils::{FNV_OFFSET, fnv1a};
+
+/// RTC clock divider - rtcClock runs 50x slower than main clock
+const RTC_CLOCK_DIVIDER: u64 = 50;
 
 pub struct GeneratedVerilator {
     pub model_name: String,
@@ -18,12 +22,7 @@ pub struct GeneratedVerilator {
 }
 
 pub fn generate_verilator(config_path: &Path) -> anyhow::Result<GeneratedVerilator> {
-    generate_verilator_with_options(
-        config_path,
-        VerilatorOptions {
-            with_monitors: false,
-        },
-    )
+    generate_verilator_with_options(config_path, VerilatorOptions::default())
 }
 
 pub fn generate_verilator_with_monitors(config_path: &Path) -> anyhow::Result<GeneratedVerilator> {
@@ -31,15 +30,81 @@ pub fn generate_verilator_with_monitors(config_path: &Path) -> anyhow::Result<Ge
         config_path,
         VerilatorOptions {
             with_monitors: true,
+            ..VerilatorOptions::default()
         },
     )
 }
 
-struct VerilatorOptions {
-    with_monitors: bool,
+#[derive(Debug, Clone, Copy, Default)]
+pub struct VerilatorOptions {
+    /// Keep the TileLink protocol monitors in the generated RTL.
+    pub with_monitors: bool,
+    /// Build with `--savable` so the wrapper can save and restore checkpoints.
+    /// Verilator does not support this for multithreaded models, so savable
+    /// models are built single-threaded.
+    pub savable: bool,
+    /// Trace to compressed FST (written on a separate thread) instead of VCD.
+    pub fst: bool,
+    /// Build single-threaded models, for test farms that run one simulation
+    /// per core.
+    pub single_threaded: bool,
+    pub profile: Profile,
+}
+
+/// Named set of Verilator build flags.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub enum Profile {
+    /// Traceable and multithreaded.
+    #[default]
+    Trace,
+    /// No tracing, one thread, `--x-assign fast` and C++ PGO trained on
+    /// CoreMark. Set `SVAROG_VERILATOR_PGO=0` to skip the training run.
+    Fast,
+    /// Traceable, with assertions kept, X values randomised and Verilator's
+    /// own optimisations off.
+    Debug,
+}
+
+impl Profile {
+    pub fn from_name(name: &str) -> Option<Self> {
+        match name {
+            "trace" => Some(Profile::Trace),
+            "fast" => Some(Profile::Fast),
+            "debug" => Some(Profile::Debug),
+            _ => None,
+        }
+    }
+
+    pub fn name(&self) -> &'static str {
+        match self {
+            Profile::Trace => "trace",
+            Profile::Fast => "fast",
+            Profile::Debug => "debug",
+        }
+    }
+
+    pub fn traces(&self) -> bool {
+        *self != Profile::Fast
+    }
+
+    /// The profile to build `config_path` with: `SVAROG_VERILATOR_PROFILE`,
+    /// else the config's `verilatorProfile`, else [`Profile::Trace`].
+    pub fn for_config(config_path: &Path) -> anyhow::Result<Self> {
+        let name = match std::env::var("SVAROG_VERILATOR_PROFILE") {
+            Ok(name) => Some(name),
+            Err(_) => Config::from_file(config_path)?
+                .verilator_profile()
+                .map(str::to_owned),
+        };
+        match name {
+            Some(name) => Profile::from_name(&name)
+                .ok_or_else(|| anyhow::anyhow!("Unknown Verilator profile {name:?}")),
+            None => Ok(Profile::default()),
+        }
+    }
 }
 
-fn generate_verilator_with_options(
+pub fn generate_verilator_with_options(
     config_path: &Path,
     options: VerilatorOptions,
 ) -> anyhow::Result<GeneratedVerilator> {
@@ -54,10 +119,8 @@ fn generate_verilator_with_options(
     };
     let wrapper_model_name = format!("{model_name}{wrapper_suffix}");
     let model_identifier = wrapper_model_name.replace("-", "_");
-    let verilator_output = build_verilator(config_path, &model_identifier, options.with_monitors)?;
-
-    let file = File::open(config_path)?;
-    let config: Config = yaml_serde::from_reader(file)?;
+    let config = Config::from_file(config_path)?;
+    let verilator_output = build_verilator(config_path, &config, &model_identifier, &options)?;
 
     let wrapper_pascal = to_pascal_case(&wrapper_model_name);
     let struct_name = format_ident!("{}Wrapper", wrapper_pascal);
@@ -72,7 +135,50 @@ fn generate_verilator_with_options(
     let ffi_ident = format_ident!("ffi_{}", model_identifier);
     let xlen = config.xlen();
     let isa = config.isa().unwrap_or("rv32i").to_string();
+    let profile_name = options.profile.name();
     let num_uarts = config.num_uarts();
+    let uart_baud_dividers = config.uart_baud_dividers();
+    let (tcm_bases, tcm_lengths): (Vec<u64>, Vec<u64>) = config.tcm_regions()?.into_iter().unzip();
+
+    let trace_extension = if options.fst { "fst" } else { "vcd" };
+
+    let checkpoint_bridge = if options.savable {
+        quote! {
+            fn save_checkpoint(self: Pin<&mut #verilator_type>, path: &str) -> bool;
+            fn restore_checkpoint(self: Pin<&mut #verilator_type>, path: &str) -> bool;
+        }
+    } else {
+        quote! {}
+    };
+    let checkpoint_impl = if options.savable {
+        quote! {
+            fn supports_checkpoints(&self) -> bool {
+                true
+            }
+
+            fn save_checkpoint(&self, path: &str) -> bool {
+                self.model.borrow_mut().pin_mut().save_checkpoint(path)
+            }
+
+            fn restore_checkpoint(&self, path: &str) -> bool {
+                self.model.borrow_mut().pin_mut().restore_checkpoint(path)
+            }
+        }
+    } else {
+        quote! {
+            fn supports_checkpoints(&self) -> bool {
+                false
+            }
+
+            fn save_checkpoint(&self, _path: &str) -> bool {
+                false
+            }
+
+            fn restore_checkpoint(&self, _path: &str) -> bool {
+                false
+            }
+        }
+    };
 
     let mut uart_bridge = quote! {};
     for i in 0..num_uarts {
@@ -110,7 +216,7 @@ fn generate_verilator_with_options(
 
         use cxx::UniquePtr;
 
-        use crate::core::SimulatorImpl;
+        use crate::core::{RunStatus, SimulatorImpl, StopReason};
 
         #[cxx::bridge(namespace = #namespace)]
         pub mod #ffi_ident {
@@ -122,13 +228,32 @@ fn generate_verilator_with_options(
 
                 fn #factory_fn() -> UniquePtr<#verilator_type>;
 
-                fn open_vcd(self: Pin<&mut #verilator_type>, path: &str);
+                fn open_vcd(self: Pin<&mut #verilator_type>, path: &str, depth: u32, scope: &str);
                 fn dump_vcd(self: Pin<&mut #verilator_type>, timestamp: u64);
                 fn close_vcd(self: Pin<&mut #verilator_type>);
 
                 fn eval(self: Pin<&mut #verilator_type>);
                 fn final_eval(self: Pin<&mut #verilator_type>);
 
+                fn tick(self: Pin<&mut #verilator_type>, dump: bool);
+                fn run_cycles(self: Pin<&mut #verilator_type>, cycles: u64, dump: bool) -> u64;
+                fn last_stop_reason(&self) -> u8;
+                fn set_idle_skip(self: Pin<&mut #verilator_type>, enable: bool);
+
+                fn preload_tcm(self: Pin<&mut #verilator_type>, base_address: u64, image_path: &str) -> bool;
+
+                #checkpoint_bridge
+
+                fn retire_enable(self: Pin<&mut #verilator_type>, enable: bool);
+                fn retire_read(self: Pin<&mut #verilator_type>, buf: &mut [u64]) -> usize;
+
+                fn backdoor_read_reg(self: Pin<&mut #verilator_type>, hart: u8, reg: u8) -> u64;
+                fn backdoor_read_mem(self: Pin<&mut #verilator_type>, addr: u64, words: &mut [u64]) -> usize;
+
+                fn uart_attach(self: Pin<&mut #verilator_type>, index: usize);
+                fn uart_read(self: Pin<&mut #verilator_type>, index: usize, buf: &mut [u8]) -> usize;
+                fn uart_write(self: Pin<&mut #verilator_type>, index: usize, data: &[u8]) -> usize;
+
                 fn get_clock(&self) -> u8;
                 fn set_clock(self: Pin<&mut #verilator_type>, value: u8);
                 fn get_reset(&self) -> u8;
@@ -195,6 +320,7 @@ fn generate_verilator_with_options(
                 fn get_debug_reg_res_bits(&self) -> u32;
 
                 fn get_debug_halted(&self) -> u8;
+                fn get_debug_sleeping(&self) -> u8;
 
                 #uart_bridge
             }
@@ -204,6 +330,11 @@ fn generate_verilator_with_options(
             model: RefCell<UniquePtr<#ffi_ident::#verilator_type>>,
         }
 
+        // SAFETY: each instance owns its VerilatedContext and model outright
+        // and all access goes through &mut, so moving it to another thread is
+        // fine. It is still not Sync.
+        unsafe impl Send for #ffi_ident::#verilator_type {}
+
         impl #struct_name {
             pub fn new() -> Self {
                 Self {
@@ -225,6 +356,10 @@ fn generate_verilator_with_options(
                 #model_name
             }
 
+            fn build_profile(&self) -> &'static str {
+                #profile_name
+            }
+
             fn eval(&self) {
                 self.model.borrow_mut().pin_mut().eval();
             }
@@ -233,8 +368,12 @@ fn generate_verilator_with_options(
                 self.model.borrow_mut().pin_mut().final_eval();
             }
 
-            fn open_vcd(&self, path: &str) {
-                self.model.borrow_mut().pin_mut().open_vcd(path);
+            fn trace_extension(&self) -> &'static str {
+                #trace_extension
+            }
+
+            fn open_vcd(&self, path: &str, depth: u32, scope: &str) {
+                self.model.borrow_mut().pin_mut().open_vcd(path, depth, scope);
             }
 
             fn dump_vcd(&self, timestamp: u64) {
@@ -245,6 +384,67 @@ fn generate_verilator_with_options(
                 self.model.borrow_mut().pin_mut().close_vcd();
             }
 
+            fn tick(&self, dump_vcd: bool) {
+                self.model.borrow_mut().pin_mut().tick(dump_vcd);
+            }
+
+            fn run_cycles(&self, cycles: u64, dump_vcd: bool) -> RunStatus {
+                let mut model = self.model.borrow_mut();
+                let cycles = model.pin_mut().run_cycles(cycles, dump_vcd);
+                let reason = match model.last_stop_reason() {
+                    1 => StopReason::Halted,
+                    2 => StopReason::UartFull,
+                    3 => StopReason::RetireFull,
+                    _ => StopReason::Budget,
+                };
+                RunStatus { cycles, reason }
+            }
+
+            fn set_idle_skip(&self, enable: bool) {
+                self.model.borrow_mut().pin_mut().set_idle_skip(enable);
+            }
+
+            fn tcm_regions(&self) -> &'static [(u64, u64)] {
+                &[#((#tcm_bases, #tcm_lengths)),*]
+            }
+
+            fn preload_tcm(&self, base_address: u64, image_path: &str) -> bool {
+                self.model
+                    .borrow_mut()
+                    .pin_mut()
+                    .preload_tcm(base_address, image_path)
+            }
+
+            #checkpoint_impl
+
+            fn retire_enable(&self, enable: bool) {
+                self.model.borrow_mut().pin_mut().retire_enable(enable);
+            }
+
+            fn retire_read(&self, buf: &mut [u64]) -> usize {
+                self.model.borrow_mut().pin_mut().retire_read(buf)
+            }
+
+            fn backdoor_read_reg(&self, hart: u8, reg: u8) -> u64 {
+                self.model.borrow_mut().pin_mut().backdoor_read_reg(hart, reg)
+            }
+
+            fn backdoor_read_mem(&self, addr: u64, words: &mut [u64]) -> usize {
+                self.model.borrow_mut().pin_mut().backdoor_read_mem(addr, words)
+            }
+
+            fn uart_attach(&self, index: usize) {
+                self.model.borrow_mut().pin_mut().uart_attach(index);
+            }
+
+            fn uart_read(&self, index: usize, buf: &mut [u8]) -> usize {
+                self.model.borrow_mut().pin_mut().uart_read(index, buf)
+            }
+
+            fn uart_write(&self, index: usize, data: &[u8]) -> usize {
+                self.model.borrow_mut().pin_mut().uart_write(index, data)
+            }
+
             fn get_clock(&self) -> u8 {
                 self.model.borrow().get_clock()
             }
@@ -512,6 +712,10 @@ fn generate_verilator_with_options(
                 self.model.borrow().get_debug_halted()
             }
 
+            fn get_debug_sleeping(&self) -> u8 {
+                self.model.borrow().get_debug_sleeping()
+            }
+
             fn get_uart_0_txd(&self) -> u8 {
                 #uart0_get
             }
@@ -534,7 +738,9 @@ fn generate_verilator_with_options(
         &model_identifier,
         &verilator_type.to_string(),
         &factory_fn.to_string(),
-        num_uarts,
+        &uart_baud_dividers,
+        config.dual_issue(),
+        &options,
     );
     let mut cpp_header_file = File::create(header_path)?;
     cpp_header_file.write_all(cpp_header.as_bytes())?;
@@ -550,8 +756,9 @@ fn generate_verilator_with_options(
 
 fn build_verilator(
     config_path: &Path,
+    config: &Config,
     model_identifier: &str,
-    with_monitors: bool,
+    options: &VerilatorOptions,
 ) -> anyhow::Result<PathBuf> {
     let manifest_dir = PathBuf::from(std::env::var("CARGO_MANIFEST_DIR")?)
         .parent()
@@ -564,45 +771,373 @@ fn build_verilator(
         .join(model_identifier);
 
     let sh = Shell::new().unwrap();
-    sh.change_dir(manifest_dir);
+    sh.change_dir(&manifest_dir);
 
-    if with_monitors {
+    if options.with_monitors {
         cmd!(sh, "./mill -i svarog.runMain svarog.VerilogGenerator --simulator-debug-iface=true --with-monitors=true --target-dir={out_path} --config={config_path}").run()?;
     } else {
         cmd!(sh, "./mill -i svarog.runMain svarog.VerilogGenerator --simulator-debug-iface=true --target-dir={out_path} --config={config_path}").run()?;
     }
 
     let verilog_file = out_path.join("SvarogSoC.sv");
-    let verilator_output = out_path.join("verilated");
+    let threads = if options.savable || options.single_threaded || options.profile != Profile::Trace
+    {
+        "1"
+    } else {
+        "4"
+    };
+    let mut flags = vec![
+        "--prefix",
+        model_identifier,
+        "-Wno-fatal",
+        "-Wno-UNUSEDSIGNAL",
+        "--cc",
+    ];
+    if !options.profile.traces() {
+        // No tracing
+    } else if options.fst {
+        flags.extend(["--trace-fst", "--trace-threads", "2"]);
+    } else {
+        flags.push("--trace");
+    }
+    match options.profile {
+        Profile::Trace => flags.extend(["-O3", "--no-assert"]),
+        Profile::Fast => flags.extend([
+            "-O3",
+            "--no-assert",
+            "--x-assign",
+            "fast",
+            "--x-initial",
+            "fast",
+        ]),
+        Profile::Debug => flags.extend(["-O0", "--x-assign", "unique", "--x-initial", "unique"]),
+    }
+    flags.extend(["--build", "--threads", threads]);
+    if options.savable {
+        flags.push("--savable");
+    }
+    let pgo = options.profile == Profile::Fast
+        && std::env::var("SVAROG_VERILATOR_PGO").map_or(true, |value| value != "0");
+    let pgo_use = [
+        "-CFLAGS",
+        "-fprofile-use",
+        "-CFLAGS",
+        "-fprofile-correction",
+        "-CFLAGS",
+        "-Wno-missing-profile",
+    ];
+    let key_flags: Vec<&str> = if pgo {
+        flags.iter().chain(&pgo_use).copied().collect()
+    } else {
+        flags.clone()
+    };
+
+    // The same design, flags and Verilator always give the same model, so
+    // reuse it whichever crate or clean build produced it first.
+    let version = cmd!(sh, "verilator --version").read()?;
+    let key = cache_key(&std::fs::read(&verilog_file)?, &key_flags, &version);
+    let cache_dir = verilator_cache_dir(&manifest_dir);
+    let verilator_output = cache_dir.join(format!("{model_identifier}-{key:016x}"));
+    if verilator_output.exists() {
+        return Ok(verilator_output);
+    }
+
+    // Build next to the final path and rename it into place, so a build
+    // that is interrupted or races another one never leaves a partial entry
+    std::fs::create_dir_all(&cache_dir)?;
+    let staging = cache_dir.join(format!(
+        "{model_identifier}-{key:016x}.tmp{}",
+        std::process::id()
+    ));
+    if staging.exists() {
+        std::fs::remove_dir_all(&staging)?;
+    }
+    if pgo {
+        train_pgo(
+            &sh,
+            &manifest_dir,
+            config,
+            model_identifier,
+            &flags,
+            &staging,
+            &verilog_file,
+        )?;
+        flags.extend(pgo_use);
+    }
+    cmd!(sh, "verilator {flags...} -Mdir {staging} {verilog_file}").run()?;
+
+    if let Err(err) = std::fs::rename(&staging, &verilator_output) {
+        if !verilator_output.exists() {
+            return Err(err.into());
+        }
+        std::fs::remove_dir_all(&staging)?;
+    }
+
+    Ok(verilator_output)
+}
+
+/// HpmEvent numbers the retire trace counts per instruction: HazardStall,
+/// FetchStall, BranchFlush, LoadWait, StoreWait, MulDivBusy, ICacheMiss and
+/// DCacheMiss. Must match `STALL_EVENTS` in the simulator crate.
+const PROFILED_EVENTS: [u8; 8] = [3, 4, 7, 8, 9, 10, 13, 15];
+
+/// Cycles the PGO training run simulates, enough for a one-iteration
+/// CoreMark to finish and print its report.
+const PGO_TRAINING_CYCLES: u64 = 4_000_000;
+
+/// First half of the PGO build: compile the model in `mdir` with
+/// `-fprofile-generate` and run it through CoreMark. The profile lands next
+/// to the objects, which are then removed so the final build in the same
+/// directory recompiles every file against it.
+fn train_pgo(
+    sh: &Shell,
+    workspace_dir: &Path,
+    config: &Config,
+    model_identifier: &str,
+    flags: &[&str],
+    mdir: &Path,
+    verilog_file: &Path,
+) -> anyhow::Result<()> {
+    let isa = config.isa().unwrap_or("rv32i");
+    let &(tcm_base, _) = config
+        .tcm_regions()?
+        .first()
+        .ok_or_else(|| anyhow::anyhow!("PGO training needs a TCM to run CoreMark from"))?;
+    let out_dir = PathBuf::from(std::env::var("OUT_DIR")?).join("pgo");
+    std::fs::create_dir_all(&out_dir)?;
+    let coremark =
+        crate::utils::build_coremark(workspace_dir, isa, 1, 1, &out_dir.join(model_identifier))?;
+    let image = coremark.join("coremark.hex");
+
+    let trainer = out_dir.join(format!("{model_identifier}_train.cpp"));
+    std::fs::write(
+        &trainer,
+        generate_pgo_trainer(model_identifier, tcm_base, PGO_TRAINING_CYCLES),
+    )?;
 
     cmd!(
         sh,
-        "verilator
-        --prefix {model_identifier}
-         -Wno-fatal
-         -Wno-UNUSEDSIGNAL
-         --cc
-         --trace
-         -O3
-         --build
-         --threads 4
-         --no-assert
-         -Mdir {verilator_output}
-         {verilog_file}"
+        "verilator {flags...} -CFLAGS -fprofile-generate -LDFLAGS -fprofile-generate --exe {trainer} -o pgo_train -Mdir {mdir} {verilog_file}"
     )
     .run()?;
+    let tcm_arg = format!("+svarog_tcm_{tcm_base:x}={}", image.display());
+    let train = mdir.join("pgo_train");
+    cmd!(sh, "{train} {tcm_arg}").run()?;
+
+    for entry in std::fs::read_dir(mdir)? {
+        let path = entry?.path();
+        if matches!(
+            path.extension().and_then(|ext| ext.to_str()),
+            Some("o" | "a")
+        ) {
+            std::fs::remove_file(path)?;
+        }
+    }
+    Ok(())
+}
 
-    Ok(verilator_output)
+/// A bare driver that boots every hart at the start of the TCM image and
+/// runs for `cycles`, the same way the Rust wrapper starts a program.
+fn generate_pgo_trainer(model_identifier: &str, entry: u64, cycles: u64) -> String {
+    format!(
+        r#"#include <cstdint>
+#include <memory>
+
+#include "verilated.h"
+#include "{model_identifier}.h"
+
+double sc_time_stamp() {{ return 0; }}
+
+int main(int argc, char **argv) {{
+    auto context = std::make_unique<VerilatedContext>();
+    context->commandArgs(argc, argv);
+    auto model = std::make_unique<{model_identifier}>(context.get());
+
+    uint64_t rtc_counter = 0;
+    auto tick = [&]() {{
+        if (++rtc_counter >= {RTC_CLOCK_DIVIDER}) {{
+            rtc_counter = 0;
+            model->io_rtcClock = !model->io_rtcClock;
+        }}
+        model->clock = 0;
+        model->eval();
+        model->clock = 1;
+        model->eval();
+    }};
+
+    model->io_idle_skip_valid = 0;
+    model->reset = 1;
+    tick();
+    tick();
+    model->reset = 0;
+    tick();
+
+    model->io_debug_hart_in_id_valid = 1;
+    model->io_debug_hart_in_id_bits = 0xff;
+    model->io_debug_hart_in_bits_setPC_valid = 1;
+    model->io_debug_hart_in_bits_setPC_bits_pc = {entry:#x};
+    tick();
+    model->io_debug_hart_in_bits_setPC_valid = 0;
+    model->io_debug_hart_in_bits_halt_valid = 1;
+    model->io_debug_hart_in_bits_halt_bits = 0;
+    tick();
+    model->io_debug_hart_in_bits_halt_valid = 0;
+    model->io_debug_hart_in_id_valid = 0;
+
+    for (uint64_t cycle = 0; cycle < {cycles}u; ++cycle) {{
+        tick();
+    }}
+    model->final();
+    return 0;
+}}
+"#
+    )
+}
+
+/// Where built models are kept: `SVAROG_VERILATOR_CACHE`, or
+/// `target/verilator-cache` in the work tree.
+fn verilator_cache_dir(workspace_dir: &Path) -> PathBuf {
+    match std::env::var_os("SVAROG_VERILATOR_CACHE") {
+        Some(dir) => PathBuf::from(dir),
+        None => workspace_dir.join("target/verilator-cache"),
+    }
+}
+
+/// FNV-1a over everything that goes into a Verilated model, each part
+/// followed by a zero byte.
+fn cache_key(verilog: &[u8], flags: &[&str], version: &str) -> u64 {
+    let parts = std::iter::once(verilog)
+        .chain(flags.iter().map(|flag| flag.as_bytes()))
+        .chain(std::iter::once(version.as_bytes()));
+    parts.fold(FNV_OFFSET, |hash, part| fnv1a(fnv1a(hash, part), &[0]))
 }
 
 fn generate_cpp_header(
     model_identifier: &str,
     class_name: &str,
     factory_fn: &str,
-    num_uarts: usize,
+    uart_baud_dividers: &[u32],
+    dual_issue: bool,
+    options: &VerilatorOptions,
 ) -> String {
+    let (trace_include, trace_on, trace_methods, trace_member) = if options.profile.traces() {
+        let (header, trace_type) = if options.fst {
+            ("verilated_fst_c.h", "VerilatedFstC")
+        } else {
+            ("verilated_vcd_c.h", "VerilatedVcdC")
+        };
+        (
+            format!("#include \"{header}\"\n"),
+            "        context_->traceEverOn(true);\n",
+            format!(
+                r#"    // The traced depth and scope are fixed by the first open; reopening only
+    // switches the output file.
+    void open_vcd(rust::Str path, uint32_t depth, rust::Str scope) {{
+        if (vcd_) {{
+            vcd_->close();
+        }}
+
+        if (!vcd_) {{
+            vcd_ = std::make_unique<{trace_type}>();
+            if (scope.empty()) {{
+                model_->trace(vcd_.get(), depth);
+            }} else {{
+                vcd_->dumpvars(depth, std::string(scope));
+                model_->trace(vcd_.get(), 99);
+            }}
+        }}
+
+        vcd_->open(std::string(path).c_str());
+    }}
+
+    void dump_vcd(uint64_t timestamp) {{
+        if (vcd_) {{
+            vcd_->dump(timestamp);
+        }}
+    }}
+
+    void close_vcd() {{
+        if (vcd_) {{
+            vcd_->close();
+        }}
+    }}
+"#
+            ),
+            format!("    std::unique_ptr<{trace_type}> vcd_;\n"),
+        )
+    } else {
+        (
+            String::new(),
+            "",
+            r#"    // Built without --trace, so there is nothing to dump.
+    void open_vcd(rust::Str, uint32_t, rust::Str) {
+        std::fprintf(stderr, "Model was built without tracing, no trace is written\n");
+    }
+
+    void dump_vcd(uint64_t) {}
+
+    void close_vcd() {}
+"#
+            .to_string(),
+            String::new(),
+        )
+    };
+    let (checkpoint_include, checkpoint_methods) = if options.savable {
+        (
+            "#include \"verilated_save.h\"\n",
+            r#"
+    // Checkpoints hold the model state plus the wrapper's clock bookkeeping.
+    // UART bytes still in flight are not part of them.
+    bool save_checkpoint(rust::Str path) {
+        VerilatedSave os;
+        os.open(std::string(path).c_str());
+        if (!os.isOpen()) {
+            return false;
+        }
+        os << timestamp_ << rtc_counter_;
+        os << *model_;
+        os.close();
+        return true;
+    }
+
+    bool restore_checkpoint(rust::Str path) {
+        VerilatedRestore os;
+        os.open(std::string(path).c_str());
+        if (!os.isOpen()) {
+            return false;
+        }
+        os >> timestamp_ >> rtc_counter_;
+        os >> *model_;
+        os.close();
+        started_ = true;
+        return true;
+    }
+"#,
+        )
+    } else {
+        ("", "")
+    };
+
+    let num_uarts = uart_baud_dividers.len();
     let mut uart_accessors = String::new();
-    for i in 0..num_uarts {
+    let mut uart_init = String::new();
+    let mut uart_steps = String::new();
+    for (i, divider) in uart_baud_dividers.iter().enumerate() {
+        // UART advances when its counter reaches the divider value, so each
+        // serial bit lasts (divider + 1) core cycles.
+        uart_init.push_str(&format!(
+            "        uarts_[{i}] = std::make_unique<svarog::UartChannel>({});\n",
+            divider + 1
+        ));
+        uart_steps.push_str(&format!(
+            r#"        if (uarts_[{i}]->attached) {{
+            model_->io_gpio_{rxd}_input = uarts_[{i}]->step(model_->io_gpio_{txd}_output);
+            full = full || uarts_[{i}]->tx_bytes.full();
+        }}
+"#,
+            rxd = i * 2,
+            txd = i * 2 + 1
+        ));
         uart_accessors.push_str(&format!(
             "    uint8_t get_uart_{i}_txd() const {{ return model_->io_gpio_{}_output; }}\n",
             i * 2 + 1
@@ -613,17 +1148,58 @@ fn generate_cpp_header(
         ));
     }
 
+    let profiled_count = PROFILED_EVENTS.len();
+    let profiled_events = PROFILED_EVENTS
+        .iter()
+        .map(|event| event.to_string())
+        .collect::<Vec<_>>()
+        .join(", ");
+
+    // Dual-issue harts retire the younger instruction of a pair on a second
+    // port; its record goes after the older one.
+    let retire_ports: &[&str] = if dual_issue {
+        &["io_retire", "io_retireSecond"]
+    } else {
+        &["io_retire"]
+    };
+    let retire_samples: String = retire_ports
+        .iter()
+        .map(|port| {
+            format!(
+                r#"        if (model_->{port}_valid) {{
+            const uint64_t flags = (model_->{port}_bits_memValid ? 1 : 0) |
+                                   (model_->{port}_bits_memWrite ? 2 : 0);
+            retired_.push_back(model_->{port}_bits_pc);
+            retired_.push_back(static_cast<uint64_t>(model_->{port}_bits_inst) |
+                               (static_cast<uint64_t>(model_->{port}_bits_rd) << 32) |
+                               (flags << 40));
+            retired_.push_back(model_->{port}_bits_rdWdata);
+            retired_.push_back(model_->{port}_bits_memAddr);
+            retired_.push_back(model_->{port}_bits_memWdata);
+            push_retire_profile();
+        }}
+"#
+            )
+        })
+        .collect();
+
     format!(
         r#"#pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <cstdio>
 #include <memory>
+#include <sstream>
 #include <string>
+#include <vector>
 #include "rust/cxx.h"
 
 #include "verilated.h"
-#include "verilated_vcd_c.h"
-
+{trace_include}{checkpoint_include}
 #include "{model_identifier}.h"
 
 #ifndef SVAROG_SC_TIME_STAMP_DEFINED
@@ -633,6 +1209,172 @@ inline double sc_time_stamp() {{
 }}
 #endif
 
+#ifndef SVAROG_UART_HELPERS_DEFINED
+#define SVAROG_UART_HELPERS_DEFINED
+namespace svarog {{
+
+// Lock-free single-producer/single-consumer byte queue. The simulation loop
+// owns one end and the host the other, so neither side needs a lock.
+template <size_t Capacity>
+class SpscByteRing {{
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    bool push(uint8_t byte) {{
+        const size_t head = head_.load(std::memory_order_relaxed);
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        if (head - tail == Capacity) {{
+            return false;
+        }}
+        data_[head & (Capacity - 1)] = byte;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }}
+
+    bool pop(uint8_t &byte) {{
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t head = head_.load(std::memory_order_acquire);
+        if (head == tail) {{
+            return false;
+        }}
+        byte = data_[tail & (Capacity - 1)];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }}
+
+    bool full() const {{
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire)
+            == Capacity;
+    }}
+
+    bool empty() const {{
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }}
+
+private:
+    std::array<uint8_t, Capacity> data_{{}};
+    std::atomic<size_t> head_{{0}};
+    std::atomic<size_t> tail_{{0}};
+}};
+
+// Decodes 8N1 frames from a UART TX pin sampled once per core clock cycle.
+// Idle is high; data bits are sampled in the middle of their period.
+class UartTxDecoder {{
+public:
+    explicit UartTxDecoder(uint32_t bit_period) : bit_period_(bit_period) {{}}
+
+    // Returns the decoded byte once the middle of the stop bit is reached,
+    // -1 otherwise.
+    int process(uint8_t txd) {{
+        const uint8_t bit = txd & 1;
+
+        if (!in_byte_ && prev_txd_ == 1 && bit == 0) {{
+            in_byte_ = true;
+            cycles_since_start_ = 0;
+            num_bits_ = 0;
+            data_ = 0;
+        }}
+
+        if (in_byte_) {{
+            ++cycles_since_start_;
+
+            const uint32_t sample_time =
+                bit_period_ + bit_period_ / 2 + num_bits_ * bit_period_;
+            if (num_bits_ < 8 && cycles_since_start_ == sample_time) {{
+                data_ |= static_cast<uint8_t>(bit << num_bits_);
+                ++num_bits_;
+            }}
+
+            const uint32_t stop_sample_time = bit_period_ * 9 + bit_period_ / 2;
+            if (num_bits_ == 8 && cycles_since_start_ >= stop_sample_time) {{
+                in_byte_ = false;
+                return data_;
+            }}
+        }}
+
+        prev_txd_ = bit;
+        return -1;
+    }}
+
+    bool busy() const {{ return in_byte_; }}
+
+private:
+    uint32_t bit_period_;
+    uint8_t prev_txd_ = 1;
+    bool in_byte_ = false;
+    uint32_t cycles_since_start_ = 0;
+    uint32_t num_bits_ = 0;
+    uint8_t data_ = 0;
+}};
+
+// Serialises bytes onto a UART RX pin as 8N1 frames, one level per cycle.
+class UartRxEncoder {{
+public:
+    explicit UartRxEncoder(uint32_t bit_period) : bit_period_(bit_period) {{}}
+
+    // Returns the RX level for the next cycle, pulling a new byte from `queue`
+    // whenever the previous frame has been fully sent.
+    template <typename Queue>
+    uint8_t next(Queue &queue) {{
+        if (!in_frame_) {{
+            uint8_t byte;
+            if (!queue.pop(byte)) {{
+                return 1;
+            }}
+            // Start bit, 8 data bits LSB first, stop bit.
+            frame_ = static_cast<uint16_t>((1u << 9) | (static_cast<uint16_t>(byte) << 1));
+            in_frame_ = true;
+            bit_index_ = 0;
+            cycles_in_bit_ = 0;
+        }}
+
+        const uint8_t level = (frame_ >> bit_index_) & 1;
+        if (++cycles_in_bit_ == bit_period_) {{
+            cycles_in_bit_ = 0;
+            if (++bit_index_ == 10) {{
+                in_frame_ = false;
+            }}
+        }}
+        return level;
+    }}
+
+    bool busy() const {{ return in_frame_; }}
+
+private:
+    uint32_t bit_period_;
+    bool in_frame_ = false;
+    uint16_t frame_ = 0;
+    uint32_t bit_index_ = 0;
+    uint32_t cycles_in_bit_ = 0;
+}};
+
+// Host-side endpoint of one UART: decoded TX bytes waiting to be drained and
+// RX bytes waiting to be shifted in.
+struct UartChannel {{
+    explicit UartChannel(uint32_t bit_period) : decoder(bit_period), encoder(bit_period) {{}}
+
+    // Samples this cycle's TX level and returns the RX level for the next one.
+    uint8_t step(uint8_t txd) {{
+        const int byte = decoder.process(txd);
+        if (byte >= 0) {{
+            tx_bytes.push(static_cast<uint8_t>(byte));
+        }}
+        return encoder.next(rx_bytes);
+    }}
+
+    // Nothing in flight on either pin, so skipping cycles loses no bits.
+    bool idle() const {{ return !decoder.busy() && !encoder.busy() && rx_bytes.empty(); }}
+
+    bool attached = false;
+    UartTxDecoder decoder;
+    UartRxEncoder encoder;
+    SpscByteRing<4096> tx_bytes;
+    SpscByteRing<4096> rx_bytes;
+}};
+
+}} // namespace svarog
+#endif
+
 namespace svarog::{model_identifier} {{
 
 class {class_name} {{
@@ -641,8 +1383,7 @@ public:
         : context_(std::make_unique<VerilatedContext>()),
           model_(std::make_unique<::{model_identifier}>(context_.get())) {{
         context_->commandArgs(0, static_cast<const char **>(nullptr));
-        context_->traceEverOn(true);
-    }}
+{trace_on}{uart_init}    }}
 
     ~{class_name}() {{
         close_vcd();
@@ -651,33 +1392,161 @@ public:
         }}
     }}
 
-    void open_vcd(rust::Str path) {{
-        if (vcd_) {{
-            vcd_->close();
+{trace_methods}
+    void eval() {{
+        started_ = true;
+        model_->eval();
+    }}
+    void final_eval() {{ model_->final(); }}
+
+    // One full clock cycle: divide down the RTC clock, then drive the falling
+    // and rising edges, dumping each to the VCD when requested.
+    void tick(bool dump) {{ step(dump); }}
+
+    // Runs up to `cycles` clock cycles without returning to the caller. Stops
+    // early when the hart halts, or when an attached UART's TX buffer or the
+    // retire trace fills up and has to be drained. Returns the number of cycles actually run;
+    // last_stop_reason() tells why it returned.
+    //
+    // While every hart sleeps in wfi, and idle skipping is on and nothing is
+    // traced, whole RTC periods up to just before the next timer interrupt
+    // are folded into a single cycle. They still count towards `cycles`.
+    uint64_t run_cycles(uint64_t cycles, bool dump) {{
+        stop_reason_ = STOP_BUDGET;
+        uint64_t ran = 0;
+        while (ran < cycles) {{
+            ++ran;
+            const bool full = step(dump);
+            model_->io_idle_skip_valid = 0;
+            if (full) {{
+                stop_reason_ = STOP_UART_FULL;
+                break;
+            }}
+
+            if (retired_.size() - retired_read_ >= RETIRE_CAPACITY * RETIRE_WORDS) {{
+                stop_reason_ = STOP_RETIRE_FULL;
+                break;
+            }}
+
+            if (model_->io_debug_halted) {{
+                stop_reason_ = STOP_HALTED;
+                break;
+            }}
+
+            if (idle_skip_ && !dump && ran < cycles) {{
+                ran += arm_idle_skip(cycles - ran - 1);
+            }}
         }}
+        return ran;
+    }}
 
-        if (!vcd_) {{
-            vcd_ = std::make_unique<VerilatedVcdC>();
-            model_->trace(vcd_.get(), 99);
+    // Lets run_cycles() fast-forward through wfi sleeps. On by default.
+    void set_idle_skip(bool enable) {{ idle_skip_ = enable; }}
+
+    uint8_t last_stop_reason() const {{ return stop_reason_; }}
+
+    // Points the TCM at `base_address` to a $readmemh image. The TCM reads it
+    // from an initial block, so this only works before the first eval().
+    bool preload_tcm(uint64_t base_address, rust::Str image_path) {{
+        if (started_) {{
+            return false;
         }}
+        std::ostringstream arg;
+        arg << "+svarog_tcm_" << std::hex << base_address << "=" << std::string(image_path);
+        const std::string value = arg.str();
+        const char *argv[] = {{value.c_str()}};
+        context_->commandArgsAdd(1, argv);
+        return true;
+    }}
+{checkpoint_methods}
+    // Records every instruction hart 0 retires from tick() onwards, until
+    // disabled again. Either way, anything not yet read is dropped.
+    void retire_enable(bool enable) {{
+        retire_enabled_ = enable;
+        retired_.clear();
+        retired_read_ = 0;
+        retire_cycle_ = timestamp_ / 2;
+        event_counts_.fill(0);
+    }}
 
-        vcd_->open(std::string(path).c_str());
+    // Moves whole retire records (RETIRE_WORDS words each, see Retirement in
+    // the simulator crate) into `buf`, returning how many were copied.
+    // Records are consumed by advancing a read index rather than erasing
+    // them, so draining a full buffer in small reads stays linear.
+    size_t retire_read(rust::Slice<uint64_t> buf) {{
+        const auto first = retired_.begin() + retired_read_;
+        const size_t available = (retired_.size() - retired_read_) / RETIRE_WORDS;
+        const size_t count = std::min(buf.size() / RETIRE_WORDS, available);
+        std::copy(first, first + count * RETIRE_WORDS, buf.begin());
+        retired_read_ += count * RETIRE_WORDS;
+        if (retired_read_ == retired_.size()) {{
+            retired_.clear();
+            retired_read_ = 0;
+        }} else if (retired_read_ >= RETIRE_CAPACITY * RETIRE_WORDS) {{
+            // A reader that never catches up still keeps the buffer bounded
+            retired_.erase(retired_.begin(), retired_.begin() + retired_read_);
+            retired_read_ = 0;
+        }}
+        return count;
     }}
 
-    void dump_vcd(uint64_t timestamp) {{
-        if (vcd_) {{
-            vcd_->dump(timestamp);
+    // Reads a register of `hart` through the SoC's backdoor port. Only
+    // combinational logic is evaluated, so no cycle passes.
+    uint64_t backdoor_read_reg(uint8_t hart, uint8_t reg) {{
+        started_ = true;
+        model_->io_backdoor_hart = hart;
+        model_->io_backdoor_reg = reg;
+        model_->eval();
+        return model_->io_backdoor_regData;
+    }}
+
+    // Reads consecutive TCM words from `addr` the same way, stopping early at
+    // the first word outside every TCM. Returns how many were read.
+    size_t backdoor_read_mem(uint64_t addr, rust::Slice<uint64_t> words) {{
+        constexpr uint64_t word_bytes = sizeof(model_->io_backdoor_memData);
+        started_ = true;
+        size_t count = 0;
+        for (; count < words.size(); ++count) {{
+            model_->io_backdoor_memAddr = addr + count * word_bytes;
+            model_->eval();
+            if (!model_->io_backdoor_memHit) {{
+                break;
+            }}
+            words[count] = model_->io_backdoor_memData;
         }}
+        return count;
     }}
 
-    void close_vcd() {{
-        if (vcd_) {{
-            vcd_->close();
+    // Starts decoding TX and driving RX of the given UART from tick() onwards.
+    void uart_attach(size_t index) {{
+        if (index < uarts_.size()) {{
+            uarts_[index]->attached = true;
         }}
     }}
 
-    void eval() {{ model_->eval(); }}
-    void final_eval() {{ model_->final(); }}
+    // Drains decoded TX bytes into `buf`, returning how many were copied.
+    size_t uart_read(size_t index, rust::Slice<uint8_t> buf) {{
+        if (index >= uarts_.size()) {{
+            return 0;
+        }}
+        size_t count = 0;
+        while (count < buf.size() && uarts_[index]->tx_bytes.pop(buf[count])) {{
+            ++count;
+        }}
+        return count;
+    }}
+
+    // Queues bytes for the UART RX pin, returning how many were accepted.
+    size_t uart_write(size_t index, rust::Slice<const uint8_t> data) {{
+        if (index >= uarts_.size()) {{
+            return 0;
+        }}
+        size_t count = 0;
+        while (count < data.size() && uarts_[index]->rx_bytes.push(data[count])) {{
+            ++count;
+        }}
+        return count;
+    }}
 
     uint8_t get_clock() const {{ return model_->clock; }}
     void set_clock(uint8_t value) {{ model_->clock = value; }}
@@ -745,11 +1614,133 @@ public:
     uint32_t get_debug_reg_res_bits() const {{ return model_->io_debug_reg_res_bits; }}
 
     uint8_t get_debug_halted() const {{ return model_->io_debug_halted; }}
+    uint8_t get_debug_sleeping() const {{ return model_->io_debug_sleeping; }}
 
 {uart_accessors}private:
+    // Must match StopReason decoding in the Rust wrapper.
+    enum : uint8_t {{
+        STOP_BUDGET = 0,
+        STOP_HALTED = 1,
+        STOP_UART_FULL = 2,
+        STOP_RETIRE_FULL = 3,
+    }};
+
+    static constexpr size_t RETIRE_WORDS = 8;
+    static constexpr size_t RETIRE_CAPACITY = 4096;
+
+    // Body of tick(). Returns true when an attached UART has no room left for
+    // decoded bytes.
+    bool step(bool dump) {{
+        started_ = true;
+        if (++rtc_counter_ >= {RTC_CLOCK_DIVIDER}) {{
+            rtc_counter_ = 0;
+            model_->io_rtcClock = !model_->io_rtcClock;
+        }}
+
+        model_->clock = 0;
+        model_->eval();
+        if (dump) {{
+            dump_vcd(timestamp_);
+        }}
+        ++timestamp_;
+
+        model_->clock = 1;
+        model_->eval();
+        if (dump) {{
+            dump_vcd(timestamp_);
+        }}
+        ++timestamp_;
+
+        if (retire_enabled_) {{
+            count_events();
+            sample_retire();
+        }}
+        return step_uarts();
+    }}
+
+    // Sets up a skip for the next step() when every hart sleeps and no UART
+    // has bits in flight, keeping at most `budget` extra cycles. Returns the
+    // cycles skipped, always whole RTC periods so the RTC clock phase holds.
+    uint64_t arm_idle_skip(uint64_t budget) {{
+        constexpr uint64_t period = 2 * {RTC_CLOCK_DIVIDER};
+        if (!model_->io_idle_allSleeping) {{
+            return 0;
+        }}
+        for (const auto &uart : uarts_) {{
+            if (uart && uart->attached && !uart->idle()) {{
+                return 0;
+            }}
+        }}
+
+        const uint64_t mtime = model_->io_idle_mtime;
+        const uint64_t deadline = model_->io_idle_deadline;
+        if (deadline <= mtime + 1) {{
+            return 0;
+        }}
+        const uint64_t ticks = std::min(deadline - mtime - 1, budget / period);
+        if (ticks == 0) {{
+            return 0;
+        }}
+
+        model_->io_idle_skip_valid = 1;
+        model_->io_idle_skip_bits_ticks = ticks;
+        model_->io_idle_skip_bits_cycles = ticks * period;
+        timestamp_ += 2 * ticks * period;
+        return ticks * period;
+    }}
+
+    // Writeback holds each instruction for exactly one cycle, so sampling once
+    // after the rising edge sees every retirement once.
+    void sample_retire() {{
+{retire_samples}    }}
+
+    void count_events() {{
+        static constexpr uint8_t profiled[] = {{{profiled_events}}};
+        const uint32_t events = model_->io_hpmEvents;
+        for (size_t i = 0; i < event_counts_.size(); ++i) {{
+            if (((events >> profiled[i]) & 1) != 0 && event_counts_[i] != UINT16_MAX) {{
+                ++event_counts_[i];
+            }}
+        }}
+    }}
+
+    // Ends a retire record with the cycles and event counts since the
+    // previous one, packed four 16-bit counts to a word.
+    void push_retire_profile() {{
+        const uint64_t cycle = timestamp_ / 2;
+        retired_.push_back(cycle - retire_cycle_);
+        retire_cycle_ = cycle;
+        for (size_t word = 0; word < event_counts_.size() / 4; ++word) {{
+            uint64_t packed = 0;
+            for (size_t i = 0; i < 4; ++i) {{
+                packed |= static_cast<uint64_t>(event_counts_[word * 4 + i]) << (16 * i);
+            }}
+            retired_.push_back(packed);
+        }}
+        event_counts_.fill(0);
+    }}
+
+    // Samples TX and drives RX of every attached UART. Returns true when one
+    // of them has no room left for decoded bytes.
+    bool step_uarts() {{
+        bool full = false;
+{uart_steps}        return full;
+    }}
+
     std::unique_ptr<VerilatedContext> context_;
     std::unique_ptr<::{model_identifier}> model_;
-    std::unique_ptr<VerilatedVcdC> vcd_;
+{trace_member}
+    bool started_ = false;
+    uint64_t timestamp_ = 0;
+    uint64_t rtc_counter_ = 0;
+    std::array<std::unique_ptr<svarog::UartChannel>, {num_uarts}> uarts_;
+    uint8_t stop_reason_ = STOP_BUDGET;
+    bool retire_enabled_ = false;
+    std::vector<uint64_t> retired_;
+    size_t retired_read_ = 0;
+    uint64_t retire_cycle_ = 0;
+    std::array<uint16_t, {profiled_count}> event_counts_{{}};
+    bool idle_skip_ = true;
 }};
 
 inline std::unique_ptr<{class_name}> {factory_fn}() {{
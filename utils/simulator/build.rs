@@ -18,6 +18,18 @@ fn main() -> Result<()> {
     println!("cargo:rerun-if-changed=build.rs");
     println!("cargo:rerun-if-changed=../../configs/");
     println!("cargo:rerun-if-changed=../../src/main/");
+    println!("cargo:rerun-if-env-changed=SVAROG_VERILATOR_CACHE");
+    println!("cargo:rerun-if-env-changed=SVAROG_VERILATOR_PROFILE");
+    println!("cargo:rerun-if-env-changed=SVAROG_VERILATOR_PGO");
+
+    // Checkpoint support needs Verilator's --savable, which costs us the
+    // multithreaded model, so it is opt-in.
+    let savable = std::env::var_os("CARGO_FEATURE_CHECKPOINT").is_some();
+    let fst = std::env::var_os("CARGO_FEATURE_FST").is_some();
+    let single_threaded = std::env::var_os("CARGO_FEATURE_SINGLE_THREAD").is_some();
+    // The monitored models are a second full build of every config, so only
+    // pay for them when something asks for Backend::VerilatorMonitored.
+    let monitored = std::env::var_os("CARGO_FEATURE_MONITORED").is_some();
 
     let pattern = workspace_root.join("configs/*.yaml");
     let mut verilator = vec![];
@@ -26,11 +38,44 @@ fn main() -> Result<()> {
     let mut verilator_constructors = Vec::new();
     let mut verilator_monitored_constructors = Vec::new();
     let mut include_paths = Vec::new();
+    let mut functional_names = Vec::new();
+    let mut functional_configs = Vec::new();
     for entry in glob::glob(pattern.to_str().unwrap())? {
         let path = entry?;
+        let profile = simtools::Profile::for_config(&path)?;
+
+        // The functional backend models one RV32 hart.
+        let config = simtools::Config::from_file(&path)?;
+        if config.xlen() == 32 && config.num_harts() == 1 {
+            let name = LitStr::new(
+                &path.file_stem().unwrap().to_string_lossy(),
+                Span::call_site(),
+            );
+            let isa = LitStr::new(config.isa().unwrap_or("rv32i"), Span::call_site());
+            let (tcm_bases, tcm_lengths): (Vec<u64>, Vec<u64>) =
+                config.tcm_regions()?.into_iter().unzip();
+            let uarts = config.uart_base_addresses()?;
+            functional_names.push(name.clone());
+            functional_configs.push(quote! {
+                crate::iss::FunctionalConfig {
+                    name: #name,
+                    isa: #isa,
+                    tcms: &[#((#tcm_bases, #tcm_lengths)),*],
+                    uarts: &[#(#uarts),*],
+                },
+            });
+        }
 
-        let model_info = simtools::generate_verilator(&path)?;
-        let monitored_info = simtools::generate_verilator_with_monitors(&path)?;
+        let model_info = simtools::generate_verilator_with_options(
+            &path,
+            simtools::VerilatorOptions {
+                with_monitors: false,
+                savable,
+                fst,
+                single_threaded,
+                profile,
+            },
+        )?;
         let simtools::GeneratedVerilator {
             model_name,
             model_identifier,
@@ -58,11 +103,24 @@ fn main() -> Result<()> {
         model_names.push(model_name_lit.clone());
         let wrapper_ident = format_ident!("{}", wrapper_name);
         verilator_constructors.push(quote! {
-            #model_name_lit => Some(std::rc::Rc::new(std::cell::RefCell::new(
+            #model_name_lit => Some(Box::new(std::cell::RefCell::new(
                 verilator::#wrapper_ident::new(),
             ))),
         });
 
+        if !monitored {
+            continue;
+        }
+        let monitored_info = simtools::generate_verilator_with_options(
+            &path,
+            simtools::VerilatorOptions {
+                with_monitors: true,
+                savable,
+                fst,
+                single_threaded,
+                profile,
+            },
+        )?;
         let simtools::GeneratedVerilator {
             model_identifier: monitored_identifier,
             wrapper_name: monitored_wrapper_name,
@@ -87,12 +145,17 @@ fn main() -> Result<()> {
         verilator_monitored.push(monitored_rust);
         let monitored_wrapper_ident = format_ident!("{}", monitored_wrapper_name);
         verilator_monitored_constructors.push(quote! {
-            #model_name_lit => Some(std::rc::Rc::new(std::cell::RefCell::new(
+            #model_name_lit => Some(Box::new(std::cell::RefCell::new(
                 verilator_monitored::#monitored_wrapper_ident::new(),
             ))),
         });
     }
 
+    if fst {
+        // The FST writer in libverilated compresses with zlib.
+        println!("cargo:rustc-link-lib=z");
+    }
+
     include_paths.sort();
     include_paths.dedup();
 
@@ -107,9 +170,17 @@ fn main() -> Result<()> {
 
         pub const VERILATOR_MODELS: &[&str] = &[#(#model_names),*];
 
+        pub const MONITORED: bool = #monitored;
+
+        pub const FUNCTIONAL_MODEL_NAMES: &[&str] = &[#(#functional_names),*];
+
+        pub(crate) const FUNCTIONAL_MODELS: &[crate::iss::FunctionalConfig] = &[
+            #(#functional_configs)*
+        ];
+
         pub fn create_verilator(
             model_name: &str,
-        ) -> Option<std::rc::Rc<std::cell::RefCell<dyn crate::core::SimulatorImpl>>> {
+        ) -> Option<Box<std::cell::RefCell<dyn crate::core::SimulatorImpl>>> {
             match model_name {
                 #(#verilator_constructors)*
                 _ => None,
@@ -118,7 +189,7 @@ fn main() -> Result<()> {
 
         pub fn create_verilator_monitored(
             model_name: &str,
-        ) -> Option<std::rc::Rc<std::cell::RefCell<dyn crate::core::SimulatorImpl>>> {
+        ) -> Option<Box<std::cell::RefCell<dyn crate::core::SimulatorImpl>>> {
             match model_name {
                 #(#verilator_monitored_constructors)*
                 _ => None,
@@ -1,20 +1,67 @@
-use std::rc::Rc;
-use std::{cell::RefCell, convert::TryInto, path::Path};
+use std::collections::BTreeMap;
+use std::io::{Read, Write};
+use std::ops::Range;
+use std::path::PathBuf;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::mpsc::Receiver;
+use std::{
+    cell::{Cell, RefCell},
+    convert::TryInto,
+    path::Path,
+};
 
 use anyhow::{Context, Result};
 use elf::abi::{SHF_ALLOC, SHT_NOBITS};
 use elf::{ElfBytes, endian::AnyEndian};
 
-use crate::uart::UartDecoder;
+use crate::htif::{HostCall, HostInterface};
+use crate::iss::{self, ArchState};
 use crate::{RegisterFile, TestResult};
 
-/// RTC clock divider - rtcClock runs 50x slower than main clock
-const RTC_CLOCK_DIVIDER: u64 = 50;
+/// Upper bound on cycles simulated per `run_cycles` call, so progress
+/// callbacks keep firing on long runs.
+const RUN_BATCH_CYCLES: usize = 1024;
+
+/// Cycles a halted hart gets to drain its pipeline before giving up.
+const DRAIN_TIMEOUT_CYCLES: usize = 1024;
+
+/// Debug hart id that addresses every hart (`TLChipDebugModule.AllHarts`).
+const ALL_HARTS: u8 = 0xff;
+
+/// What ends up in the trace file when a run is given a trace path.
+#[derive(Debug, Clone)]
+pub struct TraceOptions {
+    /// Hierarchy levels to trace, counted from `scope` when one is given.
+    pub depth: u32,
+    /// Verilator scope to restrict tracing to, e.g. `TOP.SvarogSoC.cpu`.
+    pub scope: Option<String>,
+    /// Main loop cycles to dump. Everything outside the window, including
+    /// reset and boot, runs untraced.
+    pub window: Option<Range<usize>>,
+}
+
+impl Default for TraceOptions {
+    fn default() -> Self {
+        TraceOptions {
+            depth: 99,
+            scope: None,
+            window: None,
+        }
+    }
+}
+
+impl TraceOptions {
+    fn traces_cycle(&self, cycle: usize) -> bool {
+        self.window.as_ref().is_none_or(|w| w.contains(&cycle))
+    }
+}
 
 #[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
 pub enum Backend {
     Verilator,
     VerilatorMonitored,
+    /// Instruction-accurate model of hart 0, see [`Simulator::fast_forward`].
+    Functional,
 }
 
 impl Backend {
@@ -22,6 +69,7 @@ impl Backend {
         match self {
             Backend::Verilator => "verilator",
             Backend::VerilatorMonitored => "verilator-monitored",
+            Backend::Functional => "functional",
         }
     }
 
@@ -29,23 +77,142 @@ impl Backend {
         match name {
             "verilator" => Some(Backend::Verilator),
             "verilator-monitored" => Some(Backend::VerilatorMonitored),
+            "functional" => Some(Backend::Functional),
             _ => None,
         }
     }
 }
 
+/// Why a batched `run_cycles` call handed control back.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub(crate) enum StopReason {
+    /// The requested number of cycles has been simulated.
+    Budget,
+    /// The hart reported `halted` through the debug interface.
+    Halted,
+    /// An attached UART's TX buffer is full and must be drained.
+    UartFull,
+    /// The retire trace buffer is full and must be drained.
+    RetireFull,
+}
+
+/// Number of `u64` words per record returned by `retire_read`.
+pub(crate) const RETIRE_WORDS: usize = 8;
+
+/// HpmEvent stall and miss events counted per retirement, in the order of
+/// [`Retirement::stalls`]. Must match `PROFILED_EVENTS` in simtools.
+pub const STALL_EVENTS: [&str; 8] = [
+    "hazard",
+    "fetch",
+    "branch_flush",
+    "load_wait",
+    "store_wait",
+    "muldiv",
+    "icache_miss",
+    "dcache_miss",
+];
+
+/// One instruction retired by hart 0, as reported by the retire trace port.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Retirement {
+    pub pc: u64,
+    pub inst: u32,
+    /// Destination register, 0 when the instruction writes no GPR.
+    pub rd: u8,
+    pub rd_wdata: u64,
+    pub mem_valid: bool,
+    pub mem_write: bool,
+    pub mem_addr: u64,
+    pub mem_wdata: u64,
+    /// Cycles since the previous retirement, ending with this one. The second
+    /// instruction of a dual-issue pair gets 0.
+    pub cycles: u64,
+    /// Cycles (or misses) of each [`STALL_EVENTS`] entry over the same span,
+    /// saturating.
+    pub stalls: [u16; STALL_EVENTS.len()],
+}
+
+impl Retirement {
+    fn from_words(words: &[u64]) -> Self {
+        let flags = words[1] >> 40;
+        Retirement {
+            pc: words[0],
+            inst: words[1] as u32,
+            rd: (words[1] >> 32) as u8 & 0x1f,
+            rd_wdata: words[2],
+            mem_valid: flags & 1 != 0,
+            mem_write: flags & 2 != 0,
+            mem_addr: words[3],
+            mem_wdata: words[4],
+            cycles: words[5],
+            stalls: std::array::from_fn(|i| (words[6 + i / 4] >> (16 * (i % 4))) as u16),
+        }
+    }
+}
+
+type RetireSink = Box<dyn FnMut(&Retirement) -> Result<()> + Send>;
+
+#[derive(Debug, Clone, Copy)]
+pub(crate) struct RunStatus {
+    pub cycles: u64,
+    pub reason: StopReason,
+}
+
+/// One model instance. Every instance owns its own `VerilatedContext`, so
+/// separate instances can run on separate threads.
 #[allow(dead_code)]
-pub(crate) trait SimulatorImpl {
+pub(crate) trait SimulatorImpl: Send {
     fn xlen(&self) -> u8;
     fn isa(&self) -> &'static str;
     fn name(&self) -> &'static str;
+    /// Verilator build profile the model was compiled with.
+    fn build_profile(&self) -> &'static str;
 
     fn eval(&self);
     fn final_eval(&self);
-    fn open_vcd(&self, path: &str);
+    /// File extension of the trace format the model was built with.
+    fn trace_extension(&self) -> &'static str;
+    fn open_vcd(&self, path: &str, depth: u32, scope: &str);
     fn dump_vcd(&self, timestamp: u64);
     fn close_vcd(&self);
 
+    /// Advance one clock cycle, dividing down the RTC clock on the way.
+    fn tick(&self, dump_vcd: bool);
+    /// Advance up to `cycles` clock cycles without crossing back into Rust,
+    /// stopping early on halt or when an attached UART's TX buffer fills up.
+    fn run_cycles(&self, cycles: u64, dump_vcd: bool) -> RunStatus;
+    /// Let `run_cycles` fast-forward while every hart sleeps in `wfi`.
+    fn set_idle_skip(&self, enable: bool);
+
+    /// Whether the model was built with `--savable`.
+    fn supports_checkpoints(&self) -> bool;
+    fn save_checkpoint(&self, path: &str) -> bool;
+    fn restore_checkpoint(&self, path: &str) -> bool;
+
+    /// `(base address, length)` of every TCM in the model.
+    fn tcm_regions(&self) -> &'static [(u64, u64)];
+    /// Have the TCM at `base_address` load a `$readmemh` image when the model
+    /// is first evaluated. Returns false once evaluation has started.
+    fn preload_tcm(&self, base_address: u64, image_path: &str) -> bool;
+
+    /// Start or stop recording retired instructions, dropping unread ones.
+    fn retire_enable(&self, enable: bool);
+    /// Copy whole retire records into `buf`, returning the number of records.
+    fn retire_read(&self, buf: &mut [u64]) -> usize;
+
+    /// Read a register of `hart` without simulating a cycle.
+    fn backdoor_read_reg(&self, hart: u8, reg: u8) -> u64;
+    /// Read consecutive TCM words from `addr` without simulating a cycle,
+    /// stopping at the first word outside every TCM. Returns the words read.
+    fn backdoor_read_mem(&self, addr: u64, words: &mut [u64]) -> usize;
+
+    /// Start decoding TX and driving RX of a UART inside the wrapper.
+    fn uart_attach(&self, index: usize);
+    /// Drain bytes decoded from the UART's TX pin, returning the count copied.
+    fn uart_read(&self, index: usize, buf: &mut [u8]) -> usize;
+    /// Queue bytes for the UART's RX pin, returning the count accepted.
+    fn uart_write(&self, index: usize, data: &[u8]) -> usize;
+
     fn get_clock(&self) -> u8;
     fn set_clock(&self, value: u8);
     fn get_reset(&self) -> u8;
@@ -107,23 +274,48 @@ pub(crate) trait SimulatorImpl {
     fn get_debug_reg_res_bits(&self) -> u64;
 
     fn get_debug_halted(&self) -> u8;
+    fn get_debug_sleeping(&self) -> u8;
 
     fn get_uart_0_txd(&self) -> u8;
     fn set_uart_0_rxd(&self, value: u8);
     fn get_uart_1_txd(&self) -> u8;
     fn set_uart_1_rxd(&self, value: u8);
 
+    /// Run `instructions` instructions from `entry_point` without stopping
+    /// for anything but the watchpoint, and return the resulting state. Only
+    /// models without timing can do this.
+    fn fast_forward(&self, _entry_point: u32, _instructions: u64) -> Option<ArchState> {
+        None
+    }
+
     fn mask_to_u32(&self, value: u64) -> u32 {
         (value & 0xffff_ffff) as u32
     }
 }
 
+/// Host side of the console UART.
+struct UartConsole {
+    index: usize,
+    input: Option<Receiver<u8>>,
+    /// Input bytes the wrapper had no room for yet.
+    pending: Vec<u8>,
+    /// TX output collected instead of printed.
+    captured: Option<Vec<u8>>,
+}
+
 pub struct Simulator {
-    model: Rc<RefCell<dyn SimulatorImpl>>,
-    timestamp: RefCell<u64>,
+    model: Box<RefCell<dyn SimulatorImpl>>,
     vcd_open: RefCell<bool>,
-    uart_decoder: RefCell<Option<(usize, UartDecoder)>>, // (uart_index, decoder)
-    rtc_counter: RefCell<u64>,                           // Counter for RTC clock division
+    trace: RefCell<TraceOptions>,
+    uart_console: RefCell<Option<UartConsole>>,
+    checkpoint: RefCell<Option<(usize, PathBuf)>>, // (main loop cycle, path)
+    retire_sink: RefCell<Option<RetireSink>>,
+    /// Hart whose registers and halt status are reported.
+    hart: Cell<u8>,
+    /// Mailbox of a program that makes system calls through `fromhost`.
+    host: Cell<Option<HostInterface>>,
+    /// Status the program passed to its `exit` system call.
+    host_exit: Cell<Option<u32>>,
 }
 
 impl Simulator {
@@ -161,13 +353,55 @@ impl Simulator {
 
         Ok(Simulator {
             model,
-            timestamp: RefCell::new(0),
             vcd_open: RefCell::new(false),
-            uart_decoder: RefCell::new(None),
-            rtc_counter: RefCell::new(0),
+            trace: RefCell::new(TraceOptions::default()),
+            uart_console: RefCell::new(None),
+            checkpoint: RefCell::new(None),
+            retire_sink: RefCell::new(None),
+            hart: Cell::new(0),
+            host: Cell::new(None),
+            host_exit: Cell::new(None),
         })
     }
 
+    /// Report registers and halt status of `hart` instead of hart 0.
+    ///
+    /// Halt, PC and watchpoint commands always go to every hart, so all
+    /// harts start together and each stops at the watchpoint on its own. The
+    /// run ends when the selected hart halts.
+    pub fn select_hart(&self, hart: u8) {
+        self.hart.set(hart);
+    }
+
+    /// Fast-forward through stretches where every hart sleeps in `wfi`.
+    ///
+    /// Enabled by default. Skipped cycles still count towards the cycle
+    /// budget, and mtime and mcycle move as if they had run, but peripherals
+    /// other than the timer do not see them. Never applies while tracing.
+    pub fn set_idle_skip(&self, enable: bool) {
+        self.model.borrow().set_idle_skip(enable);
+    }
+
+    /// Set the depth, scope and cycle window used for trace files.
+    pub fn set_trace_options(&self, options: TraceOptions) {
+        *self.trace.borrow_mut() = options;
+    }
+
+    /// ISA string of the model's cluster, e.g. `rv32im_zicsr`.
+    pub fn isa(&self) -> &'static str {
+        self.model.borrow().isa()
+    }
+
+    /// Verilator build profile of the model (`trace`, `fast` or `debug`).
+    pub fn build_profile(&self) -> &'static str {
+        self.model.borrow().build_profile()
+    }
+
+    /// File extension matching the model's trace format (`vcd` or `fst`).
+    pub fn trace_extension(&self) -> &'static str {
+        self.model.borrow().trace_extension()
+    }
+
     /// Enable UART console monitoring
     ///
     /// When enabled, the simulator will decode UART TX output from the specified
@@ -176,10 +410,114 @@ impl Simulator {
     /// # Arguments
     /// * `uart_index` - Which UART to monitor (0 or 1)
     pub fn enable_uart_console(&self, uart_index: usize) {
-        *self.uart_decoder.borrow_mut() = Some((uart_index, UartDecoder::new()));
+        self.model.borrow().uart_attach(uart_index);
+        *self.uart_console.borrow_mut() = Some(UartConsole {
+            index: uart_index,
+            input: None,
+            pending: Vec::new(),
+            captured: None,
+        });
         eprintln!("UART console monitoring enabled for UART {}", uart_index);
     }
 
+    /// Feed bytes from `input` into the console UART's RX pin
+    ///
+    /// Bytes are forwarded between simulation batches, so a reader thread
+    /// (e.g. on stdin) can keep sending while the simulation runs. Has no
+    /// effect unless [`Simulator::enable_uart_console`] was called first.
+    pub fn set_uart_console_input(&self, input: Receiver<u8>) {
+        if let Some(console) = &mut *self.uart_console.borrow_mut() {
+            console.input = Some(input);
+        }
+    }
+
+    /// Collect the console UART's TX output instead of printing it
+    ///
+    /// Read it back with [`Simulator::take_uart_console_output`]. Has no
+    /// effect unless [`Simulator::enable_uart_console`] was called first.
+    pub fn capture_uart_console(&self) {
+        if let Some(console) = &mut *self.uart_console.borrow_mut() {
+            console.captured.get_or_insert_with(Vec::new);
+        }
+    }
+
+    /// Output collected since the last call, see [`Simulator::capture_uart_console`].
+    pub fn take_uart_console_output(&self) -> Vec<u8> {
+        match &mut *self.uart_console.borrow_mut() {
+            Some(UartConsole {
+                captured: Some(captured),
+                ..
+            }) => std::mem::take(captured),
+            _ => Vec::new(),
+        }
+    }
+
+    /// Print bytes the console UART has transmitted and forward pending input.
+    fn service_uart_console(&self) {
+        let mut console = self.uart_console.borrow_mut();
+        let Some(console) = &mut *console else {
+            return;
+        };
+        let model = self.model.borrow();
+
+        let mut buf = [0u8; 256];
+        let mut stdout = std::io::stdout();
+        loop {
+            let count = model.uart_read(console.index, &mut buf);
+            if count == 0 {
+                break;
+            }
+            match &mut console.captured {
+                Some(captured) => captured.extend_from_slice(&buf[..count]),
+                None => {
+                    stdout.write_all(&buf[..count]).ok();
+                }
+            }
+        }
+        stdout.flush().ok();
+
+        if let Some(input) = &console.input {
+            console.pending.extend(input.try_iter());
+        }
+        if !console.pending.is_empty() {
+            let accepted = model.uart_write(console.index, &console.pending);
+            console.pending.drain(..accepted);
+        }
+    }
+
+    /// Call `sink` for every instruction hart 0 retires during the next run,
+    /// in program order.
+    ///
+    /// Returning an error from `sink` stops the run with that error, which
+    /// makes it suitable for lock-step checking against a reference model.
+    /// Retirements stop being reported once the hart halts.
+    pub fn set_retire_sink<F>(&self, sink: F)
+    where
+        F: FnMut(&Retirement) -> Result<()> + Send + 'static,
+    {
+        *self.retire_sink.borrow_mut() = Some(Box::new(sink));
+        self.model.borrow().retire_enable(true);
+    }
+
+    /// Hand everything recorded by the retire trace to the sink.
+    fn drain_retired(&self) -> Result<()> {
+        let mut sink = self.retire_sink.borrow_mut();
+        let Some(sink) = &mut *sink else {
+            return Ok(());
+        };
+
+        let mut buf = [0u64; RETIRE_WORDS * 256];
+        loop {
+            let count = self.model.borrow().retire_read(&mut buf);
+            if count == 0 {
+                return Ok(());
+            }
+            for words in buf[..count * RETIRE_WORDS].chunks_exact(RETIRE_WORDS) {
+                sink(&Retirement::from_words(words))?;
+            }
+        }
+    }
+
     /// Load a raw binary file at a specific address
     pub fn load_raw_binary<P: AsRef<Path>>(
         &self,
@@ -197,38 +535,8 @@ impl Simulator {
             load_addr
         );
 
-        // Reset and initialize
-        self.model.borrow().set_clock(0);
-        self.model.borrow().set_reset(1);
-        Self::init_debug_interface(&*self.model.borrow());
-
-        // Set halt
-        self.model.borrow().set_debug_hart_in_id_valid(1);
-        self.model.borrow().set_debug_hart_in_id_bits(0);
-        self.model.borrow().set_debug_hart_in_bits_halt_valid(1);
-        self.model.borrow().set_debug_hart_in_bits_halt_bits(1);
-
-        // Set watchpoint if provided
-        if let Some(addr) = watchpoint_addr {
-            self.model
-                .borrow()
-                .set_debug_hart_in_bits_watchpoint_valid(1);
-            self.model
-                .borrow()
-                .set_debug_hart_in_bits_watchpoint_bits_addr(addr as u64);
-            eprintln!("Setting watchpoint on address: 0x{:08x}", addr);
-        }
-
-        self.model.borrow().eval();
-
-        // Reset for a few cycles
-        for _ in 0..5 {
-            self.tick(false);
-        }
-
-        // Take reset low
-        self.model.borrow().set_reset(0);
-        self.tick(false);
+        self.reset_halted(watchpoint_addr);
+        self.host.set(None);
 
         // Load binary data to memory
         self.upload_raw_binary(&file_data, load_addr);
@@ -243,38 +551,360 @@ impl Simulator {
         watchpoint_symbol: Option<&str>,
     ) -> anyhow::Result<Option<u32>> {
         let file_data = std::fs::read(path)?;
-        let slice = file_data.as_slice();
-        let file = ElfBytes::<AnyEndian>::minimal_parse(slice)?;
-
-        // Resolve watchpoint symbol address if provided
-        let watchpoint_addr = if let Some(symbol_name) = watchpoint_symbol {
-            if let Some(symtab) = file.symbol_table()? {
-                let mut found_addr = None;
-                for symbol in symtab.0.iter() {
-                    if let Ok(name) = symtab.1.get(symbol.st_name as usize) {
-                        if name == symbol_name {
-                            found_addr = Some(symbol.st_value as u32);
-                            eprintln!(
-                                "Found symbol '{}' at address 0x{:08x}",
-                                symbol_name, symbol.st_value
-                            );
-                            break;
-                        }
-                    }
+        let file = ElfBytes::<AnyEndian>::minimal_parse(file_data.as_slice())?;
+
+        let watchpoint_addr = match watchpoint_symbol {
+            Some(symbol_name) => find_symbol(&file, symbol_name)?,
+            None => None,
+        };
+        self.attach_host(&file, watchpoint_addr)?;
+
+        self.reset_halted(watchpoint_addr);
+
+        for (name, data, start_addr) in loadable_sections(&file)? {
+            self.upload_section(name, data, start_addr);
+        }
+
+        Ok(watchpoint_addr)
+    }
+
+    /// Like [`Simulator::load_binary`], but writes sections that land in a TCM
+    /// straight into the memory array instead of over the debug bus.
+    ///
+    /// The TCM picks up its image when the model is first evaluated, so this
+    /// must be called on a freshly created simulator. Sections outside of any
+    /// TCM still go over the debug bus.
+    pub fn load_binary_fast<P: AsRef<Path>>(
+        &self,
+        path: P,
+        watchpoint_symbol: Option<&str>,
+    ) -> anyhow::Result<Option<u32>> {
+        let file_data = std::fs::read(path)?;
+        let file = ElfBytes::<AnyEndian>::minimal_parse(file_data.as_slice())?;
+
+        let watchpoint_addr = match watchpoint_symbol {
+            Some(symbol_name) => find_symbol(&file, symbol_name)?,
+            None => None,
+        };
+        self.attach_host(&file, watchpoint_addr)?;
+
+        let regions = self.model.borrow().tcm_regions();
+        let mut images: Vec<BTreeMap<u64, u32>> = vec![BTreeMap::new(); regions.len()];
+        let mut bus_sections = Vec::new();
+        for (name, data, start_addr) in loadable_sections(&file)? {
+            let start = start_addr as u64;
+            let end = start + data.len() as u64;
+            let region = regions
+                .iter()
+                .position(|&(base, length)| start >= base && end <= base + length);
+            let Some(region) = region else {
+                bus_sections.push((name, data, start_addr));
+                continue;
+            };
+
+            eprintln!(
+                "Preloading section {} ({} bytes) starting at address 0x{:08x}",
+                name,
+                data.len(),
+                start_addr
+            );
+            let base = regions[region].0;
+            for (offset, byte) in data.iter().enumerate() {
+                let byte_addr = start - base + offset as u64;
+                let shift = (byte_addr % 4) * 8;
+                let word = images[region].entry(byte_addr / 4).or_insert(0);
+                *word = (*word & !(0xff << shift)) | ((*byte as u32) << shift);
+            }
+        }
+
+        let mut image_paths = Vec::new();
+        for (&(base, _), image) in regions.iter().zip(&images) {
+            if image.is_empty() {
+                continue;
+            }
+            let image_path = write_memh_image(base, image)?;
+            if !self
+                .model
+                .borrow()
+                .preload_tcm(base, image_path.to_str().unwrap())
+            {
+                std::fs::remove_file(&image_path).ok();
+                anyhow::bail!("load_binary_fast must be called before the simulation starts");
+            }
+            image_paths.push(image_path);
+        }
+
+        // The first eval in here is what actually reads the images.
+        self.reset_halted(watchpoint_addr);
+        for image_path in image_paths {
+            std::fs::remove_file(image_path).ok();
+        }
+
+        for (name, data, start_addr) in bus_sections {
+            self.upload_section(name, data, start_addr);
+        }
+
+        Ok(watchpoint_addr)
+    }
+
+    /// Run the loaded program from `entry_point` for `instructions`
+    /// instructions and return the architectural state it reaches.
+    ///
+    /// Only [`Backend::Functional`] can do this, at instruction rather than
+    /// cycle speed. Pass the result to [`Simulator::load_arch_state`] on a
+    /// fresh Verilator simulator to measure what follows cycle-accurately.
+    /// System calls are serviced on the way. Stops early at the watchpoint,
+    /// with [`ArchState::halted`] set.
+    pub fn fast_forward(&self, entry_point: u32, instructions: u64) -> Result<ArchState> {
+        let mut state = self
+            .model
+            .borrow()
+            .fast_forward(entry_point, instructions)
+            .ok_or_else(|| anyhow::anyhow!("Only the functional backend can fast-forward"))?;
+        while state.halted {
+            self.service_uart_console();
+            match self.service_host()? {
+                // Running no instructions still captures the call's result
+                HostCall::Serviced => {
+                    state = self
+                        .model
+                        .borrow()
+                        .fast_forward(state.pc, instructions.saturating_sub(state.instret))
+                        .unwrap();
                 }
-                found_addr
-            } else {
-                eprintln!("Warning: No symbol table found in ELF file");
-                None
+                HostCall::Exit(status) => {
+                    self.host_exit.set(Some(status));
+                    break;
+                }
+                HostCall::None => break,
+            }
+        }
+        self.service_uart_console();
+        state.fromhost = self.host.get().map(|host| host.fromhost);
+        Ok(state)
+    }
+
+    /// Load a state captured by [`Simulator::fast_forward`] and release the
+    /// hart at its PC, ready for [`Simulator::resume_with_progress`].
+    ///
+    /// Memory goes in through the TCM preload like
+    /// [`Simulator::load_binary_fast`], so this must be called on a freshly
+    /// created simulator. CSRs are restored by a short program run from
+    /// zeroed memory, which is cleared again afterwards, and GPRs and the PC
+    /// over the debug port. mtime restarts from the model's own count, with
+    /// the remaining time to mtimecmp carried over.
+    pub fn load_arch_state(&self, state: &ArchState) -> Result<()> {
+        if state.halted {
+            anyhow::bail!("The program reached its watchpoint while fast-forwarding");
+        }
+
+        let stub = iss::csr_restore_stub(&state.csrs);
+        let stub_addr = iss::scratch_area(&state.memory, stub.len() * 4)
+            .ok_or_else(|| anyhow::anyhow!("No free memory to restore CSRs from"))?;
+
+        let regions = self.model.borrow().tcm_regions();
+        let mut image_paths = Vec::new();
+        for (base, data) in &state.memory {
+            if !regions.iter().any(|&(region, _)| region == *base) {
+                anyhow::bail!("Model has no TCM at 0x{base:08x}");
+            }
+            let mut image: BTreeMap<u64, u32> = data
+                .chunks(4)
+                .enumerate()
+                .map(|(index, word)| {
+                    let mut bytes = [0u8; 4];
+                    bytes[..word.len()].copy_from_slice(word);
+                    (index as u64, u32::from_le_bytes(bytes))
+                })
+                .collect();
+            if (*base..*base + data.len() as u64).contains(&stub_addr) {
+                for (index, &word) in stub.iter().enumerate() {
+                    image.insert((stub_addr - base) / 4 + index as u64, word);
+                }
+            }
+
+            let image_path = write_memh_image(*base, &image)?;
+            if !self
+                .model
+                .borrow()
+                .preload_tcm(*base, image_path.to_str().unwrap())
+            {
+                std::fs::remove_file(&image_path).ok();
+                anyhow::bail!("load_arch_state must be called before the simulation starts");
+            }
+            image_paths.push(image_path);
+        }
+
+        self.reset_halted(state.watchpoint);
+        self.host.set(
+            state
+                .watchpoint
+                .zip(state.fromhost)
+                .map(|(tohost, fromhost)| HostInterface { tohost, fromhost }),
+        );
+        for image_path in image_paths {
+            std::fs::remove_file(image_path).ok();
+        }
+
+        // The stub enables interrupts before it reaches its breakpoint, so
+        // keep the timer and msip quiet until it has halted
+        self.write_mem_word(iss::TIMER_MTIMECMP, u32::MAX);
+        self.write_mem_word(iss::TIMER_MTIMECMP + 4, u32::MAX);
+        self.write_mem_word(iss::MSIP_BASE, 0);
+
+        // Run the stub up to its final `j .`
+        let spin_addr = stub_addr + 4 * (stub.len() as u64 - 1);
+        self.model
+            .borrow()
+            .set_debug_hart_in_bits_breakpoint_valid(1);
+        self.model
+            .borrow()
+            .set_debug_hart_in_bits_breakpoint_bits_pc(spin_addr);
+        self.tick(false);
+        self.model
+            .borrow()
+            .set_debug_hart_in_bits_breakpoint_valid(0);
+        self.start_at(stub_addr as u32, false);
+        let mut cycles = 0;
+        while self.model.borrow().get_debug_halted() == 0 {
+            self.tick(false);
+            cycles += 1;
+            if cycles > 64 * stub.len() {
+                anyhow::bail!("CSR restore at 0x{stub_addr:08x} did not finish");
+            }
+        }
+        for index in 0..stub.len() as u32 {
+            self.write_mem_word(stub_addr as u32 + 4 * index, 0);
+        }
+
+        // mtimecmp and msip sit outside the TCMs
+        let mtime = u64::from(self.read_mem_word(iss::TIMER_BASE)?)
+            | u64::from(self.read_mem_word(iss::TIMER_BASE + 4)?) << 32;
+        let mtimecmp = match state.mtimecmp {
+            u64::MAX => u64::MAX,
+            mtimecmp => mtime + mtimecmp.saturating_sub(state.mtime),
+        };
+        self.write_mem_word(iss::TIMER_MTIMECMP, mtimecmp as u32);
+        self.write_mem_word(iss::TIMER_MTIMECMP + 4, (mtimecmp >> 32) as u32);
+        self.write_mem_word(iss::MSIP_BASE, state.msip as u32);
+
+        // The stub used t0, so GPRs go in after it
+        self.model.borrow().set_debug_hart_in_id_valid(1);
+        self.model.borrow().set_debug_hart_in_id_bits(0);
+        self.model.borrow().set_debug_hart_in_bits_halt_valid(1);
+        self.model.borrow().set_debug_hart_in_bits_halt_bits(1);
+        self.model
+            .borrow()
+            .set_debug_hart_in_bits_register_bits_write(1);
+        for reg in 1..32 {
+            self.model.borrow().set_debug_hart_in_bits_register_valid(1);
+            self.model
+                .borrow()
+                .set_debug_hart_in_bits_register_bits_reg(reg);
+            self.model
+                .borrow()
+                .set_debug_hart_in_bits_register_bits_data(u64::from(state.regs.get(reg)));
+            self.tick(false);
+        }
+        self.model.borrow().set_debug_hart_in_bits_register_valid(0);
+        self.model
+            .borrow()
+            .set_debug_hart_in_bits_register_bits_write(0);
+
+        eprintln!(
+            "Loaded state after {} instructions, resuming at 0x{:08x}",
+            state.instret, state.pc
+        );
+        self.start_at(state.pc, false);
+        Ok(())
+    }
+
+    /// Service system calls through the program's `fromhost` mailbox, if it
+    /// has one next to the watchpoint.
+    fn attach_host(&self, file: &ElfBytes<AnyEndian>, watchpoint_addr: Option<u32>) -> Result<()> {
+        let host = match watchpoint_addr {
+            Some(tohost) => {
+                find_symbol(file, "fromhost")?.map(|fromhost| HostInterface { tohost, fromhost })
             }
+            None => None,
+        };
+        self.host.set(host);
+        self.host_exit.set(None);
+        Ok(())
+    }
+
+    /// Carry out a system call if that is what halted the selected hart.
+    fn service_host(&self) -> Result<HostCall> {
+        match self.host.get() {
+            Some(host) => host.service(self),
+            None => Ok(HostCall::None),
+        }
+    }
+
+    /// Output of the program's `write` system calls, which goes wherever the
+    /// UART console's does.
+    pub(crate) fn host_write(&self, fd: u64, data: &[u8]) {
+        if let Some(UartConsole {
+            captured: Some(captured),
+            ..
+        }) = &mut *self.uart_console.borrow_mut()
+        {
+            captured.extend_from_slice(data);
+            return;
+        }
+        if fd == 2 {
+            std::io::stderr().write_all(data).ok();
         } else {
-            None
+            let mut stdout = std::io::stdout();
+            stdout.write_all(data).ok();
+            stdout.flush().ok();
+        }
+    }
+
+    /// Input for the program's `read` system calls: the UART console's input
+    /// when it has one, host stdin otherwise. Blocks until a byte arrives and
+    /// returns 0 at end of input.
+    pub(crate) fn host_read(&self, buf: &mut [u8]) -> usize {
+        let mut console = self.uart_console.borrow_mut();
+        let Some(UartConsole {
+            input: Some(input),
+            pending,
+            ..
+        }) = &mut *console
+        else {
+            drop(console);
+            return std::io::stdin().lock().read(buf).unwrap_or(0);
         };
 
-        // IMPORTANT: Reset FIRST before loading memory!
-        // Memory uses RegInit, so reset clears it to all zeros.
-        // We must reset first, then load memory after.
+        if pending.is_empty() {
+            match input.recv() {
+                Ok(byte) => pending.push(byte),
+                Err(_) => return 0,
+            }
+        }
+        pending.extend(input.try_iter());
+        let count = pending.len().min(buf.len());
+        buf[..count].copy_from_slice(&pending[..count]);
+        pending.drain(..count);
+        count
+    }
+
+    /// Let the selected hart carry on from where it halted.
+    fn resume_hart(&self, dump: bool) {
+        self.model.borrow().set_debug_hart_in_id_valid(1);
+        self.model
+            .borrow()
+            .set_debug_hart_in_id_bits(self.hart.get());
+        self.model.borrow().set_debug_hart_in_bits_halt_valid(1);
+        self.model.borrow().set_debug_hart_in_bits_halt_bits(0);
+        self.tick(dump);
+        self.model.borrow().set_debug_hart_in_bits_halt_valid(0);
+        self.model.borrow().set_debug_hart_in_id_valid(0);
+    }
 
+    /// Put the harts into reset with halt asserted, then take them out of
+    /// reset so memory can be loaded before execution is released.
+    fn reset_halted(&self, watchpoint_addr: Option<u32>) {
         // Establish initial state: clock low, then apply reset
         self.model.borrow().set_clock(0);
         self.model.borrow().set_reset(1);
@@ -284,9 +914,9 @@ impl Simulator {
         Self::init_debug_interface(&*self.model.borrow());
 
         // Set halt through debug interface
-        // IMPORTANT: Must set id_valid and id_bits to route commands to hart 0
+        // IMPORTANT: Must set id_valid and id_bits to route commands to the harts
         self.model.borrow().set_debug_hart_in_id_valid(1);
-        self.model.borrow().set_debug_hart_in_id_bits(0); // Hart 0
+        self.model.borrow().set_debug_hart_in_id_bits(ALL_HARTS);
         self.model.borrow().set_debug_hart_in_bits_halt_valid(1);
         self.model.borrow().set_debug_hart_in_bits_halt_bits(1);
 
@@ -313,27 +943,6 @@ impl Simulator {
         // slate once we release halt later.
         self.model.borrow().set_reset(0);
         self.tick(false);
-
-        // Load all allocatable sections (including .rodata)
-        let (shdrs_opt, strtab_opt) = file.section_headers_with_strtab()?;
-        if let (Some(shdrs), Some(strtab)) = (shdrs_opt, strtab_opt) {
-            for shdr in shdrs.iter() {
-                let is_alloc = (shdr.sh_flags & (SHF_ALLOC as u64)) != 0;
-                let is_nobits = shdr.sh_type == (SHT_NOBITS as u32);
-                if !is_alloc || is_nobits || shdr.sh_size == 0 {
-                    continue;
-                }
-
-                let name = strtab.get(shdr.sh_name as usize).unwrap_or("<unknown>");
-                let (data, _) = file.section_data(&shdr)?;
-                let start_addr = shdr.sh_addr as u32;
-                self.upload_section(name, data, start_addr);
-            }
-        } else {
-            eprintln!("Warning: No section headers found in ELF file");
-        }
-
-        Ok(watchpoint_addr)
     }
 
     fn upload_section(&self, section_name: &str, data: &[u8], start_addr: u32) {
@@ -408,42 +1017,57 @@ impl Simulator {
     where
         F: FnMut(usize),
     {
-        if vcd_path.is_some() {
-            self.model
-                .borrow()
-                .open_vcd(vcd_path.unwrap().to_str().unwrap());
-            *self.vcd_open.borrow_mut() = true;
+        if let Some(vcd_path) = vcd_path {
+            self.open_trace(vcd_path);
         }
+        // With a window, reset and boot are not part of the trace.
+        let boot_dump = self.trace.borrow().window.is_none();
 
         // Toggle reset while dumping a couple of baseline cycles so the trace captures
         // the CPU at the architectural reset vector before we let the pipeline run.
         self.model.borrow().set_reset(1);
         for _ in 0..2 {
-            self.tick(true);
+            self.tick(boot_dump);
         }
         self.model.borrow().set_reset(0);
-        self.tick(true);
+        self.tick(boot_dump);
+
+        self.start_at(entry_point, boot_dump);
 
+        self.run_main_loop(vcd_path.is_some(), max_cycles, &mut on_cycle)?;
+        self.finish_run(vcd_path.is_some())
+    }
+
+    /// Point every hart at `entry_point`, flushing the pipeline, and release
+    /// halt.
+    fn start_at(&self, entry_point: u32, dump: bool) {
         // Set PC to program entry point and flush pipeline before releasing halt
         self.model.borrow().set_debug_hart_in_id_valid(1);
-        self.model.borrow().set_debug_hart_in_id_bits(0); // Hart 0
+        self.model.borrow().set_debug_hart_in_id_bits(ALL_HARTS);
         self.model.borrow().set_debug_hart_in_bits_set_pc_valid(1);
         self.model
             .borrow()
-            .set_debug_hart_in_bits_set_pc_bits_pc(entry_point as u64);
+            .set_debug_hart_in_bits_set_pc_bits_pc(u64::from(entry_point));
         eprintln!("Setting PC to 0x{:08x} and flushing pipeline", entry_point);
-        self.tick(true);
+        self.tick(dump);
         self.model.borrow().set_debug_hart_in_bits_set_pc_valid(0);
-        self.tick(true);
+        self.tick(dump);
 
         // Release halt to start execution
         self.model.borrow().set_debug_mem_in_valid(0); // Disable memory writes
         self.model.borrow().set_debug_hart_in_id_valid(1);
-        self.model.borrow().set_debug_hart_in_id_bits(0); // Hart 0
+        self.model.borrow().set_debug_hart_in_id_bits(ALL_HARTS);
         self.model.borrow().set_debug_hart_in_bits_halt_valid(1);
         self.model.borrow().set_debug_hart_in_bits_halt_bits(0); // Release halt
         eprintln!("CPU halt released, starting execution");
-        self.tick(true);
+        self.tick(dump);
+
+        // Address the selected hart once so `halted` reports it
+        self.model.borrow().set_debug_hart_in_bits_halt_valid(0);
+        self.model
+            .borrow()
+            .set_debug_hart_in_id_bits(self.hart.get());
+        self.tick(dump);
 
         // Clear id.valid and halt.valid to enter "don't care" state
         // This allows internal events (watchpoints, breakpoints) to assert halt
@@ -453,52 +1077,175 @@ impl Simulator {
 
         // Tick more cycles to fully clear pipeline after halt
         for _ in 0..10 {
-            self.tick(true);
+            self.tick(dump);
         }
 
         // Check if halt was actually released
         let halted = self.model.borrow().get_debug_halted() != 0;
         eprintln!("After release+10cycles: halted={}", halted);
+    }
 
-        for cycle in 0..max_cycles {
-            self.tick(vcd_path.is_some());
-            on_cycle(cycle + 1);
-
-            // Sample UART TX if console monitoring is enabled
-            if let Some((uart_index, decoder)) = &mut *self.uart_decoder.borrow_mut() {
-                let txd = match uart_index {
-                    0 => self.model.borrow().get_uart_0_txd(),
-                    1 => self.model.borrow().get_uart_1_txd(),
-                    _ => 0,
-                };
-
-                if let Some(byte) = decoder.process(txd) {
-                    // Print the decoded byte as ASCII
-                    print!("{}", byte as char);
-                    std::io::Write::flush(&mut std::io::stdout()).ok();
+    /// Continue execution from a state loaded with
+    /// [`Simulator::restore_checkpoint`] or [`Simulator::load_arch_state`],
+    /// skipping reset, loading and boot.
+    ///
+    /// `max_cycles` counts from the restore point.
+    pub fn resume_with_progress<F>(
+        &self,
+        vcd_path: Option<&Path>,
+        max_cycles: usize,
+        mut on_cycle: F,
+    ) -> Result<TestResult>
+    where
+        F: FnMut(usize),
+    {
+        if let Some(vcd_path) = vcd_path {
+            self.open_trace(vcd_path);
+        }
+
+        self.run_main_loop(vcd_path.is_some(), max_cycles, &mut on_cycle)?;
+        self.finish_run(vcd_path.is_some())
+    }
+
+    /// Write a checkpoint to `path` once the main loop has run `cycle` cycles.
+    pub fn checkpoint_at(&self, cycle: usize, path: &Path) {
+        *self.checkpoint.borrow_mut() = Some((cycle, path.to_path_buf()));
+    }
+
+    /// Save the complete model state to `path`.
+    ///
+    /// Requires models built with the `checkpoint` feature.
+    pub fn save_checkpoint(&self, path: &Path) -> Result<()> {
+        self.ensure_checkpoint_support()?;
+        if !self.model.borrow().save_checkpoint(path.to_str().unwrap()) {
+            anyhow::bail!("Failed to save checkpoint to {}", path.display());
+        }
+        eprintln!("Saved checkpoint to {}", path.display());
+        Ok(())
+    }
+
+    /// Replace the model state with a checkpoint written by
+    /// [`Simulator::save_checkpoint`] from the same model.
+    pub fn restore_checkpoint(&self, path: &Path) -> Result<()> {
+        self.ensure_checkpoint_support()?;
+        if !self
+            .model
+            .borrow()
+            .restore_checkpoint(path.to_str().unwrap())
+        {
+            anyhow::bail!("Failed to restore checkpoint from {}", path.display());
+        }
+        eprintln!("Restored checkpoint from {}", path.display());
+        Ok(())
+    }
+
+    /// Save the checkpoint scheduled by [`Simulator::checkpoint_at`] if the
+    /// main loop is at its cycle.
+    fn save_due_checkpoint(&self, cycle: usize) -> Result<()> {
+        let due = matches!(&*self.checkpoint.borrow(), Some((at, _)) if *at == cycle);
+        if due {
+            let (_, path) = self.checkpoint.borrow_mut().take().unwrap();
+            self.save_checkpoint(&path)?;
+        }
+        Ok(())
+    }
+
+    fn open_trace(&self, path: &Path) {
+        let trace = self.trace.borrow();
+        self.model.borrow().open_vcd(
+            path.to_str().unwrap(),
+            trace.depth,
+            trace.scope.as_deref().unwrap_or(""),
+        );
+        *self.vcd_open.borrow_mut() = true;
+    }
+
+    fn ensure_checkpoint_support(&self) -> Result<()> {
+        if !self.model.borrow().supports_checkpoints() {
+            anyhow::bail!(
+                "Model {} was built without checkpoint support; enable the `checkpoint` feature",
+                self.model.borrow().name()
+            );
+        }
+        Ok(())
+    }
+
+    fn run_main_loop(
+        &self,
+        dump_vcd: bool,
+        max_cycles: usize,
+        on_cycle: &mut dyn FnMut(usize),
+    ) -> Result<()> {
+        // The main loop runs in batches inside the wrapper; we only come back
+        // here to report progress, print UART output, take a checkpoint, or
+        // handle a halt.
+        let dump_vcd = dump_vcd && *self.vcd_open.borrow();
+        let window = self.trace.borrow().window.clone();
+        let mut cycle = 0usize;
+        // A checkpoint at cycle 0 is taken before anything runs
+        self.save_due_checkpoint(cycle)?;
+        while cycle < max_cycles {
+            // Batches never straddle a window edge or a scheduled checkpoint.
+            let mut budget = (max_cycles - cycle).min(RUN_BATCH_CYCLES);
+            let checkpoint = self.checkpoint.borrow().as_ref().map(|(at, _)| *at);
+            let edges = window.iter().flat_map(|w| [w.start, w.end]);
+            for edge in edges.chain(checkpoint) {
+                if edge > cycle {
+                    budget = budget.min(edge - cycle);
                 }
             }
 
-            // Check if CPU has halted (watchpoint hit)
-            let halted = self.model.borrow().get_debug_halted() != 0;
+            let dump = dump_vcd && self.trace.borrow().traces_cycle(cycle);
+            let status = self.model.borrow().run_cycles(budget as u64, dump);
+            cycle += status.cycles as usize;
+            on_cycle(cycle);
+            self.service_uart_console();
+            self.drain_retired()?;
+
+            self.save_due_checkpoint(cycle)?;
+
+            // The TX buffer can fill up on the same cycle the hart halts, so
+            // don't rely on the stop reason alone.
+            let halted =
+                status.reason == StopReason::Halted || self.model.borrow().get_debug_halted() != 0;
 
             if halted {
-                eprintln!("\nCPU halted at cycle {}, watchpoint triggered", cycle);
+                match self.service_host()? {
+                    HostCall::Serviced => {
+                        self.resume_hart(dump_vcd && self.trace.borrow().traces_cycle(cycle));
+                        continue;
+                    }
+                    HostCall::Exit(status) => self.host_exit.set(Some(status)),
+                    HostCall::None => {}
+                }
+
+                eprintln!("\nCPU halted at cycle {}, watchpoint triggered", cycle - 1);
+                // Whatever drains from the pipeline now is past the halt point.
+                if self.retire_sink.borrow().is_some() {
+                    self.model.borrow().retire_enable(false);
+                }
                 // Run a few more cycles to let the pipeline settle
+                let dump = dump_vcd && self.trace.borrow().traces_cycle(cycle);
                 for _ in 0..5 {
-                    self.tick(vcd_path.is_some());
+                    self.tick(dump);
                 }
+                self.service_uart_console();
                 break;
             }
         }
 
-        if vcd_path.is_some() {
+        Ok(())
+    }
+
+    fn finish_run(&self, vcd: bool) -> Result<TestResult> {
+        if vcd {
             self.model.borrow().close_vcd();
             *self.vcd_open.borrow_mut() = false;
         }
 
         let regs = self.capture_registers()?;
-        let exit_code = regs.get(3); // x3/gp holds test result
+        // An exit system call wins, otherwise x3/gp holds the test result
+        let exit_code = self.host_exit.take().unwrap_or(regs.get(3));
 
         Ok(TestResult {
             regs,
@@ -507,52 +1254,98 @@ impl Simulator {
     }
 
     fn capture_registers(&self) -> Result<RegisterFile> {
-        let mut regs = RegisterFile::new();
-
-        // Ensure CPU is halted
+        // Ensure all harts are halted
         self.model.borrow().set_debug_hart_in_id_valid(1);
-        self.model.borrow().set_debug_hart_in_id_bits(0); // Hart 0
+        self.model.borrow().set_debug_hart_in_id_bits(ALL_HARTS);
         self.model.borrow().set_debug_hart_in_bits_halt_valid(1);
         self.model.borrow().set_debug_hart_in_bits_halt_bits(1);
-        self.model.borrow().set_debug_reg_res_ready(1); // Ready to receive results
-
-        // Tick to apply halt
         self.tick(false);
 
-        // Read each register through debug interface
-        for idx in 0..32 {
-            self.model.borrow().set_debug_hart_in_id_valid(1);
-            self.model.borrow().set_debug_hart_in_id_bits(0); // Hart 0
-            self.model.borrow().set_debug_hart_in_bits_register_valid(1);
-            self.model
-                .borrow()
-                .set_debug_hart_in_bits_register_bits_reg(idx);
-            self.model
-                .borrow()
-                .set_debug_hart_in_bits_register_bits_write(0); // Read
-            self.model
-                .borrow()
-                .set_debug_hart_in_bits_register_bits_data(0);
-
-            // Tick to process request
+        // Address the selected hart so `halted` reports it. That only rises
+        // once instructions already past Execute have written back.
+        self.model
+            .borrow()
+            .set_debug_hart_in_id_bits(self.hart.get());
+        let mut cycles = 0;
+        loop {
             self.tick(false);
+            if self.model.borrow().get_debug_halted() != 0 {
+                break;
+            }
+            cycles += 1;
+            if cycles > DRAIN_TIMEOUT_CYCLES {
+                anyhow::bail!(
+                    "Hart {} did not drain within {DRAIN_TIMEOUT_CYCLES} cycles of halting",
+                    self.hart.get()
+                );
+            }
+        }
+        self.model.borrow().set_debug_hart_in_bits_halt_valid(0);
+        self.model.borrow().set_debug_hart_in_id_valid(0);
 
-            // Wait for result
-            let val = loop {
-                if self.model.borrow().get_debug_reg_res_valid() != 0 {
-                    break self.model.borrow().get_debug_reg_res_bits() as u32;
-                }
-
-                self.tick(false);
-            };
+        Ok(self.read_registers_bulk())
+    }
 
-            regs.set(idx, val);
+    /// Register file of the selected hart, read through the backdoor port in
+    /// zero simulated time. Halt the hart first for a stable snapshot.
+    pub fn read_registers_bulk(&self) -> RegisterFile {
+        let mut regs = RegisterFile::new();
+        let model = self.model.borrow();
+        for idx in 1..32 {
+            regs.set(idx, model.backdoor_read_reg(self.hart.get(), idx) as u32);
+        }
+        regs
+    }
 
-            // Clear register request
-            self.model.borrow().set_debug_hart_in_bits_register_valid(0);
+    /// Read `len` bytes from `addr`. TCM contents come straight from the
+    /// arrays without simulating any cycles; anything else falls back to word
+    /// reads over the debug bus, which do run the model.
+    pub fn read_memory(&self, addr: u32, len: usize) -> Result<Vec<u8>> {
+        let word_bytes = u32::from(self.model.borrow().xlen() / 8);
+        let start = addr & !(word_bytes - 1);
+        let end = addr
+            .checked_add(len as u32)
+            .ok_or_else(|| anyhow::anyhow!("Read of {len} bytes at 0x{addr:08x} wraps around"))?;
+        let mut words = vec![0u64; (end - start).div_ceil(word_bytes) as usize];
+
+        let mut done = 0;
+        while done < words.len() {
+            let word_addr = start + done as u32 * word_bytes;
+            let read = self
+                .model
+                .borrow()
+                .backdoor_read_mem(word_addr as u64, &mut words[done..]);
+            done += read;
+            if read == 0 {
+                words[done] = self.read_mem_word(word_addr)? as u64;
+                done += 1;
+            }
         }
 
-        Ok(regs)
+        let bytes: Vec<u8> = words
+            .iter()
+            .flat_map(|word| word.to_le_bytes()[..word_bytes as usize].to_vec())
+            .collect();
+        let offset = (addr - start) as usize;
+        Ok(bytes[offset..offset + len].to_vec())
+    }
+
+    /// Write `data` to `addr` over the debug bus, a word at a time where it
+    /// is aligned.
+    pub fn write_memory(&self, addr: u32, data: &[u8]) {
+        let mut addr = addr;
+        let mut data = data;
+        while !data.is_empty() {
+            if addr % 4 == 0 && data.len() >= 4 {
+                self.write_mem_word(addr, u32::from_le_bytes(data[..4].try_into().unwrap()));
+                addr += 4;
+                data = &data[4..];
+            } else {
+                self.write_mem_byte(addr, data[0]);
+                addr += 1;
+                data = &data[1..];
+            }
+        }
     }
 
     fn write_mem_byte(&self, addr: u32, data: u8) {
@@ -602,8 +1395,8 @@ impl Simulator {
         }
     }
 
-    #[allow(dead_code)]
-    pub fn read_mem_word(&self, addr: u32) -> u32 {
+    /// Read one word over the debug bus.
+    pub fn read_mem_word(&self, addr: u32) -> Result<u32> {
         self.drive_mem_request(addr, 0, 2, false);
 
         let mut attempts = 0;
@@ -615,53 +1408,126 @@ impl Simulator {
             };
 
             if let Some(val) = response {
-                return val;
+                return Ok(val);
             }
 
             self.tick(false);
             attempts += 1;
             if attempts > 20 {
-                panic!("read_mem_word timeout");
+                anyhow::bail!("Debug read of 0x{addr:08x} timed out");
             }
         }
     }
 
     fn tick(&self, dump_vcd: bool) {
-        // Update RTC clock - runs at 1/50th of main clock frequency
-        let mut rtc_counter = self.rtc_counter.borrow_mut();
-        *rtc_counter += 1;
-        if *rtc_counter >= RTC_CLOCK_DIVIDER {
-            *rtc_counter = 0;
-            // Toggle RTC clock
-            let rtc_clk = self.model.borrow().get_rtc_clock();
-            self.model
-                .borrow()
-                .set_rtc_clock(if rtc_clk == 0 { 1 } else { 0 });
+        self.model
+            .borrow()
+            .tick(dump_vcd && *self.vcd_open.borrow());
+    }
+}
+
+/// Address of `symbol_name` in the ELF at `path`, if it has one.
+pub fn elf_symbol<P: AsRef<Path>>(path: P, symbol_name: &str) -> Result<Option<u32>> {
+    let file_data = std::fs::read(path)?;
+    let file = ElfBytes::<AnyEndian>::minimal_parse(file_data.as_slice())?;
+    find_symbol(&file, symbol_name)
+}
+
+/// Look up `symbol_name` in the ELF symbol table.
+fn find_symbol(file: &ElfBytes<AnyEndian>, symbol_name: &str) -> Result<Option<u32>> {
+    let Some((symbols, strtab)) = file.symbol_table()? else {
+        eprintln!("Warning: No symbol table found in ELF file");
+        return Ok(None);
+    };
+
+    for symbol in symbols.iter() {
+        if let Ok(name) = strtab.get(symbol.st_name as usize) {
+            if name == symbol_name {
+                eprintln!(
+                    "Found symbol '{}' at address 0x{:08x}",
+                    symbol_name, symbol.st_value
+                );
+                return Ok(Some(symbol.st_value as u32));
+            }
         }
-        drop(rtc_counter);
+    }
 
-        self.model.borrow().set_clock(0);
-        self.model.borrow().eval();
-        if dump_vcd && *self.vcd_open.borrow() {
-            self.model.borrow().dump_vcd(*self.timestamp.borrow());
+    Ok(None)
+}
+
+/// All allocatable sections with contents (including .rodata), as
+/// `(name, data, start address)`.
+fn loadable_sections<'data>(
+    file: &ElfBytes<'data, AnyEndian>,
+) -> Result<Vec<(&'data str, &'data [u8], u32)>> {
+    let (shdrs_opt, strtab_opt) = file.section_headers_with_strtab()?;
+    let (Some(shdrs), Some(strtab)) = (shdrs_opt, strtab_opt) else {
+        eprintln!("Warning: No section headers found in ELF file");
+        return Ok(Vec::new());
+    };
+
+    let mut sections = Vec::new();
+    for shdr in shdrs.iter() {
+        let is_alloc = (shdr.sh_flags & (SHF_ALLOC as u64)) != 0;
+        let is_nobits = shdr.sh_type == (SHT_NOBITS as u32);
+        if !is_alloc || is_nobits || shdr.sh_size == 0 {
+            continue;
         }
-        *self.timestamp.borrow_mut() += 1;
 
-        self.model.borrow().set_clock(1);
-        self.model.borrow().eval();
+        let name = strtab.get(shdr.sh_name as usize).unwrap_or("<unknown>");
+        let (data, _) = file.section_data(&shdr)?;
+        sections.push((name, data, shdr.sh_addr as u32));
+    }
 
-        if dump_vcd && *self.vcd_open.borrow() {
-            self.model.borrow().dump_vcd(*self.timestamp.borrow());
+    Ok(sections)
+}
+
+/// Write a sparse word image in `$readmemh` format to a temporary file.
+fn write_memh_image(base: u64, image: &BTreeMap<u64, u32>) -> Result<PathBuf> {
+    static NEXT_IMAGE: AtomicUsize = AtomicUsize::new(0);
+    let image_path = std::env::temp_dir().join(format!(
+        "svarog-tcm-{}-{}-{:x}.hex",
+        std::process::id(),
+        NEXT_IMAGE.fetch_add(1, Ordering::Relaxed),
+        base
+    ));
+
+    let mut out = String::new();
+    let mut next_index = None;
+    for (&index, &word) in image {
+        if next_index != Some(index) {
+            out.push_str(&format!("@{:x}\n", index));
         }
-        *self.timestamp.borrow_mut() += 1;
+        out.push_str(&format!("{:08x}\n", word));
+        next_index = Some(index + 1);
     }
+    std::fs::write(&image_path, out)
+        .with_context(|| format!("Failed to write TCM image {}", image_path.display()))?;
+
+    Ok(image_path)
 }
 
-fn create_model(backend: Backend, model_name: &str) -> Result<Rc<RefCell<dyn SimulatorImpl>>> {
+fn create_model(backend: Backend, model_name: &str) -> Result<Box<RefCell<dyn SimulatorImpl>>> {
     match backend {
         Backend::Verilator => crate::models::create_verilator(model_name)
             .ok_or_else(|| anyhow::anyhow!("Unknown Verilator model: {}", model_name)),
+        Backend::VerilatorMonitored if !crate::models::MONITORED => Err(anyhow::anyhow!(
+            "Monitored models were not built; enable the simulator's `monitored` feature"
+        )),
         Backend::VerilatorMonitored => crate::models::create_verilator_monitored(model_name)
             .ok_or_else(|| anyhow::anyhow!("Unknown Verilator model: {}", model_name)),
+        Backend::Functional => crate::models::FUNCTIONAL_MODELS
+            .iter()
+            .find(|config| config.name == model_name)
+            .map(|config| {
+                Box::new(RefCell::new(iss::FunctionalModel::new(config)))
+                    as Box<RefCell<dyn SimulatorImpl>>
+            })
+            .ok_or_else(|| {
+                anyhow::anyhow!(
+                    "No functional model of {}; it covers single-hart RV32 configs",
+                    model_name
+                )
+            }),
     }
 }
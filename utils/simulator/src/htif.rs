@@ -0,0 +1,97 @@
+//! Host side of the HTIF `tohost`/`fromhost` mailbox.
+//!
+//! The guest makes a system call by filling in a `magic_mem` block of 64-bit
+//! words (call number, then arguments) and storing its address to `tohost`.
+//! That store hits the watchpoint, and while the hart is halted the simulator
+//! carries out the call, writes the result over `magic_mem[0]` and sets
+//! `fromhost`. Call numbers follow riscv-pk and newlib; `benchmarks/htif` has
+//! the guest side.
+//!
+//! Odd `tohost` values are the plain HTIF exit of riscv-tests and end the run
+//! like any other watchpoint hit.
+
+use std::time::{SystemTime, UNIX_EPOCH};
+
+use anyhow::Result;
+
+use crate::Simulator;
+
+const SYS_READ: u64 = 63;
+const SYS_WRITE: u64 = 64;
+const SYS_EXIT: u64 = 93;
+const SYS_GETTIMEOFDAY: u64 = 169;
+
+const EBADF: i64 = 9;
+const EFAULT: i64 = 14;
+const ENOSYS: i64 = 38;
+
+/// Longest `read` or `write` in one call; newlib retries short transfers.
+const MAX_TRANSFER: u64 = 64 * 1024;
+
+/// Addresses of the program's mailbox.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub(crate) struct HostInterface {
+    pub tohost: u32,
+    pub fromhost: u32,
+}
+
+/// What the store to `tohost` asked for.
+pub(crate) enum HostCall {
+    /// A system call was carried out and the hart can carry on.
+    Serviced,
+    /// The program called `exit` with this status.
+    Exit(u32),
+    /// Not a system call, so the halt ends the run as before.
+    None,
+}
+
+impl HostInterface {
+    /// Carry out the call the halted hart left in the mailbox, if any.
+    pub(crate) fn service(&self, sim: &Simulator) -> Result<HostCall> {
+        let tohost = read_u32(sim, self.tohost)?;
+        if tohost == 0 || tohost & 1 != 0 {
+            return Ok(HostCall::None);
+        }
+
+        let block = sim.read_memory(tohost, 4 * 8)?;
+        let word = |index: usize| u64::from_le_bytes(block[index * 8..][..8].try_into().unwrap());
+        let (fd, buf, len) = (word(1), word(2) as u32, word(3).min(MAX_TRANSFER));
+        let result = match word(0) {
+            SYS_WRITE if fd == 1 || fd == 2 => match sim.read_memory(buf, len as usize) {
+                Ok(data) => {
+                    sim.host_write(fd, &data);
+                    len as i64
+                }
+                Err(_) => -EFAULT,
+            },
+            SYS_READ if fd == 0 => {
+                let mut data = vec![0; len as usize];
+                let count = sim.host_read(&mut data);
+                sim.write_memory(buf, &data[..count]);
+                count as i64
+            }
+            SYS_WRITE | SYS_READ => -EBADF,
+            SYS_EXIT => return Ok(HostCall::Exit(word(1) as u32)),
+            SYS_GETTIMEOFDAY => {
+                // struct timeval on RV32 newlib: 64-bit seconds, 32-bit microseconds
+                let now = SystemTime::now().duration_since(UNIX_EPOCH)?;
+                let mut timeval = now.as_secs().to_le_bytes().to_vec();
+                timeval.extend_from_slice(&now.subsec_micros().to_le_bytes());
+                sim.write_memory(word(1) as u32, &timeval);
+                0
+            }
+            _ => -ENOSYS,
+        };
+
+        sim.write_memory(tohost, &result.to_le_bytes());
+        sim.write_memory(self.tohost, &0u32.to_le_bytes());
+        sim.write_memory(self.fromhost, &1u32.to_le_bytes());
+        Ok(HostCall::Serviced)
+    }
+}
+
+fn read_u32(sim: &Simulator, addr: u32) -> Result<u32> {
+    Ok(u32::from_le_bytes(
+        sim.read_memory(addr, 4)?.try_into().unwrap(),
+    ))
+}
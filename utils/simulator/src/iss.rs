@@ -0,0 +1,1304 @@
+//! Instruction-accurate functional model, [`Backend::Functional`].
+//!
+//! Executes RV32IM with Zicsr, Zicntr, Zba and Zbb one instruction per cycle
+//! against the config's TCMs, UARTs, timer and MSIP, and answers the same
+//! debug pins as the Verilated SoC, so [`Simulator`] runs it unchanged. It
+//! models hart 0 only, and nothing about timing beyond one instruction per
+//! cycle and the RTC rate of `mtime`.
+//!
+//! [`Simulator::fast_forward`] uses it to get deep into a program before
+//! handing the architectural state to a Verilator model.
+//!
+//! [`Backend::Functional`]: crate::Backend::Functional
+//! [`Simulator`]: crate::Simulator
+//! [`Simulator::fast_forward`]: crate::Simulator::fast_forward
+
+use std::cell::RefCell;
+
+use crate::RegisterFile;
+use crate::core::{RETIRE_WORDS, RunStatus, SimulatorImpl, StopReason};
+
+/// Core clock cycles per `mtime` tick; the wrapper toggles the RTC clock
+/// every 50 cycles.
+const CYCLES_PER_MTIME: u64 = 100;
+
+/// Retire records buffered before `run_cycles` hands control back.
+const RETIRE_CAPACITY: usize = 4096;
+/// UART TX bytes buffered before `run_cycles` hands control back.
+const UART_CAPACITY: usize = 4096;
+
+pub(crate) const TIMER_BASE: u32 = 0x0200_0000;
+pub(crate) const TIMER_MTIMECMP: u32 = TIMER_BASE + 0x4000;
+pub(crate) const MSIP_BASE: u32 = 0x0201_0000;
+
+const UART_DATA: u32 = 0x00;
+const UART_STATUS: u32 = 0x04;
+const UART_BAUD_DIV: u32 = 0x0c;
+
+const MSTATUS_MIE: u32 = 1 << 3;
+const MSTATUS_MPIE: u32 = 1 << 7;
+const MSTATUS_MPP: u32 = 3 << 11;
+const MSTATUS_WRITE_MASK: u32 = MSTATUS_MIE | MSTATUS_MPIE | MSTATUS_MPP;
+
+const MIP_MSIP: u32 = 1 << 3;
+const MIP_MTIP: u32 = 1 << 7;
+
+/// CSRs carried over by [`ArchState`], in the order they are restored. The
+/// timer and msip stay quiet while the stub runs, so mie and mstatus need
+/// not wait for the rest. minstret goes last, high half first, so that none
+/// of the stub's own instructions are counted after it.
+pub(crate) const TRANSFERRED_CSRS: [u16; 11] = [
+    0x305, // mtvec
+    0x340, // mscratch
+    0x341, // mepc
+    0x342, // mcause
+    0x343, // mtval
+    0x304, // mie
+    0x300, // mstatus
+    0xb80, // mcycleh
+    0xb00, // mcycle
+    0xb82, // minstreth
+    0xb02, // minstret
+];
+
+/// Static description of a model, generated from its config.
+pub(crate) struct FunctionalConfig {
+    pub name: &'static str,
+    pub isa: &'static str,
+    /// `(base address, length)` of every TCM.
+    pub tcms: &'static [(u64, u64)],
+    /// Base address of every UART, in pin order.
+    pub uarts: &'static [u64],
+}
+
+/// Architectural state of hart 0 and the memory it sees, as captured by
+/// [`Simulator::fast_forward`](crate::Simulator::fast_forward).
+#[derive(Debug, Clone)]
+pub struct ArchState {
+    /// Address of the next instruction to execute.
+    pub pc: u32,
+    pub regs: RegisterFile,
+    /// `(address, value)` of the machine CSRs the core can restore.
+    pub csrs: Vec<(u16, u32)>,
+    /// Contents of every TCM, as `(base address, bytes)`.
+    pub memory: Vec<(u64, Vec<u8>)>,
+    pub mtime: u64,
+    pub mtimecmp: u64,
+    pub msip: bool,
+    pub watchpoint: Option<u32>,
+    /// `fromhost` of a program that makes system calls, see
+    /// [`Simulator::fast_forward`](crate::Simulator::fast_forward).
+    pub fromhost: Option<u32>,
+    /// Instructions executed to get here.
+    pub instret: u64,
+    /// Whether the program hit its watchpoint before the instruction count
+    /// ran out, leaving nothing to hand over.
+    pub halted: bool,
+}
+
+/// Why an instruction did not complete.
+#[derive(Debug, Clone, Copy)]
+struct Trap {
+    cause: u32,
+    tval: u32,
+}
+
+impl Trap {
+    fn illegal(inst: u32) -> Self {
+        Trap {
+            cause: 2,
+            tval: inst,
+        }
+    }
+}
+
+/// The effects of one instruction, for the retire trace.
+#[derive(Default)]
+struct Effects {
+    rd: u8,
+    rd_wdata: u32,
+    mem: Option<(u32, Option<u32>)>,
+    /// The instruction wrote mcycle or minstret, which are not to be
+    /// incremented for it.
+    counters_written: bool,
+}
+
+#[derive(Default)]
+struct Uart {
+    attached: bool,
+    tx: Vec<u8>,
+    rx: std::collections::VecDeque<u8>,
+    baud_divider: u32,
+}
+
+#[derive(Default)]
+struct Pins {
+    clock: u8,
+    reset: u8,
+
+    id_valid: u8,
+    id_bits: u8,
+    halt_valid: u8,
+    halt_bits: u8,
+    breakpoint_valid: u8,
+    breakpoint_pc: u64,
+    watchpoint_valid: u8,
+    watchpoint_addr: u64,
+    set_pc_valid: u8,
+    set_pc: u64,
+    register_valid: u8,
+    register_reg: u8,
+    register_write: u8,
+    register_data: u64,
+
+    mem_valid: u8,
+    mem_addr: u64,
+    mem_write: u8,
+    mem_data: u64,
+    mem_width: u8,
+    mem_instr: u8,
+    mem_res_ready: u8,
+    mem_res_valid: u8,
+    mem_res_bits: u64,
+    reg_res_ready: u8,
+    reg_res_valid: u8,
+    reg_res_bits: u64,
+}
+
+struct Machine {
+    config: &'static FunctionalConfig,
+    zba: bool,
+    zbb: bool,
+    m: bool,
+
+    pc: u32,
+    regs: [u32; 32],
+    mstatus: u32,
+    mie: u32,
+    mtvec: u32,
+    mscratch: u32,
+    mepc: u32,
+    mcause: u32,
+    mtval: u32,
+    medeleg: u32,
+    mideleg: u32,
+    mcountinhibit: u32,
+    mhpmevent: [u32; 32],
+    mcycle: u64,
+    minstret: u64,
+
+    halted: bool,
+    sleeping: bool,
+    breakpoint: Option<u32>,
+    watchpoint: Option<u32>,
+    /// Set by the store that hits the watchpoint.
+    watchpoint_hit: bool,
+
+    tcms: Vec<(u32, Vec<u8>)>,
+    uarts: Vec<Uart>,
+    /// Core cycles the RTC has counted, `mtime` times [`CYCLES_PER_MTIME`].
+    rtc_cycles: u64,
+    mtimecmp: u64,
+    msip: bool,
+
+    pins: Pins,
+    idle_skip: bool,
+    retire_enabled: bool,
+    retired: Vec<u64>,
+    /// Cycles since the last recorded retirement.
+    retire_cycles: u64,
+    started: bool,
+}
+
+impl Machine {
+    fn new(config: &'static FunctionalConfig) -> Self {
+        let extensions: Vec<&str> = config.isa.split('_').collect();
+        let base = extensions[0].trim_start_matches("rv32");
+        let has = |name: &str| extensions[1..].contains(&name);
+        let mut machine = Machine {
+            config,
+            zba: has("zba"),
+            zbb: has("zbb"),
+            m: base.contains('m'),
+            pc: 0,
+            regs: [0; 32],
+            mstatus: 0,
+            mie: 0,
+            mtvec: 0,
+            mscratch: 0,
+            mepc: 0,
+            mcause: 0,
+            mtval: 0,
+            medeleg: 0,
+            mideleg: 0,
+            mcountinhibit: 0,
+            mhpmevent: [0; 32],
+            mcycle: 0,
+            minstret: 0,
+            halted: false,
+            sleeping: false,
+            breakpoint: None,
+            watchpoint: None,
+            watchpoint_hit: false,
+            tcms: config
+                .tcms
+                .iter()
+                .map(|&(base, length)| (base as u32, vec![0; length as usize]))
+                .collect(),
+            uarts: config.uarts.iter().map(|_| Uart::default()).collect(),
+            rtc_cycles: 0,
+            mtimecmp: u64::MAX,
+            msip: false,
+            pins: Pins::default(),
+            idle_skip: true,
+            retire_enabled: false,
+            retired: Vec::new(),
+            retire_cycles: 0,
+            started: false,
+        };
+        machine.reset();
+        machine
+    }
+
+    /// Everything the SoC's reset clears. Memory keeps its contents.
+    fn reset(&mut self) {
+        self.pc = self.config.tcms.first().map_or(0, |&(base, _)| base as u32);
+        self.regs = [0; 32];
+        self.mstatus = 0;
+        self.mie = 0;
+        self.mtvec = 0;
+        self.mscratch = 0;
+        self.mepc = 0;
+        self.mcause = 0;
+        self.mtval = 0;
+        self.medeleg = 0;
+        self.mideleg = 0;
+        self.mcountinhibit = 0;
+        self.mhpmevent = [0; 32];
+        self.mcycle = 0;
+        self.minstret = 0;
+        self.halted = false;
+        self.sleeping = false;
+        self.breakpoint = None;
+        self.watchpoint = None;
+        self.watchpoint_hit = false;
+        self.mtimecmp = u64::MAX;
+        self.msip = false;
+    }
+
+    fn mtime(&self) -> u64 {
+        self.rtc_cycles / CYCLES_PER_MTIME
+    }
+
+    fn mip(&self) -> u32 {
+        let mut mip = 0;
+        if self.mtime() >= self.mtimecmp {
+            mip |= MIP_MTIP;
+        }
+        if self.msip {
+            mip |= MIP_MSIP;
+        }
+        mip
+    }
+
+    /// One clock cycle, with the debug pins applied first.
+    fn tick(&mut self) {
+        self.started = true;
+        if self.pins.reset != 0 {
+            self.reset();
+            return;
+        }
+        self.apply_debug_pins();
+        self.service_debug_memory();
+        self.cycle();
+    }
+
+    fn apply_debug_pins(&mut self) {
+        let pins = &self.pins;
+        let selected = pins.id_valid != 0 && (pins.id_bits == 0 || pins.id_bits == 0xff);
+        if !selected {
+            return;
+        }
+        if pins.halt_valid != 0 {
+            self.halted = pins.halt_bits != 0;
+        }
+        if pins.breakpoint_valid != 0 {
+            self.breakpoint = Some(pins.breakpoint_pc as u32);
+        }
+        if pins.watchpoint_valid != 0 {
+            self.watchpoint = Some(pins.watchpoint_addr as u32);
+        }
+        if pins.set_pc_valid != 0 {
+            self.pc = pins.set_pc as u32;
+            self.sleeping = false;
+        }
+        if pins.register_valid != 0 {
+            let reg = (pins.register_reg & 0x1f) as usize;
+            if pins.register_write != 0 {
+                if reg != 0 {
+                    self.regs[reg] = pins.register_data as u32;
+                }
+                self.pins.reg_res_valid = 0;
+            } else {
+                self.pins.reg_res_valid = 1;
+                self.pins.reg_res_bits = u64::from(self.regs[reg]);
+            }
+        }
+    }
+
+    fn service_debug_memory(&mut self) {
+        if self.pins.mem_res_ready != 0 {
+            self.pins.mem_res_valid = 0;
+        }
+        if self.pins.mem_valid == 0 {
+            return;
+        }
+        let addr = self.pins.mem_addr as u32;
+        let size = 1 << self.pins.mem_width.min(2);
+        if self.pins.mem_write != 0 {
+            let _ = self.store(addr, size, self.pins.mem_data as u32);
+        } else {
+            self.pins.mem_res_bits = u64::from(self.load(addr, size).unwrap_or(0));
+            self.pins.mem_res_valid = 1;
+        }
+    }
+
+    /// Advance time by one cycle and, unless halted or asleep, execute one
+    /// instruction. Returns whether an instruction retired.
+    fn cycle(&mut self) -> bool {
+        self.rtc_cycles += 1;
+        if self.halted {
+            return false;
+        }
+        self.mcycle += 1;
+        self.retire_cycles += 1;
+
+        let pending = self.mip() & self.mie;
+        if self.sleeping {
+            if pending == 0 {
+                return false;
+            }
+            self.sleeping = false;
+        }
+        if pending != 0 && self.mstatus & MSTATUS_MIE != 0 {
+            let code = [11, 3, 7]
+                .into_iter()
+                .find(|code| pending & (1 << code) != 0)
+                .unwrap();
+            self.take_trap(self.pc, 0x8000_0000 | code, 0);
+            return false;
+        }
+
+        self.step()
+    }
+
+    /// Execute the instruction at `pc`.
+    fn step(&mut self) -> bool {
+        let pc = self.pc;
+        let inst = match self.fetch(pc) {
+            Ok(inst) => inst,
+            Err(trap) => {
+                self.take_trap(pc, trap.cause, trap.tval);
+                return false;
+            }
+        };
+
+        let mut effects = Effects::default();
+        match self.execute(pc, inst, &mut effects) {
+            Ok(next_pc) => self.pc = next_pc,
+            Err(trap) => {
+                self.take_trap(pc, trap.cause, trap.tval);
+                // The core retires ecall and ebreak on their way to the trap.
+                if trap.cause != 3 && trap.cause != 11 {
+                    return false;
+                }
+                effects = Effects::default();
+            }
+        }
+
+        if !effects.counters_written {
+            self.minstret += 1;
+        }
+        if self.retire_enabled {
+            let flags = match effects.mem {
+                None => 0u64,
+                Some((_, None)) => 1,
+                Some((_, Some(_))) => 3,
+            };
+            let (mem_addr, mem_wdata) = effects.mem.unwrap_or_default();
+            self.retired.extend_from_slice(&[
+                u64::from(pc),
+                u64::from(inst) | u64::from(effects.rd) << 32 | flags << 40,
+                u64::from(effects.rd_wdata),
+                u64::from(mem_addr),
+                u64::from(mem_wdata.unwrap_or(0)),
+                self.retire_cycles,
+                0,
+                0,
+            ]);
+            self.retire_cycles = 0;
+        }
+
+        if self.breakpoint == Some(pc) || std::mem::take(&mut self.watchpoint_hit) {
+            self.halted = true;
+        }
+        true
+    }
+
+    fn take_trap(&mut self, pc: u32, cause: u32, tval: u32) {
+        self.mepc = pc;
+        self.mcause = cause;
+        self.mtval = tval;
+        let mie = self.mstatus & MSTATUS_MIE;
+        self.mstatus = (self.mstatus & !(MSTATUS_MIE | MSTATUS_MPIE)) | MSTATUS_MPP;
+        if mie != 0 {
+            self.mstatus |= MSTATUS_MPIE;
+        }
+        let base = self.mtvec & !3;
+        self.pc = if cause & 0x8000_0000 != 0 && self.mtvec & 3 == 1 {
+            base + 4 * (cause & 0x7fff_ffff)
+        } else {
+            base
+        };
+    }
+
+    fn fetch(&self, pc: u32) -> Result<u32, Trap> {
+        if pc & 3 != 0 {
+            return Err(Trap { cause: 0, tval: pc });
+        }
+        self.tcm_read(pc, 4).ok_or(Trap { cause: 1, tval: pc })
+    }
+
+    fn execute(&mut self, pc: u32, inst: u32, effects: &mut Effects) -> Result<u32, Trap> {
+        let opcode = inst & 0x7f;
+        let rd = ((inst >> 7) & 0x1f) as usize;
+        let funct3 = (inst >> 12) & 7;
+        let rs1 = ((inst >> 15) & 0x1f) as usize;
+        let rs2 = ((inst >> 20) & 0x1f) as usize;
+        let funct7 = inst >> 25;
+        let a = self.regs[rs1];
+        let b = self.regs[rs2];
+        let imm_i = (inst as i32 >> 20) as u32;
+        let imm_s = ((inst as i32 >> 25) << 5) as u32 | ((inst >> 7) & 0x1f);
+        let imm_u = inst & 0xffff_f000;
+        let illegal = Trap::illegal(inst);
+        let mut next_pc = pc.wrapping_add(4);
+
+        let value = match opcode {
+            0x37 => Some(imm_u),
+            0x17 => Some(pc.wrapping_add(imm_u)),
+            0x6f => {
+                let imm = ((inst as i32 >> 31) << 20) as u32
+                    | (inst & 0x000f_f000)
+                    | ((inst >> 9) & 0x800)
+                    | ((inst >> 20) & 0x7fe);
+                next_pc = jump_target(pc.wrapping_add(imm))?;
+                Some(pc.wrapping_add(4))
+            }
+            0x67 if funct3 == 0 => {
+                next_pc = jump_target(a.wrapping_add(imm_i) & !1)?;
+                Some(pc.wrapping_add(4))
+            }
+            0x63 => {
+                let taken = match funct3 {
+                    0 => a == b,
+                    1 => a != b,
+                    4 => (a as i32) < (b as i32),
+                    5 => (a as i32) >= (b as i32),
+                    6 => a < b,
+                    7 => a >= b,
+                    _ => return Err(illegal),
+                };
+                if taken {
+                    let imm = ((inst as i32 >> 31) << 12) as u32
+                        | ((inst << 4) & 0x800)
+                        | ((inst >> 20) & 0x7e0)
+                        | ((inst >> 7) & 0x1e);
+                    next_pc = jump_target(pc.wrapping_add(imm))?;
+                }
+                None
+            }
+            0x03 => {
+                let addr = a.wrapping_add(imm_i);
+                let size = match funct3 {
+                    0 | 4 => 1,
+                    1 | 5 => 2,
+                    2 => 4,
+                    _ => return Err(illegal),
+                };
+                if addr & (size - 1) != 0 {
+                    return Err(Trap {
+                        cause: 4,
+                        tval: addr,
+                    });
+                }
+                let raw = self.load(addr, size).ok_or(Trap {
+                    cause: 5,
+                    tval: addr,
+                })?;
+                effects.mem = Some((addr, None));
+                Some(match funct3 {
+                    0 => raw as i8 as u32,
+                    1 => raw as i16 as u32,
+                    _ => raw,
+                })
+            }
+            0x23 => {
+                let addr = a.wrapping_add(imm_s);
+                let size = match funct3 {
+                    0 => 1,
+                    1 => 2,
+                    2 => 4,
+                    _ => return Err(illegal),
+                };
+                if addr & (size - 1) != 0 {
+                    return Err(Trap {
+                        cause: 6,
+                        tval: addr,
+                    });
+                }
+                self.store(addr, size, b).ok_or(Trap {
+                    cause: 7,
+                    tval: addr,
+                })?;
+                if self.watchpoint == Some(addr) {
+                    self.watchpoint_hit = true;
+                }
+                let mask = if size == 4 {
+                    u32::MAX
+                } else {
+                    (1 << (8 * size)) - 1
+                };
+                effects.mem = Some((addr, Some(b & mask)));
+                None
+            }
+            0x13 => Some(self.op_imm(inst, funct3, a, imm_i).ok_or(illegal)?),
+            0x33 => Some(self.op(funct7, funct3, rs2, a, b).ok_or(illegal)?),
+            0x0f => None,
+            0x73 => match funct3 {
+                0 => {
+                    match inst {
+                        0x0000_0073 => return Err(Trap { cause: 11, tval: 0 }),
+                        0x0010_0073 => return Err(Trap { cause: 3, tval: pc }),
+                        0x3020_0073 => {
+                            next_pc = self.mepc;
+                            let mpie = self.mstatus & MSTATUS_MPIE;
+                            self.mstatus =
+                                (self.mstatus & !MSTATUS_MIE) | MSTATUS_MPIE | MSTATUS_MPP;
+                            if mpie != 0 {
+                                self.mstatus |= MSTATUS_MIE;
+                            }
+                        }
+                        // The core takes interrupts after wfi retires.
+                        0x1050_0073 => self.sleeping = self.mip() & self.mie == 0,
+                        _ => return Err(illegal),
+                    }
+                    None
+                }
+                4 => return Err(illegal),
+                _ => {
+                    let csr = (inst >> 20) as u16;
+                    let operand = if funct3 & 4 != 0 { rs1 as u32 } else { a };
+                    let old = self.csr_read(csr).ok_or(illegal)?;
+                    let new = match funct3 & 3 {
+                        1 => Some(operand),
+                        2 => (rs1 != 0).then_some(old | operand),
+                        _ => (rs1 != 0).then_some(old & !operand),
+                    };
+                    if let Some(new) = new {
+                        self.csr_write(csr, new).ok_or(illegal)?;
+                        effects.counters_written |= matches!(csr, 0xb00 | 0xb02 | 0xb80 | 0xb82);
+                    }
+                    Some(old)
+                }
+            },
+            _ => return Err(illegal),
+        };
+
+        if let Some(value) = value {
+            if rd != 0 {
+                self.regs[rd] = value;
+                effects.rd = rd as u8;
+                effects.rd_wdata = value;
+            }
+        }
+        Ok(next_pc)
+    }
+
+    fn op_imm(&self, inst: u32, funct3: u32, a: u32, imm: u32) -> Option<u32> {
+        let shamt = imm & 0x1f;
+        let funct7 = inst >> 25;
+        Some(match funct3 {
+            0 => a.wrapping_add(imm),
+            2 => ((a as i32) < (imm as i32)) as u32,
+            3 => (a < imm) as u32,
+            4 => a ^ imm,
+            6 => a | imm,
+            7 => a & imm,
+            1 => match (funct7, (inst >> 20) & 0x1f) {
+                (0x00, _) => a << shamt,
+                (0x30, 0) if self.zbb => a.leading_zeros(),
+                (0x30, 1) if self.zbb => a.trailing_zeros(),
+                (0x30, 2) if self.zbb => a.count_ones(),
+                (0x30, 4) if self.zbb => a as i8 as u32,
+                (0x30, 5) if self.zbb => a as i16 as u32,
+                _ => return None,
+            },
+            _ => match (funct7, imm & 0xfff) {
+                (0x00, _) => a >> shamt,
+                (0x20, _) => ((a as i32) >> shamt) as u32,
+                (0x30, _) if self.zbb => a.rotate_right(shamt),
+                (0x14, 0x287) if self.zbb => orc_b(a),
+                (0x34, 0x698) if self.zbb => a.swap_bytes(),
+                _ => return None,
+            },
+        })
+    }
+
+    fn op(&self, funct7: u32, funct3: u32, rs2: usize, a: u32, b: u32) -> Option<u32> {
+        let shamt = b & 0x1f;
+        Some(match (funct7, funct3) {
+            (0x00, 0) => a.wrapping_add(b),
+            (0x20, 0) => a.wrapping_sub(b),
+            (0x00, 1) => a << shamt,
+            (0x00, 2) => ((a as i32) < (b as i32)) as u32,
+            (0x00, 3) => (a < b) as u32,
+            (0x00, 4) => a ^ b,
+            (0x00, 5) => a >> shamt,
+            (0x20, 5) => ((a as i32) >> shamt) as u32,
+            (0x00, 6) => a | b,
+            (0x00, 7) => a & b,
+            (0x01, _) if self.m => muldiv(funct3, a, b),
+            (0x10, 2) if self.zba => (a << 1).wrapping_add(b),
+            (0x10, 4) if self.zba => (a << 2).wrapping_add(b),
+            (0x10, 6) if self.zba => (a << 3).wrapping_add(b),
+            (0x20, 7) if self.zbb => a & !b,
+            (0x20, 6) if self.zbb => a | !b,
+            (0x20, 4) if self.zbb => !(a ^ b),
+            (0x05, 4) if self.zbb => (a as i32).min(b as i32) as u32,
+            (0x05, 5) if self.zbb => a.min(b),
+            (0x05, 6) if self.zbb => (a as i32).max(b as i32) as u32,
+            (0x05, 7) if self.zbb => a.max(b),
+            (0x30, 1) if self.zbb => a.rotate_left(shamt),
+            (0x30, 5) if self.zbb => a.rotate_right(shamt),
+            (0x04, 4) if self.zbb && rs2 == 0 => a & 0xffff,
+            _ => return None,
+        })
+    }
+
+    fn csr_read(&self, csr: u16) -> Option<u32> {
+        Some(match csr {
+            0x300 => self.mstatus,
+            0x301 => misa(self.config.isa),
+            0x302 => self.medeleg,
+            0x303 => self.mideleg,
+            0x304 => self.mie,
+            0x305 => self.mtvec,
+            0x310 => 0,
+            0x320 => self.mcountinhibit,
+            0x323..=0x33f => self.mhpmevent[usize::from(csr - 0x320)],
+            0x340 => self.mscratch,
+            0x341 => self.mepc,
+            0x342 => self.mcause,
+            0x343 => self.mtval,
+            0x344 => self.mip(),
+            0xb00 | 0xc00 => self.mcycle as u32,
+            0xb80 | 0xc80 => (self.mcycle >> 32) as u32,
+            0xb02 | 0xc02 => self.minstret as u32,
+            0xb82 | 0xc82 => (self.minstret >> 32) as u32,
+            0xc01 => self.mtime() as u32,
+            0xc81 => (self.mtime() >> 32) as u32,
+            0xb03..=0xb1f | 0xb83..=0xb9f | 0xc03..=0xc1f | 0xc83..=0xc9f => 0,
+            0xf11..=0xf13 => 0,
+            0xf14 => 0, // mhartid
+            _ => return None,
+        })
+    }
+
+    fn csr_write(&mut self, csr: u16, value: u32) -> Option<()> {
+        // The top two address bits set mark read-only CSRs.
+        if csr >> 10 == 3 {
+            return None;
+        }
+        match csr {
+            0x300 => {
+                self.mstatus = (self.mstatus & !MSTATUS_WRITE_MASK) | (value & MSTATUS_WRITE_MASK)
+            }
+            0x301 | 0x310 | 0x344 => {}
+            0x302 => self.medeleg = value,
+            0x303 => self.mideleg = value,
+            0x304 => self.mie = value,
+            0x305 => self.mtvec = value,
+            0x320 => self.mcountinhibit = value,
+            0x323..=0x33f => self.mhpmevent[usize::from(csr - 0x320)] = value,
+            0x340 => self.mscratch = value,
+            0x341 => self.mepc = value & !3,
+            0x342 => self.mcause = value,
+            0x343 => self.mtval = value,
+            0xb00 => self.mcycle = (self.mcycle & !0xffff_ffff) | u64::from(value),
+            0xb80 => self.mcycle = (self.mcycle & 0xffff_ffff) | u64::from(value) << 32,
+            0xb02 => self.minstret = (self.minstret & !0xffff_ffff) | u64::from(value),
+            0xb82 => self.minstret = (self.minstret & 0xffff_ffff) | u64::from(value) << 32,
+            0xb03..=0xb1f | 0xb83..=0xb9f => {}
+            _ => return None,
+        }
+        Some(())
+    }
+
+    fn tcm_read(&self, addr: u32, size: u32) -> Option<u32> {
+        let (base, data) = self
+            .tcms
+            .iter()
+            .find(|(base, data)| (addr.wrapping_sub(*base) as usize) < data.len())?;
+        let offset = (addr - base) as usize;
+        let bytes = data.get(offset..offset + size as usize)?;
+        Some(
+            bytes
+                .iter()
+                .rev()
+                .fold(0, |value, &byte| value << 8 | u32::from(byte)),
+        )
+    }
+
+    fn tcm_write(&mut self, addr: u32, size: u32, value: u32) -> Option<()> {
+        let (base, data) = self
+            .tcms
+            .iter_mut()
+            .find(|(base, data)| (addr.wrapping_sub(*base) as usize) < data.len())?;
+        let offset = (addr - *base) as usize;
+        let bytes = data.get_mut(offset..offset + size as usize)?;
+        bytes.copy_from_slice(&value.to_le_bytes()[..size as usize]);
+        Some(())
+    }
+
+    fn load(&mut self, addr: u32, size: u32) -> Option<u32> {
+        if let Some(value) = self.tcm_read(addr, size) {
+            return Some(value);
+        }
+        let shift = 8 * (addr & 3);
+        let word = match addr & !3 {
+            TIMER_BASE => self.mtime() as u32,
+            a if a == TIMER_BASE + 4 => (self.mtime() >> 32) as u32,
+            TIMER_MTIMECMP => self.mtimecmp as u32,
+            a if a == TIMER_MTIMECMP + 4 => (self.mtimecmp >> 32) as u32,
+            MSIP_BASE => self.msip as u32,
+            a => {
+                let index = self.uart_index(a)?;
+                let uart = &mut self.uarts[index];
+                match a & 0xf {
+                    UART_DATA => uart.rx.pop_front().map_or(0, u32::from),
+                    UART_STATUS => 1 | (u32::from(!uart.rx.is_empty()) << 1),
+                    UART_BAUD_DIV => uart.baud_divider,
+                    _ => 0,
+                }
+            }
+        };
+        let mask = if size == 4 {
+            u32::MAX
+        } else {
+            (1 << (8 * size)) - 1
+        };
+        Some((word >> shift) & mask)
+    }
+
+    fn store(&mut self, addr: u32, size: u32, value: u32) -> Option<()> {
+        if self.tcm_write(addr, size, value).is_some() {
+            return Some(());
+        }
+        let word = addr & !3;
+        let value = value << (8 * (addr & 3));
+        match word {
+            TIMER_BASE => {}
+            a if a == TIMER_BASE + 4 => {}
+            TIMER_MTIMECMP => self.mtimecmp = (self.mtimecmp & !0xffff_ffff) | u64::from(value),
+            a if a == TIMER_MTIMECMP + 4 => {
+                self.mtimecmp = (self.mtimecmp & 0xffff_ffff) | u64::from(value) << 32
+            }
+            MSIP_BASE => self.msip = value & 1 != 0,
+            a => {
+                let index = self.uart_index(a)?;
+                let uart = &mut self.uarts[index];
+                match a & 0xf {
+                    UART_DATA if uart.attached => uart.tx.push(value as u8),
+                    UART_BAUD_DIV => uart.baud_divider = value & 0xffff,
+                    _ => {}
+                }
+            }
+        }
+        Some(())
+    }
+
+    fn uart_index(&self, addr: u32) -> Option<usize> {
+        self.config
+            .uarts
+            .iter()
+            .position(|&base| u64::from(addr) & !0xf == base)
+    }
+
+    /// Cycles an idle skip may move time forward by.
+    fn idle_cycles(&self, budget: u64) -> u64 {
+        if !self.idle_skip || !self.sleeping || self.halted || self.mip() & self.mie != 0 {
+            return 0;
+        }
+        let deadline = if self.mie & MIP_MTIP != 0 {
+            self.mtimecmp.saturating_mul(CYCLES_PER_MTIME)
+        } else {
+            u64::MAX
+        };
+        deadline.saturating_sub(self.rtc_cycles).min(budget)
+    }
+
+    fn skip_cycles(&mut self, cycles: u64) {
+        self.rtc_cycles += cycles;
+        self.mcycle += cycles;
+        self.retire_cycles += cycles;
+    }
+
+    fn arch_state(&self) -> ArchState {
+        let mut regs = RegisterFile::new();
+        for (index, &value) in self.regs.iter().enumerate() {
+            regs.set(index as u8, value);
+        }
+        ArchState {
+            pc: self.pc,
+            regs,
+            csrs: TRANSFERRED_CSRS
+                .iter()
+                .map(|&csr| (csr, self.csr_read(csr).unwrap()))
+                .collect(),
+            memory: self
+                .tcms
+                .iter()
+                .map(|(base, data)| (u64::from(*base), data.clone()))
+                .collect(),
+            mtime: self.mtime(),
+            mtimecmp: self.mtimecmp,
+            msip: self.msip,
+            watchpoint: self.watchpoint,
+            fromhost: None,
+            instret: self.minstret,
+            halted: self.halted,
+        }
+    }
+}
+
+fn jump_target(target: u32) -> Result<u32, Trap> {
+    if target & 3 != 0 {
+        return Err(Trap {
+            cause: 0,
+            tval: target,
+        });
+    }
+    Ok(target)
+}
+
+fn muldiv(funct3: u32, a: u32, b: u32) -> u32 {
+    let (sa, sb) = (a as i32, b as i32);
+    match funct3 {
+        0 => a.wrapping_mul(b),
+        1 => ((i64::from(sa) * i64::from(sb)) >> 32) as u32,
+        2 => ((i64::from(sa) * i64::from(b)) >> 32) as u32,
+        3 => ((u64::from(a) * u64::from(b)) >> 32) as u32,
+        4 if b == 0 => u32::MAX,
+        4 => sa.wrapping_div(sb) as u32,
+        5 if b == 0 => u32::MAX,
+        5 => a / b,
+        6 if b == 0 => a,
+        6 => sa.wrapping_rem(sb) as u32,
+        _ if b == 0 => a,
+        _ => a % b,
+    }
+}
+
+fn orc_b(value: u32) -> u32 {
+    u32::from_le_bytes(
+        value
+            .to_le_bytes()
+            .map(|byte| if byte != 0 { 0xff } else { 0 }),
+    )
+}
+
+fn misa(isa: &str) -> u32 {
+    let base = isa.split('_').next().unwrap_or("");
+    let letters = base.trim_start_matches("rv32").trim_start_matches("rv64");
+    letters
+        .bytes()
+        .filter(u8::is_ascii_lowercase)
+        .fold(1 << 30, |misa, letter| misa | 1 << (letter - b'a'))
+}
+
+/// Parse a `$readmemh` image into `data`, which starts at word 0.
+fn read_memh(path: &str, data: &mut [u8]) -> bool {
+    let Ok(text) = std::fs::read_to_string(path) else {
+        return false;
+    };
+    let mut index = 0usize;
+    for token in text.split_whitespace() {
+        if let Some(address) = token.strip_prefix('@') {
+            let Ok(address) = usize::from_str_radix(address, 16) else {
+                return false;
+            };
+            index = address;
+            continue;
+        }
+        let Ok(word) = u32::from_str_radix(token, 16) else {
+            return false;
+        };
+        if let Some(bytes) = data.get_mut(index * 4..index * 4 + 4) {
+            bytes.copy_from_slice(&word.to_le_bytes());
+        }
+        index += 1;
+    }
+    true
+}
+
+/// [`SimulatorImpl`] over a [`Machine`].
+pub(crate) struct FunctionalModel {
+    machine: RefCell<Machine>,
+}
+
+impl FunctionalModel {
+    pub(crate) fn new(config: &'static FunctionalConfig) -> Self {
+        FunctionalModel {
+            machine: RefCell::new(Machine::new(config)),
+        }
+    }
+}
+
+macro_rules! pins {
+    ($($get:ident / $set:ident: $field:ident: $ty:ty),* $(,)?) => {
+        $(
+            fn $get(&self) -> $ty {
+                self.machine.borrow().pins.$field
+            }
+            fn $set(&self, value: $ty) {
+                self.machine.borrow_mut().pins.$field = value;
+            }
+        )*
+    };
+}
+
+impl SimulatorImpl for FunctionalModel {
+    fn xlen(&self) -> u8 {
+        32
+    }
+
+    fn isa(&self) -> &'static str {
+        self.machine.borrow().config.isa
+    }
+
+    fn name(&self) -> &'static str {
+        self.machine.borrow().config.name
+    }
+
+    fn build_profile(&self) -> &'static str {
+        "functional"
+    }
+
+    fn eval(&self) {}
+
+    fn final_eval(&self) {}
+
+    fn trace_extension(&self) -> &'static str {
+        "vcd"
+    }
+
+    fn open_vcd(&self, path: &str, _depth: u32, _scope: &str) {
+        eprintln!("The functional backend has no signals to trace, not writing {path}");
+    }
+
+    fn dump_vcd(&self, _timestamp: u64) {}
+
+    fn close_vcd(&self) {}
+
+    fn tick(&self, _dump_vcd: bool) {
+        self.machine.borrow_mut().tick();
+    }
+
+    fn run_cycles(&self, cycles: u64, dump_vcd: bool) -> RunStatus {
+        let mut machine = self.machine.borrow_mut();
+        let mut done = 0;
+        while done < cycles {
+            let idle = if dump_vcd {
+                0
+            } else {
+                machine.idle_cycles(cycles - done)
+            };
+            if idle > 0 {
+                machine.skip_cycles(idle);
+                done += idle;
+                continue;
+            }
+
+            machine.tick();
+            done += 1;
+            let reason = if machine.halted {
+                StopReason::Halted
+            } else if machine.retired.len() >= RETIRE_CAPACITY * RETIRE_WORDS {
+                StopReason::RetireFull
+            } else if machine
+                .uarts
+                .iter()
+                .any(|uart| uart.tx.len() >= UART_CAPACITY)
+            {
+                StopReason::UartFull
+            } else {
+                continue;
+            };
+            return RunStatus {
+                cycles: done,
+                reason,
+            };
+        }
+        RunStatus {
+            cycles: done,
+            reason: StopReason::Budget,
+        }
+    }
+
+    fn set_idle_skip(&self, enable: bool) {
+        self.machine.borrow_mut().idle_skip = enable;
+    }
+
+    fn supports_checkpoints(&self) -> bool {
+        false
+    }
+
+    fn save_checkpoint(&self, _path: &str) -> bool {
+        false
+    }
+
+    fn restore_checkpoint(&self, _path: &str) -> bool {
+        false
+    }
+
+    fn tcm_regions(&self) -> &'static [(u64, u64)] {
+        self.machine.borrow().config.tcms
+    }
+
+    fn preload_tcm(&self, base_address: u64, image_path: &str) -> bool {
+        let mut machine = self.machine.borrow_mut();
+        if machine.started {
+            return false;
+        }
+        machine
+            .tcms
+            .iter_mut()
+            .find(|(base, _)| u64::from(*base) == base_address)
+            .is_some_and(|(_, data)| read_memh(image_path, data))
+    }
+
+    fn retire_enable(&self, enable: bool) {
+        let mut machine = self.machine.borrow_mut();
+        machine.retire_enabled = enable;
+        machine.retired.clear();
+        machine.retire_cycles = 0;
+    }
+
+    fn retire_read(&self, buf: &mut [u64]) -> usize {
+        let mut machine = self.machine.borrow_mut();
+        let words = machine
+            .retired
+            .len()
+            .min(buf.len() / RETIRE_WORDS * RETIRE_WORDS);
+        buf[..words].copy_from_slice(&machine.retired[..words]);
+        machine.retired.drain(..words);
+        words / RETIRE_WORDS
+    }
+
+    fn backdoor_read_reg(&self, hart: u8, reg: u8) -> u64 {
+        let machine = self.machine.borrow();
+        if hart != 0 {
+            return 0;
+        }
+        u64::from(machine.regs[usize::from(reg & 0x1f)])
+    }
+
+    fn backdoor_read_mem(&self, addr: u64, words: &mut [u64]) -> usize {
+        let machine = self.machine.borrow();
+        for (index, word) in words.iter_mut().enumerate() {
+            match machine.tcm_read((addr as u32).wrapping_add(4 * index as u32), 4) {
+                Some(value) => *word = u64::from(value),
+                None => return index,
+            }
+        }
+        words.len()
+    }
+
+    fn uart_attach(&self, index: usize) {
+        if let Some(uart) = self.machine.borrow_mut().uarts.get_mut(index) {
+            uart.attached = true;
+        }
+    }
+
+    fn uart_read(&self, index: usize, buf: &mut [u8]) -> usize {
+        let mut machine = self.machine.borrow_mut();
+        let Some(uart) = machine.uarts.get_mut(index) else {
+            return 0;
+        };
+        let count = uart.tx.len().min(buf.len());
+        buf[..count].copy_from_slice(&uart.tx[..count]);
+        uart.tx.drain(..count);
+        count
+    }
+
+    fn uart_write(&self, index: usize, data: &[u8]) -> usize {
+        let mut machine = self.machine.borrow_mut();
+        let Some(uart) = machine.uarts.get_mut(index) else {
+            return 0;
+        };
+        let count = UART_CAPACITY.saturating_sub(uart.rx.len()).min(data.len());
+        uart.rx.extend(&data[..count]);
+        count
+    }
+
+    pins! {
+        get_clock / set_clock: clock: u8,
+        get_reset / set_reset: reset: u8,
+        get_debug_hart_in_id_valid / set_debug_hart_in_id_valid: id_valid: u8,
+        get_debug_hart_in_id_bits / set_debug_hart_in_id_bits: id_bits: u8,
+        get_debug_hart_in_bits_halt_valid / set_debug_hart_in_bits_halt_valid: halt_valid: u8,
+        get_debug_hart_in_bits_halt_bits / set_debug_hart_in_bits_halt_bits: halt_bits: u8,
+        get_debug_hart_in_bits_breakpoint_valid / set_debug_hart_in_bits_breakpoint_valid:
+            breakpoint_valid: u8,
+        get_debug_hart_in_bits_breakpoint_bits_pc / set_debug_hart_in_bits_breakpoint_bits_pc:
+            breakpoint_pc: u64,
+        get_debug_hart_in_bits_watchpoint_valid / set_debug_hart_in_bits_watchpoint_valid:
+            watchpoint_valid: u8,
+        get_debug_hart_in_bits_watchpoint_bits_addr / set_debug_hart_in_bits_watchpoint_bits_addr:
+            watchpoint_addr: u64,
+        get_debug_hart_in_bits_set_pc_valid / set_debug_hart_in_bits_set_pc_valid: set_pc_valid: u8,
+        get_debug_hart_in_bits_set_pc_bits_pc / set_debug_hart_in_bits_set_pc_bits_pc: set_pc: u64,
+        get_debug_hart_in_bits_register_valid / set_debug_hart_in_bits_register_valid:
+            register_valid: u8,
+        get_debug_hart_in_bits_register_bits_reg / set_debug_hart_in_bits_register_bits_reg:
+            register_reg: u8,
+        get_debug_hart_in_bits_register_bits_write / set_debug_hart_in_bits_register_bits_write:
+            register_write: u8,
+        get_debug_hart_in_bits_register_bits_data / set_debug_hart_in_bits_register_bits_data:
+            register_data: u64,
+        get_debug_mem_in_valid / set_debug_mem_in_valid: mem_valid: u8,
+        get_debug_mem_in_bits_addr / set_debug_mem_in_bits_addr: mem_addr: u64,
+        get_debug_mem_in_bits_write / set_debug_mem_in_bits_write: mem_write: u8,
+        get_debug_mem_in_bits_data / set_debug_mem_in_bits_data: mem_data: u64,
+        get_debug_mem_in_bits_req_width / set_debug_mem_in_bits_req_width: mem_width: u8,
+        get_debug_mem_in_bits_instr / set_debug_mem_in_bits_instr: mem_instr: u8,
+        get_debug_mem_res_ready / set_debug_mem_res_ready: mem_res_ready: u8,
+        get_debug_reg_res_ready / set_debug_reg_res_ready: reg_res_ready: u8,
+    }
+
+    // mtime follows the cycle count, the RTC pin only exists for the RTL
+    fn get_rtc_clock(&self) -> u8 {
+        0
+    }
+
+    fn set_rtc_clock(&self, _value: u8) {}
+
+    fn get_debug_mem_in_ready(&self) -> u8 {
+        1
+    }
+
+    fn get_debug_mem_res_valid(&self) -> u8 {
+        self.machine.borrow().pins.mem_res_valid
+    }
+
+    fn get_debug_mem_res_bits(&self) -> u64 {
+        self.machine.borrow().pins.mem_res_bits
+    }
+
+    fn get_debug_reg_res_valid(&self) -> u8 {
+        self.machine.borrow().pins.reg_res_valid
+    }
+
+    fn get_debug_reg_res_bits(&self) -> u64 {
+        self.machine.borrow().pins.reg_res_bits
+    }
+
+    fn get_debug_halted(&self) -> u8 {
+        self.machine.borrow().halted as u8
+    }
+
+    fn get_debug_sleeping(&self) -> u8 {
+        self.machine.borrow().sleeping as u8
+    }
+
+    fn get_uart_0_txd(&self) -> u8 {
+        1
+    }
+
+    fn set_uart_0_rxd(&self, _value: u8) {}
+
+    fn get_uart_1_txd(&self) -> u8 {
+        1
+    }
+
+    fn set_uart_1_rxd(&self, _value: u8) {}
+
+    fn fast_forward(&self, entry_point: u32, instructions: u64) -> Option<ArchState> {
+        let mut machine = self.machine.borrow_mut();
+        machine.started = true;
+        machine.pc = entry_point;
+        machine.halted = false;
+        let mut retired = 0;
+        while retired < instructions && !machine.halted {
+            if machine.sleeping && machine.mip() & machine.mie == 0 {
+                // Only the timer can wake a sleeping hart from in here.
+                if machine.mie & MIP_MTIP == 0 || machine.mtimecmp == u64::MAX {
+                    break;
+                }
+                let wake = machine.mtimecmp.saturating_mul(CYCLES_PER_MTIME);
+                let idle = wake.saturating_sub(machine.rtc_cycles);
+                machine.skip_cycles(idle);
+            }
+            if machine.cycle() {
+                retired += 1;
+            }
+        }
+        eprintln!(
+            "Fast-forwarded {} instructions, stopping at pc=0x{:08x}",
+            retired, machine.pc
+        );
+        Some(machine.arch_state())
+    }
+}
+
+/// A program that writes `csrs` through t0 and then spins in place, for
+/// restoring CSRs on a core that cannot write them from the debug port.
+pub(crate) fn csr_restore_stub(csrs: &[(u16, u32)]) -> Vec<u32> {
+    const T0: u32 = 5;
+    let mut stub = Vec::with_capacity(csrs.len() * 3 + 1);
+    for &(csr, value) in csrs {
+        let upper = value.wrapping_add(0x800) & 0xffff_f000;
+        let lower = value.wrapping_sub(upper) & 0xfff;
+        stub.push(upper | T0 << 7 | 0x37); // lui t0, upper
+        stub.push(lower << 20 | T0 << 15 | T0 << 7 | 0x13); // addi t0, t0, lower
+        stub.push(u32::from(csr) << 20 | T0 << 15 | 1 << 12 | 0x73); // csrw csr, t0
+    }
+    stub.push(0x0000_006f); // j .
+    stub
+}
+
+/// Cache-line aligned address of `bytes` bytes of zeros in `memory`, from
+/// the middle of the longest zero run so that neither the heap nor the stack
+/// is likely to reach it. Zeros never execute, so no instruction cache can
+/// hold a line from there.
+pub(crate) fn scratch_area(memory: &[(u64, Vec<u8>)], bytes: usize) -> Option<u64> {
+    const LINE: usize = 64;
+    let mut best: Option<(usize, u64)> = None;
+    for (base, data) in memory {
+        let mut run_start = 0;
+        for (index, line) in data.chunks(LINE).enumerate() {
+            if line.iter().any(|&byte| byte != 0) {
+                run_start = index + 1;
+                continue;
+            }
+            let length = (index + 1 - run_start) * LINE;
+            if best.is_none_or(|(best_length, _)| length > best_length) {
+                best = Some((length, base + (run_start * LINE) as u64));
+            }
+        }
+    }
+    let (length, start) = best.filter(|&(length, _)| length >= bytes)?;
+    let offset = (length - bytes) / 2 / LINE * LINE;
+    Some(start + offset as u64)
+}
@@ -1,10 +1,14 @@
 mod core;
+mod htif;
+mod iss;
 mod models;
+mod profile;
 mod register_file;
-mod uart;
 
 // Re-export public API
-pub use core::{Backend, Simulator};
+pub use core::{Backend, Retirement, STALL_EVENTS, Simulator, TraceOptions, elf_symbol};
+pub use iss::ArchState;
+pub use profile::{Counts, FunctionProfile, Profiler};
 pub use register_file::{RegisterFile, TestResult};
 
 impl Simulator {
@@ -12,6 +16,7 @@ impl Simulator {
     pub fn available_models(backend: Backend) -> &'static [&'static str] {
         match backend {
             Backend::Verilator | Backend::VerilatorMonitored => crate::models::VERILATOR_MODELS,
+            Backend::Functional => crate::models::FUNCTIONAL_MODEL_NAMES,
         }
     }
 }
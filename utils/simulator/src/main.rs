@@ -1,8 +1,9 @@
 use anyhow::{Context, Result};
-use camino::Utf8PathBuf;
+use camino::{Utf8Path, Utf8PathBuf};
 use clap::Parser;
-use simulator::{Backend, Simulator};
-use std::io::Write;
+use simulator::{Backend, Profiler, STALL_EVENTS, Simulator, TraceOptions};
+use std::io::{Read, Write};
+use std::sync::{Arc, Mutex};
 
 #[derive(Parser)]
 #[command(name = "svarog-sim")]
@@ -21,10 +22,22 @@ struct Args {
     #[arg(short, long)]
     model: Option<String>,
 
-    /// VCD output file
+    /// Trace output file (VCD, or FST when built with the `fst` feature)
     #[arg(long)]
     vcd: Option<Utf8PathBuf>,
 
+    /// Hierarchy levels to trace
+    #[arg(long, default_value = "99")]
+    trace_depth: u32,
+
+    /// Only trace below this Verilator scope (e.g. TOP.SvarogSoC.cpu)
+    #[arg(long)]
+    trace_scope: Option<String>,
+
+    /// Only trace cycles START..END of execution; everything else runs untraced
+    #[arg(long, value_name = "START:END", value_parser = parse_window)]
+    trace_window: Option<std::ops::Range<usize>>,
+
     /// Maximum simulation cycles
     #[arg(long, default_value = "100000")]
     max_cycles: usize,
@@ -45,10 +58,44 @@ struct Args {
     #[arg(long, value_parser = parse_hex)]
     entry_point: Option<u32>,
 
-    /// Enable UART console output (0 or 1)
+    /// Enable UART console (0 or 1): print its TX output and feed stdin to its RX
     #[arg(long)]
     uart_console: Option<usize>,
 
+    /// Hart whose halt ends the run and whose registers are reported
+    #[arg(long, default_value = "0")]
+    hart: u8,
+
+    /// Run every cycle while all harts sleep in wfi instead of skipping ahead
+    #[arg(long)]
+    no_idle_skip: bool,
+
+    /// Preload ELF sections straight into TCM instead of over the debug bus
+    #[arg(long)]
+    fast_load: bool,
+
+    /// Save a checkpoint after this many cycles of execution (needs the `checkpoint` feature)
+    #[arg(long)]
+    checkpoint_at: Option<usize>,
+
+    /// Checkpoint file written by --checkpoint-at
+    #[arg(long, default_value = "svarog.ckpt")]
+    checkpoint_file: Utf8PathBuf,
+
+    /// Resume from a checkpoint instead of loading and booting BINARY
+    #[arg(long)]
+    restore: Option<Utf8PathBuf>,
+
+    /// Execute the first N instructions on the functional model, then hand
+    /// the architectural state to BACKEND for detailed simulation
+    #[arg(long, value_name = "N")]
+    fast_forward: Option<u64>,
+
+    /// Count every instruction hart 0 retires and write cycles per call stack
+    /// to OUT, as folded stacks or, for a .pb or .pprof path, as pprof
+    #[arg(long, value_name = "OUT")]
+    profile: Option<Utf8PathBuf>,
+
     /// List available models and exit
     #[arg(long)]
     list_models: bool,
@@ -62,6 +109,18 @@ fn parse_hex(s: &str) -> Result<u32, std::num::ParseIntError> {
     }
 }
 
+fn parse_window(s: &str) -> Result<std::ops::Range<usize>, String> {
+    let (start, end) = s
+        .split_once(':')
+        .ok_or_else(|| format!("expected START:END, got {s}"))?;
+    let start: usize = start.parse().map_err(|e| format!("invalid start: {e}"))?;
+    let end: usize = end.parse().map_err(|e| format!("invalid end: {e}"))?;
+    if end <= start {
+        return Err(format!("empty trace window {s}"));
+    }
+    Ok(start..end)
+}
+
 fn draw_progress(current: usize, max: usize) {
     let bar_width = 40usize;
     let capped = current.min(max);
@@ -105,10 +164,6 @@ fn main() -> Result<()> {
         return Ok(());
     }
 
-    let binary = args
-        .binary
-        .ok_or_else(|| anyhow::anyhow!("BINARY argument is required"))?;
-
     let model_name = if let Some(model_name) = &args.model {
         model_name.clone()
     } else {
@@ -127,33 +182,53 @@ fn main() -> Result<()> {
 
     // Create simulator
     let sim = Simulator::new(backend, &model_name).context("Failed to create simulator")?;
+    sim.select_hart(args.hart);
+    sim.set_idle_skip(!args.no_idle_skip);
 
     // Enable UART console if requested
     if let Some(uart_index) = args.uart_console {
         sim.enable_uart_console(uart_index);
+
+        let (input_tx, input_rx) = std::sync::mpsc::channel();
+        std::thread::spawn(move || {
+            for byte in std::io::stdin().lock().bytes() {
+                let Ok(byte) = byte else { break };
+                if input_tx.send(byte).is_err() {
+                    break;
+                }
+            }
+        });
+        sim.set_uart_console_input(input_rx);
     }
 
-    // Detect file type and load appropriately
-    let is_raw_binary = binary.extension().map(|ext| ext == "bin").unwrap_or(false);
+    sim.set_trace_options(TraceOptions {
+        depth: args.trace_depth,
+        scope: args.trace_scope.clone(),
+        window: args.trace_window.clone(),
+    });
 
-    let entry_point = if is_raw_binary {
-        // Raw binary file
-        let load_addr = args.load_addr.unwrap_or(0x80000000);
-        println!("Loading raw binary: {}", binary);
-        println!("  Load address: 0x{:08x}", load_addr);
+    if let Some(cycle) = args.checkpoint_at {
+        sim.checkpoint_at(cycle, args.checkpoint_file.as_std_path());
+    }
 
-        let entry = sim
-            .load_raw_binary(&binary, load_addr, args.entry_point, args.watchpoint_addr)
-            .context("Failed to load raw binary")?;
+    // Either restore a saved state or detect the file type and load appropriately
+    let entry_point = match (&args.restore, &args.binary) {
+        (Some(checkpoint), _) => {
+            sim.restore_checkpoint(checkpoint.as_std_path())
+                .context("Failed to restore checkpoint")?;
+            None
+        }
+        (None, Some(binary)) if args.fast_forward.is_some() => {
+            fast_forward(&sim, &model_name, binary, &args)?;
+            None
+        }
+        (None, Some(binary)) => Some(load(&sim, binary, &args)?),
+        (None, None) => return Err(anyhow::anyhow!("BINARY argument is required")),
+    };
 
-        println!("  Entry point:  0x{:08x}", entry);
-        entry
-    } else {
-        // ELF file
-        println!("Loading ELF binary: {}", binary);
-        sim.load_binary(&binary, args.watchpoint.as_deref())
-            .context("Failed to load ELF binary")?;
-        0x80000000 // Default entry point for ELF
+    let profiler = match &args.profile {
+        Some(_) => Some(start_profiler(&sim, &args)?),
+        None => None,
     };
 
     // Run simulation
@@ -165,23 +240,24 @@ fn main() -> Result<()> {
         draw_progress(0, args.max_cycles);
     }
 
-    let result = sim
-        .run_with_entry_point_and_progress(
-            args.vcd.as_ref().map(|p| p.as_std_path()),
-            args.max_cycles,
-            entry_point,
-            |cycle| {
-                if !show_progress {
-                    return;
-                }
-                last_seen_cycle = cycle;
-                if cycle == args.max_cycles || cycle.saturating_sub(last_drawn_cycle) >= 256 {
-                    draw_progress(cycle, args.max_cycles);
-                    last_drawn_cycle = cycle;
-                }
-            },
-        )
-        .context("Simulation failed")?;
+    let vcd_path = args.vcd.as_ref().map(|p| p.as_std_path());
+    let on_cycle = |cycle: usize| {
+        if !show_progress {
+            return;
+        }
+        last_seen_cycle = cycle;
+        if cycle == args.max_cycles || cycle.saturating_sub(last_drawn_cycle) >= 256 {
+            draw_progress(cycle, args.max_cycles);
+            last_drawn_cycle = cycle;
+        }
+    };
+    let result = match entry_point {
+        Some(entry_point) => {
+            sim.run_with_entry_point_and_progress(vcd_path, args.max_cycles, entry_point, on_cycle)
+        }
+        None => sim.resume_with_progress(vcd_path, args.max_cycles, on_cycle),
+    }
+    .context("Simulation failed")?;
     if show_progress {
         if last_drawn_cycle != last_seen_cycle {
             draw_progress(last_seen_cycle, args.max_cycles);
@@ -191,6 +267,10 @@ fn main() -> Result<()> {
 
     println!("\nSimulation complete!");
 
+    if let (Some(profiler), Some(path)) = (&profiler, &args.profile) {
+        write_profile(&profiler.lock().unwrap(), path)?;
+    }
+
     if let Some(exit_code) = result.exit_code {
         println!("Exit code: {}", exit_code);
 
@@ -209,3 +289,119 @@ fn main() -> Result<()> {
 
     Ok(())
 }
+
+/// Run the first `--fast-forward` instructions of `binary` on the functional
+/// model and load the resulting state into `sim`.
+fn fast_forward(sim: &Simulator, model_name: &str, binary: &Utf8Path, args: &Args) -> Result<()> {
+    let instructions = args.fast_forward.unwrap_or(0);
+    let functional = Simulator::new(Backend::Functional, model_name)
+        .context("Failed to create the functional model")?;
+    if let Some(uart_index) = args.uart_console {
+        functional.enable_uart_console(uart_index);
+    }
+    let entry_point = load(&functional, binary, args)?;
+
+    println!("Fast-forwarding {instructions} instructions...");
+    let state = functional.fast_forward(entry_point, instructions)?;
+    if state.halted {
+        anyhow::bail!(
+            "The program finished after {} instructions, before the fast-forward point",
+            state.instret
+        );
+    }
+    println!("  Switching at pc 0x{:08x}", state.pc);
+    sim.load_arch_state(&state)
+        .context("Failed to load the fast-forwarded state")
+}
+
+/// Feed the retire trace to a profiler symbolized from the ELF binary.
+fn start_profiler(sim: &Simulator, args: &Args) -> Result<Arc<Mutex<Profiler>>> {
+    let binary = args
+        .binary
+        .as_ref()
+        .filter(|binary| binary.extension() != Some("bin"))
+        .ok_or_else(|| anyhow::anyhow!("--profile needs an ELF binary for its symbols"))?;
+    let profiler = Arc::new(Mutex::new(
+        Profiler::from_elf(binary).context("Failed to read symbols for the profile")?,
+    ));
+
+    let sink = profiler.clone();
+    sim.set_retire_sink(move |retirement| {
+        sink.lock().unwrap().record(retirement);
+        Ok(())
+    });
+    Ok(profiler)
+}
+
+/// Write the profile to `path` and print the hottest functions.
+fn write_profile(profiler: &Profiler, path: &Utf8Path) -> Result<()> {
+    if matches!(path.extension(), Some("pb" | "pprof")) {
+        profiler.write_pprof(path)
+    } else {
+        profiler.write_folded(path)
+    }
+    .with_context(|| format!("Failed to write profile {path}"))?;
+    println!("\nProfile written to {path}");
+
+    let functions = profiler.functions();
+    let total: u64 = functions.iter().map(|f| f.self_counts.cycles).sum();
+    print!(
+        "{:<32} {:>12} {:>7} {:>12} {:>12} {:>6}",
+        "function", "cycles", "self%", "total", "retired", "CPI"
+    );
+    for event in STALL_EVENTS {
+        print!(" {event:>12}");
+    }
+    println!();
+    for function in functions.iter().take(PROFILE_TOP_FUNCTIONS) {
+        let counts = &function.self_counts;
+        print!(
+            "{:<32} {:>12} {:>6.2}% {:>12} {:>12} {:>6.2}",
+            function.name,
+            counts.cycles,
+            counts.cycles as f64 * 100.0 / total.max(1) as f64,
+            function.total_cycles,
+            counts.retired,
+            counts.cycles as f64 / counts.retired.max(1) as f64
+        );
+        for stall in counts.stalls {
+            print!(" {stall:>12}");
+        }
+        println!();
+    }
+    Ok(())
+}
+
+/// Functions listed by [`write_profile`]; the output file has all of them.
+const PROFILE_TOP_FUNCTIONS: usize = 25;
+
+/// Load `binary` into the model and return the entry point.
+fn load(sim: &Simulator, binary: &Utf8Path, args: &Args) -> Result<u32> {
+    let is_raw_binary = binary.extension().map(|ext| ext == "bin").unwrap_or(false);
+
+    let entry_point = if is_raw_binary {
+        // Raw binary file
+        let load_addr = args.load_addr.unwrap_or(0x80000000);
+        println!("Loading raw binary: {}", binary);
+        println!("  Load address: 0x{:08x}", load_addr);
+
+        let entry = sim
+            .load_raw_binary(binary, load_addr, args.entry_point, args.watchpoint_addr)
+            .context("Failed to load raw binary")?;
+
+        println!("  Entry point:  0x{:08x}", entry);
+        entry
+    } else {
+        // ELF file
+        println!("Loading ELF binary: {}", binary);
+        if args.fast_load {
+            sim.load_binary_fast(binary, args.watchpoint.as_deref())
+        } else {
+            sim.load_binary(binary, args.watchpoint.as_deref())
+        }
+        .context("Failed to load ELF binary")?;
+        0x80000000 // Default entry point for ELF
+    };
+
+    Ok(entry_point)
+}
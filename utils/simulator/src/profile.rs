@@ -0,0 +1,371 @@
+//! Guest profiler fed by the retire trace.
+//!
+//! Every instruction hart 0 retires is counted exactly, together with the
+//! cycles since the previous retirement and the [`STALL_EVENTS`] counts over
+//! the same span. Call stacks are rebuilt from the calls and returns seen in
+//! the trace and symbolized from the ELF symbol table.
+
+use std::collections::HashMap;
+use std::path::Path;
+
+use anyhow::Result;
+use elf::abi::{STB_GLOBAL, STT_FUNC, STT_NOTYPE};
+use elf::{ElfBytes, endian::AnyEndian};
+
+use crate::{Retirement, STALL_EVENTS};
+
+/// Deeper call chains are still tracked, but only this many frames are kept.
+const MAX_DEPTH: usize = 128;
+
+const OPCODE_JAL: u32 = 0x6f;
+const OPCODE_JALR: u32 = 0x67;
+
+/// Counts attributed to one PC or function.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct Counts {
+    pub retired: u64,
+    pub cycles: u64,
+    pub stalls: [u64; STALL_EVENTS.len()],
+}
+
+impl Counts {
+    fn add(&mut self, other: &Counts) {
+        self.retired += other.retired;
+        self.cycles += other.cycles;
+        for (total, count) in self.stalls.iter_mut().zip(other.stalls) {
+            *total += count;
+        }
+    }
+}
+
+/// Per-function totals, see [`Profiler::functions`].
+#[derive(Debug, Clone)]
+pub struct FunctionProfile {
+    pub name: String,
+    /// Counts of instructions in the function itself.
+    pub self_counts: Counts,
+    /// Cycles spent in the function and everything it called.
+    pub total_cycles: u64,
+}
+
+struct Symbol {
+    start: u64,
+    end: u64,
+    name: String,
+}
+
+pub struct Profiler {
+    symbols: Vec<Symbol>,
+    /// Call sites of the active frames, outermost first.
+    stack: Vec<u64>,
+    /// Frames past MAX_DEPTH that were called but not recorded.
+    overflow: usize,
+    stack_ids: HashMap<Vec<u64>, usize>,
+    stacks: Vec<Vec<u64>>,
+    current_stack: usize,
+    samples: HashMap<(usize, u64), Counts>,
+}
+
+impl Profiler {
+    /// Profile a program, taking function names from the ELF at `path`.
+    pub fn from_elf<P: AsRef<Path>>(path: P) -> Result<Self> {
+        let file_data = std::fs::read(path)?;
+        let file = ElfBytes::<AnyEndian>::minimal_parse(file_data.as_slice())?;
+        let Some((symtab, strtab)) = file.symbol_table()? else {
+            anyhow::bail!("The ELF has no symbol table to profile against");
+        };
+
+        let mut symbols: Vec<Symbol> = symtab
+            .iter()
+            .filter(|sym| {
+                sym.st_symtype() == STT_FUNC
+                    || (sym.st_symtype() == STT_NOTYPE && sym.st_bind() == STB_GLOBAL)
+            })
+            .filter(|sym| sym.st_value != 0 && !sym.is_undefined())
+            .filter_map(|sym| {
+                let name = strtab.get(sym.st_name as usize).ok()?;
+                Some(Symbol {
+                    start: sym.st_value,
+                    end: sym.st_value + sym.st_size,
+                    name: name.to_owned(),
+                })
+            })
+            .collect();
+        symbols.sort_by_key(|sym| (sym.start, std::cmp::Reverse(sym.end)));
+        symbols.dedup_by_key(|sym| sym.start);
+        // Labels without a size run up to the next symbol
+        for i in 0..symbols.len() {
+            if symbols[i].end == symbols[i].start {
+                symbols[i].end = symbols.get(i + 1).map_or(u64::MAX, |next| next.start);
+            }
+        }
+
+        Ok(Self::with_symbols(symbols))
+    }
+
+    fn with_symbols(symbols: Vec<Symbol>) -> Self {
+        let mut profiler = Profiler {
+            symbols,
+            stack: Vec::new(),
+            overflow: 0,
+            stack_ids: HashMap::new(),
+            stacks: Vec::new(),
+            current_stack: 0,
+            samples: HashMap::new(),
+        };
+        profiler.current_stack = profiler.intern_stack();
+        profiler
+    }
+
+    /// Account one retirement, in trace order.
+    pub fn record(&mut self, retirement: &Retirement) {
+        let counts = self
+            .samples
+            .entry((self.current_stack, retirement.pc))
+            .or_default();
+        counts.retired += 1;
+        counts.cycles += retirement.cycles;
+        for (total, count) in counts.stalls.iter_mut().zip(retirement.stalls) {
+            *total += u64::from(count);
+        }
+
+        let opcode = retirement.inst & 0x7f;
+        let rs1 = (retirement.inst >> 15) & 0x1f;
+        let links = |reg: u32| reg == 1 || reg == 5;
+        if (opcode == OPCODE_JAL || opcode == OPCODE_JALR) && links(retirement.rd.into()) {
+            if self.stack.len() < MAX_DEPTH {
+                self.stack.push(retirement.pc);
+                self.current_stack = self.intern_stack();
+            } else {
+                self.overflow += 1;
+            }
+        } else if opcode == OPCODE_JALR && retirement.rd == 0 && links(rs1) {
+            if self.overflow > 0 {
+                self.overflow -= 1;
+            } else if self.stack.pop().is_some() {
+                self.current_stack = self.intern_stack();
+            }
+        }
+    }
+
+    fn intern_stack(&mut self) -> usize {
+        if let Some(&id) = self.stack_ids.get(&self.stack) {
+            return id;
+        }
+        let id = self.stacks.len();
+        self.stacks.push(self.stack.clone());
+        self.stack_ids.insert(self.stack.clone(), id);
+        id
+    }
+
+    fn symbol(&self, pc: u64) -> Option<usize> {
+        let index = self.symbols.partition_point(|sym| sym.start <= pc);
+        let index = index.checked_sub(1)?;
+        (pc < self.symbols[index].end).then_some(index)
+    }
+
+    fn name(&self, pc: u64) -> &str {
+        self.symbol(pc)
+            .map_or("[unknown]", |index| &self.symbols[index].name)
+    }
+
+    /// PCs of every sample's frames, leaf first, with its counts.
+    fn frames(&self) -> impl Iterator<Item = (Vec<u64>, &Counts)> {
+        self.samples.iter().map(|(&(stack, pc), counts)| {
+            let pcs = std::iter::once(pc)
+                .chain(self.stacks[stack].iter().rev().copied())
+                .collect();
+            (pcs, counts)
+        })
+    }
+
+    /// Per-function counts, hottest (by self cycles) first.
+    pub fn functions(&self) -> Vec<FunctionProfile> {
+        let mut functions: HashMap<&str, FunctionProfile> = HashMap::new();
+        for (pcs, counts) in self.frames() {
+            let leaf = self.name(pcs[0]);
+            functions
+                .entry(leaf)
+                .or_insert_with(|| FunctionProfile {
+                    name: leaf.to_owned(),
+                    self_counts: Counts::default(),
+                    total_cycles: 0,
+                })
+                .self_counts
+                .add(counts);
+
+            // Recursive functions count once per sample
+            let mut seen: Vec<&str> = pcs.iter().map(|&pc| self.name(pc)).collect();
+            seen.sort_unstable();
+            seen.dedup();
+            for name in seen {
+                functions
+                    .entry(name)
+                    .or_insert_with(|| FunctionProfile {
+                        name: name.to_owned(),
+                        self_counts: Counts::default(),
+                        total_cycles: 0,
+                    })
+                    .total_cycles += counts.cycles;
+            }
+        }
+        let mut functions: Vec<_> = functions.into_values().collect();
+        functions.sort_by(|a, b| {
+            b.self_counts
+                .cycles
+                .cmp(&a.self_counts.cycles)
+                .then_with(|| a.name.cmp(&b.name))
+        });
+        functions
+    }
+
+    /// Write cycles per call stack in the folded format read by
+    /// flamegraph.pl and inferno.
+    pub fn write_folded<P: AsRef<Path>>(&self, path: P) -> Result<()> {
+        let mut folded: HashMap<String, u64> = HashMap::new();
+        for (pcs, counts) in self.frames() {
+            let names: Vec<&str> = pcs.iter().rev().map(|&pc| self.name(pc)).collect();
+            *folded.entry(names.join(";")).or_default() += counts.cycles;
+        }
+        let mut lines: Vec<_> = folded.into_iter().filter(|(_, c)| *c > 0).collect();
+        lines.sort();
+
+        let mut out = String::new();
+        for (stack, cycles) in lines {
+            out.push_str(&format!("{stack} {cycles}\n"));
+        }
+        std::fs::write(path, out)?;
+        Ok(())
+    }
+
+    /// Write an uncompressed pprof profile. Every PC is its own location, so
+    /// `pprof -disasm` and `-lines` by address work as well as `-top`.
+    pub fn write_pprof<P: AsRef<Path>>(&self, path: P) -> Result<()> {
+        let mut strings = StringTable::default();
+        let mut profile = Proto::default();
+
+        let value_types = ["retired", "cycles"].into_iter().chain(STALL_EVENTS);
+        for name in value_types {
+            let mut value_type = Proto::default();
+            value_type.varint(1, strings.id(name));
+            value_type.varint(2, strings.id("count"));
+            profile.message(1, &value_type);
+        }
+
+        let mut locations: HashMap<u64, u64> = HashMap::new();
+        let mut samples: Vec<_> = self.frames().collect();
+        samples.sort_by(|a, b| a.0.cmp(&b.0));
+        for (pcs, counts) in &samples {
+            let location_ids: Vec<u64> = pcs
+                .iter()
+                .map(|&pc| {
+                    let next_id = locations.len() as u64 + 1;
+                    *locations.entry(pc).or_insert(next_id)
+                })
+                .collect();
+            let values: Vec<u64> = [counts.retired, counts.cycles]
+                .into_iter()
+                .chain(counts.stalls)
+                .collect();
+
+            let mut sample = Proto::default();
+            sample.packed(1, &location_ids);
+            sample.packed(2, &values);
+            profile.message(2, &sample);
+        }
+
+        let mut functions: HashMap<usize, u64> = HashMap::new();
+        let mut locations: Vec<_> = locations.into_iter().collect();
+        locations.sort_by_key(|&(_, id)| id);
+        for (pc, id) in locations {
+            let mut location = Proto::default();
+            location.varint(1, id);
+            location.varint(3, pc);
+            if let Some(symbol) = self.symbol(pc) {
+                let next_id = functions.len() as u64 + 1;
+                let function_id = *functions.entry(symbol).or_insert(next_id);
+                let mut line = Proto::default();
+                line.varint(1, function_id);
+                location.message(4, &line);
+            }
+            profile.message(4, &location);
+        }
+
+        let mut functions: Vec<_> = functions.into_iter().collect();
+        functions.sort_by_key(|&(_, id)| id);
+        for (symbol, id) in functions {
+            let name = strings.id(&self.symbols[symbol].name);
+            let mut function = Proto::default();
+            function.varint(1, id);
+            function.varint(2, name);
+            function.varint(3, name);
+            profile.message(5, &function);
+        }
+
+        for string in &strings.strings {
+            profile.bytes(6, string.as_bytes());
+        }
+        std::fs::write(path, profile.0)?;
+        Ok(())
+    }
+}
+
+#[derive(Default)]
+struct StringTable {
+    strings: Vec<String>,
+    ids: HashMap<String, u64>,
+}
+
+impl StringTable {
+    /// pprof requires string 0 to be empty, so it is added first.
+    fn id(&mut self, value: &str) -> u64 {
+        if self.strings.is_empty() {
+            self.strings.push(String::new());
+            self.ids.insert(String::new(), 0);
+        }
+        if let Some(&id) = self.ids.get(value) {
+            return id;
+        }
+        let id = self.strings.len() as u64;
+        self.strings.push(value.to_owned());
+        self.ids.insert(value.to_owned(), id);
+        id
+    }
+}
+
+/// Just enough of the protobuf wire format for profile.proto.
+#[derive(Default)]
+struct Proto(Vec<u8>);
+
+impl Proto {
+    fn raw_varint(&mut self, mut value: u64) {
+        while value >= 0x80 {
+            self.0.push(value as u8 | 0x80);
+            value >>= 7;
+        }
+        self.0.push(value as u8);
+    }
+
+    fn varint(&mut self, field: u32, value: u64) {
+        self.raw_varint(u64::from(field) << 3);
+        self.raw_varint(value);
+    }
+
+    fn bytes(&mut self, field: u32, value: &[u8]) {
+        self.raw_varint(u64::from(field) << 3 | 2);
+        self.raw_varint(value.len() as u64);
+        self.0.extend_from_slice(value);
+    }
+
+    fn message(&mut self, field: u32, message: &Proto) {
+        self.bytes(field, &message.0);
+    }
+
+    fn packed(&mut self, field: u32, values: &[u64]) {
+        let mut packed = Proto::default();
+        for &value in values {
+            packed.raw_varint(value);
+        }
+        self.bytes(field, &packed.0);
+    }
+}